@@ -0,0 +1,202 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Audit mode (-audit=FILE): check every account in a pwdump/secretsdump
+ * style file against an NTLM hash file.
+ *
+ * Each account line looks like:
+ *
+ *     DOMAIN\user:1104:aad3b435b51404eeaad3b435b51404ee:8846f7eaee8fb117ad06bdd830b7586c:::
+ *
+ * Other lines (secretsdump status messages, Kerberos keys, ...) are skipped.
+ *
+ * Rather than searching the hash file once per account, the NT hashes are
+ * sorted and deduplicated, then merge joined against the hash file in
+ * parallel (see join.c). Results are printed in the order of the dump.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find-pwned.h"
+#include "join.h"
+#include "parallel.h"
+#include "sort.h"
+
+/**
+ * An account parsed from the dump. The strings point into the dump text and
+ * are not NUL-terminated.
+ */
+typedef struct {
+    const char* user;
+    const char* rid;
+    uint32_t user_length;
+    uint32_t rid_length;
+    uint32_t count;             /**< Occurrence count of the account's NT hash. */
+    uint8_t nt[PWNED_NTLM_KEY_BYTES];
+} account_t;
+
+/**
+ * Sort record: an NT hash and the index of its account. This has the same
+ * shape as an NTLM hash file record, which is handy for debugging.
+ */
+typedef struct {
+    uint8_t nt[PWNED_NTLM_KEY_BYTES];
+    uint32_t account;
+} __attribute__((packed)) audit_record_t;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Parse one dump line [@a line, @a end) into @a account.
+ *
+ * @return 1 if it is an account line with a valid NT hash, 0 otherwise.
+ */
+static int parse_account(const char* line, const char* end, account_t* account) {
+    const char* field[4];
+    const char* p = line;
+    field[0] = line;
+    for (int f = 1; f < 4; ++f) {
+        while ((p < end) && (':' != *p)) {
+            ++p;
+        }
+        if (p >= end) {
+            return 0;
+        }
+        field[f] = ++p;
+    }
+    if ((end - field[3] < 2 * PWNED_NTLM_KEY_BYTES) ||
+        ((end - field[3] > 2 * PWNED_NTLM_KEY_BYTES) && (':' != field[3][2 * PWNED_NTLM_KEY_BYTES])) ||
+        !pwned_parse_hex(field[3], account->nt, PWNED_NTLM_KEY_BYTES)) {
+        return 0;
+    }
+    account->user = field[0];
+    account->user_length = (uint32_t) (field[1] - field[0] - 1);
+    account->rid = field[1];
+    account->rid_length = (uint32_t) (field[2] - field[1] - 1);
+    account->count = 0;
+    return 1;
+}   /* parse_account() */
+
+/* ------------------------------------------------------------------------- */
+int run_audit(const char* path, const pwned_db_t* db) {
+    double start = pwned_seconds();
+    if (PWNED_KEY_NTLM != db->type) {
+        PrintError("-audit requires an NTLM hash file");
+        return 2;
+    }
+    size_t size = 0;
+    char* text = pwned_read_file(path, &size);
+    if (NULL == text) {
+        PrintError("could not read dump file \"%s\"", path);
+        return 2;
+    }
+    int rval = 2;
+    account_t* accounts = NULL;
+    audit_record_t* records = NULL;
+    uint8_t* keys = NULL;
+    uint32_t* key_of_record = NULL;
+    uint32_t* counts = NULL;
+
+    /*
+     * One account per line at most, so count lines for the allocations.
+     */
+    size_t lines = 1;
+    for (const char* p = text; NULL != (p = memchr(p, '\n', &text[size] - p)); ++p) {
+        ++lines;
+    }
+    accounts = (account_t*) malloc(lines * sizeof(account_t));
+    records = (audit_record_t*) malloc(lines * sizeof(audit_record_t));
+    if ((NULL == accounts) || (NULL == records)) {
+        PrintError("out of memory for %zu lines of \"%s\"", lines, path);
+        goto done;
+    }
+    size_t n = 0;
+    for (const char* line = text; line < &text[size]; ) {
+        const char* end = memchr(line, '\n', &text[size] - line);
+        const char* next = (NULL == end) ? &text[size] : (end + 1);
+        end = (NULL == end) ? &text[size] : end;
+        if ((end > line) && ('\r' == end[-1])) {
+            --end;
+        }
+        if (parse_account(line, end, &accounts[n])) {
+            memcpy(records[n].nt, accounts[n].nt, sizeof(records[n].nt));
+            records[n].account = (uint32_t) n;
+            ++n;
+        }
+        line = next;
+    }
+    double parsed = pwned_seconds();
+
+    /*
+     * Sort by hash, then squeeze out duplicate hashes (shared passwords),
+     * remembering which unique hash each record maps to.
+     */
+    if (0 != pwned_sort_records(records, n, sizeof(audit_record_t), PWNED_NTLM_KEY_BYTES)) {
+        PrintError("out of memory sorting %zu hashes", n);
+        goto done;
+    }
+    keys = (uint8_t*) malloc((n + 1) * PWNED_NTLM_KEY_BYTES);
+    key_of_record = (uint32_t*) malloc((n + 1) * sizeof(uint32_t));
+    counts = (uint32_t*) malloc((n + 1) * sizeof(uint32_t));
+    if ((NULL == keys) || (NULL == key_of_record) || (NULL == counts)) {
+        PrintError("out of memory for %zu hashes", n);
+        goto done;
+    }
+    size_t unique = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if ((0 == unique) ||
+            (0 != memcmp(&keys[(unique - 1) * PWNED_NTLM_KEY_BYTES], records[i].nt, PWNED_NTLM_KEY_BYTES))) {
+            memcpy(&keys[unique * PWNED_NTLM_KEY_BYTES], records[i].nt, PWNED_NTLM_KEY_BYTES);
+            ++unique;
+        }
+        key_of_record[i] = (uint32_t) (unique - 1);
+    }
+    double sorted = pwned_seconds();
+    uint64_t hits = pwned_join(db, keys, unique, PWNED_NTLM_KEY_BYTES, counts, g_threads);
+    double joined = pwned_seconds();
+
+    uint64_t pwned_accounts = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t count = counts[key_of_record[i]];
+        accounts[records[i].account].count = count;
+        pwned_accounts += (count > 0);
+    }
+    if (!g_quiet) {
+        for (size_t i = 0; i < n; ++i) {
+            const account_t* account = &accounts[i];
+            int found = (account->count > 0);
+            if (!((found && g_print_found) || (!found && g_print_not_found))) {
+                continue;
+            }
+            if (g_print_index) {
+                printf("%zu%s", i + 1, g_delimiter);
+            }
+            printf("%.*s%s%.*s", (int) account->user_length, account->user, g_delimiter,
+                   (int) account->rid_length, account->rid);
+            if (g_print_hash) {
+                printf("%s", g_delimiter);
+                print_hex(account->nt, PWNED_NTLM_KEY_BYTES);
+            }
+            if (g_print_count) {
+                printf("%s%" PRIu32, g_delimiter, account->count);
+            }
+            printf("\n");
+        }
+    }
+    PrintVerbose("audit: %zu accounts, %zu unique hashes, %" PRIu64 " pwned hashes, %" PRIu64
+                 " pwned accounts", n, unique, hits, pwned_accounts);
+    PrintVerbose("audit: parse %.3fs, sort %.3fs, join %.3fs (%d threads)",
+                 parsed - start, sorted - parsed, joined - sorted, pwned_thread_count(g_threads));
+    rval = (pwned_accounts > 0) ? 0 : 1;
+done:
+    free(counts);
+    free(key_of_record);
+    free(keys);
+    free(records);
+    free(accounts);
+    free(text);
+    return rval;
+}   /* run_audit() */
@@ -0,0 +1,272 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Memory-budget-aware choice of lookup strategy (-auto); see auto.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "auto.h"
+
+/**
+ * Part of the budget the whole file may take and still be locked; the rest
+ * is left for the index, the hashing and everything else on the machine.
+ */
+#define kAutoLockedShare    0.75
+
+/**
+ * Least part of the file the budget must hold for the indexed strategy.
+ * Below this most leaves come from the device anyway, and pread() with
+ * batched readahead beats taking a page fault for each.
+ */
+#define kAutoIndexedShare   0.25
+
+/**
+ * Inputs per batch for each strategy. A cached lookup gains little from
+ * bigger batches; a cold one needs many reads in flight at once to keep the
+ * device busy.
+ */
+#define kAutoLockedBatch    64
+#define kAutoIndexedBatch   256
+#define kAutoColdBatch      1024
+
+/**
+ * v1 cgroups report "no limit" as a huge page-rounded number.
+ */
+#define kCgroupV1Unlimited  (1ull << 62)
+
+/**
+ * Pages mincore() checks per call, to bound the size of its vector.
+ */
+#define kMincorePages       0x40000
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Read a number from the first line of @a path; "max" is UINT64_MAX.
+ *
+ * @return 1 on success, 0 if the file is missing or holds no number.
+ */
+static int read_u64(const char* path, uint64_t* value) {
+    char text[0x40];
+    FILE* file = fopen(path, "r");
+    if (NULL == file) {
+        return 0;
+    }
+    int ok = (NULL != fgets(text, sizeof(text), file));
+    fclose(file);
+    if (ok && (0 == strncmp(text, "max", 3))) {
+        *value = UINT64_MAX;
+    } else if (ok) {
+        char* end = NULL;
+        *value = strtoull(text, &end, 10);
+        ok = (end != text);
+    }
+    return ok;
+}   /* read_u64() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Find the tightest memory limit from our cgroup up to the root of the
+ * hierarchy mounted at @a mount, where the limit and usage are in files
+ * @a limit_name and @a usage_name, and our cgroup is @a group.
+ *
+ * @return 1 if any limit file was found.
+ */
+static int walk_cgroup(pwned_auto_plan_t* plan, const char* mount, const char* group,
+                       const char* limit_name, const char* usage_name) {
+    char dir[0x400];
+    char path[0x480];
+    int found = 0;
+    snprintf(dir, sizeof(dir), "%s%s", mount, group);
+    while (1) {
+        uint64_t limit;
+        uint64_t usage;
+        snprintf(path, sizeof(path), "%s/%s", dir, limit_name);
+        if (read_u64(path, &limit)) {
+            found = 1;
+            if (limit >= kCgroupV1Unlimited) {
+                limit = UINT64_MAX;
+            }
+            snprintf(path, sizeof(path), "%s/%s", dir, usage_name);
+            if ((limit < plan->cgroup_limit) && read_u64(path, &usage)) {
+                plan->cgroup_limit = limit;
+                plan->cgroup_usage = usage;
+            }
+        }
+        char* slash = strrchr(dir, '/');
+        if ((NULL == slash) || (strlen(dir) <= strlen(mount))) {
+            break;
+        }
+        *slash = 0;
+    }
+    return found;
+}   /* walk_cgroup() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Set the cgroup limit and usage in @a plan from /proc/self/cgroup: the
+ * unified (v2) hierarchy if there is one, else the v1 memory controller.
+ * In a container our cgroup is often the root of what is mounted, so a
+ * path that does not exist under the mount just walks up to it.
+ */
+static void read_cgroup(pwned_auto_plan_t* plan) {
+    char line[0x400];
+    char v1[0x400] = "";
+    FILE* file = fopen("/proc/self/cgroup", "r");
+    while ((NULL != file) && (NULL != fgets(line, sizeof(line), file))) {
+        line[strcspn(line, "\n")] = 0;
+        char* controllers = strchr(line, ':');
+        char* group = (NULL == controllers) ? NULL : strchr(controllers + 1, ':');
+        if (NULL == group) {
+            continue;
+        }
+        *group++ = 0;
+        ++controllers;
+        if ((0 == strcmp(line, "0")) && ('\0' == *controllers)) {
+            if (walk_cgroup(plan, "/sys/fs/cgroup", group, "memory.max", "memory.current")) {
+                v1[0] = 0;
+                break;
+            }
+        } else if (NULL != strstr(controllers, "memory")) {
+            snprintf(v1, sizeof(v1), "%s", group);
+        }
+    }
+    if (NULL != file) {
+        fclose(file);
+    }
+    if ('\0' != v1[0]) {
+        walk_cgroup(plan, "/sys/fs/cgroup/memory", v1, "memory.limit_in_bytes",
+                    "memory.usage_in_bytes");
+    }
+}   /* read_cgroup() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * @return MemAvailable from /proc/meminfo, or UINT64_MAX if unknown.
+ */
+static uint64_t read_mem_available(void) {
+    char line[0x100];
+    uint64_t available = UINT64_MAX;
+    FILE* file = fopen("/proc/meminfo", "r");
+    while ((NULL != file) && (NULL != fgets(line, sizeof(line), file))) {
+        unsigned long long kb;
+        if (1 == sscanf(line, "MemAvailable: %llu kB", &kb)) {
+            available = kb * 1024;
+            break;
+        }
+    }
+    if (NULL != file) {
+        fclose(file);
+    }
+    return available;
+}   /* read_mem_available() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * @return the bytes of @a db's mapping that are in the page cache.
+ */
+static uint64_t resident_bytes(const pwned_db_t* db) {
+    const uint64_t page = sysconf(_SC_PAGESIZE);
+    unsigned char* vec = (unsigned char*) malloc(kMincorePages);
+    uint64_t resident = 0;
+    if (NULL == vec) {
+        return 0;
+    }
+    for (uint64_t offset = 0; offset < db->size; offset += kMincorePages * page) {
+        uint64_t size = db->size - offset;
+        if (size > kMincorePages * page) {
+            size = kMincorePages * page;
+        }
+        if (0 != mincore((void*) (db->data + offset), size, vec)) {
+            break;
+        }
+        for (uint64_t i = 0; i < (size + page - 1) / page; ++i) {
+            resident += (vec[i] & 1) ? page : 0;
+        }
+    }
+    free(vec);
+    return (resident > db->size) ? db->size : resident;
+}   /* resident_bytes() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_auto_plan(pwned_auto_plan_t* plan, const pwned_db_t* db, uint64_t budget) {
+    memset(plan, 0, sizeof(*plan));
+    plan->cgroup_limit = UINT64_MAX;
+    plan->file_bytes = db->size;
+    plan->index_bytes = ((db->size + PWNED_AUTO_LEAF_BYTES - 1) / PWNED_AUTO_LEAF_BYTES) * sizeof(uint64_t);
+    read_cgroup(plan);
+    plan->mem_available = read_mem_available();
+    plan->resident_bytes = resident_bytes(db);
+    if (0 == budget) {
+        /*
+         * Pages of the file already in the page cache count against the
+         * cgroup, but they are just what the file needs, so they go back
+         * into the cgroup's room. MemAvailable already counts them, as
+         * reclaimable page cache, so they are not added to that.
+         */
+        budget = plan->mem_available;
+        if (UINT64_MAX != plan->cgroup_limit) {
+            uint64_t room = (plan->cgroup_usage < plan->cgroup_limit) ?
+                (plan->cgroup_limit - plan->cgroup_usage) : 0;
+            room += plan->resident_bytes;
+            budget = (room < budget) ? room : budget;
+        }
+    }
+    plan->budget = budget;
+    if ((double) plan->file_bytes <= kAutoLockedShare * (double) budget) {
+        plan->strategy = PWNED_AUTO_LOCKED;
+        plan->batch = kAutoLockedBatch;
+    } else if ((double) plan->file_bytes * kAutoIndexedShare <= (double) budget) {
+        plan->strategy = PWNED_AUTO_INDEXED;
+        plan->batch = kAutoIndexedBatch;
+    } else if (db->fd < 0) {
+        plan->strategy = PWNED_AUTO_INDEXED;        /* No file to pread(), e.g. with -attach. */
+        plan->batch = kAutoIndexedBatch;
+    } else {
+        plan->strategy = PWNED_AUTO_COLD;
+        plan->batch = kAutoColdBatch;
+    }
+}   /* pwned_auto_plan() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_auto_apply(pwned_auto_plan_t* plan, const pwned_db_t* db, pwned_index_t* index) {
+    void* data = (void*) db->data;
+    plan->locked = 0;
+    if (PWNED_AUTO_LOCKED == plan->strategy) {
+        if (0 == mlock(data, db->size)) {
+            plan->locked = 1;
+        } else {
+            madvise(data, db->size, MADV_WILLNEED);     /* RLIMIT_MEMLOCK; just read it in. */
+        }
+        return 0;
+    }
+    if (0 != pwned_index_build(index, db, PWNED_AUTO_LEAF_BYTES)) {
+        return -1;
+    }
+    mlock(index->prefixes, (index->leaves + 1) * sizeof(index->prefixes[0]));  /* Best effort. */
+    madvise(data, db->size, MADV_RANDOM);
+    if ((PWNED_AUTO_COLD == plan->strategy) && (db->fd >= 0)) {
+        posix_fadvise(db->fd, 0, 0, POSIX_FADV_RANDOM);
+    }
+    return 0;
+}   /* pwned_auto_apply() */
+
+/* ------------------------------------------------------------------------- */
+const char* pwned_auto_strategy_name(pwned_auto_strategy_t strategy) {
+    switch (strategy) {
+    case PWNED_AUTO_LOCKED:
+        return "locked";
+    case PWNED_AUTO_INDEXED:
+        return "indexed";
+    default:
+        return "cold";
+    }
+}   /* pwned_auto_strategy_name() */
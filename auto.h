@@ -0,0 +1,80 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __auto_h__
+#define __auto_h__
+
+#include <stdint.h>
+
+#include "dbindex.h"
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * How -auto serves lookups from a hash file, picked from how much of the
+ * file the memory budget can hold:
+ *   locked  - the whole file fits: lock it in RAM (or, past RLIMIT_MEMLOCK,
+ *             just read it in) and binary search the mapping.
+ *   indexed - a good part fits: keep a sparse index of the leaves in RAM and
+ *             read one leaf through the mapping, with readahead turned off
+ *             so the page cache holds only leaves that were asked for.
+ *   cold    - little fits: the same index, but each leaf is read with
+ *             pread() into a buffer, and a whole batch of leaves is asked for
+ *             with posix_fadvise() before any is searched, so the reads
+ *             overlap on the device.
+ */
+typedef enum {
+    PWNED_AUTO_LOCKED,
+    PWNED_AUTO_INDEXED,
+    PWNED_AUTO_COLD,
+} pwned_auto_strategy_t;
+
+/**
+ * Leaf size of the -auto index: one page. Leaves follow page boundaries
+ * (see dbindex.h), so a lookup reads one page, or two in the rare case
+ * that the key falls at the record running over into the next page.
+ */
+#define PWNED_AUTO_LEAF_BYTES   0x1000
+
+/**
+ * What -auto found out about the machine and the file, and what it chose.
+ * Sizes are in bytes; UINT64_MAX means no limit.
+ */
+typedef struct {
+    uint64_t cgroup_limit;      /**< Memory limit of our cgroup (v2 memory.max or v1 limit_in_bytes). */
+    uint64_t cgroup_usage;      /**< ... and what the cgroup already uses. */
+    uint64_t mem_available;     /**< MemAvailable from /proc/meminfo. */
+    uint64_t file_bytes;
+    uint64_t resident_bytes;    /**< Bytes of the file already in the page cache (mincore()). */
+    uint64_t index_bytes;       /**< Size of the leaf index. */
+    uint64_t budget;            /**< Memory the file may use. */
+    pwned_auto_strategy_t strategy;
+    uint32_t batch;             /**< Inputs to look up per batch. */
+    int locked;                 /**< Set by pwned_auto_apply(): the file is mlock()ed. */
+} pwned_auto_plan_t;
+
+/**
+ * Fill in @a plan for lookups in @a db. A non-zero @a budget replaces the
+ * one worked out from the cgroup and /proc/meminfo, to try each strategy
+ * on a small file.
+ */
+void pwned_auto_plan(pwned_auto_plan_t* plan, const pwned_db_t* db, uint64_t budget);
+
+/**
+ * Carry out @a plan on @a db: lock or advise the mapping and, for the
+ * indexed and cold strategies, build @a index.
+ *
+ * @return 0 on success, -1 if out of memory for the index.
+ */
+int pwned_auto_apply(pwned_auto_plan_t* plan, const pwned_db_t* db, pwned_index_t* index);
+
+const char* pwned_auto_strategy_name(pwned_auto_strategy_t strategy);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
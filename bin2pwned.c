@@ -0,0 +1,203 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Write a binary hash file back out as "HASH:count" text lines, the reverse
+ * of pwned2bin. See pwned_db.h for the binary record layout.
+ *
+ * The records are split into chunks that -threads threads claim in order.
+ * Each thread formats its chunk into a private buffer, using the byte-to-hex
+ * and two-digits-at-a-time tables in pwned_db.c, and the
+ * buffers are written in chunk order with one large write each.
+ */
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "options.h"
+#include "parallel.h"
+#include "pwned_db.h"
+
+/**
+ * Name of this program, from argv[0].
+ */
+const char* g_program = "bin2pwned";
+
+/**
+ * Type of hash in the input file; set by -ntlm.
+ */
+pwned_key_type_t g_key_type = PWNED_KEY_SHA1;
+
+/**
+ * Whether to end lines with "\r\n", like the original downloads.
+ */
+int g_crlf = 0;
+
+/**
+ * Threads used to format; 0 means one per CPU.
+ */
+int g_threads = 0;
+
+/**
+ * Whether or not to emit verbose messages.
+ */
+int g_verbose = 0;
+
+/**
+ * Records formatted per chunk. A SHA1 line is at most 53 bytes, so a chunk
+ * comes to about 3.5MB of text.
+ */
+#define kChunkRecords 0x10000
+
+/**
+ * Longest line: hex key, ':', 10 digits, "\r\n".
+ */
+#define kMaxLineBytes (2 * PWNED_MAX_KEY_BYTES + 1 + 10 + 2)
+
+/* ------------------------------------------------------------------------- */
+void Verbose(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void Verbose(const char* format, ...) {
+    if (g_verbose) {
+        va_list va;
+        va_start(va, format);
+        fprintf(stderr, "%s: ", g_program);
+        vfprintf(stderr, format, va);
+        fprintf(stderr, "\n");
+        va_end(va);
+    }
+}   /* Verbose() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Format @a n records at @a records as text at @a text. Always inlined into a
+ * wrapper for each key width so the hex loop is unrolled.
+ *
+ * @return the number of bytes written.
+ */
+static inline __attribute__((always_inline))
+size_t format_records(const uint8_t* records, uint64_t n, char* text, const uint32_t key_bytes) {
+    const uint32_t record_bytes = key_bytes + PWNED_COUNT_BYTES;
+    char* p = text;
+    for (uint64_t i = 0; i < n; ++i) {
+        const uint8_t* record = &records[i * record_bytes];
+        p = pwned_format_hex(p, record, key_bytes);
+        *p++ = ':';
+        uint32_t count;
+        memcpy(&count, &record[key_bytes], sizeof(count));
+        p = pwned_format_count(p, count);
+        if (g_crlf) {
+            *p++ = '\r';
+        }
+        *p++ = '\n';
+    }
+    return p - text;
+}   /* format_records() */
+
+/* ------------------------------------------------------------------------- */
+static size_t format_sha1(const uint8_t* records, uint64_t n, char* text) {
+    return format_records(records, n, text, PWNED_SHA1_KEY_BYTES);
+}   /* format_sha1() */
+
+/* ------------------------------------------------------------------------- */
+static size_t format_ntlm(const uint8_t* records, uint64_t n, char* text) {
+    return format_records(records, n, text, PWNED_NTLM_KEY_BYTES);
+}   /* format_ntlm() */
+
+/**
+ * Shared state for the export threads.
+ */
+typedef struct {
+    const pwned_db_t* db;
+    pwned_ordered_t out;
+} export_t;
+
+/* ------------------------------------------------------------------------- */
+static void export_chunks(void* arg, int index, int threads) {
+    export_t* export = (export_t*) arg;
+    const pwned_db_t* db = export->db;
+    size_t (*format)(const uint8_t*, uint64_t, char*) =
+        (PWNED_KEY_NTLM == db->type) ? format_ntlm : format_sha1;
+    char* text = (char*) malloc(kChunkRecords * kMaxLineBytes);
+    if (NULL == text) {
+        Fail("out of memory for output buffer");
+    }
+    int chunk = 0;
+    while ((chunk = pwned_ordered_claim(&export->out)) >= 0) {
+        uint64_t start = (uint64_t) chunk * kChunkRecords;
+        uint64_t n = db->records - start;
+        n = (n > kChunkRecords) ? kChunkRecords : n;
+        size_t size = format(pwned_db_record(db, start), n, text);
+        if (0 != pwned_ordered_write(&export->out, chunk, text, size)) {
+            Fail("write failed: %s", strerror(errno));
+        }
+    }
+    free(text);
+}   /* export_chunks() */
+
+/* ------------------------------------------------------------------------- */
+int main(int argc, char* argv[]) {
+    g_program = NamePartOfPath(argv[0]);
+    const char* path = NULL;
+    for (int i = 1; i < argc; ++i) {
+        const char* opt = NULL;
+        int ntlm = 0;
+        if (IsFlagOption(argv[i], &ntlm, "ntlm")) {
+            g_key_type = ntlm ? PWNED_KEY_NTLM : PWNED_KEY_SHA1;
+        } else if (IsFlagOption(argv[i], &g_crlf, "crlf")) {
+        } else if (IsFlagOption(argv[i], &g_verbose, "v:erbose")) {
+        } else if (IsOption(argv[i], &opt, "t:hreads")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%d", &g_threads)) || (g_threads < 0)) {
+                Fail("-threads requires a non-negative integer");
+            }
+        } else if (('-' != argv[i][0]) && (NULL == path)) {
+            path = argv[i];
+        } else {
+            fprintf(stderr,
+                    "usage: %s [options] hashes.bin > hashes.txt\n"
+                    "\n"
+                    "    -[no-]ntlm      File holds NTLM rather than SHA1 hashes. [-no-ntlm]\n"
+                    "    -[no-]crlf      End lines with CR LF. [-no-crlf]\n"
+                    "    -t:hreads=N     Format threads; 0 for one per CPU. [0]\n"
+                    "    -[no-]v:erbose  Print progress to stderr. [-no-verbose]\n"
+                    , g_program);
+            return 2;
+        }
+    }
+    if (NULL == path) {
+        Fail("no hash file given; try -help");
+    }
+    pwned_db_t db;
+    int err = pwned_db_open(&db, path, g_key_type);
+    if (PWNED_DB_OK != err) {
+        Fail("could not open %s hash file \"%s\" (error %d)", pwned_key_name(g_key_type), path, err);
+    }
+    madvise((void*) db.data, db.size, MADV_SEQUENTIAL);
+    export_t export;
+    export.db = &db;
+    uint64_t chunks = (db.records + kChunkRecords - 1) / kChunkRecords;
+    assert(chunks <= INT32_MAX);
+    pwned_ordered_init(&export.out, STDOUT_FILENO, (int) chunks);
+    uint64_t first = export.out.offset;
+    int threads = pwned_thread_count(g_threads);
+    threads = ((uint64_t) threads > chunks) ? (int) chunks : threads;
+    double start = pwned_seconds();
+    pwned_parallel(threads, export_chunks, &export);
+    double elapsed = pwned_seconds() - start;
+    uint64_t bytes = export.out.offset - first;
+    pwned_ordered_destroy(&export.out);
+    Verbose("%" PRIu64 " records, %" PRIu64 " bytes on %d thread%s in %.3fs (%.1f MB/s)",
+            db.records, bytes, threads, (1 == threads) ? "" : "s", elapsed,
+            (elapsed > 0) ? (bytes / elapsed / 1e6) : 0.0);
+    pwned_db_close(&db);
+    return 0;
+}   /* main() */
@@ -0,0 +1,91 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Convert a binary hash file (see pwned_db.h) into a counting quotient filter
+ * (see qfilter.h), which answers approximate lookups in about a fifth of the
+ * space. Use it when the hash file will not fit in memory and an occasional
+ * false positive is acceptable; find-pwned recognizes filters by their
+ * header.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "options.h"
+#include "parallel.h"
+#include "pwned_db.h"
+#include "qfilter.h"
+
+/**
+ * Name of this program, from argv[0].
+ */
+const char* g_program = "bin2qf";
+
+/**
+ * Type of hash in the input file; set by -ntlm.
+ */
+pwned_key_type_t g_key_type = PWNED_KEY_SHA1;
+
+/**
+ * Whether or not to emit verbose messages.
+ */
+int g_verbose = 0;
+
+/* ------------------------------------------------------------------------- */
+int main(int argc, char* argv[]) {
+    g_program = NamePartOfPath(argv[0]);
+    const char* paths[2] = { NULL, NULL };
+    int path_count = 0;
+    for (int i = 1; i < argc; ++i) {
+        int ntlm = 0;
+        if (IsFlagOption(argv[i], &ntlm, "ntlm")) {
+            g_key_type = ntlm ? PWNED_KEY_NTLM : PWNED_KEY_SHA1;
+        } else if (IsFlagOption(argv[i], &g_verbose, "v:erbose")) {
+        } else if (('-' != argv[i][0]) && (path_count < 2)) {
+            paths[path_count++] = argv[i];
+        } else {
+            path_count = 0;
+            break;
+        }
+    }
+    if (2 != path_count) {
+        fprintf(stderr,
+                "usage: %s [options] hashes.bin hashes.qf\n"
+                "\n"
+                "    -[no-]ntlm      File holds NTLM rather than SHA1 hashes. [-no-ntlm]\n"
+                "    -[no-]v:erbose  Print statistics to stderr. [-no-verbose]\n"
+                , g_program);
+        return 2;
+    }
+    pwned_db_t db;
+    int err = pwned_db_open(&db, paths[0], g_key_type);
+    if (PWNED_DB_OK != err) {
+        Fail("could not open %s hash file \"%s\" (error %d)", pwned_key_name(g_key_type), paths[0], err);
+    }
+    int fd = open(paths[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        Fail("could not create \"%s\"", paths[1]);
+    }
+    double start = pwned_seconds();
+    pwned_qf_header_t header;
+    if (0 != pwned_qf_build(&db, fd, &header)) {
+        Fail("could not write \"%s\"", paths[1]);
+    }
+    if (0 != close(fd)) {
+        Fail("could not write \"%s\"", paths[1]);
+    }
+    if (g_verbose) {
+        uint64_t bytes = sizeof(header) + (header.blocks * sizeof(pwned_qf_block_t));
+        fprintf(stderr, "%s: %" PRIu64 " records in %" PRIu64 " slots (%" PRIu64 " blocks), %.1f%%"
+                " full, %.2f bytes per record, in %.3fs\n", g_program, header.records, header.slots,
+                header.blocks, 100.0 * header.records / (header.blocks * PWNED_QF_BLOCK_SLOTS),
+                header.records ? ((double) bytes / header.records) : 0.0, pwned_seconds() - start);
+    }
+    pwned_db_close(&db);
+    return 0;
+}   /* main() */
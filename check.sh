@@ -0,0 +1,100 @@
+#!/bin/bash
+
+# (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt.
+# You are free to do whatever you want with this software. Have at it!
+
+# Checks for 'make check': runs the programs in this directory over a small
+# synthetic hash list in a scratch directory (first argument, default
+# check-data) that is removed at the end. Prints each failure and exits
+# with 1 if there were any.
+
+set -e
+
+dir=${1:-check-data}
+failures=0
+
+# Report failure of check $1 unless the rest of the arguments succeed.
+check() {
+    local name="$1"
+    shift
+    if "$@"; then
+        echo "ok: $name"
+    else
+        echo "FAILED: $name"
+        failures=$((failures + 1))
+    fi
+}
+
+# Succeed if the -replay/-load report on stdin shows a non-zero rate.
+nonzero_rate() {
+    awk '/achieved/ { for (i = 1; i < NF; ++i) if ($i == "achieved") rate = $(i + 1) }
+         END { exit !(rate + 0 > 0) }'
+}
+
+rm -rf "$dir"
+mkdir -p "$dir"
+awk 'BEGIN {
+    srand(1);
+    for (i = 0; i < 20000; ++i) {
+        h = "";
+        for (j = 0; j < 40; j += 4) h = h sprintf("%04X", int(rand() * 65536));
+        printf "%s:%d\n", h, 1 + int(rand() * 1000);
+    }
+}' > "$dir/sha1.txt"
+./pwned2bin < "$dir/sha1.txt" > "$dir/sha1.bin"
+cut -d: -f1 "$dir/sha1.txt" > "$dir/hashes.txt"
+
+./find-pwned -f="$dir/sha1.bin" -record="$dir/lookups.trc" < "$dir/hashes.txt" > /dev/null
+check "replay at -speed=0 reports a rate" \
+    nonzero_rate < <(./find-pwned -f="$dir/sha1.bin" -replay="$dir/lookups.trc" -speed=0)
+
+# A newer release with some records dropped, some counts changed and some
+# records added, looked up directly and as the older release plus -add of
+# the delta between them. The added keys are small numbers, so they all
+# share their cuckoo buckets and most of them go to the stash.
+awk 'NR % 7 != 0 { if (NR % 5 == 0) $0 = substr($0, 1, 41) (NR % 1000); print }
+     END { for (i = 0; i < 500; ++i) printf "%040X:%d\n", i * 7919, i + 1 }' \
+    "$dir/sha1.txt" > "$dir/newer.txt"
+./pwned2bin < "$dir/newer.txt" > "$dir/newer.bin"
+./find-pwned -f="$dir/newer.bin" -diff="$dir/sha1.bin" -diff-bin > "$dir/delta.bin" || true
+cut -d: -f1 "$dir/newer.txt" | cat - "$dir/hashes.txt" > "$dir/both.txt"
+./find-pwned -f="$dir/newer.bin" -pc -pnf < "$dir/both.txt" > "$dir/newer.out" || true
+check "cuckoo -add of a release delta matches the newer release" \
+    cmp -s "$dir/newer.out" \
+    <(./find-pwned -f="$dir/sha1.bin" -engine=cuckoo -add="$dir/delta.bin" -pc -pnf < "$dir/both.txt")
+
+# Re-audits against the delta report only the hashes that were added or
+# changed to a non-zero count, with their new counts; removed records
+# (count 0 in the delta) are in the lists too but must not be reported.
+# An empty delta, from two identical releases, reports nothing and exits
+# with 1.
+./find-pwned -f="$dir/newer.bin" -diff="$dir/sha1.bin" > "$dir/delta.txt" || true
+awk -F: '/^[+~]/ && $NF != 0 { print substr($1, 2) ":" $NF }' "$dir/delta.txt" > "$dir/changed.txt"
+check "join -delta reports only added and changed hashes" \
+    cmp -s "$dir/changed.txt" <(./find-pwned -join="$dir/both.txt" -delta="$dir/delta.bin")
+
+awk -F: '{ print substr($1, 9) ":" $2 }' "$dir/sha1.txt" > "$dir/ntlm.txt"
+awk -F: '{ print substr($1, 9) ":" $2 }' "$dir/newer.txt" > "$dir/ntlm-newer.txt"
+./pwned2bin -ntlm < "$dir/ntlm.txt" > "$dir/ntlm.bin"
+./pwned2bin -ntlm < "$dir/ntlm-newer.txt" > "$dir/ntlm-newer.bin"
+./find-pwned -ntlm -f="$dir/ntlm-newer.bin" -diff="$dir/ntlm.bin" -diff-bin > "$dir/ntlm-delta.bin" || true
+./find-pwned -ntlm -f="$dir/ntlm-newer.bin" -diff="$dir/ntlm.bin" > "$dir/ntlm-delta.txt" || true
+cut -d: -f1 "$dir/ntlm.txt" "$dir/ntlm-newer.txt" |
+    awk '{ printf "CORP\\user%d:%d:aad3b435b51404eeaad3b435b51404ee:%s:::\n", NR, 1000 + NR, tolower($0) }' \
+    > "$dir/dump.txt"
+awk -F: 'NR == FNR { if (/^[+~]/ && $NF != 0) count[substr($1, 2)] = $NF; next }
+         toupper($4) in count { print $1 ":" $2 ":" count[toupper($4)] }' \
+    "$dir/ntlm-delta.txt" "$dir/dump.txt" > "$dir/accounts.txt"
+check "audit -delta reports only accounts with added and changed hashes" \
+    cmp -s "$dir/accounts.txt" <(./find-pwned -audit="$dir/dump.txt" -delta="$dir/ntlm-delta.bin")
+
+: > "$dir/empty.bin"
+check "join -delta of an empty delta finds nothing" \
+    test 1 -eq "$(./find-pwned -join="$dir/both.txt" -delta="$dir/empty.bin" > /dev/null; echo $?)"
+check "audit -delta of an empty delta finds nothing" \
+    test 1 -eq "$(./find-pwned -audit="$dir/dump.txt" -delta="$dir/empty.bin" > /dev/null; echo $?)"
+
+check "cuckoo inserts" ./cuckoo-check
+
+rm -rf "$dir"
+[ "$failures" -eq 0 ]
@@ -0,0 +1,408 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Lookup protocol and client; see client.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "client.h"
+#include "parallel.h"
+
+/**
+ * Answer times needed before the hedging delay follows them; until then
+ * batches are hedged after kHedgeInitialDelay seconds.
+ */
+#define kHedgeMinSamples 0x10
+#define kHedgeInitialDelay 0.05
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Parse one hex prefix of 1 to 16 digits into the lowest and highest
+ * 64-bit key prefixes that start with it.
+ */
+static int parse_prefix(const char* text, size_t length, uint64_t* lo, uint64_t* hi) {
+    if ((0 == length) || (length > 16)) {
+        return 0;
+    }
+    uint64_t value = 0;
+    for (size_t i = 0; i < length; ++i) {
+        char c = text[i];
+        int digit = (('0' <= c) && (c <= '9')) ? (c - '0') :
+            (('A' <= c) && (c <= 'F')) ? (10 + c - 'A') :
+            (('a' <= c) && (c <= 'f')) ? (10 + c - 'a') : -1;
+        if (digit < 0) {
+            return 0;
+        }
+        value = (value << 4) | digit;
+    }
+    uint32_t shift = 64 - (4 * length);
+    *lo = (shift < 64) ? (value << shift) : 0;
+    *hi = *lo | ((shift < 64) ? ((1ull << shift) - 1) : ~0ull);
+    return 1;
+}   /* parse_prefix() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_parse_range(const char* text, pwned_range_t* range) {
+    const char* dash = strchr(text, '-');
+    uint64_t ignored;
+    if (NULL == dash) {
+        return parse_prefix(text, strlen(text), &range->lo, &range->hi);
+    }
+    return parse_prefix(text, dash - text, &range->lo, &ignored) &&
+        parse_prefix(&dash[1], strlen(&dash[1]), &ignored, &range->hi) &&
+        (range->lo <= range->hi);
+}   /* pwned_parse_range() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Resolve @a address, "HOST:PORT" or "PORT", into a list from getaddrinfo().
+ */
+static struct addrinfo* resolve(const char* address, int passive) {
+    char host[0x100] = "";
+    const char* port = address;
+    const char* colon = strrchr(address, ':');
+    if (NULL != colon) {
+        size_t n = colon - address;
+        if (n >= sizeof(host)) {
+            return NULL;
+        }
+        memcpy(host, address, n);
+        host[n] = 0;
+        port = &colon[1];
+    }
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = passive ? AI_PASSIVE : 0;
+    struct addrinfo* list = NULL;
+    if (0 != getaddrinfo(host[0] ? host : NULL, port, &hints, &list)) {
+        return NULL;
+    }
+    return list;
+}   /* resolve() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_net_listen(const char* address) {
+    struct addrinfo* list = resolve(address, 1);
+    int fd = -1;
+    for (struct addrinfo* ai = list; (NULL != ai) && (fd < 0); ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if ((0 != bind(fd, ai->ai_addr, ai->ai_addrlen)) || (0 != listen(fd, SOMAXCONN))) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (NULL != list) {
+        freeaddrinfo(list);
+    }
+    return fd;
+}   /* pwned_net_listen() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_net_connect(const char* address) {
+    struct addrinfo* list = resolve(address, 0);
+    int fd = -1;
+    for (struct addrinfo* ai = list; (NULL != ai) && (fd < 0); ai = ai->ai_next) {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if (fd < 0) {
+            continue;
+        }
+        if (0 != connect(fd, ai->ai_addr, ai->ai_addrlen)) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    if (NULL != list) {
+        freeaddrinfo(list);
+    }
+    if (fd >= 0) {
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+    }
+    return fd;
+}   /* pwned_net_connect() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_net_read(int fd, void* data, size_t size) {
+    uint8_t* p = (uint8_t*) data;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = recv(fd, &p[done], size - done, 0);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        if (0 == n) {
+            return (0 == done) ? 0 : -1;
+        }
+        done += n;
+    }
+    return 1;
+}   /* pwned_net_read() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Send all @a size bytes with send() @a flags, never raising SIGPIPE.
+ */
+static int net_send(int fd, const void* data, size_t size, int flags) {
+    const uint8_t* p = (const uint8_t*) data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, flags | MSG_NOSIGNAL);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}   /* net_send() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_net_write(int fd, const void* data, size_t size) {
+    return net_send(fd, data, size, 0);
+}   /* pwned_net_write() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_client_open(pwned_client_t* client, const char* addresses, pwned_key_type_t type) {
+    memset(client, 0, sizeof(*client));
+    client->key_bytes = pwned_key_bytes(type);
+    client->active[0] = client->active[1] = -1;
+    for (int r = 0; r < PWNED_CLIENT_MAX_REPLICAS; ++r) {
+        client->fds[r] = -1;
+    }
+    client->list = strdup(addresses);
+    if (NULL == client->list) {
+        return -1;
+    }
+    for (char* p = client->list; NULL != p; ) {
+        if (client->replicas == PWNED_CLIENT_MAX_REPLICAS) {
+            pwned_client_close(client);     /* Frees the list; no replica is connected. */
+            return -1;
+        }
+        client->addresses[client->replicas++] = p;
+        p = strchr(p, ',');
+        if (NULL != p) {
+            *p++ = 0;
+        }
+    }
+    for (int r = 0; r < client->replicas; ++r) {
+        client->fds[r] = pwned_net_connect(client->addresses[r]);
+        if (client->fds[r] >= 0) {
+            client->next = r;
+            return 0;
+        }
+    }
+    pwned_client_close(client);     /* Frees the list; no replica is connected. */
+    return -1;
+}   /* pwned_client_open() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Close replica @a r's connection, which also cancels anything it is
+ * working on for us.
+ */
+static void client_disconnect(pwned_client_t* client, int r) {
+    if (client->fds[r] >= 0) {
+        close(client->fds[r]);
+    }
+    client->fds[r] = -1;
+}   /* client_disconnect() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_client_close(pwned_client_t* client) {
+    for (int r = 0; r < client->replicas; ++r) {
+        client_disconnect(client, r);
+    }
+    free(client->list);
+    client->list = NULL;
+    client->replicas = 0;
+}   /* pwned_client_close() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Send the batch in flight to replica @a r, connecting first if needed.
+ *
+ * @return 0 on success, -1 on error.
+ */
+static int client_send_to(pwned_client_t* client, int r) {
+    if (client->fds[r] < 0) {
+        client->fds[r] = pwned_net_connect(client->addresses[r]);
+        if (client->fds[r] < 0) {
+            return -1;
+        }
+    }
+
+    /*
+     * MSG_MORE keeps the header from going out in a packet of its own.
+     */
+    pwned_net_request_t request = { client->key_bytes, client->n };
+    if ((0 != net_send(client->fds[r], &request, sizeof(request), MSG_MORE)) ||
+        (0 != pwned_net_write(client->fds[r], client->keys, (size_t) client->n * client->key_bytes))) {
+        client_disconnect(client, r);
+        return -1;
+    }
+    return 0;
+}   /* client_send_to() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Send the batch in flight to the next replica not yet tried that takes it.
+ *
+ * @return the replica, or -1 if none is left.
+ */
+static int client_send_next(pwned_client_t* client) {
+    while (client->tried < client->replicas) {
+        int r = (client->next + client->tried++) % client->replicas;
+        if (0 == client_send_to(client, r)) {
+            return r;
+        }
+    }
+    return -1;
+}   /* client_send_next() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_client_send(pwned_client_t* client, const uint8_t* keys, uint32_t n) {
+    client->keys = keys;
+    client->n = n;
+    client->tried = 0;
+    client->sent_at = pwned_seconds();
+    client->active[0] = client_send_next(client);
+    client->active[1] = -1;
+    return (client->active[0] < 0) ? -1 : 0;
+}   /* pwned_client_send() */
+
+/* ------------------------------------------------------------------------- */
+double pwned_client_hedge_delay(const pwned_client_t* client) {
+    uint32_t m = (client->latency_count < PWNED_CLIENT_LATENCY_SAMPLES) ?
+        client->latency_count : PWNED_CLIENT_LATENCY_SAMPLES;
+    if (m < kHedgeMinSamples) {
+        return kHedgeInitialDelay;
+    }
+    double sorted[PWNED_CLIENT_LATENCY_SAMPLES];
+    memcpy(sorted, client->latencies, m * sizeof(sorted[0]));
+    qsort(sorted, m, sizeof(sorted[0]), pwned_compare_doubles);
+    uint32_t k = (uint32_t) ((client->hedge_percentile / 100.0) * m);
+    return sorted[(k < m) ? k : (m - 1)];
+}   /* pwned_client_hedge_delay() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Read an answer of @a n counts from replica @a r.
+ *
+ * @return the status, or -1 on error (and the connection is closed).
+ */
+static int client_read_answer(pwned_client_t* client, int r, uint32_t* counts, uint32_t n) {
+    pwned_net_response_t response;
+    if ((1 != pwned_net_read(client->fds[r], &response, sizeof(response))) ||
+        (response.count != n) ||
+        (1 != pwned_net_read(client->fds[r], counts, (size_t) n * sizeof(counts[0])))) {
+        client_disconnect(client, r);
+        return -1;
+    }
+    return (int) response.status;
+}   /* client_read_answer() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_client_receive(pwned_client_t* client, uint32_t* counts, uint32_t n) {
+    int* active = client->active;
+    int can_hedge = (client->hedge_percentile > 0) && (client->replicas > 1);
+    double deadline = client->sent_at + (can_hedge ? pwned_client_hedge_delay(client) : 0);
+    client->batches++;
+    while (1) {
+        if ((active[0] < 0) && (active[1] < 0)) {
+            /* Every replica asked so far failed: fail over to the next one. */
+            active[0] = client_send_next(client);
+            if (active[0] < 0) {
+                client->next = (client->next + 1) % client->replicas;
+                return -1;
+            }
+        }
+        struct pollfd fds[2];
+        int slot[2];
+        int nfds = 0;
+        for (int i = 0; i < 2; ++i) {
+            if (active[i] >= 0) {
+                fds[nfds].fd = client->fds[active[i]];
+                fds[nfds].events = POLLIN;
+                slot[nfds++] = i;
+            }
+        }
+        int hedge_pending = can_hedge && (active[1] < 0) && (client->tried < client->replicas);
+        int timeout = -1;
+        if (hedge_pending) {
+            double left = deadline - pwned_seconds();
+            timeout = (left > 0) ? (int) (left * 1000.0) + 1 : 0;
+        }
+        int ready = poll(fds, nfds, timeout);
+        if (ready < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        if (0 == ready) {
+            if (hedge_pending) {
+                client->hedges++;
+                client->hedged_at = pwned_seconds();
+                active[1] = client_send_next(client);
+            }
+            continue;
+        }
+        for (int i = 0; i < nfds; ++i) {
+            if (0 == fds[i].revents) {
+                continue;
+            }
+            int r = active[slot[i]];
+            int status = client_read_answer(client, r, counts, n);
+            active[slot[i]] = -1;
+            if (status >= 0) {
+                int other = active[1 - slot[i]];
+                if (other >= 0) {
+                    client_disconnect(client, other);       /* Cancel the loser. */
+                    active[1 - slot[i]] = -1;
+                }
+                /*
+                 * Time the answer from when the winner was asked, so that
+                 * stalled replicas do not push the delay up.
+                 */
+                client->hedges_won += (1 == slot[i]);
+                client->latencies[client->latency_count++ % PWNED_CLIENT_LATENCY_SAMPLES] =
+                    pwned_seconds() - ((1 == slot[i]) ? client->hedged_at : client->sent_at);
+                client->next = (client->next + 1) % client->replicas;
+                return status;
+            }
+        }
+    }
+}   /* pwned_client_receive() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_client_lookup(pwned_client_t* client, const uint8_t* keys, uint32_t n, uint32_t* counts) {
+    if (0 != pwned_client_send(client, keys, n)) {
+        return -1;
+    }
+    return pwned_client_receive(client, counts, n);
+}   /* pwned_client_lookup() */
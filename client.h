@@ -0,0 +1,187 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __client_h__
+#define __client_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Lookup protocol spoken by find-pwned servers (-serve), routers (-route)
+ * and clients (-connect).
+ *
+ * A client sends batches of keys over a persistent TCP connection. Each
+ * batch is a pwned_net_request_t followed by @a count keys of @a key_bytes
+ * bytes each; the answer is a pwned_net_response_t followed by @a count
+ * 32-bit occurrence counts in the same order, 0 for keys not found. Batches
+ * on one connection are answered in the order they were sent. All integers
+ * are little-endian.
+ */
+#define PWNED_NET_MAX_BATCH     0x10000
+
+#define PWNED_NET_OK            0
+#define PWNED_NET_BAD_REQUEST   1       /**< Wrong key width or batch too big; connection closed. */
+#define PWNED_NET_OUT_OF_RANGE  2       /**< Some keys are outside the server's range; their counts are 0. */
+#define PWNED_NET_UNAVAILABLE   3       /**< A router could not reach a shard; counts are 0. */
+
+typedef struct {
+    uint32_t key_bytes;
+    uint32_t count;
+} pwned_net_request_t;
+
+typedef struct {
+    uint32_t status;            /**< PWNED_NET_xxx. */
+    uint32_t count;
+} pwned_net_response_t;
+
+/**
+ * A range of keys, by the first 64 bits of the key read big-endian, with
+ * both ends included.
+ */
+typedef struct {
+    uint64_t lo;
+    uint64_t hi;
+} pwned_range_t;
+
+/**
+ * Parse a hex prefix range "LO-HI" (e.g. "00-7F" or "8000-BFFF") into
+ * @a range; it holds the keys that start with any prefix from LO through
+ * HI. A single prefix "LO" is the same as "LO-LO".
+ *
+ * @return 1 on success, 0 if @a text is not a valid range.
+ */
+int pwned_parse_range(const char* text, pwned_range_t* range);
+
+static inline int pwned_range_contains(const pwned_range_t* range, const uint8_t* key) {
+    uint64_t prefix = pwned_load_be64(key);
+    return (range->lo <= prefix) && (prefix <= range->hi);
+}
+
+/**
+ * Create a listening TCP socket on @a address, "HOST:PORT" or just "PORT"
+ * for all interfaces.
+ *
+ * @return the socket, or -1 on error.
+ */
+int pwned_net_listen(const char* address);
+
+/**
+ * Connect to "HOST:PORT" @a address, with Nagle disabled since every
+ * message is written whole.
+ *
+ * @return the socket, or -1 on error.
+ */
+int pwned_net_connect(const char* address);
+
+/**
+ * Read exactly @a size bytes from socket @a fd.
+ *
+ * @return 1 on success, 0 if the peer closed the connection before the
+ * first byte, -1 on error or a partial read.
+ */
+int pwned_net_read(int fd, void* data, size_t size);
+
+/**
+ * Write @a size bytes to socket @a fd.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int pwned_net_write(int fd, const void* data, size_t size);
+
+/**
+ * Replicas a client can spread one server's requests over, and latencies
+ * kept to pick the hedging delay.
+ */
+#define PWNED_CLIENT_MAX_REPLICAS       8
+#define PWNED_CLIENT_LATENCY_SAMPLES    0x100
+
+/**
+ * A client for a server or router that may be replicated.
+ *
+ * Batches go to the replicas in turn. With @a hedge_percentile set (and
+ * more than one replica), a batch that has not been answered within that
+ * percentile of recent answer times is sent again to the next replica, and
+ * whichever answer comes first is used. The slower request is cancelled by
+ * closing its connection, which is reopened when that replica is next
+ * used. Only the slowest few percent of batches are sent twice, so the tail
+ * latency drops at little cost in load. A replica that cannot be reached is
+ * skipped at once.
+ *
+ * One batch is in flight per client at a time, but a caller can send
+ * batches on many clients before receiving any of the answers, to talk to
+ * many servers at once from one thread.
+ */
+typedef struct {
+    char* list;                 /**< Copy of the address list, split at commas. */
+    const char* addresses[PWNED_CLIENT_MAX_REPLICAS];
+    int fds[PWNED_CLIENT_MAX_REPLICAS];     /**< Sockets, or -1 when not connected. */
+    int replicas;
+    uint32_t key_bytes;
+    double hedge_percentile;    /**< 0 (the default) to never hedge. */
+    int next;                   /**< Replica to send the next batch to first. */
+    int active[2];              /**< Replicas working on the batch in flight, or -1. */
+    int tried;                  /**< Replicas tried for the batch in flight. */
+    const uint8_t* keys;        /**< Batch in flight, kept to resend it. */
+    uint32_t n;
+    double sent_at;
+    double hedged_at;
+    double latencies[PWNED_CLIENT_LATENCY_SAMPLES];
+    uint32_t latency_count;
+    uint64_t batches;
+    uint64_t hedges;            /**< Batches sent a second time. */
+    uint64_t hedges_won;        /**< ... that were answered first by the second replica. */
+} pwned_client_t;
+
+/**
+ * Set up @a client for @a addresses, one "HOST:PORT" or a comma-separated
+ * list of replicas holding the same data, for keys of @a type, and connect
+ * to the first replica that answers.
+ *
+ * @return 0 on success, -1 if no replica could be reached (the client is
+ * still usable and retries on each send) or the list is invalid.
+ */
+int pwned_client_open(pwned_client_t* client, const char* addresses, pwned_key_type_t type);
+
+void pwned_client_close(pwned_client_t* client);
+
+/**
+ * Send a batch of @a n keys (at most PWNED_NET_MAX_BATCH), packed at
+ * @a keys, which must stay valid until pwned_client_receive() since a hedge
+ * resends them. Replicas whose connection was lost are reconnected.
+ *
+ * @return 0 on success, -1 if no replica could take the batch.
+ */
+int pwned_client_send(pwned_client_t* client, const uint8_t* keys, uint32_t n);
+
+/**
+ * Wait for the answer to the batch in flight, hedging as described above,
+ * and store its @a n counts in @a counts.
+ *
+ * @return the PWNED_NET_xxx status, or -1 if no replica answered.
+ */
+int pwned_client_receive(pwned_client_t* client, uint32_t* counts, uint32_t n);
+
+/**
+ * The hedging delay in seconds that @a client would use now.
+ */
+double pwned_client_hedge_delay(const pwned_client_t* client);
+
+/**
+ * Send a batch and wait for its answer.
+ *
+ * @return the PWNED_NET_xxx status, or -1 on error.
+ */
+int pwned_client_lookup(pwned_client_t* client, const uint8_t* keys, uint32_t n, uint32_t* counts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
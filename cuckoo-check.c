@@ -0,0 +1,134 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Checks of pwned_cuckoo_insert() for 'make check'. A table is built over a
+ * small synthetic hash file, then keys are inserted into a pair of buckets
+ * until they overflow into the stash, counts are changed and removed, and
+ * enough keys are inserted to make the table grow. After each step every
+ * key, from the file or inserted, must be found with its latest count.
+ *
+ * Keys are the SHA1s of their numbers. The two buckets of a key are picked
+ * by its bytes 8-15 (see cuckoo.c), so keys that share those bytes all go to
+ * the same two buckets.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuckoo.h"
+#include "pwned_db.h"
+#include "sha1.h"
+
+/**
+ * Records in the hash file, keys inserted into one pair of buckets (more
+ * than their 2 * PWNED_CUCKOO_SLOTS slots) and keys inserted to grow the
+ * table.
+ */
+#define kRecords 1000
+#define kCrowded 40
+#define kGrowth 4000
+
+#define kKeys (kRecords + kCrowded + kGrowth)
+
+uint8_t g_keys[kKeys][PWNED_SHA1_KEY_BYTES];
+uint32_t g_counts[kKeys];
+int g_failures = 0;
+
+/* ------------------------------------------------------------------------- */
+static int compare_records(const void* a, const void* b) {
+    return memcmp(a, b, PWNED_SHA1_KEY_BYTES);
+}   /* compare_records() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Check that keys 0 through @a n - 1 are found in @a table with their counts
+ * in g_counts, those with a count of 0 not being found.
+ */
+static void check_keys(const pwned_cuckoo_t* table, size_t n, const char* step) {
+    size_t wrong = 0;
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t count = 0;
+        int found = pwned_cuckoo_find(table, g_keys[i], &count);
+        if ((found != (0 != g_counts[i])) || (count != g_counts[i])) {
+            wrong++;
+        }
+    }
+    if (0 != wrong) {
+        printf("FAILED: %s: %zu of %zu keys have the wrong count\n", step, wrong, n);
+        g_failures++;
+    } else {
+        printf("ok: %s\n", step);
+    }
+}   /* check_keys() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Insert key @a i with count @a count into @a table.
+ */
+static void insert_key(pwned_cuckoo_t* table, size_t i, uint32_t count) {
+    if (0 != pwned_cuckoo_insert(table, g_keys[i], count)) {
+        fprintf(stderr, "cuckoo-check: out of memory inserting key %zu\n", i);
+        exit(2);
+    }
+    g_counts[i] = count;
+}   /* insert_key() */
+
+/* ------------------------------------------------------------------------- */
+int main(int argc, char* argv[]) {
+    static uint8_t records[kRecords][PWNED_SHA1_RECORD_BYTES];
+    for (uint32_t i = 0; i < kKeys; ++i) {
+        sha1_buffer_bin(&i, sizeof(i), g_keys[i]);
+    }
+    for (size_t i = 0; i < kRecords; ++i) {
+        uint32_t count = (uint32_t) (i + 1);
+        memcpy(records[i], g_keys[i], PWNED_SHA1_KEY_BYTES);
+        memcpy(&records[i][PWNED_SHA1_KEY_BYTES], &count, sizeof(count));
+    }
+    qsort(records, kRecords, sizeof(records[0]), compare_records);
+    for (size_t i = 0; i < kRecords; ++i) {
+        memcpy(g_keys[i], records[i], PWNED_SHA1_KEY_BYTES);
+        memcpy(&g_counts[i], &records[i][PWNED_SHA1_KEY_BYTES], sizeof(g_counts[i]));
+    }
+    pwned_db_t db;
+    pwned_db_attach(&db, records, sizeof(records), PWNED_KEY_SHA1);
+    pwned_cuckoo_t table;
+    if (0 != pwned_cuckoo_build(&table, &db)) {
+        fprintf(stderr, "cuckoo-check: could not build the table\n");
+        return 2;
+    }
+    check_keys(&table, kRecords, "build");
+
+    /* Crowd the buckets of key 0 until they are full and spill into the stash. */
+    for (size_t i = kRecords; i < kRecords + kCrowded; ++i) {
+        memcpy(&g_keys[i][8], &g_keys[0][8], 8);
+        insert_key(&table, i, (uint32_t) (i + 1));
+    }
+    if (table.stash_size < kCrowded - (2 * PWNED_CUCKOO_SLOTS)) {
+        printf("FAILED: insert into full buckets: only %u keys stashed\n", table.stash_size);
+        g_failures++;
+    }
+    check_keys(&table, kRecords + kCrowded, "insert into full buckets");
+
+    /* New counts for keys from the file and inserted ones, and removals. */
+    insert_key(&table, 0, 7);
+    insert_key(&table, 1, 0);
+    insert_key(&table, kRecords, 9);
+    insert_key(&table, kRecords + kCrowded - 1, 0);
+    check_keys(&table, kRecords + kCrowded, "change and remove counts");
+
+    uint64_t buckets = table.buckets;
+    for (size_t i = kRecords + kCrowded; i < kKeys; ++i) {
+        insert_key(&table, i, (uint32_t) (i + 1));
+    }
+    if (table.buckets <= buckets) {
+        printf("FAILED: grow: still %" PRIu64 " buckets\n", table.buckets);
+        g_failures++;
+    }
+    check_keys(&table, kKeys, "grow");
+
+    pwned_cuckoo_free(&table);
+    return (0 == g_failures) ? 0 : 1;
+}   /* main() */
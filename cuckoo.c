@@ -0,0 +1,410 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Bucketized cuckoo hash table; see cuckoo.h.
+ *
+ * The keys are already cryptographic hashes, so no further hashing is
+ * needed: bytes 0-7 of a key are its fingerprint and bytes 8-11 and 12-15
+ * pick its two buckets. Since every slot records the index of its record,
+ * an evicted entry's other bucket is found from its full key.
+ *
+ * The bucket compare is written with GCC vector extensions, once for the
+ * baseline (SSE2 on x86-64) and once compiled for AVX2, and the AVX2 version
+ * is selected at run time when the CPU supports it, as in md4.c.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cuckoo.h"
+
+/**
+ * Target fraction of slots in use after building. Bucketized cuckoo tables
+ * with 8 slots fill past 95% before inserts start failing, so this leaves
+ * room for pwned_cuckoo_insert() without making evictions chains long.
+ */
+#define kCuckooLoad         0.85
+
+/**
+ * pwned_cuckoo_insert() doubles the table past this load, or when the stash
+ * holds more than kCuckooMaxStash entries plus one per kCuckooStashBuckets
+ * buckets. Growing does not help keys that share both their buckets, so the
+ * stash allowed grows with the table, or such keys would double it on every
+ * insert.
+ */
+#define kCuckooMaxLoad      0.93
+#define kCuckooMaxStash     0x40
+#define kCuckooStashBuckets 0x40
+
+/**
+ * Evictions tried before a key goes to the stash.
+ */
+#define kCuckooMaxKicks     500
+
+/**
+ * Slot record index meaning "empty".
+ */
+#define kCuckooEmpty        UINT32_MAX
+
+typedef uint64_t cuckoo_vec_t __attribute__((vector_size(32)));
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Compare the fingerprints of @a bucket with @a fingerprint.
+ *
+ * @return non-zero if any of them match.
+ */
+#define CUCKOO_MATCH(_name, _attributes)                                \
+    static _attributes uint64_t _name(const uint64_t* bucket, uint64_t fingerprint) { \
+        cuckoo_vec_t lo;                                                \
+        cuckoo_vec_t hi;                                                \
+        memcpy(&lo, &bucket[0], sizeof(lo));                            \
+        memcpy(&hi, &bucket[4], sizeof(hi));                            \
+        cuckoo_vec_t f = { fingerprint, fingerprint, fingerprint, fingerprint }; \
+        cuckoo_vec_t m = (cuckoo_vec_t) ((lo == f) | (hi == f));        \
+        return m[0] | m[1] | m[2] | m[3];                               \
+    }
+
+CUCKOO_MATCH(cuckoo_match_generic, )
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CUCKOO_HAVE_AVX2 1
+CUCKOO_MATCH(cuckoo_match_avx2, __attribute__((target("avx2"))))
+#else
+#define CUCKOO_HAVE_AVX2 0
+#endif
+
+/* ------------------------------------------------------------------------- */
+const char* pwned_cuckoo_kernel_name(void) {
+#if CUCKOO_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return "avx2";
+    }
+    return "sse2";
+#else
+    return "generic";
+#endif
+}   /* pwned_cuckoo_kernel_name() */
+
+/* ------------------------------------------------------------------------- */
+static inline uint64_t cuckoo_fingerprint(const uint8_t* key) {
+    uint64_t f;
+    memcpy(&f, key, sizeof(f));
+    return f;
+}   /* cuckoo_fingerprint() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Map 32 random bits @a h onto [0, @a buckets) without a division.
+ */
+static inline uint64_t cuckoo_reduce(uint32_t h, uint64_t buckets) {
+    return (uint64_t) (((unsigned __int128) h * buckets) >> 32);
+}   /* cuckoo_reduce() */
+
+/* ------------------------------------------------------------------------- */
+static inline void cuckoo_buckets(const pwned_cuckoo_t* table, const uint8_t* key,
+                                  uint64_t* b1, uint64_t* b2) {
+    uint32_t h1;
+    uint32_t h2;
+    memcpy(&h1, &key[8], sizeof(h1));
+    memcpy(&h2, &key[12], sizeof(h2));
+    *b1 = cuckoo_reduce(h1, table->buckets);
+    *b2 = cuckoo_reduce(h2, table->buckets);
+    if (*b1 == *b2) {
+        *b2 = (*b1 + 1 < table->buckets) ? (*b1 + 1) : 0;
+    }
+}   /* cuckoo_buckets() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Record number @a index: one of the hash file's, or one added later.
+ */
+static inline const uint8_t* cuckoo_record(const pwned_cuckoo_t* table, uint32_t index) {
+    const pwned_db_t* db = table->db;
+    if (index < db->records) {
+        return pwned_db_record(db, index);
+    }
+    return &table->extra[(index - db->records) * db->record_bytes];
+}   /* cuckoo_record() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Find the slot holding @a key in bucket @a b.
+ *
+ * @return the slot, or -1 if @a key is not in the bucket.
+ */
+static inline int cuckoo_find_slot(const pwned_cuckoo_t* table, uint64_t b, const uint8_t* key,
+                                   uint64_t fingerprint) {
+    const uint64_t* bucket = table->fingerprints[b];
+    if (0 == table->match(bucket, fingerprint)) {
+        return -1;
+    }
+    for (int s = 0; s < PWNED_CUCKOO_SLOTS; ++s) {
+        uint32_t index = table->slots[b][s];
+        if ((bucket[s] == fingerprint) && (kCuckooEmpty != index) &&
+            (0 == memcmp(cuckoo_record(table, index), key, table->db->key_bytes))) {
+            return s;
+        }
+    }
+    return -1;
+}   /* cuckoo_find_slot() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Put record @a index in a free slot of bucket @a b, if there is one.
+ *
+ * @return 1 if placed, 0 if the bucket is full.
+ */
+static inline int cuckoo_place(pwned_cuckoo_t* table, uint64_t b, uint32_t index,
+                               uint64_t fingerprint) {
+    for (int s = 0; s < PWNED_CUCKOO_SLOTS; ++s) {
+        if (kCuckooEmpty == table->slots[b][s]) {
+            table->slots[b][s] = index;
+            table->fingerprints[b][s] = fingerprint;
+            return 1;
+        }
+    }
+    return 0;
+}   /* cuckoo_place() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Add record @a index, which must not already be in the table, evicting
+ * entries to their other bucket as needed.
+ *
+ * @return 0 on success, -1 if the stash could not grow.
+ */
+static int cuckoo_add(pwned_cuckoo_t* table, uint32_t index) {
+    const uint8_t* key = cuckoo_record(table, index);
+    uint64_t fingerprint = cuckoo_fingerprint(key);
+    uint64_t b1;
+    uint64_t b2;
+    cuckoo_buckets(table, key, &b1, &b2);
+    if (cuckoo_place(table, b1, index, fingerprint) || cuckoo_place(table, b2, index, fingerprint)) {
+        ++table->used;
+        return 0;
+    }
+    uint64_t b = b1;
+    for (int kick = 0; kick < kCuckooMaxKicks; ++kick) {
+        table->seed = (table->seed * 6364136223846793005ull) + 1442695040888963407ull;
+        int s = (int) (table->seed >> 61);
+        uint32_t victim = table->slots[b][s];
+        uint64_t victim_fingerprint = table->fingerprints[b][s];
+        table->slots[b][s] = index;
+        table->fingerprints[b][s] = fingerprint;
+        index = victim;
+        fingerprint = victim_fingerprint;
+        cuckoo_buckets(table, cuckoo_record(table, index), &b1, &b2);
+        b = (b == b1) ? b2 : b1;
+        if (cuckoo_place(table, b, index, fingerprint)) {
+            ++table->used;
+            return 0;
+        }
+    }
+    if (table->stash_size == table->stash_capacity) {
+        uint32_t capacity = (0 == table->stash_capacity) ? 0x40 : (2 * table->stash_capacity);
+        uint32_t* stash = (uint32_t*) realloc(table->stash, capacity * sizeof(stash[0]));
+        if (NULL == stash) {
+            return -1;
+        }
+        table->stash = stash;
+        table->stash_capacity = capacity;
+    }
+    table->stash[table->stash_size++] = index;
+    ++table->used;
+    return 0;
+}   /* cuckoo_add() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Allocate empty buckets for @a table->buckets buckets.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+static int cuckoo_alloc(pwned_cuckoo_t* table) {
+    table->fingerprints = aligned_alloc(64, table->buckets * sizeof(table->fingerprints[0]));
+    table->slots = malloc(table->buckets * sizeof(table->slots[0]));
+    if ((NULL == table->fingerprints) || (NULL == table->slots)) {
+        free(table->fingerprints);
+        free(table->slots);
+        table->fingerprints = NULL;
+        table->slots = NULL;
+        return -1;
+    }
+    memset(table->fingerprints, 0, table->buckets * sizeof(table->fingerprints[0]));
+    memset(table->slots, 0xFF, table->buckets * sizeof(table->slots[0]));
+    table->used = 0;
+    table->stash_size = 0;
+    return 0;
+}   /* cuckoo_alloc() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Double the number of buckets and re-add every entry.
+ *
+ * @return 0 on success, -1 if out of memory (leaving @a table unchanged).
+ */
+static int cuckoo_grow(pwned_cuckoo_t* table) {
+    pwned_cuckoo_t old = *table;
+    table->buckets = 2 * old.buckets;
+    table->stash = NULL;
+    table->stash_capacity = 0;
+    if (0 != cuckoo_alloc(table)) {
+        *table = old;
+        return -1;
+    }
+    int err = 0;
+    for (uint64_t b = 0; b < old.buckets; ++b) {
+        for (int s = 0; s < PWNED_CUCKOO_SLOTS; ++s) {
+            if (kCuckooEmpty != old.slots[b][s]) {
+                err |= cuckoo_add(table, old.slots[b][s]);
+            }
+        }
+    }
+    for (uint32_t i = 0; i < old.stash_size; ++i) {
+        err |= cuckoo_add(table, old.stash[i]);
+    }
+    if (0 != err) {
+        free(table->fingerprints);
+        free(table->slots);
+        free(table->stash);
+        *table = old;
+        return -1;
+    }
+    free(old.fingerprints);
+    free(old.slots);
+    free(old.stash);
+    return 0;
+}   /* cuckoo_grow() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_cuckoo_build(pwned_cuckoo_t* table, const pwned_db_t* db) {
+    memset(table, 0, sizeof(*table));
+    table->db = db;
+    table->seed = 0x9E3779B97F4A7C15ull;
+    table->match = cuckoo_match_generic;
+#if CUCKOO_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        table->match = cuckoo_match_avx2;
+    }
+#endif
+    if (db->records >= kCuckooEmpty / 2) {
+        return -1;
+    }
+    table->buckets = (uint64_t) (db->records / (kCuckooLoad * PWNED_CUCKOO_SLOTS)) + 2;
+    if (0 != cuckoo_alloc(table)) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < db->records; ++i) {
+        if ((0 != pwned_db_count(db, i)) && (0 != cuckoo_add(table, (uint32_t) i))) {
+            pwned_cuckoo_free(table);
+            return -1;
+        }
+    }
+    return 0;
+}   /* pwned_cuckoo_build() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_cuckoo_free(pwned_cuckoo_t* table) {
+    free(table->fingerprints);
+    free(table->slots);
+    free(table->stash);
+    free(table->extra);
+    table->fingerprints = NULL;
+    table->slots = NULL;
+    table->stash = NULL;
+    table->extra = NULL;
+}   /* pwned_cuckoo_free() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Locate @a key.
+ *
+ * @return its record index, or kCuckooEmpty if it is not in the table.
+ */
+static uint32_t cuckoo_lookup(const pwned_cuckoo_t* table, const uint8_t* key,
+                              uint32_t** where) {
+    uint64_t fingerprint = cuckoo_fingerprint(key);
+    uint64_t b1;
+    uint64_t b2;
+    cuckoo_buckets(table, key, &b1, &b2);
+    int s = cuckoo_find_slot(table, b1, key, fingerprint);
+    uint64_t b = b1;
+    if (s < 0) {
+        s = cuckoo_find_slot(table, b2, key, fingerprint);
+        b = b2;
+    }
+    if (s >= 0) {
+        *where = &table->slots[b][s];
+        return table->slots[b][s];
+    }
+    for (uint32_t i = 0; i < table->stash_size; ++i) {
+        if (0 == memcmp(cuckoo_record(table, table->stash[i]), key, table->db->key_bytes)) {
+            *where = &table->stash[i];
+            return table->stash[i];
+        }
+    }
+    return kCuckooEmpty;
+}   /* cuckoo_lookup() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_cuckoo_find(const pwned_cuckoo_t* table, const uint8_t* key, uint64_t* count) {
+    uint32_t* where = NULL;
+    uint32_t index = cuckoo_lookup(table, key, &where);
+    uint32_t n = 0;
+    if (kCuckooEmpty != index) {
+        memcpy(&n, cuckoo_record(table, index) + table->db->key_bytes, sizeof(n));
+    }
+    *count = n;
+    return (n > 0);
+}   /* pwned_cuckoo_find() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_cuckoo_insert(pwned_cuckoo_t* table, const uint8_t* key, uint32_t count) {
+    const pwned_db_t* db = table->db;
+    uint32_t* where = NULL;
+    uint32_t index = cuckoo_lookup(table, key, &where);
+    if ((kCuckooEmpty != index) && (index >= db->records)) {
+        memcpy(&table->extra[(index - db->records) * db->record_bytes + db->key_bytes],
+               &count, sizeof(count));
+        return 0;
+    }
+    if (db->records + table->extra_records >= kCuckooEmpty - 1) {
+        return -1;
+    }
+    if (table->extra_records == table->extra_capacity) {
+        uint64_t capacity = (0 == table->extra_capacity) ? 0x400 : (2 * table->extra_capacity);
+        uint8_t* extra = (uint8_t*) realloc(table->extra, capacity * db->record_bytes);
+        if (NULL == extra) {
+            return -1;
+        }
+        table->extra = extra;
+        table->extra_capacity = capacity;
+    }
+    uint8_t* record = &table->extra[table->extra_records * db->record_bytes];
+    memcpy(record, key, db->key_bytes);
+    memcpy(&record[db->key_bytes], &count, sizeof(count));
+    uint32_t added = (uint32_t) (db->records + table->extra_records++);
+    if (kCuckooEmpty != index) {
+        *where = added;         /* Shadow the hash file's record. */
+        return 0;
+    }
+    if (((table->used + 1) > kCuckooMaxLoad * PWNED_CUCKOO_SLOTS * table->buckets) ||
+        (table->stash_size > kCuckooMaxStash + (table->buckets / kCuckooStashBuckets))) {
+        if (0 != cuckoo_grow(table)) {
+            table->extra_records--;
+            return -1;
+        }
+    }
+    return cuckoo_add(table, added);
+}   /* pwned_cuckoo_insert() */
+
+/* ------------------------------------------------------------------------- */
+uint64_t pwned_cuckoo_bytes(const pwned_cuckoo_t* table) {
+    return (table->buckets * (sizeof(table->fingerprints[0]) + sizeof(table->slots[0]))) +
+        (table->stash_capacity * sizeof(table->stash[0])) +
+        (table->extra_capacity * table->db->record_bytes);
+}   /* pwned_cuckoo_bytes() */
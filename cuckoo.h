@@ -0,0 +1,91 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __cuckoo_h__
+#define __cuckoo_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Slots per bucket. A bucket's fingerprints fill one 64-byte cache line.
+ */
+#define PWNED_CUCKOO_SLOTS      8
+
+/**
+ * In-memory bucketized cuckoo hash table over the records of a hash file.
+ *
+ * Each key hashes to two buckets of PWNED_CUCKOO_SLOTS slots. A slot holds
+ * the first 64 bits of a key as its fingerprint, plus (in a parallel array)
+ * the index of the record it came from so the full key and count can be
+ * checked. A lookup compares all of a bucket's fingerprints at once with
+ * SIMD, so it reads at most two fingerprint cache lines before touching the
+ * record. Keys that could not be placed after a bounded number of evictions
+ * go to a small stash that is searched linearly.
+ *
+ * Records added with pwned_cuckoo_insert() are kept in a side array, so the
+ * table can grow without a rebuild while the hash file stays read-only.
+ */
+typedef struct {
+    const pwned_db_t* db;
+    uint64_t (*fingerprints)[PWNED_CUCKOO_SLOTS];   /**< One cache line per bucket. */
+    uint32_t (*slots)[PWNED_CUCKOO_SLOTS];          /**< Record index of each slot. */
+    uint64_t buckets;
+    uint64_t used;              /**< Occupied slots, including the stash. */
+    uint32_t* stash;            /**< Record indices that did not fit. */
+    uint32_t stash_size;
+    uint32_t stash_capacity;
+    uint8_t* extra;             /**< Records added by pwned_cuckoo_insert(). */
+    uint64_t extra_records;
+    uint64_t extra_capacity;
+    uint64_t seed;              /**< State for choosing eviction victims. */
+    uint64_t (*match)(const uint64_t* bucket, uint64_t fingerprint);
+} pwned_cuckoo_t;
+
+/**
+ * Build a table over all of @a db's records, which must outlive the table.
+ * Records with a count of 0 are left out.
+ *
+ * @return 0 on success, -1 if memory could not be allocated or @a db has
+ * too many records for 32-bit record indices.
+ */
+int pwned_cuckoo_build(pwned_cuckoo_t* table, const pwned_db_t* db);
+
+void pwned_cuckoo_free(pwned_cuckoo_t* table);
+
+/**
+ * Look up @a key, setting @a *count to its occurrence count.
+ *
+ * @return 1 if found with a non-zero count, 0 otherwise.
+ */
+int pwned_cuckoo_find(const pwned_cuckoo_t* table, const uint8_t* key, uint64_t* count);
+
+/**
+ * Add @a key with @a count, or replace the count of a key already in the
+ * table. A count of 0 effectively removes the key.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+int pwned_cuckoo_insert(pwned_cuckoo_t* table, const uint8_t* key, uint32_t count);
+
+/**
+ * Bytes of memory used by the table, not counting the hash file.
+ */
+uint64_t pwned_cuckoo_bytes(const pwned_cuckoo_t* table);
+
+/**
+ * Name of the bucket compare kernel selected for this CPU, e.g. "avx2".
+ */
+const char* pwned_cuckoo_kernel_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
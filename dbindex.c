@@ -0,0 +1,153 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Sparse hash file index; see dbindex.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dbindex.h"
+
+/**
+ * Largest leaf pwned_index_pread_find() reads through its stack buffer.
+ */
+#define kIndexMaxLeafBytes 0x2000
+
+/* ------------------------------------------------------------------------- */
+/**
+ * @return the first record of leaf @a leaf: the first record starting in
+ * block @a leaf. Leaf 0 starts at record 0 even when db->data is not
+ * aligned.
+ */
+static inline uint64_t leaf_first(const pwned_index_t* index, uint64_t leaf) {
+    if (0 == leaf) {
+        return 0;
+    }
+    const uint32_t record_bytes = index->db->record_bytes;
+    return (leaf * index->leaf_bytes - index->phase + record_bytes - 1) / record_bytes;
+}   /* leaf_first() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_index_build(pwned_index_t* index, const pwned_db_t* db, uint32_t leaf_bytes) {
+    index->db = db;
+    index->leaf_bytes = leaf_bytes;
+    index->phase = (uint32_t) ((uintptr_t) db->data % leaf_bytes);
+    index->leaves = (0 == db->records) ? 0 :
+        (((db->records - 1) * db->record_bytes + index->phase) / leaf_bytes) + 1;
+    index->prefixes = (uint64_t*) malloc((index->leaves + 1) * sizeof(index->prefixes[0]));
+    if (NULL == index->prefixes) {
+        return -1;
+    }
+    for (uint64_t i = 0; i < index->leaves; ++i) {
+        index->prefixes[i] = pwned_load_be64(pwned_db_record(db, leaf_first(index, i)));
+    }
+    return 0;
+}   /* pwned_index_build() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_index_free(pwned_index_t* index) {
+    free(index->prefixes);
+    index->prefixes = NULL;
+    index->leaves = 0;
+}   /* pwned_index_free() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Set [@a *first, @a *last) to the records of the leaf (or, rarely, leaves)
+ * that would hold @a key, and @a *whole to the end of those records that
+ * lie wholly within the leaves' blocks; if it is below @a *last, record
+ * @a *whole runs over into the next block.
+ */
+static void index_leaves(const pwned_index_t* index, const uint8_t* key, uint64_t* first,
+                         uint64_t* whole, uint64_t* last) {
+    const uint64_t* prefixes = index->prefixes;
+    uint64_t prefix = pwned_load_be64(key);
+    uint64_t lo = 0;
+    uint64_t hi = index->leaves;
+    while (lo < hi) {
+        uint64_t mid = lo + ((hi - lo) / 2);
+        if (prefixes[mid] < prefix) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    /*
+     * The key is in the leaf before the first one starting at or above its
+     * prefix, or in a leaf starting with the same prefix (which only
+     * happens if two keys share their first 64 bits).
+     */
+    uint64_t end = lo;
+    while ((end < index->leaves) && (prefixes[end] == prefix)) {
+        ++end;
+    }
+    const uint64_t records = index->db->records;
+    *first = leaf_first(index, (lo > 0) ? (lo - 1) : 0);
+    *last = (end < index->leaves) ? leaf_first(index, end) : records;
+    *whole = (end * index->leaf_bytes - index->phase) / index->db->record_bytes;
+    if (*whole > *last) {
+        *whole = *last;
+    }
+}   /* index_leaves() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_index_find(const pwned_index_t* index, const uint8_t* key, uint64_t* count) {
+    const pwned_db_t* db = index->db;
+    uint64_t first;
+    uint64_t whole;
+    uint64_t last;
+    index_leaves(index, key, &first, &whole, &last);
+    return db->find(pwned_db_record(db, first), last - first, key, count);
+}   /* pwned_index_find() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_index_pread_find(const pwned_index_t* index, int fd, const uint8_t* key, uint64_t* count) {
+    const pwned_db_t* db = index->db;
+    uint64_t first;
+    uint64_t whole;
+    uint64_t last;
+    uint8_t buffer[2 * kIndexMaxLeafBytes];
+    index_leaves(index, key, &first, &whole, &last);
+    size_t size = (whole - first) * db->record_bytes;
+    *count = 0;
+    if (size > sizeof(buffer)) {
+        return pwned_index_find(index, key, count);     /* Shared prefix; rare. */
+    }
+    if ((ssize_t) size != pread(fd, buffer, size, first * db->record_bytes)) {
+        return 0;
+    }
+    if (db->find(buffer, whole - first, key, count)) {
+        return 1;
+    }
+
+    /*
+     * Read the record that runs over into the next page only if the key
+     * sorts after every record before it, so that other lookups leave the
+     * next page alone.
+     */
+    if ((whole < last) &&
+        ((whole == first) || (memcmp(key, &buffer[size - db->record_bytes], db->key_bytes) > 0))) {
+        if ((ssize_t) db->record_bytes != pread(fd, buffer, db->record_bytes, whole * db->record_bytes)) {
+            return 0;
+        }
+        return db->find(buffer, 1, key, count);
+    }
+    return 0;
+}   /* pwned_index_pread_find() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_index_prefetch(const pwned_index_t* index, int fd, const uint8_t* key) {
+    uint64_t first;
+    uint64_t whole;
+    uint64_t last;
+    index_leaves(index, key, &first, &whole, &last);
+    posix_fadvise(fd, first * index->db->record_bytes, (whole - first) * index->db->record_bytes,
+                  POSIX_FADV_WILLNEED);
+}   /* pwned_index_prefetch() */
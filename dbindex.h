@@ -0,0 +1,75 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __dbindex_h__
+#define __dbindex_h__
+
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A sparse index over a hash file: the first 64 bits of the first key of
+ * every leaf. It is the top of the binary search pulled out into its own
+ * small array, so that a lookup searches the index and then a single leaf
+ * of the file. Each NUMA node can keep a copy in its own memory, leaving
+ * only the leaf reads to go to the shared mapping, and -auto keeps one in
+ * RAM when the file itself does not fit.
+ *
+ * Leaves follow the @a leaf_bytes-aligned blocks (pages) of memory that
+ * db->data lies in: leaf i holds the records that start in block i. Records
+ * do not divide a page evenly, so the last record of most leaves runs over
+ * into the next page; a lookup only touches it when the key falls between
+ * it and the one before, and otherwise reads a single page.
+ */
+typedef struct {
+    const pwned_db_t* db;
+    uint64_t* prefixes;
+    uint64_t leaves;
+    uint32_t leaf_bytes;
+    uint32_t phase;             /**< Offset of db->data into its aligned block. */
+} pwned_index_t;
+
+/**
+ * Build an index over @a db with leaves following @a leaf_bytes-aligned
+ * blocks (a power of two no smaller than a record), allocating (and so
+ * first touching) it on the calling thread.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+int pwned_index_build(pwned_index_t* index, const pwned_db_t* db, uint32_t leaf_bytes);
+
+void pwned_index_free(pwned_index_t* index);
+
+/**
+ * Look up @a key through @a index, with the same results as
+ * pwned_db_find().
+ */
+int pwned_index_find(const pwned_index_t* index, const uint8_t* key, uint64_t* count);
+
+/**
+ * Look up @a key through @a index, reading its leaf from @a fd (the hash
+ * file) with pread() rather than through the mapping. Each lookup is then
+ * one small read within one page (two when the key falls at the record that
+ * runs over into the next page), and the hash file needs no address space or
+ * page tables.
+ *
+ * @return 1 if found, 0 if not found or the read failed.
+ */
+int pwned_index_pread_find(const pwned_index_t* index, int fd, const uint8_t* key, uint64_t* count);
+
+/**
+ * Ask the kernel to start reading the leaf of @a key from @a fd, so that
+ * the reads for a batch of keys overlap.
+ */
+void pwned_index_prefetch(const pwned_index_t* index, int fd, const uint8_t* key);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,265 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Diff mode (-diff=OLD): compare an older release OLD with the hash file and
+ * report what changed, in one merged sequential pass over both files.
+ *
+ * Text output has one line per difference, in hash order:
+ *
+ *     +HASH:count              Added in the new file.
+ *     -HASH:count              Removed from the new file.
+ *     ~HASH:old:new            Count changed.
+ *
+ * With -diff-bin the output is instead a binary hash file (see pwned_db.h)
+ * holding the added and changed records with their new counts, and the
+ * removed records with a count of 0. It is sorted like any other hash file,
+ * so it can itself be searched or joined against.
+ *
+ * The key space is cut into chunks at every 64K'th record of the larger
+ * file; the matching range of the smaller file is found by binary search.
+ * Threads diff chunks independently and the results are written in chunk
+ * order through pwned_ordered_t.
+ */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "find-pwned.h"
+#include "join.h"
+#include "parallel.h"
+
+/**
+ * Records of the larger file per chunk.
+ */
+#define kDiffChunkRecords 0x10000
+
+/**
+ * Longest text line: '~', hex key, two delimiters, two 10-digit counts and
+ * '\n', allowing for a multi-character delimiter.
+ */
+#define kDiffLineBytes (1 + 2 * PWNED_MAX_KEY_BYTES + 2 * 10 + 1)
+
+/**
+ * Shared state for the diff threads.
+ */
+typedef struct {
+    const pwned_db_t* old_db;
+    const pwned_db_t* new_db;
+    const pwned_db_t* big;      /**< Whichever file has more records; sets the chunks. */
+    pwned_ordered_t out;
+    size_t delimiter_length;
+    pthread_mutex_t lock;       /**< Guards the totals and failure below. */
+    uint64_t added;
+    uint64_t removed;
+    uint64_t changed;
+    int failed;
+    int error;                  /**< errno of the first failed write, 0 if out of memory. */
+} diff_t;
+
+/**
+ * Growable per-thread output buffer.
+ */
+typedef struct {
+    char* data;
+    size_t used;
+    size_t capacity;
+} diff_buffer_t;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Make sure @a buffer has room for @a more bytes.
+ *
+ * @return 1 on success, 0 if out of memory.
+ */
+static int diff_reserve(diff_buffer_t* buffer, size_t more) {
+    if (buffer->used + more <= buffer->capacity) {
+        return 1;
+    }
+    size_t capacity = (0 == buffer->capacity) ? (1 << 20) : (2 * buffer->capacity);
+    while (capacity < buffer->used + more) {
+        capacity *= 2;
+    }
+    char* data = (char*) realloc(buffer->data, capacity);
+    if (NULL == data) {
+        return 0;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 1;
+}   /* diff_reserve() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Record the first failure: a write that failed with @a error, or running
+ * out of memory if @a error is 0. errno is per thread, so it has to be kept
+ * here for run_diff() to report it.
+ */
+static void diff_fail(diff_t* diff, int error) {
+    pthread_mutex_lock(&diff->lock);
+    if (!diff->failed) {
+        diff->failed = 1;
+        diff->error = error;
+    }
+    pthread_mutex_unlock(&diff->lock);
+}   /* diff_fail() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Append one difference to @a buffer. @a old_record or @a new_record is NULL
+ * for a removed or added record.
+ */
+static void diff_emit(const diff_t* diff, diff_buffer_t* buffer,
+                      const uint8_t* old_record, const uint8_t* new_record) {
+    const uint32_t key_bytes = diff->new_db->key_bytes;
+    const uint8_t* key = (NULL != new_record) ? new_record : old_record;
+    uint32_t old_count = 0;
+    uint32_t new_count = 0;
+    if (NULL != old_record) {
+        memcpy(&old_count, &old_record[key_bytes], sizeof(old_count));
+    }
+    if (NULL != new_record) {
+        memcpy(&new_count, &new_record[key_bytes], sizeof(new_count));
+    }
+    if (g_diff_binary) {
+        memcpy(&buffer->data[buffer->used], key, key_bytes);
+        memcpy(&buffer->data[buffer->used + key_bytes], &new_count, sizeof(new_count));
+        buffer->used += key_bytes + sizeof(new_count);
+        return;
+    }
+    char* p = &buffer->data[buffer->used];
+    *p++ = (NULL == old_record) ? '+' : (NULL == new_record) ? '-' : '~';
+    p = pwned_format_hex(p, key, key_bytes);
+    memcpy(p, g_delimiter, diff->delimiter_length);
+    p += diff->delimiter_length;
+    if ((NULL != old_record) && (NULL != new_record)) {
+        p = pwned_format_count(p, old_count);
+        memcpy(p, g_delimiter, diff->delimiter_length);
+        p += diff->delimiter_length;
+    }
+    p = pwned_format_count(p, (NULL != new_record) ? new_count : old_count);
+    *p++ = '\n';
+    buffer->used = p - buffer->data;
+}   /* diff_emit() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Range [@a *lo, @a *hi) of @a db's records that fall in chunk @a chunk.
+ */
+static void diff_chunk_range(const diff_t* diff, const pwned_db_t* db, int chunk,
+                             uint64_t* lo, uint64_t* hi) {
+    const pwned_db_t* big = diff->big;
+    uint64_t start = (uint64_t) chunk * kDiffChunkRecords;
+    uint64_t end = start + kDiffChunkRecords;
+    if (db == big) {
+        *lo = start;
+        *hi = (end < big->records) ? end : big->records;
+        return;
+    }
+    *lo = (0 == start) ? 0 : pwned_lower_bound(db, pwned_db_record(big, start), 0, db->records);
+    *hi = (end >= big->records) ? db->records :
+        pwned_lower_bound(db, pwned_db_record(big, end), *lo, db->records);
+}   /* diff_chunk_range() */
+
+/* ------------------------------------------------------------------------- */
+static void diff_chunks(void* arg, int index, int threads) {
+    diff_t* diff = (diff_t*) arg;
+    const pwned_db_t* old_db = diff->old_db;
+    const pwned_db_t* new_db = diff->new_db;
+    const uint32_t key_bytes = new_db->key_bytes;
+    const size_t line_bytes = kDiffLineBytes + 2 * diff->delimiter_length;
+    diff_buffer_t buffer = { NULL, 0, 0 };
+    uint64_t added = 0;
+    uint64_t removed = 0;
+    uint64_t changed = 0;
+    int chunk = 0;
+    while ((chunk = pwned_ordered_claim(&diff->out)) >= 0) {
+        uint64_t i = 0;
+        uint64_t i_end = 0;
+        uint64_t j = 0;
+        uint64_t j_end = 0;
+        diff_chunk_range(diff, old_db, chunk, &i, &i_end);
+        diff_chunk_range(diff, new_db, chunk, &j, &j_end);
+        buffer.used = 0;
+        int complete = 1;
+        while ((i < i_end) || (j < j_end)) {
+            if (!diff_reserve(&buffer, line_bytes)) {
+                diff_fail(diff, 0);
+                complete = 0;
+                break;
+            }
+            const uint8_t* a = (i < i_end) ? pwned_db_record(old_db, i) : NULL;
+            const uint8_t* b = (j < j_end) ? pwned_db_record(new_db, j) : NULL;
+            int cmp = (NULL == a) ? 1 : (NULL == b) ? -1 : pwned_key_cmp(a, b, key_bytes);
+            if (cmp < 0) {
+                diff_emit(diff, &buffer, a, NULL);
+                ++removed;
+                ++i;
+            } else if (cmp > 0) {
+                diff_emit(diff, &buffer, NULL, b);
+                ++added;
+                ++j;
+            } else {
+                if (0 != memcmp(&a[key_bytes], &b[key_bytes], PWNED_COUNT_BYTES)) {
+                    diff_emit(diff, &buffer, a, b);
+                    ++changed;
+                }
+                ++i;
+                ++j;
+            }
+        }
+        /* A chunk that could not be finished still takes its turn, empty. */
+        size_t size = (complete && !g_quiet) ? buffer.used : 0;
+        if (0 != pwned_ordered_write(&diff->out, chunk, buffer.data, size)) {
+            diff_fail(diff, errno);
+        }
+    }
+    free(buffer.data);
+    pthread_mutex_lock(&diff->lock);
+    diff->added += added;
+    diff->removed += removed;
+    diff->changed += changed;
+    pthread_mutex_unlock(&diff->lock);
+}   /* diff_chunks() */
+
+/* ------------------------------------------------------------------------- */
+int run_diff(const char* old_path, const pwned_db_t* db) {
+    pwned_db_t old_db;
+    if (PWNED_DB_OK != pwned_db_open(&old_db, old_path, db->type)) {
+        PrintError("could not open %s hash file \"%s\"", pwned_key_name(db->type), old_path);
+        return 2;
+    }
+    double start = pwned_seconds();
+    diff_t diff;
+    memset(&diff, 0, sizeof(diff));
+    diff.old_db = &old_db;
+    diff.new_db = db;
+    diff.big = (old_db.records > db->records) ? &old_db : db;
+    diff.delimiter_length = strlen(g_delimiter);
+    uint64_t chunks = (diff.big->records + kDiffChunkRecords - 1) / kDiffChunkRecords;
+    int threads = pwned_thread_count(g_threads);
+    threads = ((uint64_t) threads > chunks) ? (int) chunks : threads;
+    fflush(stdout);
+    pwned_ordered_init(&diff.out, STDOUT_FILENO, (int) chunks);
+    pthread_mutex_init(&diff.lock, NULL);
+    pwned_parallel(threads, diff_chunks, &diff);
+    pthread_mutex_destroy(&diff.lock);
+    pwned_ordered_destroy(&diff.out);
+    pwned_db_close(&old_db);
+    if (diff.failed && (0 == diff.error)) {
+        PrintError("out of memory buffering diff output");
+        return 2;
+    }
+    if (diff.failed) {
+        PrintError("diff output failed: %s", strerror(diff.error));
+        return 2;
+    }
+    PrintVerbose("diff: %" PRIu64 " added, %" PRIu64 " removed, %" PRIu64 " changed "
+                 "in %.3fs (%d threads)", diff.added, diff.removed, diff.changed,
+                 pwned_seconds() - start, threads);
+    return (diff.added + diff.removed + diff.changed > 0) ? 0 : 1;
+}   /* run_diff() */
@@ -10,6 +10,9 @@
  * and the next 4 bytes are a 32-bit little-endian occurrence count for the
  * corresponding password.
  *
+ * With -ntlm the file instead holds 20-byte records: a 16-byte NTLM hash
+ * followed by the same 4-byte count. See pwned_db.h.
+ *
  * A set of text hashes is provided by https://haveibeenpwned.com/Passwords.
  * The last two major versions (2.0 and 3.0) provide those passwords in text
  * files wrapped inside a 7z wrapper. Version 2.0 provided fixed-length
@@ -48,8 +51,23 @@
 #include <termios.h>
 #include <unistd.h>
 
+#include "auto.h"
 #include "bsd_0_clause_license.h"
+#include "client.h"
+#include "cuckoo.h"
+#include "dbindex.h"
+#include "find-pwned.h"
+#include "md4.h"
+#include "options.h"
+#include "pagefile.h"
+#include "parallel.h"
+#include "perfctr.h"
+#include "probes.h"
+#include "pwned_db.h"
+#include "qfilter.h"
+#include "searchcore.h"
 #include "sha1.h"
+#include "share.h"
 
 /**
  * Default name of this program.
@@ -72,45 +90,47 @@
 #define VERSION_TEXT (EXPAND_VALUE(VERSION_MAJOR) "."EXPAND_VALUE(VERSION_MINOR) "."EXPAND_VALUE(VERSION_PATCH))
 
 /**
- * Size of binary SHA1 hash in bytes.
+ * Most inputs handled together by handle_inputs().
  */
-#define kBinHashBytes SHA1_BINARY_BYTES
+#define kInputBatch 64
 
 /**
- * Size of text SHA1 hash in bytes, not including a terminating NUL.
+ * Lines read from stdin and sent to the server per request with -connect;
+ * bigger batches amortize the round trip.
  */
-#define kTextHashChars (2 * SHA1_BINARY_BYTES)
+#define kRemoteBatch 0x1000
 
 /**
- * An individual binary record consists of the SHA1 hash of a password
- * followed by an occurrence count.
+ * Name of this program; this may be modified by argv[0] in main().
  */
-struct pwned_info_s {
-    uint8_t hash[SHA1_BINARY_BYTES];    /**< SHA1 hash of password. */
-    uint32_t count;                     /**< Number of times password was found in breaches. */
-} __attribute__((packed));
+const char* g_program = kProgram;
 
-typedef struct pwned_info_s pwned_info_t;
+/**
+ * Name of the text hash file. The file should be sorted by hash
+ */
+#define kDefaultHashFile "pwned-passwords-ordered-by-hash.bin"
 
 /**
- * Handy 64-bit size of the struct.
+ * Name of the hash file used by default with -ntlm.
  */
-const uint64_t kPwnedInfoSize = sizeof(pwned_info_t);
+#define kDefaultNtlmHashFile "pwned-passwords-ntlm-ordered-by-hash.bin"
 
 /**
- * Name of this program; this may be modified by argv[0] in main().
+ * File of binary hashes and counts. When NULL the default for the key type
+ * is used.
  */
-const char* g_program = kProgram;
+const char* g_hash_file = NULL;
 
 /**
- * Name of the text hash file. The file should be sorted by hash
+ * Whether the hash file holds NTLM rather than SHA1 hashes.
  */
-#define kDefaultHashFile "pwned-passwords-ordered-by-hash.bin"
+#define kDefaultNtlm 0
+int g_ntlm = kDefaultNtlm;
 
 /**
- * File of binary hashes and counts.
+ * Type of key in the hash file, set from g_ntlm.
  */
-const char* g_hash_file = kDefaultHashFile;
+pwned_key_type_t g_key_type = PWNED_KEY_SHA1;
 
 /**
  * Number of items so far processed.
@@ -185,6 +205,159 @@ int g_print_not_found = kDefaultPrintNotFound;
 #define kDefaultDelimiter ":"
 const char* g_delimiter = kDefaultDelimiter;
 
+/**
+ * Number of threads for bulk modes; 0 means one per CPU.
+ */
+#define kDefaultThreads 0
+int g_threads = kDefaultThreads;
+
+/**
+ * Account dump file to audit (-audit), or NULL.
+ */
+const char* g_audit_file = NULL;
+
+/**
+ * List of hashes to join against the hash file (-join), or NULL.
+ */
+const char* g_join_file = NULL;
+
+/**
+ * What the -join list is: "hex", "keys" or "records" (-join-format); see
+ * hashlist.c.
+ */
+#define kDefaultJoinFormat "hex"
+const char* g_join_format = kDefaultJoinFormat;
+
+/**
+ * Older hash file to compare with the hash file (-diff), or NULL, and
+ * whether to write the differences as binary records (-diff-bin).
+ */
+const char* g_diff_file = NULL;
+#define kDefaultDiffBinary 0
+int g_diff_binary = kDefaultDiffBinary;
+
+/**
+ * Release delta (from -diff-bin) to re-audit against instead of the whole
+ * hash file (-delta), or NULL.
+ */
+const char* g_delta_file = NULL;
+
+/**
+ * Release delta (from -diff-bin) to add to the -engine=cuckoo table before
+ * looking anything up (-add), or NULL.
+ */
+const char* g_add_file = NULL;
+
+/**
+ * Lookup engine used for single hashes and passwords (-engine); see
+ * engine_t in find-pwned.h.
+ */
+#define kDefaultEngine "search"
+const char* g_engine = kDefaultEngine;
+engine_t g_lookup = ENGINE_SEARCH;
+pwned_cuckoo_t g_cuckoo;
+pwned_pages_t g_pages;
+pwned_qf_t g_filter;
+pwned_index_t g_index;
+pwned_core_t g_core;
+
+/**
+ * Whether to pick the lookup strategy and batch size from the memory
+ * budget (-auto), and a budget to use instead of the one found (-budget).
+ */
+#define kDefaultAuto 0
+int g_auto = kDefaultAuto;
+uint64_t g_budget = 0;
+
+/**
+ * Lines read from stdin and looked up together; -auto may raise it.
+ */
+size_t g_input_batch = kInputBatch;
+
+/**
+ * Cluster modes (see server.c): serve lookups on an address (-serve) for a
+ * range of hash prefixes (-range), route them to shards (-route, -shard),
+ * or send them to a server or router (-connect).
+ */
+#define kMaxShards 0x100
+const char* g_serve_address = NULL;
+pwned_range_t g_range = { 0, UINT64_MAX };
+const char* g_route_address = NULL;
+const char* g_shards[kMaxShards];
+int g_shard_count = 0;
+const char* g_connect_address = NULL;
+pwned_client_t g_client;
+
+/**
+ * Unix socket to hand out a shared in-memory copy of the hash file on
+ * (-share), or to get one from (-attach); see share.h.
+ */
+const char* g_share_socket = NULL;
+const char* g_attach_socket = NULL;
+
+/**
+ * Whether -serve binds its threads to NUMA nodes and gives each node its
+ * own copy of the search index or cuckoo table (-numa).
+ */
+#define kDefaultNuma 0
+int g_numa = kDefaultNuma;
+
+/**
+ * Percentile of recent answer times after which a request to a replicated
+ * server (-connect=A,B or -shard=RANGE@A,B) is also sent to the next
+ * replica (-hedge); 0 to never hedge.
+ */
+#define kDefaultHedgePercentile 95
+double g_hedge_percentile = kDefaultHedgePercentile;
+
+/**
+ * Open-loop load generator (-load; see loadgen.c): requests per second
+ * (-rate), for how long (-duration), over how many connections
+ * (-connections), keys per request (-batch), percentage of keys that are in
+ * the hash file (-hit), and where to write the latency histogram
+ * (-histogram).
+ */
+#define kDefaultLoadRate 1000
+#define kDefaultLoadDuration 10
+#define kDefaultLoadConnections 4
+#define kDefaultLoadBatch 1
+#define kDefaultLoadHitPercent 50
+const char* g_load_address = NULL;
+double g_load_rate = kDefaultLoadRate;
+double g_load_duration = kDefaultLoadDuration;
+int g_load_connections = kDefaultLoadConnections;
+uint32_t g_load_batch = kDefaultLoadBatch;
+double g_load_hit_percent = kDefaultLoadHitPercent;
+const char* g_load_histogram = NULL;
+
+/**
+ * Trace file to record every lookup in (-record), and one to replay
+ * (-replay) at some multiple of its recorded speed (-speed; 0 for as fast
+ * as possible). See trace.h.
+ */
+#define kDefaultReplaySpeed 1
+const char* g_record_file = NULL;
+pwned_trace_writer_t g_trace_writer;
+pwned_trace_writer_t* g_trace = NULL;
+const char* g_replay_file = NULL;
+double g_replay_speed = kDefaultReplaySpeed;
+
+/**
+ * Whether to count hardware events in each phase of the lookups and report
+ * them at exit (-perf).
+ */
+#define kDefaultPerf 0
+int g_perf = kDefaultPerf;
+pwned_perf_t g_perf_counters;
+
+/**
+ * Whether to check rule-based variants of each password (-rules), and the
+ * rule file to use; NULL selects the built-in rules.
+ */
+int g_use_rules = 0;
+const char* g_rules_file = NULL;
+rules_t g_rules = { NULL, 0, 0 };
+
 /* ------------------------------------------------------------------------- */
 /**
  * Prints usage information to @a file.
@@ -227,9 +400,99 @@ void Usage(FILE* file, int exit_code) {
             "    When -password is specified, %s will treat each command\n"
             "    line argument or line from stdin as a password rather than a hash. In this\n"
             "    case, %s will perform the SHA1 hash of the password and\n"
-            "    search for the associated hash. When reading from a tty with -secure (see\n"
-            "    OPTIONS), %s will disable echoing to protect the password.\n"
+            "    search for the associated hash (or NTLM hash with -ntlm). When reading\n"
+            "    from a tty with -secure (see OPTIONS), %s will disable echoing to\n"
+            "    protect the password.\n"
             , g_program, g_program, g_program);
+    fprintf(file,
+            "\n"
+            "    With -audit=FILE, %s reads a pwdump/secretsdump file of\n"
+            "    'user:rid:lm:nt:::' lines and reports each account whose NT hash is in\n"
+            "    the (NTLM) hash file as 'user:rid:count'. The hashes are sorted and merge\n"
+            "    joined against the hash file using -threads threads. The exit code is 0\n"
+            "    if any account is pwned, 1 if none are. -audit implies -ntlm.\n"
+            "\n"
+            "    With -join=FILE, %s reads a list of hashes from FILE, sorts it if\n"
+            "    it is not already sorted and merge joins it against the hash file,\n"
+            "    printing 'hash:count' in hash order. -join-format says what FILE holds:\n"
+            "    'hex' hashes, one per line; binary 'keys' packed back to back; or\n"
+            "    'records' of another hash file, whose counts are ignored. The exit code\n"
+            "    is 0 if any hash is found.\n"
+            "\n"
+            "    With -diff=OLD, %s compares older hash file OLD with the hash\n"
+            "    file in one sequential pass and prints '+hash:count' for added records,\n"
+            "    '-hash:count' for removed ones and '~hash:old:new' for changed counts.\n"
+            "    With -diff-bin it writes a binary hash file of the added and changed\n"
+            "    records instead, plus the removed ones with a count of 0. The exit code\n"
+            "    is 0 if the files differ.\n"
+            "\n"
+            "    With -delta=DELTA, -audit and -join check the list against release\n"
+            "    delta DELTA (from -diff-bin) instead of the whole hash file and print\n"
+            "    only the accounts or hashes that are in it with a non-zero count: the\n"
+            "    ones that are newly pwned or whose count changed. When the delta is much\n"
+            "    smaller than the list, only the list entries that match it are touched.\n"
+            "\n"
+            "    With -engine=cuckoo -add=DELTA, release delta DELTA (from -diff-bin) is\n"
+            "    added to the table after it is built, so lookups see the newer release\n"
+            "    without rebuilding the hash file: its records are added or get their\n"
+            "    new counts, and those with a count of 0 are no longer found.\n"
+            "\n"
+            "    With -serve=[HOST:]PORT, %s answers lookups from other hosts\n"
+            "    instead of the command line, using any -engine. With -range=LO-HI it\n"
+            "    only answers for hashes whose hex prefix is from LO through HI (e.g.\n"
+            "    00-7F), and only that part of the hash file is read. With\n"
+            "    -route=[HOST:]PORT it holds no data but splits each batch of lookups\n"
+            "    among the servers given by -shard=RANGE@HOST:PORT, which must cover all\n"
+            "    prefixes, and merges their answers. With -connect=HOST:PORT, hashes and\n"
+            "    passwords are looked up on a server or router instead of a local file.\n"
+            "    With -serve -numa, each connection's thread is bound to a NUMA node\n"
+            "    and searches a copy of the index (or -engine=cuckoo table) in that\n"
+            "    node's memory, so only the final reads of the hash file cross nodes.\n"
+            "    -connect and -shard take a comma-separated list of replicas; batches go\n"
+            "    to them in turn, and a batch not answered within the -hedge percentile\n"
+            "    of recent answer times is also sent to the next replica and the slower\n"
+            "    request cancelled.\n"
+            "\n"
+            "    With -share=SOCKET, %s copies the hash file into sealed shared\n"
+            "    memory (on huge pages if any are reserved) and passes it to each process\n"
+            "    started with -attach=SOCKET, which uses it instead of -file.\n"
+            "\n"
+            "    With -load=HOST:PORT, %s measures a server (or router, or a\n"
+            "    comma-separated list of them) instead: it sends -rate requests a second\n"
+            "    of -batch keys each over -connections connections for -duration seconds,\n"
+            "    on schedule whether or not earlier requests have been answered, and\n"
+            "    prints latency percentiles measured from when each request was due.\n"
+            "    -hit percent of the keys are records of the hash file, the rest are not\n"
+            "    in it.\n"
+            "\n"
+            "    With -record=TRACE, every lookup from the command line, stdin or -serve\n"
+            "    is written to TRACE with its time; hashes that are not found are left\n"
+            "    out, keeping only the time of the miss. -replay=TRACE looks the trace up\n"
+            "    again at -speed times the recorded rate, to the -load servers or to the\n"
+            "    hash file on -threads threads, and prints latency percentiles.\n"
+            "\n"
+            "    With -auto, the lookup strategy is picked from the memory budget (the\n"
+            "    cgroup limit and MemAvailable, or -budget): a file that fits is locked\n"
+            "    in RAM; otherwise a small index is kept in RAM and each lookup reads one\n"
+            "    4KB leaf, through the mapping or with pread() for a mostly uncached\n"
+            "    file. The choice is printed to stderr unless -quiet.\n"
+            "\n"
+            "    When -file is a filter made by bin2qf (or with -engine=filter), lookups\n"
+            "    are approximate: counts are rounded down to a power of two, and about\n"
+            "    one in 2^27 hashes that are not pwned is reported as found.\n"
+            "\n"
+            "    With -rules, each password is expanded into variants (case changes,\n"
+            "    leetspeak, appended digits and symbols) and every variant found is\n"
+            "    printed as 'rule:count' ('password:rule:variant:count' with -pp). Use\n"
+            "    -rules=FILE to read hashcat-style rules instead; see rules.h for the\n"
+            "    supported functions. -rules requires -password.\n"
+            , g_program, g_program, g_program, g_program, g_program, g_program);
+    fprintf(file,
+            "\n"
+            "    When -ntlm is specified, hashes are 32-character NTLM hashes and the hash\n"
+            "    file must be built from the NTLM list with 'pwned2bin -ntlm'. The default\n"
+            "    hash file is then '%s'.\n"
+            , kDefaultNtlmHashFile);
     fprintf(file,
             "\n"
             "CREATING HASH FILE\n"
@@ -269,6 +532,9 @@ void Usage(FILE* file, int exit_code) {
             "    -f:ile=filename             Name of binary hash file that should be sorted\n"
             "                                by hash. [%s]\n"
             , kDefaultHashFile);
+    fprintf(file,
+            "    -[no-]ntlm                  Hash file holds NTLM hashes. [%s-ntlm]\n"
+            , kDefaultNtlm ? "" : "-no");
     fprintf(file,
             "    -[no-]p:assword             Inputs are passwords that must be hashed. [%s-password]\n"
             , kDefaultPassword ? "" : "-no");
@@ -296,6 +562,87 @@ void Usage(FILE* file, int exit_code) {
     fprintf(file,
             "    -[no-]pnf                   Print values that do *not* appear in database. [%s-pnf]\n"
             , kDefaultPrintNotFound ? "" : "-no");
+    fprintf(file,
+            "    -audit=FILE                 Audit accounts in pwdump FILE (implies -ntlm).\n");
+    fprintf(file,
+            "    -join=FILE                  Join hash list FILE against the hash file.\n");
+    fprintf(file,
+            "    -join-format=FORMAT         -join FILE format: hex, keys or records. [%s]\n"
+            , kDefaultJoinFormat);
+    fprintf(file,
+            "    -diff=OLD                   Print differences from older hash file OLD.\n");
+    fprintf(file,
+            "    -[no-]diff-bin              Write -diff output as binary records. [%s-diff-bin]\n"
+            , kDefaultDiffBinary ? "" : "-no");
+    fprintf(file,
+            "    -delta=DELTA                Re-audit -audit/-join list against DELTA only.\n");
+    fprintf(file,
+            "    -add=DELTA                  Add release DELTA to the -engine=cuckoo table.\n");
+    fprintf(file,
+            "    -e:ngine=NAME               Lookup engine: search, cuckoo, pages, filter, or\n"
+            "                                LAYOUT-SEARCH-BACKEND from aos|soa, binary|branchless|\n"
+            "                                interpolation, mmap|pread. [%s]\n"
+            , kDefaultEngine);
+    fprintf(file,
+            "    -share=SOCKET               Load the hash file into shared memory for -attach.\n");
+    fprintf(file,
+            "    -attach=SOCKET              Use the hash file shared by -share on SOCKET.\n");
+    fprintf(file,
+            "    -[no-]auto                  Pick the lookup strategy from free memory. [%s-auto]\n"
+            , kDefaultAuto ? "" : "-no");
+    fprintf(file,
+            "    -budget=SIZE                Memory budget for -auto (e.g. 512M). [from cgroup]\n");
+    fprintf(file,
+            "    -serve=[HOST:]PORT          Serve lookups from the hash file over TCP.\n");
+    fprintf(file,
+            "    -range=LO-HI                Hex prefix range to serve with -serve. [all]\n");
+    fprintf(file,
+            "    -[no-]numa                  Give each NUMA node its own index with -serve. [%s-numa]\n"
+            , kDefaultNuma ? "" : "-no");
+    fprintf(file,
+            "    -route=[HOST:]PORT          Route lookups to the -shard servers.\n");
+    fprintf(file,
+            "    -shard=RANGE@HOST:PORT      Server for a prefix range; repeat for each.\n");
+    fprintf(file,
+            "    -c:onnect=HOST:PORT[,...]   Look up hashes on a server or router.\n");
+    fprintf(file,
+            "    -hedge=PCT                  Retry on another replica after this percentile\n"
+            "                                of answer times; 0 for never. [%d]\n"
+            , kDefaultHedgePercentile);
+    fprintf(file,
+            "    -load=HOST:PORT[,...]       Send lookups to servers at a fixed -rate.\n");
+    fprintf(file,
+            "    -rate=N                     Requests per second with -load. [%d]\n"
+            , kDefaultLoadRate);
+    fprintf(file,
+            "    -duration=SECONDS           How long to run -load. [%d]\n"
+            , kDefaultLoadDuration);
+    fprintf(file,
+            "    -connections=N              Connections to open with -load. [%d]\n"
+            , kDefaultLoadConnections);
+    fprintf(file,
+            "    -batch=N                    Keys per request with -load. [%d]\n"
+            , kDefaultLoadBatch);
+    fprintf(file,
+            "    -hit=PCT                    Percentage of -load keys in the hash file. [%d]\n"
+            , kDefaultLoadHitPercent);
+    fprintf(file,
+            "    -histogram=FILE             Write -load latencies to FILE (.hgrm format).\n");
+    fprintf(file,
+            "    -record=TRACE               Record every lookup's hash and time in TRACE.\n");
+    fprintf(file,
+            "    -replay=TRACE               Replay the lookups in TRACE and print latencies.\n");
+    fprintf(file,
+            "    -speed=X                    Replay at X times the recorded rate; 0 for flat out. [%d]\n"
+            , kDefaultReplaySpeed);
+    fprintf(file,
+            "    -rules[=FILE]               Also check variants of each password.\n");
+    fprintf(file,
+            "    -[no-]perf                  Report CPU counters per lookup phase at exit. [%s-perf]\n"
+            , kDefaultPerf ? "" : "-no");
+    fprintf(file,
+            "    -t:hreads=N                 Threads for bulk modes; 0 for one per CPU. [%d]\n"
+            , kDefaultThreads);
     fprintf(file,
             "    -[no-]v:erbose              Print verbose (debug) messages. [%s-verbose]\n"
             , kDefaultVerbose ? "" : "-no");
@@ -348,110 +695,6 @@ void PrintVerbose(const char* format, ...) {
     }
 }   /* PrintVerbose() */
 
-/* ------------------------------------------------------------------------- */
-/**
- * Find and return a pointer to the file name portion of @a path.
- *
- * @param path - a path whose name is desired. Typically this is argv[0] from
- * main().
- *
- * @return a pointer the first character after the last directory delimiter
- * (forward or back slash) in @a path, or @a path if none is found.
- */
-const char* NamePartOfPath(const char* path) {
-    const char* rval = path;
-    if (NULL != path) {
-        for (; 0 != *path; ++path) {
-            if ((('/' == path[0]) || ('\\' == path[0])) &&
-                !((0 == path[1]) || ('/' == path[1]) || ('\\' == path[1]))) {
-                rval = &path[1];
-            }
-        }
-    }
-    return rval;
-}   /* NamePartOfPath() */
-
-/* ------------------------------------------------------------------------- */
-/**
- * Look for an option of the form "[-[-]]option[=value]".
- *
- * If @a input contains '=' then non-null @a *value_ptr is set to point
- * to the character after '=' (or is set to NULL if there is no argument).
- *
- * @a descriptor may contain ':' characters which indicate abbreviation
- * points for the option. For example, "o:pt:ion" will match "-o",
- * "-o=value", "-opt", "-opt=value", "-option" and "-option=value".
- *
- * @return 1 if @a input matches @a descriptor, 0 otherwise.
- */
-int IsOption(const char* input, const char** value_ptr, const char* descriptor) {
-    int rval = 0;
-    int finished = 0;
-    assert(NULL != input);
-    assert(NULL != descriptor);
-    if ('-' == *input) {
-        ++input;
-        if ('-' == *input) {
-            ++input;
-        }
-    } else {
-        finished = 1;
-    }
-    while (!finished) {
-        if ((0 == *input) || ('=' == *input)) {
-            finished = 1;
-            rval = (0 == *descriptor) || (':' == *descriptor);
-        } else if ((0 == *descriptor) || ((':' != *descriptor) && (*input != *descriptor))) {
-            finished = 1;
-        } else {
-            if (':' != *descriptor) {
-                ++input;
-            }
-            ++descriptor;
-        }
-    }
-    if (NULL != value_ptr) {
-        *value_ptr = (rval && ('=' == *input)) ? (input + 1) : NULL;
-    }
-    return rval;
-}   /* IsOption() */
-
-/* ------------------------------------------------------------------------- */
-/**
- * Look for flag option of the form "-[-][no-]option".
- *
- * @a descriptor may contain ':' characters which indicate abbreviation
- * points for the option. See IsOption() for more information.
- *
- * If @a input matches the descriptor then the value of @a *flag_value_ptr (if
- * not NULL) will be set to 1. If @a input matches the descriptor with "no-"
- * prefixed then @a *flag_value_ptr will be set to 0. If @a input does not
- * match @a descriptor, @a *flag_value_ptr is not modified.
- *
- * @return 1 if @a input matches @a descriptor with or without a "no-" prefix,
- * 0 otherwise.
- */
-int IsFlagOption(const char* input, int* flag_value_ptr, const char* descriptor) {
-    int flag_value = 1;
-    int rval = 0;
-    assert(NULL != input);
-    assert(NULL != descriptor);
-    if ('-' == *input) {
-        rval = IsOption(input, NULL, descriptor);
-        if (!rval) {
-            flag_value = 0;
-            const int k = ('-' == input[1]) ? 1 : 0;
-            if (('n' == input[k+1]) && ('o' == input[k+2]) && ('-' == input[k+3])) {
-                rval = IsOption(&input[k+3], NULL, descriptor);
-            }
-        }
-    }
-    if (rval && (NULL != flag_value_ptr)) {
-        *flag_value_ptr = flag_value;
-    }
-    return rval;
-}   /* IsFlagOption() */
-
 /* ------------------------------------------------------------------------- */
 /**
  * Parse options from the command line, removing them from @a argv[].
@@ -492,6 +735,7 @@ int ParseOptions(int argc, char* argv[]) {
                 PrintUsageError(2, "--delimiter option requires argument");
             }
             g_delimiter = opt;
+        } else if (IsFlagOption(arg, &g_ntlm, "ntlm")) {
         } else if (IsFlagOption(arg, &g_password, "p:assword")) {
         } else if (IsFlagOption(arg, &g_print_index, "pi")) {
         } else if (IsFlagOption(arg, &g_print_password, "pp")) {
@@ -506,6 +750,150 @@ int ParseOptions(int argc, char* argv[]) {
         } else if (IsFlagOption(arg, &g_print_found, "pf")) {
         } else if (IsFlagOption(arg, &g_print_not_found, "pnf")) {
         } else if (IsFlagOption(arg, &g_verbose, "v:erbose")) {
+        } else if (IsOption(arg, &opt, "audit")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--audit option requires argument");
+            }
+            g_audit_file = opt;
+            g_ntlm = 1;
+        } else if (IsOption(arg, &opt, "join")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--join option requires argument");
+            }
+            g_join_file = opt;
+        } else if (IsOption(arg, &opt, "join-format")) {
+            if ((NULL == opt) || ((0 != strcmp(opt, "hex")) && (0 != strcmp(opt, "keys")) &&
+                                  (0 != strcmp(opt, "records")))) {
+                PrintUsageError(2, "--join-format option requires 'hex', 'keys' or 'records'");
+            }
+            g_join_format = opt;
+        } else if (IsOption(arg, &opt, "diff")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--diff option requires argument");
+            }
+            g_diff_file = opt;
+        } else if (IsFlagOption(arg, &g_diff_binary, "diff-bin")) {
+        } else if (IsOption(arg, &opt, "delta")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--delta option requires argument");
+            }
+            g_delta_file = opt;
+        } else if (IsOption(arg, &opt, "add")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--add option requires argument");
+            }
+            g_add_file = opt;
+        } else if (IsOption(arg, &opt, "e:ngine")) {
+            pwned_layout_t layout;
+            pwned_search_t search;
+            pwned_backend_t backend;
+            if ((NULL == opt) || ((0 != strcmp(opt, "search")) && (0 != strcmp(opt, "cuckoo")) &&
+                                  (0 != strcmp(opt, "pages")) && (0 != strcmp(opt, "filter")) &&
+                                  !pwned_core_parse(opt, &layout, &search, &backend))) {
+                PrintUsageError(2, "--engine option requires 'search', 'cuckoo', 'pages', 'filter' "
+                                "or LAYOUT-SEARCH-BACKEND");
+            }
+            g_engine = opt;
+        } else if (IsOption(arg, &opt, "share")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--share option requires a socket path");
+            }
+            g_share_socket = opt;
+        } else if (IsOption(arg, &opt, "attach")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--attach option requires a socket path");
+            }
+            g_attach_socket = opt;
+        } else if (IsFlagOption(arg, &g_auto, "auto")) {
+        } else if (IsOption(arg, &opt, "budget")) {
+            if ((NULL == opt) || !ParseSize(opt, &g_budget) || (0 == g_budget)) {
+                PrintUsageError(2, "--budget option requires a size like 512M");
+            }
+        } else if (IsOption(arg, &opt, "serve")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--serve option requires [HOST:]PORT");
+            }
+            g_serve_address = opt;
+        } else if (IsOption(arg, &opt, "range")) {
+            if ((NULL == opt) || !pwned_parse_range(opt, &g_range)) {
+                PrintUsageError(2, "--range option requires a hex prefix range like 00-7F");
+            }
+        } else if (IsOption(arg, &opt, "route")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--route option requires [HOST:]PORT");
+            }
+            g_route_address = opt;
+        } else if (IsOption(arg, &opt, "shard")) {
+            if ((NULL == opt) || (g_shard_count >= kMaxShards)) {
+                PrintUsageError(2, "--shard option requires RANGE@HOST:PORT (at most %d)", kMaxShards);
+            }
+            g_shards[g_shard_count++] = opt;
+        } else if (IsOption(arg, &opt, "c:onnect")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--connect option requires HOST:PORT");
+            }
+            g_connect_address = opt;
+        } else if (IsFlagOption(arg, &g_numa, "numa")) {
+        } else if (IsOption(arg, &opt, "hedge")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%lf", &g_hedge_percentile)) ||
+                (g_hedge_percentile < 0) || (g_hedge_percentile >= 100)) {
+                PrintUsageError(2, "--hedge option requires a percentile from 0 to 99.9");
+            }
+        } else if (IsOption(arg, &opt, "load")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--load option requires HOST:PORT");
+            }
+            g_load_address = opt;
+        } else if (IsOption(arg, &opt, "rate")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%lf", &g_load_rate)) || (g_load_rate <= 0)) {
+                PrintUsageError(2, "--rate option requires a positive number of requests per second");
+            }
+        } else if (IsOption(arg, &opt, "duration")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%lf", &g_load_duration)) || (g_load_duration <= 0)) {
+                PrintUsageError(2, "--duration option requires a positive number of seconds");
+            }
+        } else if (IsOption(arg, &opt, "connections")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%d", &g_load_connections)) ||
+                (g_load_connections < 1)) {
+                PrintUsageError(2, "--connections option requires a positive integer");
+            }
+        } else if (IsOption(arg, &opt, "batch")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%" SCNu32, &g_load_batch)) || (g_load_batch < 1) ||
+                (g_load_batch > PWNED_NET_MAX_BATCH)) {
+                PrintUsageError(2, "--batch option requires 1 to %d keys", PWNED_NET_MAX_BATCH);
+            }
+        } else if (IsOption(arg, &opt, "hit")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%lf", &g_load_hit_percent)) ||
+                (g_load_hit_percent < 0) || (g_load_hit_percent > 100)) {
+                PrintUsageError(2, "--hit option requires a percentage from 0 to 100");
+            }
+        } else if (IsOption(arg, &opt, "histogram")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--histogram option requires a file name");
+            }
+            g_load_histogram = opt;
+        } else if (IsOption(arg, &opt, "record")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--record option requires a file name");
+            }
+            g_record_file = opt;
+        } else if (IsOption(arg, &opt, "replay")) {
+            if (NULL == opt) {
+                PrintUsageError(2, "--replay option requires a trace file name");
+            }
+            g_replay_file = opt;
+        } else if (IsOption(arg, &opt, "speed")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%lf", &g_replay_speed)) || (g_replay_speed < 0)) {
+                PrintUsageError(2, "--speed option requires a non-negative multiple, 0 for flat out");
+            }
+        } else if (IsFlagOption(arg, &g_perf, "perf")) {
+        } else if (IsOption(arg, &opt, "rules")) {
+            g_use_rules = 1;
+            g_rules_file = opt;
+        } else if (IsOption(arg, &opt, "t:hreads")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%d", &g_threads)) || (g_threads < 0)) {
+                PrintUsageError(2, "--threads option requires a non-negative integer");
+            }
         } else if (IsOption(arg, NULL, "V") || IsOption(arg, NULL, "version")) {
             fprintf(stdout, "%s: v%s\n", g_program, VERSION_TEXT);
             print_bsd_0_clause_license_and_disclaimer(stdout, 2018, 2019, "Doug Rogers");
@@ -519,49 +907,50 @@ int ParseOptions(int argc, char* argv[]) {
 
 /* ------------------------------------------------------------------------- */
 /**
- * Perform a binary search for the given SHA1 @a hash in the memory-mapped
- * file and print the number of occurences of that hash to stdout, possibly
- * with the hash itself.
- *
- * When the hash is not found, print 0.
- *
- * @param file_data - mmap()'d pointer to the contents of a hash file in the
- * format of "pwned-passwords-ordered-2.0.txt".
+ * Look up the given binary @a hash in the memory-mapped hash file @a db,
+ * with a binary search or through the -engine table built over it.
  *
- * @param file_size - size, in bytes, of the data at @a file_data.
+ * @param db - mmap()'d hash file; the search used is specialized for the
+ * width of the keys in the file.
  *
- * @param hash - NUL-terminated string holding the hash to search. The string
- * should be exactly kTextHashChars in length.
+ * @param hash - binary hash to find, db->key_bytes long.
  *
  * @param count - pointer to a count to hold the number of occurrences of @a
- * hash found in the file data.
+ * hash found in the file data, or 0 if not found.
  *
  * @return 1 if the hash was found, 0 otherwise.
  */
-int find_hash(const pwned_info_t* data, off_t file_size, const uint8_t* hash, uint64_t* count) {
-    off_t lo = 0;
-    off_t hi = (file_size / kPwnedInfoSize) - 1;
-    off_t mid = (lo + hi) / 2;
-
-    while (1) {
-        const pwned_info_t* pwned = &data[mid];
-        int cmp = memcmp(hash, pwned->hash, SHA1_BINARY_BYTES);
-        if (0 == cmp) {
-            *count = pwned->count;
-            return 1;
-        }
-        if (lo == mid) {
-            break;
-        }
-        if (cmp < 0) {
-            hi = mid;
-        } else {
-            lo = mid;
-        }
-        mid = (lo + hi) / 2;
+int find_hash(const pwned_db_t* db, const uint8_t* hash, uint64_t* count) {
+    int found;
+    PWNED_PROBE1(find_entry, hash);
+    switch (g_lookup) {
+    case ENGINE_CUCKOO:
+        found = pwned_cuckoo_find(&g_cuckoo, hash, count);
+        break;
+    case ENGINE_PAGES:
+        found = pwned_pages_find(&g_pages, hash, count);
+        break;
+    case ENGINE_FILTER:
+        found = pwned_qf_find(&g_filter, hash, count);
+        break;
+    case ENGINE_INDEX:
+        found = pwned_index_find(&g_index, hash, count);
+        break;
+    case ENGINE_COLD:
+        found = pwned_index_pread_find(&g_index, db->fd, hash, count);
+        break;
+    case ENGINE_CORE:
+        found = pwned_core_find(&g_core, hash, count);
+        break;
+    default:
+        found = pwned_db_find(db, hash, count);
+        break;
     }
-    *count = 0;
-    return 0;
+    PWNED_PROBE2(find_return, found, *count);
+    if (NULL != g_trace) {
+        pwned_trace_record(g_trace, hash, found);
+    }
+    return found;
 }   /* find_hash() */
 
 /* ------------------------------------------------------------------------- */
@@ -585,26 +974,63 @@ static int hex2byte(const char* h, uint8_t* byte) {
 }   /* hex2byte() */
 
 /* ------------------------------------------------------------------------- */
-int handle_input(const char* input, const char* file_data, uint64_t file_size) {
-    int found = 1;
-    uint64_t count = 0 ;
-    uint8_t hash[SHA1_BINARY_BYTES] = {0};
-    g_count++;
+/**
+ * Report that password @a input could not be hashed, without showing it.
+ */
+static void report_unhashed(const char* input) {
+    PrintError("out of memory hashing a %zu-byte password", strlen(input));
+}   /* report_unhashed() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Convert @a input to a binary hash in @a hash. Passwords are hashed with
+ * SHA1 or NTLM to match the hash file; otherwise @a input must be a hex
+ * hash of the right length.
+ *
+ * @return 1 on success, 0 if @a input is not a valid hash.
+ */
+int input_to_hash(const char* input, const pwned_db_t* db, uint8_t* hash) {
+    const uint32_t hash_bytes = db->key_bytes;
+    PWNED_PROBE1(input, input);
     if (g_password) {
-        sha1_buffer_bin(input, strlen(input), hash);
-    } else if (strlen(input) != kTextHashChars) {
-        PrintUsageError(0, "invalid SHA1 hash '%s' should have length %u but has length %u.",
-                        input, kTextHashChars, (unsigned int) strlen(input));
+        if (PWNED_KEY_NTLM == db->type) {
+            if (NULL == ntlm_hash(input, strlen(input), hash)) {
+                report_unhashed(input);
+                return 0;
+            }
+        } else {
+            sha1_buffer_bin(input, strlen(input), hash);
+        }
+        PWNED_PROBE2(hashed, hash, hash_bytes);
+    } else if (strlen(input) != 2 * hash_bytes) {
+        PrintUsageError(0, "invalid %s hash '%s' should have length %u but has length %u.",
+                        pwned_key_name(db->type), input, 2 * hash_bytes, (unsigned int) strlen(input));
         return 0;
     } else {
-        for (int i = 0; i < SHA1_BINARY_BYTES; ++i) {
+        for (int i = 0; i < hash_bytes; ++i) {
             if (!hex2byte(&input[2*i], &hash[i])) {
                 PrintUsageError(0, "invalid 2-digit hex byte at index %d of hash '%s'", 2*i, input);
                 return 0;
             }
         }
     }
-    found = find_hash((const pwned_info_t*) file_data, file_size, hash, &count);
+    return 1;
+}   /* input_to_hash() */
+
+/* ------------------------------------------------------------------------- */
+void print_hex(const uint8_t* hash, uint32_t bytes) {
+    for (uint32_t i = 0; i < bytes; ++i) {
+        printf("%02X", hash[i]);
+    }
+}   /* print_hex() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Print the result of looking up binary @a hash computed from @a input.
+ */
+void print_result(const char* input, const uint8_t* hash, const pwned_db_t* db, int found,
+                  uint64_t count) {
+    const uint32_t hash_bytes = db->key_bytes;
     if (!g_quiet) {
         const char* delim = "";
         if ((found && g_print_found) ||
@@ -619,9 +1045,7 @@ int handle_input(const char* input, const char* file_data, uint64_t file_size) {
             }
             if (g_print_hash) {
                 printf("%s", delim);
-                for (int i = 0; i < SHA1_BINARY_BYTES; ++i) {
-                    printf("%02X", hash[i]);
-                }
+                print_hex(hash, hash_bytes);
                 delim = g_delimiter;
             }
             if (g_print_count) {
@@ -633,9 +1057,242 @@ int handle_input(const char* input, const char* file_data, uint64_t file_size) {
             }
         }
     }
+    PWNED_PROBE3(output, input, found, count);
+}   /* print_result() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Look up binary @a hash computed from @a input and print the result.
+ *
+ * @return 1 if found, 0 otherwise.
+ */
+int handle_hash(const char* input, const uint8_t* hash, const pwned_db_t* db) {
+    uint64_t count = 0;
+    int found = find_hash(db, hash, &count);
+    print_result(input, hash, db, found, count);
     return found;
+}   /* handle_hash() */
+
+/* ------------------------------------------------------------------------- */
+int handle_input(const char* input, const pwned_db_t* db) {
+    uint8_t hash[PWNED_MAX_KEY_BYTES] = {0};
+    g_count++;
+    if (!input_to_hash(input, db, hash)) {
+        return 0;
+    }
+    return handle_hash(input, hash, db);
 }   /* handle_input() */
 
+/* ------------------------------------------------------------------------- */
+/**
+ * Handle up to kRemoteBatch inputs with -connect: hash them all, look them
+ * up in one request, then print the results in order.
+ *
+ * @return 1 if all inputs were found, 0 otherwise.
+ */
+static int handle_remote_inputs(const char* const* inputs, size_t n, const pwned_db_t* db) {
+    static uint8_t hashes[kRemoteBatch * PWNED_MAX_KEY_BYTES];
+    static uint32_t counts[kRemoteBatch];
+    static uint8_t valid[kRemoteBatch];
+    const uint32_t hash_bytes = db->key_bytes;
+    uint32_t sent = 0;
+    for (size_t i = 0; i < n; ++i) {
+        valid[i] = (uint8_t) input_to_hash(inputs[i], db, &hashes[sent * hash_bytes]);
+        sent += valid[i];
+    }
+    int status = (0 == sent) ? PWNED_NET_OK : pwned_client_lookup(&g_client, hashes, sent, counts);
+    if (status < 0) {
+        PrintError("lookup failed on \"%s\"", g_connect_address);
+        exit(2);
+    }
+    if (PWNED_NET_OK != status) {
+        PrintError("server \"%s\" answered with status %d; some counts may be missing",
+                   g_connect_address, status);
+    }
+    int all_found = 1;
+    uint32_t j = 0;
+    for (size_t i = 0; i < n; ++i) {
+        g_count++;
+        if (!valid[i]) {
+            all_found = 0;
+            continue;
+        }
+        int found = (counts[j] > 0);
+        print_result(inputs[i], &hashes[j * hash_bytes], db, found, counts[j]);
+        all_found &= found;
+        ++j;
+    }
+    return all_found;
+}   /* handle_remote_inputs() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Handle up to g_input_batch inputs with -auto's cold engine: hash them
+ * all and ask for all their leaves before searching any, so the reads
+ * overlap.
+ *
+ * @return 1 if all inputs were found, 0 otherwise.
+ */
+static int handle_cold_inputs(const char* const* inputs, size_t n, const pwned_db_t* db) {
+    static uint8_t hashes[kRemoteBatch * PWNED_MAX_KEY_BYTES];
+    static uint8_t valid[kRemoteBatch];
+    const uint32_t hash_bytes = db->key_bytes;
+    for (size_t i = 0; i < n; ++i) {
+        valid[i] = (uint8_t) input_to_hash(inputs[i], db, &hashes[i * hash_bytes]);
+        if (valid[i]) {
+            pwned_index_prefetch(&g_index, db->fd, &hashes[i * hash_bytes]);
+        }
+    }
+    int all_found = 1;
+    for (size_t i = 0; i < n; ++i) {
+        g_count++;
+        if (!valid[i] || !handle_hash(inputs[i], &hashes[i * hash_bytes], db)) {
+            all_found = 0;
+        }
+    }
+    return all_found;
+}   /* handle_cold_inputs() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Handle up to kInputBatch inputs with -perf: parse or hash them all, look
+ * them all up, then print them all, so that the counters are read once per
+ * phase per batch rather than around every lookup.
+ *
+ * @return 1 if all inputs were found, 0 otherwise.
+ */
+static int handle_perf_inputs(const char* const* inputs, size_t n, const pwned_db_t* db) {
+    uint8_t hashes[kInputBatch * PWNED_MAX_KEY_BYTES];
+    uint8_t valid[kInputBatch];
+    uint8_t found[kInputBatch];
+    uint64_t counts[kInputBatch];
+    const uint32_t hash_bytes = db->key_bytes;
+    pwned_perf_phase(&g_perf_counters, g_password ? PWNED_PHASE_HASH : PWNED_PHASE_PARSE);
+    if (g_password && (PWNED_KEY_NTLM == db->type)) {
+        size_t sizes[kInputBatch];
+        for (size_t i = 0; i < n; ++i) {
+            PWNED_PROBE1(input, inputs[i]);
+            sizes[i] = strlen(inputs[i]);
+        }
+        ntlm_hash_batch(inputs, sizes, n, hashes, valid);
+        for (size_t i = 0; i < n; ++i) {
+            if (!valid[i]) {
+                report_unhashed(inputs[i]);
+                continue;
+            }
+            PWNED_PROBE2(hashed, &hashes[i * hash_bytes], hash_bytes);
+        }
+    } else {
+        for (size_t i = 0; i < n; ++i) {
+            valid[i] = (uint8_t) input_to_hash(inputs[i], db, &hashes[i * hash_bytes]);
+        }
+    }
+    pwned_perf_phase(&g_perf_counters, PWNED_PHASE_SEARCH);
+    if (ENGINE_COLD == g_lookup) {
+        for (size_t i = 0; i < n; ++i) {
+            if (valid[i]) {
+                pwned_index_prefetch(&g_index, db->fd, &hashes[i * hash_bytes]);
+            }
+        }
+    }
+    for (size_t i = 0; i < n; ++i) {
+        counts[i] = 0;
+        found[i] = valid[i] && find_hash(db, &hashes[i * hash_bytes], &counts[i]);
+    }
+    pwned_perf_phase(&g_perf_counters, PWNED_PHASE_OUTPUT);
+    int all_found = 1;
+    for (size_t i = 0; i < n; ++i) {
+        g_count++;
+        if (valid[i]) {
+            print_result(inputs[i], &hashes[i * hash_bytes], db, found[i], counts[i]);
+        }
+        all_found &= found[i];
+    }
+    fflush(stdout);
+    pwned_perf_phase(&g_perf_counters, PWNED_PHASE_NONE);
+    return all_found;
+}   /* handle_perf_inputs() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Handle @a n inputs at once. NTLM passwords are hashed together by the
+ * multi-buffer MD4 kernel; everything else goes through handle_input().
+ *
+ * @return 1 if all inputs were found, 0 otherwise.
+ */
+int handle_inputs(const char* const* inputs, size_t n, const pwned_db_t* db) {
+    int all_found = 1;
+    if (ENGINE_REMOTE == g_lookup) {
+        for (size_t i = 0; i < n; i += kRemoteBatch) {
+            size_t chunk = (n - i < kRemoteBatch) ? (n - i) : kRemoteBatch;
+            if (!handle_remote_inputs(&inputs[i], chunk, db)) {
+                all_found = 0;
+            }
+        }
+        return all_found;
+    }
+    if (g_perf) {
+        for (size_t i = 0; i < n; i += kInputBatch) {
+            size_t chunk = (n - i < kInputBatch) ? (n - i) : kInputBatch;
+            if (!handle_perf_inputs(&inputs[i], chunk, db)) {
+                all_found = 0;
+            }
+        }
+        return all_found;
+    }
+    if ((ENGINE_COLD == g_lookup) && !g_use_rules) {
+        for (size_t i = 0; i < n; i += kRemoteBatch) {
+            size_t chunk = (n - i < kRemoteBatch) ? (n - i) : kRemoteBatch;
+            if (!handle_cold_inputs(&inputs[i], chunk, db)) {
+                all_found = 0;
+            }
+        }
+        return all_found;
+    }
+    if (g_use_rules) {
+        for (size_t i = 0; i < n; ++i) {
+            if (!handle_variants(inputs[i], db, &g_rules)) {
+                all_found = 0;
+            }
+        }
+        return all_found;
+    }
+    if (!(g_password && (PWNED_KEY_NTLM == db->type))) {
+        for (size_t i = 0; i < n; ++i) {
+            if (!handle_input(inputs[i], db)) {
+                all_found = 0;
+            }
+        }
+        return all_found;
+    }
+    while (n > 0) {
+        uint8_t hashes[kInputBatch * MD4_BINARY_BYTES];
+        uint8_t ok[kInputBatch];
+        size_t sizes[kInputBatch];
+        size_t chunk = (n < kInputBatch) ? n : kInputBatch;
+        for (size_t i = 0; i < chunk; ++i) {
+            PWNED_PROBE1(input, inputs[i]);
+            sizes[i] = strlen(inputs[i]);
+        }
+        ntlm_hash_batch(inputs, sizes, chunk, hashes, ok);
+        for (size_t i = 0; i < chunk; ++i) {
+            g_count++;
+            if (!ok[i]) {
+                report_unhashed(inputs[i]);
+                all_found = 0;
+                continue;
+            }
+            PWNED_PROBE2(hashed, &hashes[i * MD4_BINARY_BYTES], MD4_BINARY_BYTES);
+            if (!handle_hash(inputs[i], &hashes[i * MD4_BINARY_BYTES], db)) {
+                all_found = 0;
+            }
+        }
+        inputs += chunk;
+        n -= chunk;
+    }
+    return all_found;
+}   /* handle_inputs() */
+
 /* ------------------------------------------------------------------------- */
 /**
  * Enable or disable echoing of input characters on stdin.
@@ -655,6 +1312,219 @@ void echo_on_stdin(int enable) {
     tcsetattr(STDIN_FILENO, TCSANOW, &tty);
 }   /* echo_on_stdin() */
 
+/* ------------------------------------------------------------------------- */
+/**
+ * Add the records of release delta @a path to g_cuckoo, which was built
+ * over @a db, leaving out those a -serve server does not answer for.
+ *
+ * @return 0 on success, otherwise the exit code to return.
+ */
+static int add_delta(const char* path, const pwned_db_t* db) {
+    pwned_db_t delta;
+    int status = pwned_db_open(&delta, path, db->type);
+    if (PWNED_DB_ERR_OPEN == status) {
+        PrintUsageError(2, "could not open \"%s\"", path);
+    } else if ((PWNED_DB_ERR_SIZE == status) && (0 == delta.size)) {
+        return 0;               /* The releases were the same. */
+    } else if (PWNED_DB_OK != status) {
+        PrintError("\"%s\" is not a %s hash file", path, pwned_key_name(db->type));
+        return 3;
+    }
+    double start = pwned_seconds();
+    for (uint64_t i = 0; i < delta.records; ++i) {
+        if ((NULL != g_serve_address) && !pwned_range_contains(&g_range, pwned_db_record(&delta, i))) {
+            continue;
+        }
+        if (0 != pwned_cuckoo_insert(&g_cuckoo, pwned_db_record(&delta, i),
+                                     pwned_db_count(&delta, i))) {
+            PrintError("out of memory adding \"%s\" to the cuckoo table", path);
+            pwned_db_close(&delta);
+            return 2;
+        }
+    }
+    PrintVerbose("cuckoo: added %" PRIu64 " records from \"%s\" in %.3fs; %" PRIu64 " buckets, "
+                 "%u stashed", delta.records, path, pwned_seconds() - start, g_cuckoo.buckets,
+                 g_cuckoo.stash_size);
+    pwned_db_close(&delta);
+    return 0;
+}   /* add_delta() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Look up each of the @a argc - 1 hashes or passwords in @a argv, or each
+ * line of stdin if there are none.
+ *
+ * @return 1 if any was not found, 0 otherwise.
+ */
+int lookup_inputs(int argc, char* argv[], const pwned_db_t* db) {
+    int not_found = 0;
+    if (argc > 1) {
+        if (!handle_inputs((const char* const*) &argv[1], argc - 1, db)) {
+            not_found = 1;
+        }
+        PWNED_PROBE1(batch, argc - 1);
+    } else {
+        if (g_password && g_secure && isatty(STDIN_FILENO)) {
+            echo_on_stdin(0);
+        }
+        /*
+         * Batch lines from pipes and files, but answer each line at once
+         * when someone is typing.
+         */
+        static char lines[kRemoteBatch][0x100];
+        static const char* inputs[kRemoteBatch];
+        const size_t batch = isatty(STDIN_FILENO) ? 1 :
+            (ENGINE_REMOTE == g_lookup) ? kRemoteBatch : g_input_batch;
+        size_t count = 0;
+        while (1) {
+            char* line = lines[count];
+            int eof = (NULL == fgets(line, sizeof(lines[0]), stdin));
+            if (!eof) {
+                size_t n = strlen(line);
+                while ((n > 0) && ('\n' == line[n-1])) {
+                    line[--n] = 0;
+                }
+                inputs[count++] = line;
+            }
+            if ((count > 0) && (eof || (count == batch))) {
+                if (!handle_inputs(inputs, count, db)) {
+                    not_found = 1;
+                }
+                PWNED_PROBE1(batch, count);
+                count = 0;
+            }
+            if (eof) {
+                break;
+            }
+        }
+        if (g_password && g_secure && isatty(STDIN_FILENO)) {
+            echo_on_stdin(1);
+        }
+    }
+    return not_found;
+}   /* lookup_inputs() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Finish the -record trace, if any.
+ *
+ * @return 0 on success, -1 if it could not be written.
+ */
+static int stop_recording(void) {
+    if (NULL == g_trace) {
+        return 0;
+    }
+    uint64_t records = g_trace->records;
+    g_trace = NULL;
+    if (0 != pwned_trace_close(&g_trace_writer)) {
+        PrintError("could not write \"%s\"", g_record_file);
+        return -1;
+    }
+    PrintVerbose("recorded %" PRIu64 " lookups in \"%s\"", records, g_record_file);
+    return 0;
+}   /* stop_recording() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Serve lookups from @a db with -serve, replay a trace with -replay,
+ * otherwise look up the inputs.
+ *
+ * @return the exit code.
+ */
+int serve_or_lookup(int argc, char* argv[], const pwned_db_t* db) {
+    if (NULL != g_replay_file) {
+        return run_replay(g_replay_file, NULL, db);
+    }
+    if (NULL != g_record_file) {
+        if (0 != pwned_trace_create(&g_trace_writer, g_record_file, db->type)) {
+            PrintError("could not create \"%s\"", g_record_file);
+            return 2;
+        }
+        g_trace = &g_trace_writer;
+    }
+    if (NULL != g_serve_address) {
+        int rval = run_server(g_serve_address, &g_range, db);
+        stop_recording();
+        return rval;
+    }
+    if (g_perf && (0 == pwned_perf_open(&g_perf_counters))) {
+        PrintError("no CPU counters available (perf_event_paranoid, or a VM without a PMU?);"
+                   " reporting time only");
+    }
+    int not_found = lookup_inputs(argc, argv, db);
+    if (g_perf) {
+        fprintf(stderr, "%s: %" PRIu64 " lookups; per lookup:\n", g_program, g_count);
+        pwned_perf_report(&g_perf_counters, stderr, g_count);
+        pwned_perf_close(&g_perf_counters);
+    }
+    if (0 != stop_recording()) {
+        return 2;
+    }
+    return not_found;
+}   /* serve_or_lookup() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Pick and set up the lookup strategy for @a db from the memory budget
+ * (-auto), and say what was picked and why unless -quiet.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+static int auto_select(const pwned_db_t* db) {
+    pwned_auto_plan_t plan;
+    pwned_auto_plan(&plan, db, g_budget);
+    if (0 != pwned_auto_apply(&plan, db, &g_index)) {
+        PrintError("could not build an index for %" PRIu64 " records", db->records);
+        return -1;
+    }
+    g_input_batch = plan.batch;
+    g_lookup = (PWNED_AUTO_LOCKED == plan.strategy) ? ENGINE_SEARCH :
+        (PWNED_AUTO_INDEXED == plan.strategy) ? ENGINE_INDEX : ENGINE_COLD;
+    if (!g_quiet) {
+        const double mb = 1024.0 * 1024.0;
+        char limit[0x40] = "none";
+        if (UINT64_MAX != plan.cgroup_limit) {
+            snprintf(limit, sizeof(limit), "%.0fM (%.0fM used)", plan.cgroup_limit / mb,
+                     plan.cgroup_usage / mb);
+        }
+        fprintf(stderr, "%s: auto: file %.0fM (%.0fM cached), cgroup limit %s, "
+                "available %.0fM, budget %.0fM%s -> %s", g_program, plan.file_bytes / mb,
+                plan.resident_bytes / mb, limit, plan.mem_available / mb,
+                plan.budget / mb, (0 != g_budget) ? " (-budget)" : "",
+                pwned_auto_strategy_name(plan.strategy));
+        if (PWNED_AUTO_LOCKED == plan.strategy) {
+            fprintf(stderr, ", %s", plan.locked ? "mlock()ed" : "mlock() failed (RLIMIT_MEMLOCK?), read in");
+        } else {
+            fprintf(stderr, ", %.1fM index", plan.index_bytes / mb);
+        }
+        fprintf(stderr, ", batch %u\n", plan.batch);
+    }
+    return 0;
+}   /* auto_select() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Copy @a db into a sealed memfd and hand it to every -attach process that
+ * connects to g_share_socket (-share). Returns only on error.
+ *
+ * @return the exit code.
+ */
+static int run_share(pwned_db_t* db) {
+    pwned_share_header_t header;
+    double start = pwned_seconds();
+    int memfd = pwned_share_load(db, &header);
+    pwned_db_close(db);
+    if (memfd < 0) {
+        PrintError("could not copy \"%s\" into shared memory", g_hash_file);
+        return 2;
+    }
+    PrintVerbose("shared %" PRIu64 " bytes in %s pages in %.3fs on \"%s\"", header.size,
+                 header.huge_pages ? "huge" : "normal", pwned_seconds() - start, g_share_socket);
+    pwned_share_serve(g_share_socket, memfd, &header);
+    PrintError("could not listen on \"%s\"", g_share_socket);
+    return 2;
+}   /* run_share() */
+
 /* ------------------------------------------------------------------------- */
 /**
  * Main program. Parses command line arguments. See Usage().
@@ -667,57 +1537,243 @@ void echo_on_stdin(int enable) {
  */
 int main(int argc, char* argv[]) {
     g_program = NamePartOfPath(argv[0]);
-    assert(sizeof(pwned_info_t) == 24);
+    assert(sizeof(pwned_sha1_info_t) == PWNED_SHA1_RECORD_BYTES);
+    assert(sizeof(pwned_ntlm_info_t) == PWNED_NTLM_RECORD_BYTES);
     argc = ParseOptions(argc, argv);  /* Remove options; leave program name and arguments. */
-    int fd = open(g_hash_file, O_RDONLY);
-    if (fd < 0) {
-        PrintUsageError(2, "could not open \"%s\"", g_hash_file);
+    g_key_type = g_ntlm ? PWNED_KEY_NTLM : PWNED_KEY_SHA1;
+    if (NULL != g_delta_file) {
+        if ((NULL == g_audit_file) && (NULL == g_join_file)) {
+            PrintUsageError(2, "-delta requires -audit or -join");
+        }
+        g_hash_file = g_delta_file;
+        g_print_not_found = 0;
+    }
+    if (NULL == g_hash_file) {
+        g_hash_file = g_ntlm ? kDefaultNtlmHashFile : kDefaultHashFile;
+    }
+    if ((NULL != g_add_file) &&
+        ((0 != strcmp(g_engine, "cuckoo")) || ((NULL != g_serve_address) && g_numa) ||
+         (NULL != g_audit_file) || (NULL != g_join_file) || (NULL != g_diff_file))) {
+        PrintUsageError(2, "-add requires -engine=cuckoo without -numa, -audit, -join or -diff");
+    }
+    if ((NULL != g_replay_file) &&
+        ((NULL != g_audit_file) || (NULL != g_join_file) || (NULL != g_diff_file) ||
+         (NULL != g_serve_address) || (NULL != g_connect_address) || g_use_rules || g_perf)) {
+        PrintUsageError(2, "-replay cannot be used with -audit, -join, -diff, -serve, -connect,"
+                        " -rules or -perf");
+    }
+    if ((NULL != g_record_file) &&
+        ((NULL != g_audit_file) || (NULL != g_join_file) || (NULL != g_diff_file) ||
+         (NULL != g_route_address) || (NULL != g_connect_address) || (NULL != g_load_address))) {
+        PrintUsageError(2, "-record only records lookups from the command line, stdin or -serve");
+    }
+    if ((NULL != g_replay_file) && (NULL != g_load_address)) {
+        pwned_db_t db;
+        pwned_db_attach(&db, NULL, 0, g_key_type);   /* Just for the key width. */
+        return run_replay(g_replay_file, g_load_address, &db);
+    }
+    if (NULL != g_route_address) {
+        return run_router(g_route_address, g_shards, g_shard_count, g_key_type);
+    }
+    if (NULL != g_connect_address) {
+        if ((NULL != g_audit_file) || (NULL != g_join_file) || (NULL != g_diff_file) ||
+            (NULL != g_serve_address) || g_use_rules) {
+            PrintUsageError(2, "-connect only looks up hashes and passwords");
+        }
+        if (0 != pwned_client_open(&g_client, g_connect_address, g_key_type)) {
+            PrintUsageError(2, "could not connect to any of \"%s\"", g_connect_address);
+        }
+        g_client.hedge_percentile = g_hedge_percentile;
+        pwned_db_t db;
+        pwned_db_attach(&db, NULL, 0, g_key_type);   /* Just for the key width. */
+        g_lookup = ENGINE_REMOTE;
+        int not_found = lookup_inputs(argc, argv, &db);
+        PrintVerbose("%" PRIu64 " batches, %" PRIu64 " hedged, %" PRIu64 " won by the hedge;"
+                     " hedge delay %.3f ms", g_client.batches, g_client.hedges, g_client.hedges_won,
+                     1000.0 * pwned_client_hedge_delay(&g_client));
+        pwned_client_close(&g_client);
+        return not_found;
+    }
+    if (g_perf && (g_use_rules || (NULL != g_serve_address) || (NULL != g_connect_address))) {
+        PrintUsageError(2, "-perf only measures local lookups, not -rules, -serve or -connect");
+    }
+    if (g_use_rules) {
+        size_t rejected = 0;
+        if (!g_password) {
+            PrintUsageError(2, "-rules requires -password");
+        }
+        if (NULL == g_rules_file) {
+            if (0 != rules_default(&g_rules)) {
+                PrintError("out of memory for rules");
+                return 2;
+            }
+        } else if (0 != rules_load(&g_rules, g_rules_file, &rejected)) {
+            PrintUsageError(2, "could not read rules from \"%s\"", g_rules_file);
+        }
+        if (rejected > 0) {
+            PrintError("skipped %zu unsupported rules in \"%s\"", rejected, g_rules_file);
+        }
+        PrintVerbose("%zu rules", g_rules.count);
+    }
+    pwned_db_t db;
+    if ((0 == strcmp(g_engine, "pages")) || pwned_is_page_file(g_hash_file)) {
+        if ((NULL != g_audit_file) || (NULL != g_join_file) || (NULL != g_diff_file)) {
+            PrintUsageError(2, "-audit, -join and -diff need a sorted hash file, not a page file");
+        }
+        switch (pwned_pages_open(&g_pages, g_hash_file, g_key_type)) {
+        case PWNED_DB_OK:
+            break;
+        case PWNED_DB_ERR_OPEN:
+            PrintUsageError(2, "could not open \"%s\"", g_hash_file);
+            break;
+        default:
+            PrintUsageError(4, "\"%s\" is not a %s page file", g_hash_file, pwned_key_name(g_key_type));
+            break;
+        }
+        PrintVerbose("page file \"%s\": %" PRIu64 " %s hashes in %" PRIu64 " pages + %" PRIu64
+                     " overflow pages", g_hash_file, g_pages.header.records,
+                     pwned_key_name(g_key_type), g_pages.header.pages, g_pages.header.overflow_pages);
+        pwned_db_attach(&db, NULL, 0, g_key_type);   /* Just for the key width. */
+        g_lookup = ENGINE_PAGES;
+        int not_found = serve_or_lookup(argc, argv, &db);
+        pwned_pages_close(&g_pages);
+        return not_found;
+    }
+    if ((0 == strcmp(g_engine, "filter")) || pwned_is_qf_file(g_hash_file)) {
+        if ((NULL != g_audit_file) || (NULL != g_join_file) || (NULL != g_diff_file)) {
+            PrintUsageError(2, "-audit, -join and -diff need a sorted hash file, not a filter");
+        }
+        switch (pwned_qf_open(&g_filter, g_hash_file, g_key_type)) {
+        case PWNED_DB_OK:
+            break;
+        case PWNED_DB_ERR_OPEN:
+            PrintUsageError(2, "could not open \"%s\"", g_hash_file);
+            break;
+        case PWNED_DB_ERR_MMAP:
+            PrintError("mmap() failed");
+            return 5;
+        default:
+            PrintUsageError(4, "\"%s\" is not a %s filter file", g_hash_file, pwned_key_name(g_key_type));
+            break;
+        }
+        PrintVerbose("filter \"%s\": %" PRIu64 " %s hashes in %" PRIu64 " slots, %" PRIu64 " bytes",
+                     g_hash_file, g_filter.header->records, pwned_key_name(g_key_type),
+                     g_filter.header->slots, g_filter.size);
+        pwned_db_attach(&db, NULL, 0, g_key_type);   /* Just for the key width. */
+        g_lookup = ENGINE_FILTER;
+        int not_found = serve_or_lookup(argc, argv, &db);
+        pwned_qf_close(&g_filter);
+        return not_found;
     }
-    off_t file_size =  lseek(fd, 0, SEEK_END);
-    if (file_size < 0) {
+    const char* source = (NULL != g_attach_socket) ? g_attach_socket : g_hash_file;
+    int status = (NULL != g_attach_socket) ? pwned_share_attach(&db, g_attach_socket, g_key_type) :
+        pwned_db_open(&db, g_hash_file, g_key_type);
+    switch (status) {
+    case PWNED_DB_OK:
+        break;
+    case PWNED_DB_ERR_OPEN:
+        PrintUsageError(2, "could not open \"%s\"", source);
+        break;
+    case PWNED_SHARE_ERR_TYPE:
+        PrintUsageError(2, "\"%s\" does not share %s hashes", source, pwned_key_name(g_key_type));
+        break;
+    case PWNED_SHARE_ERR_SEALS:
+        PrintError("\"%s\" shared memory that is not sealed against writes", source);
+        return 5;
+    case PWNED_DB_ERR_SEEK:
         PrintError("_llseek() failed");
         return 3;
-    }
-    if ((0 == file_size) || (0 != (file_size % kPwnedInfoSize))) {
-        PrintUsageError(3, "invalid file size %" PRIu64 "; should be > 0 and divisible by %" PRIu64 ".",
-                        file_size, kPwnedInfoSize);
+    case PWNED_DB_ERR_SIZE:
+        if ((NULL != g_delta_file) && (0 == db.size)) {
+            break;              /* The releases were the same, so nothing is newly pwned. */
+        }
+        PrintUsageError(3, "invalid file size %" PRIu64 "; should be > 0 and divisible by %u.",
+                        db.size, db.record_bytes);
         return 4;
-    }
-    lseek(fd, 0, SEEK_SET);
-    uint64_t hashes = file_size / kPwnedInfoSize;
-    PrintVerbose("file \"%s\" size=%" PRIu64 " bytes, %" PRIu64 " hash%s.",
-                 g_hash_file, file_size, hashes, (1 == hashes) ? "" : "es");
-
-    const char* file_data = (const char*) mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    if (NULL == file_data) {
+    default:
         PrintError("mmap() failed");
         return 5;
     }
-    int not_found = 0;
-    if (argc > 1) {
-        for (int i = 1; i < argc; ++i) {
-            if (!handle_input(argv[i], file_data, file_size)) {
-                not_found = 1;
-            }
+    PrintVerbose("file \"%s\" size=%" PRIu64 " bytes, %" PRIu64 " %s hash%s.",
+                 source, db.size, db.records, pwned_key_name(db.type),
+                 (1 == db.records) ? "" : "es");
+
+    if (NULL != g_share_socket) {
+        return run_share(&db);
+    }
+    if (NULL != g_audit_file) {
+        int rval = run_audit(g_audit_file, &db);
+        pwned_db_close(&db);
+        return rval;
+    }
+    if (NULL != g_join_file) {
+        int rval = run_join(g_join_file, &db);
+        pwned_db_close(&db);
+        return rval;
+    }
+    if (NULL != g_diff_file) {
+        int rval = run_diff(g_diff_file, &db);
+        pwned_db_close(&db);
+        return rval;
+    }
+    if (NULL != g_load_address) {
+        int rval = run_load(g_load_address, &db);
+        pwned_db_close(&db);
+        return rval;
+    }
+    pwned_db_t cuckoo_db;       /* The part of db in the -engine=cuckoo table. */
+    if (g_auto) {
+        if (0 != strcmp(g_engine, "search")) {
+            PrintUsageError(2, "-auto picks its own engine; drop -engine");
         }
-    } else {
-        if (g_password && g_secure && isatty(STDIN_FILENO)) {
-            echo_on_stdin(0);
+        if (0 != auto_select(&db)) {
+            return 2;
         }
-        char line[0x100] = "";
-        while (NULL != fgets(line, sizeof(line), stdin)) {
-            size_t n = strlen(line);
-            while ((n > 0) && ('\n' == line[n-1])) {
-                line[--n] = 0;
-            }
-            if (!handle_input(line, file_data, file_size)) {
-                not_found = 1;
+    } else if ((0 == strcmp(g_engine, "cuckoo")) && (NULL != g_serve_address) && g_numa) {
+        g_lookup = ENGINE_CUCKOO;       /* run_server() builds a table on each node. */
+    } else if (0 == strcmp(g_engine, "cuckoo")) {
+        double start = pwned_seconds();
+        cuckoo_db = db;
+        if (NULL != g_serve_address) {
+            range_view(&db, &g_range, &cuckoo_db);      /* Only what the server answers for. */
+        }
+        if (0 != pwned_cuckoo_build(&g_cuckoo, &cuckoo_db)) {
+            PrintError("could not build cuckoo table for %" PRIu64 " records", cuckoo_db.records);
+            return 2;
+        }
+        g_lookup = ENGINE_CUCKOO;
+        PrintVerbose("cuckoo: %" PRIu64 " buckets, %" PRIu64 " bytes, %u stashed, %s compare, "
+                     "built in %.3fs", g_cuckoo.buckets, pwned_cuckoo_bytes(&g_cuckoo),
+                     g_cuckoo.stash_size, pwned_cuckoo_kernel_name(), pwned_seconds() - start);
+        if (NULL != g_add_file) {
+            int rval = add_delta(g_add_file, &cuckoo_db);
+            if (0 != rval) {
+                pwned_cuckoo_free(&g_cuckoo);
+                return rval;
             }
         }
-        if (g_password && g_secure && isatty(STDIN_FILENO)) {
-            echo_on_stdin(1);
+    } else if (0 != strcmp(g_engine, "search")) {
+        pwned_layout_t layout;
+        pwned_search_t search;
+        pwned_backend_t backend;
+        pwned_core_parse(g_engine, &layout, &search, &backend);
+        double start = pwned_seconds();
+        if (0 != pwned_core_open(&g_core, &db, layout, search, backend)) {
+            PrintError("could not set up engine '%s' for %" PRIu64 " records", g_engine, db.records);
+            return 2;
         }
+        g_lookup = ENGINE_CORE;
+        PrintVerbose("%s: %" PRIu64 " bytes, set up in %.3fs", g_engine, pwned_core_bytes(&g_core),
+                     pwned_seconds() - start);
+    }
+    int not_found = serve_or_lookup(argc, argv, &db);
+    if (ENGINE_CUCKOO == g_lookup) {
+        pwned_cuckoo_free(&g_cuckoo);
+    } else if ((ENGINE_INDEX == g_lookup) || (ENGINE_COLD == g_lookup)) {
+        pwned_index_free(&g_index);
+    } else if (ENGINE_CORE == g_lookup) {
+        pwned_core_close(&g_core);
     }
-    munmap((void*) file_data, file_size);
-    return not_found ? 1 : 0;
+    pwned_db_close(&db);
+    return not_found;
 }   /* main() */
@@ -0,0 +1,180 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __find_pwned_h__
+#define __find_pwned_h__
+
+/*
+ * Options and helpers shared by find-pwned.c and the files that implement
+ * its other modes (audit.c, diff.c, hashlist.c, server.c, variants.c, ...).
+ * See find-pwned.c for descriptions.
+ */
+
+#include <stdint.h>
+
+#include "client.h"
+#include "pwned_db.h"
+#include "rules.h"
+#include "trace.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern const char* g_program;
+extern const char* g_hash_file;
+extern uint64_t g_count;
+extern int g_verbose;
+extern int g_quiet;
+extern int g_print_index;
+extern int g_print_password;
+extern int g_print_hash;
+extern int g_print_count;
+extern int g_print_found;
+extern int g_print_not_found;
+extern const char* g_delimiter;
+extern int g_threads;
+extern int g_diff_binary;
+extern const char* g_join_format;
+extern double g_hedge_percentile;
+extern int g_numa;
+extern double g_load_rate;
+extern double g_load_duration;
+extern int g_load_connections;
+extern uint32_t g_load_batch;
+extern double g_load_hit_percent;
+extern const char* g_load_histogram;
+extern double g_replay_speed;
+
+/**
+ * Trace that every lookup is recorded in (-record), or NULL.
+ */
+extern pwned_trace_writer_t* g_trace;
+
+/**
+ * Most servers a -load can spread its connections over.
+ */
+#define kMaxLoadAddresses 0x10
+
+/**
+ * Lookup engine used for single hashes and passwords (-engine):
+ *   search - binary search of the mapped hash file; nothing to load.
+ *   cuckoo - in-RAM bucketized cuckoo table (see cuckoo.h); costs about 15
+ *            bytes per record and some load time, but each lookup touches at
+ *            most two buckets.
+ *   pages  - one pread() of a 4KB page per lookup from a page file made by
+ *            bin2pages (see pagefile.h); picked automatically when -file is
+ *            a page file.
+ *   filter - approximate lookups in a counting quotient filter made by bin2qf
+ *            (see qfilter.h); picked automatically when -file is a filter.
+ *   LAYOUT-SEARCH-BACKEND - one of the policy-built engines in searchcore.h,
+ *            such as soa-interpolation-mmap.
+ * -auto picks search, or one of the two index engines below when the hash
+ * file does not fit in memory; see auto.h.
+ */
+typedef enum {
+    ENGINE_SEARCH,
+    ENGINE_CUCKOO,
+    ENGINE_PAGES,
+    ENGINE_FILTER,
+    ENGINE_INDEX,               /**< -auto: leaf index in RAM, leaves through the mapping. */
+    ENGINE_COLD,                /**< -auto: leaf index in RAM, leaves with pread(). */
+    ENGINE_REMOTE,              /**< -connect: lookups are sent to a server. */
+    ENGINE_CORE,                /**< A searchcore.h engine. */
+} engine_t;
+
+extern engine_t g_lookup;
+
+void PrintUsageError(int exit_code, const char* format, ...);
+void PrintError(const char* format, ...);
+void PrintVerbose(const char* format, ...);
+
+/**
+ * Look up binary @a hash with the selected -engine. See find-pwned.c.
+ *
+ * @return 1 if found, 0 otherwise.
+ */
+int find_hash(const pwned_db_t* db, const uint8_t* hash, uint64_t* count);
+
+/**
+ * Print @a bytes bytes at @a hash as upper-case hex to stdout.
+ */
+void print_hex(const uint8_t* hash, uint32_t bytes);
+
+/**
+ * Audit a pwdump/secretsdump file of user:rid:lm:nt lines against NTLM hash
+ * file @a db. See audit.c.
+ *
+ * @return 0 if any account's hash is in @a db, 1 if none is, >1 on error.
+ */
+int run_audit(const char* path, const pwned_db_t* db);
+
+/**
+ * Join the list of hashes in @a path, in format g_join_format, against
+ * @a db. See hashlist.c.
+ *
+ * @return 0 if any hash is in @a db, 1 if none is, >1 on error.
+ */
+int run_join(const char* path, const pwned_db_t* db);
+
+/**
+ * Compare older hash file @a old_path with @a db, printing added, removed
+ * and changed records. See diff.c.
+ *
+ * @return 0 if the files differ, 1 if they hold the same records, >1 on error.
+ */
+int run_diff(const char* old_path, const pwned_db_t* db);
+
+/**
+ * Set @a view to the part of @a db holding the keys in @a range. It shares
+ * @a db's mapping and file descriptor.
+ */
+void range_view(const pwned_db_t* db, const pwned_range_t* range, pwned_db_t* view);
+
+/**
+ * Serve lookups from @a db on @a address for keys in @a range until killed.
+ * See server.c.
+ *
+ * @return an exit code if the server cannot run.
+ */
+int run_server(const char* address, const pwned_range_t* range, const pwned_db_t* db);
+
+/**
+ * Route lookups received on @a address to the shards in @a specs
+ * ("RANGE@HOST:PORT"), which must cover all keys. See server.c.
+ *
+ * @return an exit code if the router cannot run.
+ */
+int run_router(const char* address, const char* const* specs, int spec_count, pwned_key_type_t type);
+
+/**
+ * Send lookups for keys drawn from @a db to the servers in @a addresses
+ * ("HOST:PORT,...") at a fixed rate and print the latencies. See
+ * loadgen.c.
+ *
+ * @return 0 if every request was answered, an exit code otherwise.
+ */
+int run_load(const char* addresses, const pwned_db_t* db);
+
+/**
+ * Replay the lookups in trace file @a path, as recorded with -record, to
+ * the servers in @a addresses or, if it is NULL, to find_hash() on @a db,
+ * and print the latencies. See loadgen.c.
+ *
+ * @return 0 if every lookup was answered, an exit code otherwise.
+ */
+int run_replay(const char* path, const char* addresses, const pwned_db_t* db);
+
+/**
+ * Look up password @a input and all its variants under @a rules, printing
+ * each variant found. See variants.c.
+ *
+ * @return 1 if any variant is found, 0 otherwise.
+ */
+int handle_variants(const char* input, const pwned_db_t* db, const rules_t* rules);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
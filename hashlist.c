@@ -0,0 +1,144 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Join mode (-join=FILE): intersect a whole list of hashes with the hash
+ * file in one pass instead of one binary search per hash.
+ *
+ * The format of FILE is never guessed; -join-format says what it is:
+ *   hex     - text, one hex hash per line (the default). Anything after the
+ *             hash, such as ":count", is ignored.
+ *   keys    - binary hashes packed back to back.
+ *   records - another hash file, records of hash and count; the counts are
+ *             ignored.
+ * The list is radix sorted and deduplicated unless it already is, then
+ * merge joined against the hash file by pwned_join().
+ */
+
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find-pwned.h"
+#include "join.h"
+#include "parallel.h"
+#include "sort.h"
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Parse text hash list @a text into packed keys at @a keys.
+ *
+ * @return the number of keys parsed.
+ */
+static size_t parse_text_list(const char* text, size_t size, uint8_t* keys, uint32_t key_bytes) {
+    size_t n = 0;
+    const char* end = &text[size];
+    for (const char* line = text; line < end; ) {
+        const char* eol = memchr(line, '\n', end - line);
+        const char* next = (NULL == eol) ? end : (eol + 1);
+        eol = (NULL == eol) ? end : eol;
+        if (((size_t) (eol - line) >= 2 * key_bytes) &&
+            ((eol - line == 2 * key_bytes) || !isxdigit((unsigned char) line[2 * key_bytes])) &&
+            pwned_parse_hex(line, &keys[n * key_bytes], key_bytes)) {
+            ++n;
+        } else if (eol > line + (('\r' == eol[-1]) ? 1 : 0)) {
+            PrintVerbose("join: skipping line \"%.*s\"", (int) (eol - line), line);
+        }
+        line = next;
+    }
+    return n;
+}   /* parse_text_list() */
+
+/* ------------------------------------------------------------------------- */
+int run_join(const char* path, const pwned_db_t* db) {
+    const uint32_t key_bytes = db->key_bytes;
+    double start = pwned_seconds();
+    size_t size = 0;
+    char* data = pwned_read_file(path, &size);
+    if (NULL == data) {
+        PrintError("could not read hash list \"%s\"", path);
+        return 2;
+    }
+    int rval = 2;
+    uint8_t* keys = NULL;
+    uint32_t* counts = NULL;
+    size_t n = 0;
+    if (0 == strcmp(g_join_format, "hex")) {
+        keys = (uint8_t*) malloc((size / (2 * key_bytes) + 1) * key_bytes);
+        if (NULL == keys) {
+            PrintError("out of memory parsing \"%s\"", path);
+            goto done;
+        }
+        n = parse_text_list(data, size, keys, key_bytes);
+        free(data);
+        data = NULL;
+        if ((0 == n) && (size > 0)) {
+            PrintError("no hex hashes in \"%s\"; use -join-format=keys or -join-format=records "
+                       "for a binary list", path);
+            goto done;
+        }
+    } else if (0 == strcmp(g_join_format, "keys")) {
+        if (0 != (size % key_bytes)) {
+            PrintError("\"%s\" is %zu bytes, not a multiple of the %u-byte hash", path, size, key_bytes);
+            goto done;
+        }
+        keys = (uint8_t*) data;
+        data = NULL;
+        n = size / key_bytes;
+    } else {
+        if (0 != (size % db->record_bytes)) {
+            PrintError("\"%s\" is %zu bytes, not a multiple of the %u-byte record", path, size,
+                       db->record_bytes);
+            goto done;
+        }
+        keys = (uint8_t*) data;
+        data = NULL;
+        n = size / db->record_bytes;
+        for (size_t i = 0; i < n; ++i) {
+            memmove(&keys[i * key_bytes], &keys[i * db->record_bytes], key_bytes);
+        }
+    }
+    double loaded = pwned_seconds();
+    if (!pwned_records_sorted(keys, n, key_bytes, key_bytes)) {
+        PrintVerbose("join: sorting %zu hashes", n);
+        if (0 != pwned_sort_records(keys, n, key_bytes, key_bytes)) {
+            PrintError("out of memory sorting %zu hashes", n);
+            goto done;
+        }
+        n = pwned_unique_records(keys, n, key_bytes, key_bytes, 0);
+    }
+    double sorted = pwned_seconds();
+    counts = (uint32_t*) malloc((n + 1) * sizeof(uint32_t));
+    if (NULL == counts) {
+        PrintError("out of memory for %zu hashes", n);
+        goto done;
+    }
+    uint64_t found = pwned_join(db, keys, n, key_bytes, counts, g_threads);
+    double joined = pwned_seconds();
+    if (!g_quiet) {
+        for (size_t i = 0; i < n; ++i) {
+            if (!(((counts[i] > 0) && g_print_found) || ((0 == counts[i]) && g_print_not_found))) {
+                continue;
+            }
+            if (g_print_index) {
+                printf("%zu%s", i + 1, g_delimiter);
+            }
+            print_hex(&keys[i * key_bytes], key_bytes);
+            if (g_print_count) {
+                printf("%s%" PRIu32, g_delimiter, counts[i]);
+            }
+            printf("\n");
+        }
+    }
+    PrintVerbose("join: %zu unique hashes, %" PRIu64 " found", n, found);
+    PrintVerbose("join: load %.3fs, sort %.3fs, join %.3fs (%d threads)",
+                 loaded - start, sorted - loaded, joined - sorted, pwned_thread_count(g_threads));
+    rval = (found > 0) ? 0 : 1;
+done:
+    free(counts);
+    free(keys);
+    free(data);
+    return rval;
+}   /* run_join() */
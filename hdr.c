@@ -0,0 +1,138 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * High dynamic range histogram; see hdr.h.
+ *
+ * Value v is kept in bucket (s << 6) + (v >> s), where s is how far v must
+ * be shifted right to fit in 7 bits (0 for v < 128). So bucket v holds v
+ * for v < 128, buckets 128-191 hold 128-255 in steps of 2, 192-255 hold
+ * 256-511 in steps of 4, and so on.
+ */
+
+#include <inttypes.h>
+#include <math.h>
+#include <string.h>
+
+#include "hdr.h"
+
+#define kSubBuckets     (1u << PWNED_HDR_SUB_BITS)
+#define kHalfBuckets    (kSubBuckets >> 1)
+
+/**
+ * Percentile lines written per halving of the distance to 100%, as in
+ * HdrHistogram's default output.
+ */
+#define kTicksPerHalf   5
+
+/* ------------------------------------------------------------------------- */
+static inline uint32_t bucket_of(uint64_t value) {
+    uint32_t shift = 0;
+    if (value >= kSubBuckets) {
+        shift = 63 - __builtin_clzll(value) - (PWNED_HDR_SUB_BITS - 1);
+    }
+    return (shift << (PWNED_HDR_SUB_BITS - 1)) + (uint32_t) (value >> shift);
+}   /* bucket_of() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Highest value kept in @a bucket.
+ */
+static uint64_t bucket_highest(uint32_t bucket) {
+    if (bucket < kSubBuckets) {
+        return bucket;
+    }
+    uint32_t shift = (bucket >> (PWNED_HDR_SUB_BITS - 1)) - 1;
+    uint64_t lowest = (uint64_t) (bucket - (shift << (PWNED_HDR_SUB_BITS - 1))) << shift;
+    return lowest + ((1ull << shift) - 1);
+}   /* bucket_highest() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_hdr_init(pwned_hdr_t* hdr) {
+    memset(hdr, 0, sizeof(*hdr));
+    hdr->min = UINT64_MAX;
+}   /* pwned_hdr_init() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_hdr_record(pwned_hdr_t* hdr, uint64_t value) {
+    hdr->counts[bucket_of(value)]++;
+    hdr->total++;
+    hdr->min = (value < hdr->min) ? value : hdr->min;
+    hdr->max = (value > hdr->max) ? value : hdr->max;
+    hdr->sum += (double) value;
+    hdr->sum_squares += (double) value * value;
+}   /* pwned_hdr_record() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_hdr_merge(pwned_hdr_t* hdr, const pwned_hdr_t* from) {
+    for (uint32_t b = 0; b < PWNED_HDR_BUCKETS; ++b) {
+        hdr->counts[b] += from->counts[b];
+    }
+    hdr->total += from->total;
+    hdr->min = (from->min < hdr->min) ? from->min : hdr->min;
+    hdr->max = (from->max > hdr->max) ? from->max : hdr->max;
+    hdr->sum += from->sum;
+    hdr->sum_squares += from->sum_squares;
+}   /* pwned_hdr_merge() */
+
+/* ------------------------------------------------------------------------- */
+uint64_t pwned_hdr_value_at(const pwned_hdr_t* hdr, double percentile) {
+    if (0 == hdr->total) {
+        return 0;
+    }
+    uint64_t wanted = (uint64_t) ceil(percentile / 100.0 * hdr->total);
+    wanted = (wanted < 1) ? 1 : (wanted > hdr->total) ? hdr->total : wanted;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; b < PWNED_HDR_BUCKETS; ++b) {
+        seen += hdr->counts[b];
+        if (seen >= wanted) {
+            uint64_t value = bucket_highest(b);
+            return (value > hdr->max) ? hdr->max : value;
+        }
+    }
+    return hdr->max;
+}   /* pwned_hdr_value_at() */
+
+/* ------------------------------------------------------------------------- */
+double pwned_hdr_mean(const pwned_hdr_t* hdr) {
+    return (hdr->total > 0) ? hdr->sum / hdr->total : 0.0;
+}   /* pwned_hdr_mean() */
+
+/* ------------------------------------------------------------------------- */
+double pwned_hdr_stddev(const pwned_hdr_t* hdr) {
+    if (0 == hdr->total) {
+        return 0.0;
+    }
+    double mean = pwned_hdr_mean(hdr);
+    double variance = hdr->sum_squares / hdr->total - mean * mean;
+    return (variance > 0) ? sqrt(variance) : 0.0;
+}   /* pwned_hdr_stddev() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_hdr_write(const pwned_hdr_t* hdr, FILE* file, double scale) {
+    fprintf(file, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    double level = 0.0;
+    uint64_t seen = 0;
+    for (uint32_t b = 0; (b < PWNED_HDR_BUCKETS) && (seen < hdr->total); ++b) {
+        if (0 == hdr->counts[b]) {
+            continue;
+        }
+        seen += hdr->counts[b];
+        uint64_t highest = bucket_highest(b);
+        double value = ((highest > hdr->max) ? hdr->max : highest) / scale;
+        while ((100.0 * seen / hdr->total >= level) &&
+               ((seen < hdr->total) || (100.0 / (100.0 - level) <= hdr->total))) {
+            fprintf(file, "%12.3f %2.12f %10" PRIu64 " %14.2f\n", value, level / 100.0, seen,
+                    100.0 / (100.0 - level));
+            double halvings = floor(log2(100.0 / (100.0 - level)));
+            level += 100.0 / (kTicksPerHalf * pow(2.0, halvings + 1));
+        }
+        if (seen == hdr->total) {
+            fprintf(file, "%12.3f %2.12f %10" PRIu64 "\n", value, 1.0, seen);
+        }
+    }
+    fprintf(file, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+            pwned_hdr_mean(hdr) / scale, pwned_hdr_stddev(hdr) / scale);
+    fprintf(file, "#[Max     = %12.3f, Total count    = %12" PRIu64 "]\n", hdr->max / scale, hdr->total);
+    fprintf(file, "#[Buckets = %12u, SubBuckets     = %12u]\n", 64 - PWNED_HDR_SUB_BITS + 2, kHalfBuckets);
+}   /* pwned_hdr_write() */
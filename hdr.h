@@ -0,0 +1,67 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __hdr_h__
+#define __hdr_h__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A high dynamic range histogram of latencies (or any non-negative
+ * integers), after Gil Tene's HdrHistogram. Values below 128 get a bucket
+ * each; above that, each power of two is split into 64 buckets, so any
+ * value is kept to within 1/64 (two significant digits) over the whole
+ * 64-bit range, in a fixed 30KB of counts. Recording is a few instructions
+ * and never allocates, and histograms from several threads are merged by
+ * adding their counts.
+ */
+#define PWNED_HDR_SUB_BITS      7
+#define PWNED_HDR_BUCKETS       ((64 - PWNED_HDR_SUB_BITS + 2) << (PWNED_HDR_SUB_BITS - 1))
+
+typedef struct {
+    uint64_t counts[PWNED_HDR_BUCKETS];
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    double sum_squares;
+} pwned_hdr_t;
+
+void pwned_hdr_init(pwned_hdr_t* hdr);
+
+void pwned_hdr_record(pwned_hdr_t* hdr, uint64_t value);
+
+/**
+ * Add the counts in @a from to @a hdr.
+ */
+void pwned_hdr_merge(pwned_hdr_t* hdr, const pwned_hdr_t* from);
+
+/**
+ * The value at @a percentile (0 to 100) of the recorded values: the highest
+ * value that falls in the same bucket, so never less than the true value.
+ * 0 for an empty histogram.
+ */
+uint64_t pwned_hdr_value_at(const pwned_hdr_t* hdr, double percentile);
+
+double pwned_hdr_mean(const pwned_hdr_t* hdr);
+
+double pwned_hdr_stddev(const pwned_hdr_t* hdr);
+
+/**
+ * Write the percentile distribution of @a hdr to @a file in the text
+ * format of HdrHistogram's outputPercentileDistribution() (.hgrm), which
+ * its plotting tools read. Values are divided by @a scale, e.g. 1e6 to
+ * print nanoseconds as milliseconds.
+ */
+void pwned_hdr_write(const pwned_hdr_t* hdr, FILE* file, double scale);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
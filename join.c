@@ -0,0 +1,218 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#include <string.h>
+
+#include "join.h"
+#include "parallel.h"
+
+/**
+ * Most threads used by pwned_join().
+ */
+#define kMaxJoinThreads 0x100
+
+/**
+ * When the hash file has fewer than 1/kSparseRatio as many records as there
+ * are keys (a release delta against a whole user base, say), pwned_join()
+ * walks the records and gallops through the keys instead.
+ */
+#define kSparseRatio 8
+
+/**
+ * Shared state for the threads of pwned_join().
+ */
+typedef struct {
+    const pwned_db_t* db;
+    const uint8_t* keys;
+    size_t n;
+    size_t key_stride;
+    uint32_t* counts;
+    uint64_t found[kMaxJoinThreads];    /**< Keys found by each thread. */
+} join_t;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Lower bound of @a key in records [lo, hi), specialized like find_key() in
+ * pwned_db.c by inlining with a constant @a key_bytes.
+ */
+static inline __attribute__((always_inline))
+uint64_t lower_bound_key(const uint8_t* data, const uint8_t* key, uint64_t lo, uint64_t hi,
+                         const uint32_t key_bytes) {
+    const uint32_t record_bytes = key_bytes + PWNED_COUNT_BYTES;
+    while (lo < hi) {
+        uint64_t mid = lo + ((hi - lo) / 2);
+        if (pwned_key_cmp(&data[mid * record_bytes], key, key_bytes) < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}   /* lower_bound_key() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Gallop forward from @a lo for the lower bound of @a key in [lo, hi):
+ * probe lo+1, lo+3, lo+7, ... until passing @a key, then binary search the
+ * last interval.
+ */
+static inline __attribute__((always_inline))
+uint64_t gallop_key(const uint8_t* data, const uint8_t* key, uint64_t lo, uint64_t hi,
+                    const uint32_t key_bytes) {
+    const uint32_t record_bytes = key_bytes + PWNED_COUNT_BYTES;
+    uint64_t step = 1;
+    while ((lo < hi) && (pwned_key_cmp(&data[lo * record_bytes], key, key_bytes) < 0)) {
+        uint64_t next = lo + step;
+        if ((next >= hi) || (pwned_key_cmp(&data[next * record_bytes], key, key_bytes) >= 0)) {
+            return lower_bound_key(data, key, lo + 1, (next < hi) ? next : hi, key_bytes);
+        }
+        lo = next + 1;
+        step *= 2;
+    }
+    return lo;
+}   /* gallop_key() */
+
+/* ------------------------------------------------------------------------- */
+static inline __attribute__((always_inline))
+void join_part(join_t* join, int index, int threads, const uint32_t key_bytes) {
+    const pwned_db_t* db = join->db;
+    const uint32_t record_bytes = key_bytes + PWNED_COUNT_BYTES;
+    const uint64_t start = pwned_part_start(join->n, index, threads);
+    const uint64_t end = pwned_part_start(join->n, index + 1, threads);
+    uint64_t found = 0;
+    if (start < end) {
+        uint64_t pos = lower_bound_key(db->data, &join->keys[start * join->key_stride],
+                                       0, db->records, key_bytes);
+        for (uint64_t i = start; i < end; ++i) {
+            const uint8_t* key = &join->keys[i * join->key_stride];
+            pos = gallop_key(db->data, key, pos, db->records, key_bytes);
+            uint32_t count = 0;
+            if ((pos < db->records) &&
+                (0 == pwned_key_cmp(&db->data[pos * record_bytes], key, key_bytes))) {
+                memcpy(&count, &db->data[(pos * record_bytes) + key_bytes], sizeof(count));
+                found += (count > 0);
+            }
+            join->counts[i] = count;
+        }
+    }
+    join->found[index] = found;
+}   /* join_part() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Lower bound of @a key among keys [lo, hi) at @a keys, @a stride bytes
+ * apart, galloping forward from @a lo like gallop_key().
+ */
+static inline __attribute__((always_inline))
+uint64_t gallop_keys(const uint8_t* keys, size_t stride, const uint8_t* key, uint64_t lo,
+                     uint64_t hi, const uint32_t key_bytes) {
+    uint64_t step = 1;
+    while ((lo < hi) && (pwned_key_cmp(&keys[lo * stride], key, key_bytes) < 0)) {
+        uint64_t next = lo + step;
+        if ((next >= hi) || (pwned_key_cmp(&keys[next * stride], key, key_bytes) >= 0)) {
+            hi = (next < hi) ? next : hi;
+            ++lo;
+            while (lo < hi) {
+                uint64_t mid = lo + ((hi - lo) / 2);
+                if (pwned_key_cmp(&keys[mid * stride], key, key_bytes) < 0) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            return lo;
+        }
+        lo = next + 1;
+        step *= 2;
+    }
+    return lo;
+}   /* gallop_keys() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Sparse join: split the records rather than the keys between threads, and
+ * gallop through the keys from one record to the next. Only keys equal to
+ * some record are touched; pwned_join() has already zeroed the counts.
+ */
+static inline __attribute__((always_inline))
+void join_sparse_part(join_t* join, int index, int threads, const uint32_t key_bytes) {
+    const pwned_db_t* db = join->db;
+    const uint32_t record_bytes = key_bytes + PWNED_COUNT_BYTES;
+    const uint64_t start = pwned_part_start(db->records, index, threads);
+    const uint64_t end = pwned_part_start(db->records, index + 1, threads);
+    uint64_t found = 0;
+    uint64_t pos = 0;
+    for (uint64_t r = start; (r < end) && (pos < join->n); ++r) {
+        const uint8_t* record = &db->data[r * record_bytes];
+        pos = gallop_keys(join->keys, join->key_stride, record, pos, join->n, key_bytes);
+        uint32_t count;
+        memcpy(&count, &record[key_bytes], sizeof(count));
+        while ((pos < join->n) &&
+               (0 == pwned_key_cmp(&join->keys[pos * join->key_stride], record, key_bytes))) {
+            join->counts[pos++] = count;
+            found += (count > 0);
+        }
+    }
+    join->found[index] = found;
+}   /* join_sparse_part() */
+
+/* ------------------------------------------------------------------------- */
+static void join_sha1(void* arg, int index, int threads) {
+    join_part((join_t*) arg, index, threads, PWNED_SHA1_KEY_BYTES);
+}   /* join_sha1() */
+
+/* ------------------------------------------------------------------------- */
+static void join_ntlm(void* arg, int index, int threads) {
+    join_part((join_t*) arg, index, threads, PWNED_NTLM_KEY_BYTES);
+}   /* join_ntlm() */
+
+/* ------------------------------------------------------------------------- */
+static void join_sparse_sha1(void* arg, int index, int threads) {
+    join_sparse_part((join_t*) arg, index, threads, PWNED_SHA1_KEY_BYTES);
+}   /* join_sparse_sha1() */
+
+/* ------------------------------------------------------------------------- */
+static void join_sparse_ntlm(void* arg, int index, int threads) {
+    join_sparse_part((join_t*) arg, index, threads, PWNED_NTLM_KEY_BYTES);
+}   /* join_sparse_ntlm() */
+
+/* ------------------------------------------------------------------------- */
+uint64_t pwned_join(const pwned_db_t* db, const uint8_t* keys, size_t n, size_t key_stride,
+                    uint32_t* counts, int threads) {
+    join_t join;
+    join.db = db;
+    join.keys = keys;
+    join.n = n;
+    join.key_stride = key_stride;
+    join.counts = counts;
+    threads = pwned_thread_count(threads);
+    if (threads > kMaxJoinThreads) {
+        threads = kMaxJoinThreads;
+    }
+    if (db->records < n / kSparseRatio) {
+        memset(counts, 0, n * sizeof(counts[0]));
+        if ((uint64_t) threads > db->records) {
+            threads = (int) db->records;
+        }
+        pwned_parallel(threads, (PWNED_KEY_NTLM == db->type) ? join_sparse_ntlm : join_sparse_sha1,
+                       &join);
+    } else {
+        if ((size_t) threads > n) {
+            threads = (n > 0) ? (int) n : 1;
+        }
+        pwned_parallel(threads, (PWNED_KEY_NTLM == db->type) ? join_ntlm : join_sha1, &join);
+    }
+    uint64_t found = 0;
+    for (int i = 0; i < threads; ++i) {
+        found += join.found[i];
+    }
+    return found;
+}   /* pwned_join() */
+
+/* ------------------------------------------------------------------------- */
+uint64_t pwned_lower_bound(const pwned_db_t* db, const uint8_t* key, uint64_t lo, uint64_t hi) {
+    if (PWNED_KEY_NTLM == db->type) {
+        return lower_bound_key(db->data, key, lo, hi, PWNED_NTLM_KEY_BYTES);
+    }
+    return lower_bound_key(db->data, key, lo, hi, PWNED_SHA1_KEY_BYTES);
+}   /* pwned_lower_bound() */
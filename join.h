@@ -0,0 +1,52 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __join_h__
+#define __join_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Merge join @a n keys against hash file @a db.
+ *
+ * The keys are at @a keys, @a key_stride bytes apart, and must be sorted by
+ * key (duplicates are fine). The keys are split into @a threads contiguous
+ * partitions; each thread binary searches the file once for its first key
+ * then walks forward, galloping over the records between consecutive keys.
+ * Dense key sets therefore read the file sequentially while sparse ones
+ * touch about log2(gap) records per key.
+ *
+ * When @a db is much smaller than the key set, as when checking a whole
+ * user base against a release delta, the roles swap: the records are split
+ * between threads and each gallops through the keys, so the cost depends on
+ * the size of @a db rather than on @a n.
+ *
+ * Records with a count of 0 (removed records in a -diff-bin delta) match
+ * but are not counted as found.
+ *
+ * @param counts - receives, for each key, its occurrence count in @a db or
+ * 0 if the key is not in @a db.
+ *
+ * @return the number of keys found.
+ */
+uint64_t pwned_join(const pwned_db_t* db, const uint8_t* keys, size_t n, size_t key_stride,
+                    uint32_t* counts, int threads);
+
+/**
+ * Index of the first record in @a db in [lo, hi) whose key is not less than
+ * @a key, or @a hi if there is none.
+ */
+uint64_t pwned_lower_bound(const pwned_db_t* db, const uint8_t* key, uint64_t lo, uint64_t hi);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
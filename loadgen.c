@@ -0,0 +1,487 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Load generator (-load=HOST:PORT) and trace replay (-replay=TRACE) modes.
+ *
+ * -load finds how many lookups a server (-serve) or router (-route) can
+ * take before its latency goes bad.
+ *
+ * The load is open loop: requests are sent on a fixed schedule, -rate
+ * requests a second spread evenly over -connections connections, whether
+ * or not earlier requests have been answered. A closed-loop tester, which
+ * waits for each answer before sending the next request, slows down
+ * whenever the server does, so the requests that would have queued behind
+ * a stall are never sent and never measured ("coordinated omission"); its
+ * latencies look fine right up to the point where the server falls over.
+ * Here every request's latency is measured from when the schedule said it
+ * should be sent, so time spent queued behind a stall counts, whether in
+ * the server or in the socket buffers on the way there.
+ *
+ * Each connection has a thread that sends on schedule and another that
+ * reads the answers, which come back in order. Latencies go into an HDR
+ * histogram (hdr.h) per connection, both from the scheduled time
+ * (corrected) and from when the request was actually written
+ * (uncorrected); the gap between the two is the queueing a closed-loop test
+ * would have hidden.
+ *
+ * Each request holds -batch keys drawn from a pool made up front: -hit
+ * percent are random records of the hash file, so they are found, and the
+ * rest are random keys checked not to be in it.
+ *
+ * -replay sends the lookups of a trace (see trace.h) instead, each at its
+ * recorded time divided by -speed, to the -load servers or, without -load,
+ * to find_hash() in this process on -threads threads, with any -engine. The
+ * schedule comes from the trace rather than -rate and -duration, and each
+ * request holds one lookup.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "client.h"
+#include "find-pwned.h"
+#include "hdr.h"
+#include "parallel.h"
+#include "trace.h"
+
+/**
+ * Keys in the pool the requests cycle through; big enough that the server
+ * cannot keep them all in cache unless the hash file is small.
+ */
+#define kKeyPool 0x10000
+
+/**
+ * Requests in flight per connection before the sender waits for answers.
+ * The wait is still counted against the requests it delays.
+ */
+#define kMaxInFlight 0x1000
+
+/**
+ * Seconds to wait for an answer before giving up on a server.
+ */
+#define kAnswerTimeout 10
+
+/**
+ * Percentiles printed in the summary.
+ */
+static const double kPercentiles[] = { 50, 90, 99, 99.9, 99.99, 100 };
+#define kPercentileCount (sizeof(kPercentiles) / sizeof(kPercentiles[0]))
+
+struct load_s;
+
+/**
+ * One connection's schedule, requests in flight and results. The sender
+ * and receiver share @a sent and @a answered; each writes only its own.
+ */
+typedef struct {
+    struct load_s* load;
+    int index;
+    int fd;
+    double scheduled[kMaxInFlight];     /**< When each request in flight was due. */
+    double written[kMaxInFlight];       /**< When it was actually written. */
+    uint64_t sent;
+    uint64_t answered;
+    int done;                           /**< Sender has sent its last request. */
+    double last_answer;
+    uint64_t found;
+    uint64_t errors;                    /**< Answers with a status other than PWNED_NET_OK. */
+    pwned_hdr_t corrected;
+    pwned_hdr_t uncorrected;
+} load_connection_t;
+
+typedef struct load_s {
+    const char* addresses[kMaxLoadAddresses];
+    int address_count;                  /**< 0 to look up in this process. */
+    const pwned_db_t* db;
+    uint32_t key_bytes;
+    const uint8_t* keys;                /**< Keys the requests cycle through. */
+    uint64_t key_count;
+    uint64_t requests;                  /**< Requests to send over all connections. */
+    double start;
+    double interval;                    /**< Seconds between requests, without @a due. */
+    const double* due;                  /**< Seconds from @a start to each request, or NULL. */
+    double speed;                       /**< Divides @a due; 0 to send as fast as possible. */
+    int connections;                    /**< Or threads, in this process. */
+    uint32_t batch;
+    int failed;
+    load_connection_t* conns;
+} load_t;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Fill @a pool with kKeyPool keys: @a hit_percent percent records of
+ * @a db, the rest random keys that are not in it, shuffled.
+ */
+static void fill_pool(uint8_t* pool, const pwned_db_t* db, double hit_percent) {
+    const uint32_t key_bytes = db->key_bytes;
+    uint64_t seed = 0x10AD;
+    uint32_t hits = (db->records > 0) ? (uint32_t) (kKeyPool * hit_percent / 100.0 + 0.5) : 0;
+    for (uint32_t i = 0; i < kKeyPool; ++i) {
+        uint8_t* key = &pool[(size_t) i * key_bytes];
+        if (i < hits) {
+            memcpy(key, pwned_db_record(db, pwned_splitmix64(&seed) % db->records), key_bytes);
+            continue;
+        }
+        uint64_t count = 0;
+        do {
+            for (uint32_t b = 0; b < key_bytes; b += 8) {
+                uint64_t r = pwned_splitmix64(&seed);
+                memcpy(&key[b], &r, (key_bytes - b < 8) ? key_bytes - b : 8);
+            }
+        } while ((db->records > 0) && pwned_db_find(db, key, &count));
+    }
+    uint8_t tmp[PWNED_MAX_KEY_BYTES];
+    for (uint32_t i = kKeyPool - 1; i > 0; --i) {
+        uint32_t j = (uint32_t) (pwned_splitmix64(&seed) % (i + 1));
+        memcpy(tmp, &pool[(size_t) i * key_bytes], key_bytes);
+        memcpy(&pool[(size_t) i * key_bytes], &pool[(size_t) j * key_bytes], key_bytes);
+        memcpy(&pool[(size_t) j * key_bytes], tmp, key_bytes);
+    }
+}   /* fill_pool() */
+
+/* ------------------------------------------------------------------------- */
+static void sleep_until(double when) {
+    if (when <= pwned_seconds()) {
+        return;                 /* Behind schedule: no system call. */
+    }
+    struct timespec ts;
+    ts.tv_sec = (time_t) when;
+    ts.tv_nsec = (long) ((when - (double) ts.tv_sec) * 1e9);
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL)) {
+    }
+}   /* sleep_until() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * When request @a n is due. At speed 0 every request is due at the start,
+ * so latencies include the time spent queued behind the earlier ones.
+ */
+static inline double due_time(const load_t* load, uint64_t n) {
+    if (NULL == load->due) {
+        return load->start + n * load->interval;
+    }
+    return (load->speed > 0) ? load->start + load->due[n] / load->speed : load->start;
+}   /* due_time() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Read the answers on a connection, in the order the requests were sent,
+ * until the sender is done and everything has been answered.
+ */
+static void* receive_answers(void* arg) {
+    load_connection_t* conn = (load_connection_t*) arg;
+    load_t* load = conn->load;
+    uint32_t* counts = (uint32_t*) malloc(load->batch * sizeof(uint32_t));
+    pwned_net_response_t response;
+    while (NULL != counts) {
+        int status = pwned_net_read(conn->fd, &response, sizeof(response));
+        uint64_t sent = __atomic_load_n(&conn->sent, __ATOMIC_ACQUIRE);
+        if (0 == status) {
+            if (!__atomic_load_n(&conn->done, __ATOMIC_ACQUIRE) || (conn->answered < sent)) {
+                PrintError("connection %d: server closed the connection", conn->index);
+                __atomic_store_n(&load->failed, 1, __ATOMIC_RELEASE);
+            }
+            break;
+        }
+        if ((1 != status) || (conn->answered >= sent) || (response.count > load->batch) ||
+            ((response.count > 0) &&
+             (1 != pwned_net_read(conn->fd, counts, response.count * sizeof(uint32_t))))) {
+            PrintError("connection %d: %s", conn->index, (1 != status) ? strerror(errno) : "bad answer");
+            __atomic_store_n(&load->failed, 1, __ATOMIC_RELEASE);
+            break;
+        }
+        double now = pwned_seconds();
+        uint32_t slot = conn->answered % kMaxInFlight;
+        pwned_hdr_record(&conn->corrected, (uint64_t) (1e9 * (now - conn->scheduled[slot])));
+        pwned_hdr_record(&conn->uncorrected, (uint64_t) (1e9 * (now - conn->written[slot])));
+        if (PWNED_NET_OK != response.status) {
+            conn->errors++;
+        }
+        for (uint32_t i = 0; i < response.count; ++i) {
+            conn->found += (0 != counts[i]);
+        }
+        conn->last_answer = now;
+        __atomic_store_n(&conn->answered, conn->answered + 1, __ATOMIC_RELEASE);
+    }
+    free(counts);
+    return NULL;
+}   /* receive_answers() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Connect and send connection @a index's share of the requests on
+ * schedule, reading the answers on a second thread.
+ */
+static void run_connection(void* arg, int index, int threads) {
+    load_t* load = (load_t*) arg;
+    load_connection_t* conn = &load->conns[index];
+    const char* address = load->addresses[index % load->address_count];
+    conn->fd = pwned_net_connect(address);
+    if (conn->fd < 0) {
+        PrintError("connection %d: could not connect to \"%s\"", index, address);
+        __atomic_store_n(&load->failed, 1, __ATOMIC_RELEASE);
+        return;
+    }
+    struct timeval timeout = { kAnswerTimeout, 0 };
+    setsockopt(conn->fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    pthread_t receiver;
+    if (0 != pthread_create(&receiver, NULL, receive_answers, conn)) {
+        PrintError("connection %d: could not start a thread", index);
+        __atomic_store_n(&load->failed, 1, __ATOMIC_RELEASE);
+        close(conn->fd);
+        return;
+    }
+    const size_t key_bytes = (size_t) load->batch * load->key_bytes;
+    uint8_t* request = (uint8_t*) malloc(sizeof(pwned_net_request_t) + key_bytes);
+    pwned_net_request_t header = { load->key_bytes, load->batch };
+    for (uint64_t n = index; (NULL != request) && (n < load->requests) &&
+         !__atomic_load_n(&load->failed, __ATOMIC_ACQUIRE); n += load->connections) {
+        double due = due_time(load, n);
+        while ((conn->sent - __atomic_load_n(&conn->answered, __ATOMIC_ACQUIRE) >= kMaxInFlight) &&
+               !__atomic_load_n(&load->failed, __ATOMIC_ACQUIRE)) {
+            sleep_until(pwned_seconds() + 100e-6);
+        }
+        memcpy(request, &header, sizeof(header));
+        for (uint32_t i = 0; i < load->batch; ++i) {
+            size_t key = (n * load->batch + i) % load->key_count;
+            memcpy(&request[sizeof(header) + (size_t) i * load->key_bytes],
+                   &load->keys[key * load->key_bytes], load->key_bytes);
+        }
+        sleep_until(due);
+        uint32_t slot = conn->sent % kMaxInFlight;
+        conn->written[slot] = pwned_seconds();
+        conn->scheduled[slot] = due;
+        __atomic_store_n(&conn->sent, conn->sent + 1, __ATOMIC_RELEASE);
+        if (0 != pwned_net_write(conn->fd, request, sizeof(header) + key_bytes)) {
+            PrintError("connection %d: %s", index, strerror(errno));
+            __atomic_store_n(&load->failed, 1, __ATOMIC_RELEASE);
+        }
+    }
+    __atomic_store_n(&conn->done, 1, __ATOMIC_RELEASE);
+    shutdown(conn->fd, SHUT_WR);        /* The server closes once it has answered everything. */
+    pthread_join(receiver, NULL);
+    close(conn->fd);
+    free(request);
+}   /* run_connection() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Look up thread @a index's share of the keys in this process, on
+ * schedule.
+ */
+static void run_local(void* arg, int index, int threads) {
+    load_t* load = (load_t*) arg;
+    load_connection_t* conn = &load->conns[index];
+    for (uint64_t n = index; n < load->requests; n += load->connections) {
+        double due = due_time(load, n);
+        sleep_until(due);
+        double begun = pwned_seconds();
+        uint64_t count = 0;
+        conn->found += find_hash(load->db, &load->keys[(n % load->key_count) * load->key_bytes], &count);
+        double now = pwned_seconds();
+        pwned_hdr_record(&conn->corrected, (uint64_t) (1e9 * (now - due)));
+        pwned_hdr_record(&conn->uncorrected, (uint64_t) (1e9 * (now - begun)));
+        conn->last_answer = now;
+        conn->sent++;
+    }
+}   /* run_local() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Print one line of percentiles of @a hdr, in milliseconds.
+ */
+static void print_latencies(const char* name, const pwned_hdr_t* hdr) {
+    printf("  %-12s", name);
+    for (size_t p = 0; p < kPercentileCount; ++p) {
+        printf(" %9.3f", pwned_hdr_value_at(hdr, kPercentiles[p]) / 1e6);
+    }
+    printf(" %9.3f\n", pwned_hdr_mean(hdr) / 1e6);
+}   /* print_latencies() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Send @a load's requests and print what came of them, under @a title,
+ * with @a pace saying how fast they were meant to go and @a hit_percent
+ * the percentage of lookups that should be found.
+ *
+ * @return 0 if every request was answered, an exit code otherwise.
+ */
+static int run_requests(load_t* load, const char* title, const char* pace, double hit_percent) {
+    for (int c = 0; c < load->connections; ++c) {
+        load->conns[c].load = load;
+        load->conns[c].index = c;
+        pwned_hdr_init(&load->conns[c].corrected);
+        pwned_hdr_init(&load->conns[c].uncorrected);
+    }
+    /* Leave time for every connection to connect, unless nothing waits for a schedule. */
+    const int unpaced = (NULL != load->due) && (0 == load->speed);
+    load->start = pwned_seconds() + (unpaced ? 0 : 0.1);
+    pwned_parallel(load->connections, (load->address_count > 0) ? run_connection : run_local, load);
+
+    pwned_hdr_t corrected;
+    pwned_hdr_t uncorrected;
+    pwned_hdr_init(&corrected);
+    pwned_hdr_init(&uncorrected);
+    uint64_t sent = 0;
+    uint64_t found = 0;
+    uint64_t errors = 0;
+    double last = load->start;
+    for (int c = 0; c < load->connections; ++c) {
+        load_connection_t* conn = &load->conns[c];
+        pwned_hdr_merge(&corrected, &conn->corrected);
+        pwned_hdr_merge(&uncorrected, &conn->uncorrected);
+        sent += conn->sent;
+        found += conn->found;
+        errors += conn->errors;
+        last = (conn->last_answer > last) ? conn->last_answer : last;
+    }
+    const uint64_t answered = corrected.total;
+    const double seconds = last - load->start;
+    printf("%s: %" PRIu64 " requests sent, %" PRIu64 " answered (%" PRIu64 " with errors)"
+           " in %.3fs\n", title, sent, answered, errors, seconds);
+    printf("  %s, achieved %.1f requests/s, %.1f lookups/s\n", pace,
+           (seconds > 0) ? answered / seconds : 0.0,
+           (seconds > 0) ? answered * (double) load->batch / seconds : 0.0);
+    printf("  found %.2f%% of lookups (%.2f%% expected)\n",
+           (answered > 0) ? 100.0 * found / (answered * (double) load->batch) : 0.0, hit_percent);
+    printf("  %-12s", "latency ms");
+    for (size_t p = 0; p < kPercentileCount; ++p) {
+        char heading[0x10] = "max";
+        if (kPercentiles[p] < 100) {
+            snprintf(heading, sizeof(heading), "p%g", kPercentiles[p]);
+        }
+        printf(" %9s", heading);
+    }
+    printf(" %9s\n", "mean");
+    print_latencies("corrected", &corrected);
+    print_latencies("uncorrected", &uncorrected);
+
+    int rval = (load->failed || (answered < sent)) ? 3 : 0;
+    if (NULL != g_load_histogram) {
+        FILE* file = fopen(g_load_histogram, "w");
+        if (NULL == file) {
+            PrintError("could not write \"%s\"", g_load_histogram);
+            rval = 2;
+        } else {
+            pwned_hdr_write(&corrected, file, 1e6);
+            fclose(file);
+        }
+    }
+    return rval;
+}   /* run_requests() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Split comma-separated @a addresses into @a load, in a copy that the
+ * caller frees.
+ *
+ * @return the copy, or NULL if out of memory.
+ */
+static char* split_addresses(load_t* load, const char* addresses) {
+    char* list = strdup(addresses);
+    for (char* next = list; (NULL != next) && (load->address_count < kMaxLoadAddresses); ) {
+        load->addresses[load->address_count++] = strsep(&next, ",");
+    }
+    return list;
+}   /* split_addresses() */
+
+/* ------------------------------------------------------------------------- */
+int run_load(const char* addresses, const pwned_db_t* db) {
+    load_t load;
+    memset(&load, 0, sizeof(load));
+    char* list = split_addresses(&load, addresses);
+    uint8_t* pool = (uint8_t*) malloc((size_t) kKeyPool * db->key_bytes);
+    load.db = db;
+    load.key_bytes = db->key_bytes;
+    load.keys = pool;
+    load.key_count = kKeyPool;
+    load.connections = g_load_connections;
+    load.batch = g_load_batch;
+    load.interval = 1.0 / g_load_rate;
+    load.requests = (uint64_t) ceil(g_load_duration * g_load_rate);
+    load.conns = (load_connection_t*) calloc(load.connections, sizeof(load.conns[0]));
+    if ((NULL == list) || (NULL == pool) || (NULL == load.conns)) {
+        PrintError("out of memory for the load generator");
+        return 2;
+    }
+    fill_pool(pool, db, g_load_hit_percent);
+    PrintVerbose("%.0f requests/s of %u %s keys (%.0f%% in \"%s\") for %.1fs over %d connections",
+                 g_load_rate, load.batch, pwned_key_name(db->type), g_load_hit_percent, g_hash_file,
+                 g_load_duration, load.connections);
+    char pace[0x40];
+    snprintf(pace, sizeof(pace), "target %.1f requests/s", g_load_rate);
+    int rval = run_requests(&load, addresses, pace, g_load_hit_percent);
+    free(load.conns);
+    free(pool);
+    free(list);
+    return rval;
+}   /* run_load() */
+
+/* ------------------------------------------------------------------------- */
+int run_replay(const char* path, const char* addresses, const pwned_db_t* db) {
+    pwned_trace_t trace;
+    switch (pwned_trace_load(&trace, path, db->type)) {
+    case PWNED_DB_OK:
+        break;
+    case PWNED_TRACE_ERR_FORMAT:
+        PrintError("\"%s\" is not a trace file", path);
+        return 4;
+    case PWNED_TRACE_ERR_TYPE:
+        PrintError("\"%s\" is not a trace of %s hashes", path, pwned_key_name(db->type));
+        return 4;
+    default:
+        PrintError("could not read \"%s\"", path);
+        return 2;
+    }
+    if (0 == trace.count) {
+        PrintError("\"%s\" holds no lookups", path);
+        pwned_trace_free(&trace);
+        return 4;
+    }
+    const double seconds = trace.at[trace.count - 1];
+    load_t load;
+    memset(&load, 0, sizeof(load));
+    char* list = (NULL != addresses) ? split_addresses(&load, addresses) : NULL;
+    load.db = db;
+    load.key_bytes = db->key_bytes;
+    load.keys = trace.keys;
+    load.key_count = trace.count;
+    load.requests = trace.count;
+    load.due = trace.at;
+    load.speed = g_replay_speed;
+    load.batch = 1;
+    load.connections = (NULL != addresses) ? g_load_connections : pwned_thread_count(g_threads);
+    load.conns = (load_connection_t*) calloc(load.connections, sizeof(load.conns[0]));
+    if (((NULL != addresses) && (NULL == list)) || (NULL == load.conns)) {
+        PrintError("out of memory for the replay");
+        pwned_trace_free(&trace);
+        return 2;
+    }
+    PrintVerbose("%" PRIu64 " %s lookups (%" PRIu64 " found) over %.3fs in \"%s\", replayed on %d %s",
+                 trace.count, pwned_key_name(db->type), trace.hits, seconds, path, load.connections,
+                 (NULL != addresses) ? "connections" : "threads");
+    char pace[0x80];
+    if (g_replay_speed > 0) {
+        snprintf(pace, sizeof(pace), "trace at %gx speed, %.1f requests/s", g_replay_speed,
+                 (seconds > 0) ? trace.count * g_replay_speed / seconds : 0.0);
+    } else {
+        snprintf(pace, sizeof(pace), "trace as fast as possible");
+    }
+    int rval = run_requests(&load, (NULL != addresses) ? addresses : g_hash_file, pace,
+                            100.0 * trace.hits / trace.count);
+    free(load.conns);
+    free(list);
+    pwned_trace_free(&trace);
+    return rval;
+}   /* run_replay() */
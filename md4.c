@@ -0,0 +1,287 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * MD4 (RFC 1320) and the NTLM password hash built on it.
+ *
+ * NTLM hashes are almost always of short passwords, which fit in a single
+ * MD4 block once converted to UTF-16LE. ntlm_hash_batch() takes advantage of
+ * that by hashing several passwords at once, one per SIMD lane. The kernels
+ * are written with GCC vector extensions; the 4-lane kernel compiles to SSE2
+ * (baseline on x86-64) and the 8-lane kernel is compiled for AVX2 and only
+ * selected at run time when the CPU supports it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "md4.h"
+#include "multibuf.h"
+
+/**
+ * Rotate @a _x to the left by @a _c bits. Works on scalars and vectors.
+ */
+#define ROTATE_LEFT(_x,_c) (((_x) << (_c)) | ((_x) >> (0x20 - (_c))))
+
+#define MD4_F(_x,_y,_z) ((_z) ^ ((_x) & ((_y) ^ (_z))))
+#define MD4_G(_x,_y,_z) (((_x) & (_y)) | ((_z) & ((_x) | (_y))))
+#define MD4_H(_x,_y,_z) ((_x) ^ (_y) ^ (_z))
+
+#define MD4_R1(_a,_b,_c,_d,_k,_s) _a = ROTATE_LEFT(_a + MD4_F(_b,_c,_d) + X[_k], _s)
+#define MD4_R2(_a,_b,_c,_d,_k,_s) _a = ROTATE_LEFT(_a + MD4_G(_b,_c,_d) + X[_k] + 0x5A827999, _s)
+#define MD4_R3(_a,_b,_c,_d,_k,_s) _a = ROTATE_LEFT(_a + MD4_H(_b,_c,_d) + X[_k] + 0x6ED9EBA1, _s)
+
+/**
+ * The 48 MD4 steps on a, b, c, d using message words X[]. Shared by the
+ * scalar and vector code, so X[] and a..d may be uint32_t or vectors.
+ */
+#define MD4_ROUNDS()                                                    \
+    do {                                                                \
+        MD4_R1(a,b,c,d, 0, 3); MD4_R1(d,a,b,c, 1, 7); MD4_R1(c,d,a,b, 2,11); MD4_R1(b,c,d,a, 3,19); \
+        MD4_R1(a,b,c,d, 4, 3); MD4_R1(d,a,b,c, 5, 7); MD4_R1(c,d,a,b, 6,11); MD4_R1(b,c,d,a, 7,19); \
+        MD4_R1(a,b,c,d, 8, 3); MD4_R1(d,a,b,c, 9, 7); MD4_R1(c,d,a,b,10,11); MD4_R1(b,c,d,a,11,19); \
+        MD4_R1(a,b,c,d,12, 3); MD4_R1(d,a,b,c,13, 7); MD4_R1(c,d,a,b,14,11); MD4_R1(b,c,d,a,15,19); \
+        MD4_R2(a,b,c,d, 0, 3); MD4_R2(d,a,b,c, 4, 5); MD4_R2(c,d,a,b, 8, 9); MD4_R2(b,c,d,a,12,13); \
+        MD4_R2(a,b,c,d, 1, 3); MD4_R2(d,a,b,c, 5, 5); MD4_R2(c,d,a,b, 9, 9); MD4_R2(b,c,d,a,13,13); \
+        MD4_R2(a,b,c,d, 2, 3); MD4_R2(d,a,b,c, 6, 5); MD4_R2(c,d,a,b,10, 9); MD4_R2(b,c,d,a,14,13); \
+        MD4_R2(a,b,c,d, 3, 3); MD4_R2(d,a,b,c, 7, 5); MD4_R2(c,d,a,b,11, 9); MD4_R2(b,c,d,a,15,13); \
+        MD4_R3(a,b,c,d, 0, 3); MD4_R3(d,a,b,c, 8, 9); MD4_R3(c,d,a,b, 4,11); MD4_R3(b,c,d,a,12,15); \
+        MD4_R3(a,b,c,d, 2, 3); MD4_R3(d,a,b,c,10, 9); MD4_R3(c,d,a,b, 6,11); MD4_R3(b,c,d,a,14,15); \
+        MD4_R3(a,b,c,d, 1, 3); MD4_R3(d,a,b,c, 9, 9); MD4_R3(c,d,a,b, 5,11); MD4_R3(b,c,d,a,13,15); \
+        MD4_R3(a,b,c,d, 3, 3); MD4_R3(d,a,b,c,11, 9); MD4_R3(c,d,a,b, 7,11); MD4_R3(b,c,d,a,15,15); \
+    } while (0)
+
+#define MD4_H0  0x67452301
+#define MD4_H1  0xEFCDAB89
+#define MD4_H2  0x98BADCFE
+#define MD4_H3  0x10325476
+
+/* ------------------------------------------------------------------------- */
+static inline uint32_t load_le32(const uint8_t* p) {
+    return ((uint32_t) p[0]) | (((uint32_t) p[1]) << 8) |
+           (((uint32_t) p[2]) << 16) | (((uint32_t) p[3]) << 24);
+}   /* load_le32() */
+
+/* ------------------------------------------------------------------------- */
+static inline void store_le32(uint8_t* p, uint32_t v) {
+    p[0] = v >> 0;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}   /* store_le32() */
+
+/* ------------------------------------------------------------------------- */
+static void md4_hash_block(uint32_t* restrict h, const uint8_t* restrict block_data) {
+    uint32_t X[0x10];
+    for (int i = 0; i < 0x10; ++i) {
+        X[i] = load_le32(&block_data[4*i]);
+    }
+    uint32_t a = h[0];
+    uint32_t b = h[1];
+    uint32_t c = h[2];
+    uint32_t d = h[3];
+    MD4_ROUNDS();
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+}   /* md4_hash_block() */
+
+/* ------------------------------------------------------------------------- */
+uint8_t* md4_buffer_bin(const void* restrict data, size_t size, uint8_t* restrict bin) {
+    uint32_t h[4] = { MD4_H0, MD4_H1, MD4_H2, MD4_H3 };
+    const uint8_t* b = data;
+    const uint64_t bits = 8 * (uint64_t) size;
+    uint8_t block[MD4_BLOCK_BYTES];
+    while (size >= MD4_BLOCK_BYTES) {
+        md4_hash_block(h, b);
+        b += MD4_BLOCK_BYTES;
+        size -= MD4_BLOCK_BYTES;
+    }
+    memcpy(block, b, size);
+    block[size++] = 0x80;
+    if (size > (MD4_BLOCK_BYTES - 8)) {
+        memset(&block[size], 0, MD4_BLOCK_BYTES - size);
+        md4_hash_block(h, block);
+        size = 0;
+    }
+    memset(&block[size], 0, (MD4_BLOCK_BYTES - 8) - size);
+    store_le32(&block[MD4_BLOCK_BYTES - 8], (uint32_t) bits);          /* MD4 is little-endian. */
+    store_le32(&block[MD4_BLOCK_BYTES - 4], (uint32_t) (bits >> 32));
+    md4_hash_block(h, block);
+    for (int w = 0; w < 4; ++w) {
+        store_le32(&bin[4*w], h[w]);
+    }
+    return bin;
+}   /* md4_buffer_bin() */
+
+/* ------------------------------------------------------------------------- */
+size_t utf8_to_utf16le(const char* restrict text, size_t size, uint8_t* restrict out) {
+    const uint8_t* s = (const uint8_t*) text;
+    uint8_t* o = out;
+    size_t i = 0;
+    while (i < size) {
+        /*
+         * Fast path: widen runs of ASCII eight bytes at a time.
+         */
+        while ((i + 8 <= size)) {
+            uint64_t v;
+            memcpy(&v, &s[i], sizeof(v));
+            if (0 != (v & 0x8080808080808080ull)) {
+                break;
+            }
+            for (int k = 0; k < 8; ++k) {
+                o[2*k+0] = s[i+k];
+                o[2*k+1] = 0;
+            }
+            o += 16;
+            i += 8;
+        }
+        if (i >= size) {
+            break;
+        }
+        uint32_t cp = s[i];
+        size_t n = 1;
+        if ((cp >= 0xC2) && (cp <= 0xDF)) {
+            n = 2;
+            cp &= 0x1F;
+        } else if ((cp >= 0xE0) && (cp <= 0xEF)) {
+            n = 3;
+            cp &= 0x0F;
+        } else if ((cp >= 0xF0) && (cp <= 0xF4)) {
+            n = 4;
+            cp &= 0x07;
+        }
+        if ((n > 1) && (i + n <= size)) {
+            for (size_t k = 1; k < n; ++k) {
+                if (0x80 != (s[i+k] & 0xC0)) {
+                    n = 1;
+                    break;
+                }
+                cp = (cp << 6) | (s[i+k] & 0x3F);
+            }
+        } else {
+            n = 1;
+        }
+        if (1 == n) {
+            cp = s[i];          /* ASCII or a stray byte taken as Latin-1. */
+        }
+        i += n;
+        if (cp >= 0x10000) {
+            cp -= 0x10000;
+            uint32_t hi = 0xD800 | (cp >> 10);
+            uint32_t lo = 0xDC00 | (cp & 0x3FF);
+            *o++ = hi;
+            *o++ = hi >> 8;
+            *o++ = lo;
+            *o++ = lo >> 8;
+        } else {
+            *o++ = cp;
+            *o++ = cp >> 8;
+        }
+    }
+    return o - out;
+}   /* utf8_to_utf16le() */
+
+/* ------------------------------------------------------------------------- */
+uint8_t* ntlm_hash(const char* password, size_t size, uint8_t* bin) {
+    uint8_t stack_buffer[0x200];
+    uint8_t* wide = (2 * size <= sizeof(stack_buffer)) ? stack_buffer : malloc(2 * size);
+    if (NULL == wide) {
+        return NULL;
+    }
+    md4_buffer_bin(wide, utf8_to_utf16le(password, size, wide), bin);
+    if (wide != stack_buffer) {
+        free(wide);
+    }
+    return bin;
+}   /* ntlm_hash() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Multi-buffer MD4 of single, already padded blocks; see multibuf.h.
+ * Message word i of lane l is at x[i][l]; result word w of lane l goes to
+ * h[w][l].
+ */
+#define MD4_KERNEL(_name, _lanes, _attributes)                          \
+    typedef uint32_t _name##_vec_t __attribute__((vector_size(4 * _lanes))); \
+    static _attributes void _name(const uint32_t x[0x10][_lanes], uint32_t h[4][_lanes]) { \
+        _name##_vec_t X[0x10];                                          \
+        for (int i = 0; i < 0x10; ++i) {                                \
+            memcpy(&X[i], x[i], sizeof(X[i]));                          \
+        }                                                               \
+        _name##_vec_t zero = { 0 };                                     \
+        _name##_vec_t a = zero + MD4_H0;                                \
+        _name##_vec_t b = zero + MD4_H1;                                \
+        _name##_vec_t c = zero + MD4_H2;                                \
+        _name##_vec_t d = zero + MD4_H3;                                \
+        MD4_ROUNDS();                                                   \
+        a += MD4_H0;                                                    \
+        b += MD4_H1;                                                    \
+        c += MD4_H2;                                                    \
+        d += MD4_H3;                                                    \
+        memcpy(h[0], &a, sizeof(a));                                    \
+        memcpy(h[1], &b, sizeof(b));                                    \
+        memcpy(h[2], &c, sizeof(c));                                    \
+        memcpy(h[3], &d, sizeof(d));                                    \
+    }
+
+MD4_KERNEL(md4_kernel_x4, 4, )
+MD4_KERNEL(md4_kernel_x8, 8, MULTIBUF_AVX2)
+
+/* ------------------------------------------------------------------------- */
+const char* md4_kernel_name(void) {
+    return multibuf_kernel_name();
+}   /* md4_kernel_name() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Hash up to NTLM_BATCH_MAX passwords at once with the widest kernel.
+ * Passwords that might not fit in one block are skipped here and left to the
+ * caller.
+ */
+static void ntlm_hash_lanes(const char* const* passwords, const size_t* sizes, size_t n,
+                            uint8_t* bins) {
+    uint32_t x[0x10][MULTIBUF_LANES_MAX];
+    uint32_t h[4][MULTIBUF_LANES_MAX];
+    memset(x, 0, sizeof(x));
+    for (size_t l = 0; l < n; ++l) {
+        uint8_t block[MD4_BLOCK_BYTES] = { 0 };
+        if (2 * sizes[l] > MD4_SINGLE_BLOCK_BYTES) {
+            continue;
+        }
+        size_t wide_size = utf8_to_utf16le(passwords[l], sizes[l], block);
+        block[wide_size] = 0x80;
+        store_le32(&block[MD4_BLOCK_BYTES - 8], (uint32_t) (8 * wide_size));
+        for (int i = 0; i < 0x10; ++i) {
+            x[i][l] = load_le32(&block[4*i]);
+        }
+    }
+    multibuf_run((const uint32_t (*)[MULTIBUF_LANES_MAX]) x, h, 4, n, md4_kernel_x4, md4_kernel_x8);
+    for (size_t l = 0; l < n; ++l) {
+        for (int w = 0; w < 4; ++w) {
+            store_le32(&bins[(l * MD4_BINARY_BYTES) + (4 * w)], h[w][l]);
+        }
+    }
+}   /* ntlm_hash_lanes() */
+
+/* ------------------------------------------------------------------------- */
+void ntlm_hash_batch(const char* const* passwords, const size_t* sizes, size_t n, uint8_t* bins,
+                     uint8_t* hashed) {
+    while (n > 0) {
+        size_t chunk = (n < NTLM_BATCH_MAX) ? n : NTLM_BATCH_MAX;
+        ntlm_hash_lanes(passwords, sizes, chunk, bins);
+        for (size_t l = 0; l < chunk; ++l) {
+            hashed[l] = 1;
+            if (2 * sizes[l] > MD4_SINGLE_BLOCK_BYTES) {
+                /* Might not have fit in one block; redo with the scalar code. */
+                hashed[l] = (NULL != ntlm_hash(passwords[l], sizes[l], &bins[l * MD4_BINARY_BYTES]));
+            }
+        }
+        passwords += chunk;
+        sizes += chunk;
+        bins += chunk * MD4_BINARY_BYTES;
+        hashed += chunk;
+        n -= chunk;
+    }
+}   /* ntlm_hash_batch() */
@@ -0,0 +1,71 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __md4_h__
+#define __md4_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define MD4_BINARY_BYTES    0x10
+#define MD4_BLOCK_BYTES     0x40
+
+/**
+ * Most UTF-16LE bytes that fit with MD4 padding in a single block. Passwords
+ * at or below this size are hashed by the multi-buffer kernel; longer ones
+ * fall back to the scalar code.
+ */
+#define MD4_SINGLE_BLOCK_BYTES  (MD4_BLOCK_BYTES - 9)
+
+/**
+ * Most passwords hashed together by ntlm_hash_batch(); also the lane count
+ * of the widest kernel.
+ */
+#define NTLM_BATCH_MAX      8
+
+/**
+ * MD4 of @a size bytes at @a data, written as MD4_BINARY_BYTES to @a bin.
+ */
+uint8_t* md4_buffer_bin(const void* restrict data, size_t size, uint8_t* restrict bin);
+
+/**
+ * Convert UTF-8 @a text of @a size bytes to UTF-16LE in @a out, which must
+ * hold at least 2 * @a size bytes. Bytes that are not valid UTF-8 are taken
+ * to be Latin-1 characters.
+ *
+ * @return the number of bytes written to @a out.
+ */
+size_t utf8_to_utf16le(const char* restrict text, size_t size, uint8_t* restrict out);
+
+/**
+ * NTLM hash (MD4 of the UTF-16LE encoding) of @a password of @a size bytes.
+ *
+ * @return @a bin, or NULL if @a password is too long for the stack and
+ * there is no memory for its UTF-16LE form.
+ */
+uint8_t* ntlm_hash(const char* password, size_t size, uint8_t* bin);
+
+/**
+ * NTLM hash @a n passwords, writing MD4_BINARY_BYTES per password to
+ * consecutive locations in @a bins and setting @a hashed[i] to 0 if
+ * password i could not be hashed (see ntlm_hash()), 1 otherwise. Any @a n
+ * is accepted; passwords are processed NTLM_BATCH_MAX at a time using the
+ * widest SIMD kernel that the CPU supports.
+ */
+void ntlm_hash_batch(const char* const* passwords, const size_t* sizes, size_t n, uint8_t* bins,
+                     uint8_t* hashed);
+
+/**
+ * Name of the multi-buffer kernel selected for this CPU, e.g. "avx2".
+ */
+const char* md4_kernel_name(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
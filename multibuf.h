@@ -0,0 +1,92 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __multibuf_h__
+#define __multibuf_h__
+
+/*
+ * What the multi-buffer hash kernels in sha1.c and md4.c share. Each file
+ * writes its compression function once with GCC vector extensions and
+ * compiles it for 4 lanes (the baseline, SSE2 on x86-64) and 8 lanes (with
+ * MULTIBUF_AVX2). multibuf_run() feeds a batch of single blocks to the
+ * widest kernel the CPU runs, selected at run time.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * Most messages hashed by one multibuf_run(), and the most result words.
+ */
+#define MULTIBUF_LANES_MAX  8
+#define MULTIBUF_WORDS_MAX  5
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MULTIBUF_HAVE_AVX2  1
+#define MULTIBUF_AVX2       __attribute__((target("avx2")))
+#else
+#define MULTIBUF_HAVE_AVX2  0
+#define MULTIBUF_AVX2
+#endif
+
+/**
+ * Kernels: message word i of lane l is at in[i][l]; result word j of lane l
+ * goes to out[j][l].
+ */
+typedef void (*multibuf_x4_fn)(const uint32_t in[0x10][4], uint32_t out[][4]);
+typedef void (*multibuf_x8_fn)(const uint32_t in[0x10][8], uint32_t out[][8]);
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Name of the widest kernel this CPU runs, e.g. "avx2".
+ */
+static inline const char* multibuf_kernel_name(void) {
+#if MULTIBUF_HAVE_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return "avx2";
+    }
+    return "sse2";
+#else
+    return "generic";
+#endif
+}   /* multibuf_kernel_name() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Hash the @a n (at most MULTIBUF_LANES_MAX) single blocks in @a in, giving
+ * @a words result words per block in @a out, with kernel @a x8 if the CPU
+ * has AVX2 and otherwise with @a x4 on as many groups of 4 as needed.
+ */
+static inline void multibuf_run(const uint32_t in[0x10][MULTIBUF_LANES_MAX],
+                                uint32_t out[][MULTIBUF_LANES_MAX], int words, size_t n,
+                                multibuf_x4_fn x4, multibuf_x8_fn x8) {
+#if MULTIBUF_HAVE_AVX2
+    static int lanes = 0;
+    if (0 == lanes) {
+        lanes = __builtin_cpu_supports("avx2") ? 8 : 4;
+    }
+    if (8 == lanes) {
+        x8(in, out);
+        return;
+    }
+#else
+    (void) x8;
+#endif
+    uint32_t in4[0x10][4];
+    uint32_t out4[MULTIBUF_WORDS_MAX][4];
+    for (int half = 0; half < MULTIBUF_LANES_MAX; half += 4) {
+        for (int i = 0; i < 0x10; ++i) {
+            memcpy(in4[i], &in[i][half], sizeof(in4[i]));
+        }
+        x4((const uint32_t (*)[4]) in4, out4);
+        for (int j = 0; j < words; ++j) {
+            memcpy(&out[j][half], out4[j], sizeof(out4[j]));
+        }
+        if ((size_t) half + 4 >= n) {
+            break;
+        }
+    }
+}   /* multibuf_run() */
+
+#endif
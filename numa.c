@@ -0,0 +1,118 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * NUMA node discovery and thread binding; see numa.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "numa.h"
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Parse a kernel CPU list like "0-3,8-11" into @a node's CPU mask.
+ *
+ * @return 1 on success, 0 if @a text is malformed.
+ */
+static int parse_cpu_list(const char* text, pwned_numa_node_t* node) {
+    const char* p = text;
+    while (('\0' != *p) && ('\n' != *p)) {
+        char* end = NULL;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if ((end == p) || (first < 0)) {
+            return 0;
+        }
+        p = end;
+        if ('-' == *p) {
+            last = strtol(&p[1], &end, 10);
+            if ((end == &p[1]) || (last < first)) {
+                return 0;
+            }
+            p = end;
+        }
+        for (long cpu = first; (cpu <= last) && (cpu < PWNED_NUMA_MAX_CPUS); ++cpu) {
+            node->cpus[cpu / 64] |= 1ull << (cpu % 64);
+            node->cpu_count++;
+        }
+        if (',' == *p) {
+            ++p;
+        }
+    }
+    return 1;
+}   /* parse_cpu_list() */
+
+/* ------------------------------------------------------------------------- */
+static int compare_nodes(const void* a, const void* b) {
+    return ((const pwned_numa_node_t*) a)->id - ((const pwned_numa_node_t*) b)->id;
+}   /* compare_nodes() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_numa_nodes(pwned_numa_node_t* nodes, int max) {
+    int count = 0;
+    DIR* dir = opendir("/sys/devices/system/node");
+    struct dirent* entry;
+    while ((NULL != dir) && (count < max) && (NULL != (entry = readdir(dir)))) {
+        int id;
+        char extra;
+        if (1 != sscanf(entry->d_name, "node%d%c", &id, &extra)) {
+            continue;
+        }
+        char path[0x200];
+        char text[0x1000];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist", entry->d_name);
+        FILE* file = fopen(path, "r");
+        if (NULL == file) {
+            continue;
+        }
+        pwned_numa_node_t* node = &nodes[count];
+        memset(node, 0, sizeof(*node));
+        node->id = id;
+        if ((NULL != fgets(text, sizeof(text), file)) && parse_cpu_list(text, node) &&
+            (node->cpu_count > 0)) {
+            ++count;            /* Memory-only nodes have no threads to serve. */
+        }
+        fclose(file);
+    }
+    if (NULL != dir) {
+        closedir(dir);
+    }
+    if (0 == count) {
+        cpu_set_t set;
+        memset(&nodes[0], 0, sizeof(nodes[0]));
+        if (0 == sched_getaffinity(0, sizeof(set), &set)) {
+            for (int cpu = 0; (cpu < CPU_SETSIZE) && (cpu < PWNED_NUMA_MAX_CPUS); ++cpu) {
+                if (CPU_ISSET(cpu, &set)) {
+                    nodes[0].cpus[cpu / 64] |= 1ull << (cpu % 64);
+                    nodes[0].cpu_count++;
+                }
+            }
+        }
+        return 1;
+    }
+    qsort(nodes, count, sizeof(nodes[0]), compare_nodes);
+    return count;
+}   /* pwned_numa_nodes() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_numa_bind(const pwned_numa_node_t* node) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu = 0; (cpu < CPU_SETSIZE) && (cpu < PWNED_NUMA_MAX_CPUS); ++cpu) {
+        if (node->cpus[cpu / 64] & (1ull << (cpu % 64))) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    if (0 == CPU_COUNT(&set)) {
+        return -1;
+    }
+    return (0 == pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) ? 0 : -1;
+}   /* pwned_numa_bind() */
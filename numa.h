@@ -0,0 +1,48 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __numa_h__
+#define __numa_h__
+
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * NUMA nodes as the kernel reports them in /sys/devices/system/node, with
+ * no need for libnuma. Memory is placed on a node by first touch: a thread
+ * bound to the node's CPUs allocates and fills it.
+ */
+#define PWNED_NUMA_MAX_NODES    64
+#define PWNED_NUMA_MAX_CPUS     1024
+
+typedef struct {
+    int id;                     /**< Kernel node number. */
+    int cpu_count;
+    uint64_t cpus[PWNED_NUMA_MAX_CPUS / 64];        /**< Bit mask of the node's CPUs. */
+} pwned_numa_node_t;
+
+/**
+ * Fill in up to @a max nodes that have CPUs. On a machine without NUMA
+ * information this is one node holding every CPU.
+ *
+ * @return the number of nodes, at least 1.
+ */
+int pwned_numa_nodes(pwned_numa_node_t* nodes, int max);
+
+/**
+ * Bind the calling thread to the CPUs of @a node.
+ *
+ * @return 0 on success, -1 on error.
+ */
+int pwned_numa_bind(const pwned_numa_node_t* node);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,169 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#include <assert.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "options.h"
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Find and return a pointer to the file name portion of @a path.
+ *
+ * @param path - a path whose name is desired. Typically this is argv[0] from
+ * main().
+ *
+ * @return a pointer the first character after the last directory delimiter
+ * (forward or back slash) in @a path, or @a path if none is found.
+ */
+const char* NamePartOfPath(const char* path) {
+    const char* rval = path;
+    if (NULL != path) {
+        for (; 0 != *path; ++path) {
+            if ((('/' == path[0]) || ('\\' == path[0])) &&
+                !((0 == path[1]) || ('/' == path[1]) || ('\\' == path[1]))) {
+                rval = &path[1];
+            }
+        }
+    }
+    return rval;
+}   /* NamePartOfPath() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Look for an option of the form "[-[-]]option[=value]".
+ *
+ * If @a input contains '=' then non-null @a *value_ptr is set to point
+ * to the character after '=' (or is set to NULL if there is no argument).
+ *
+ * @a descriptor may contain ':' characters which indicate abbreviation
+ * points for the option. For example, "o:pt:ion" will match "-o",
+ * "-o=value", "-opt", "-opt=value", "-option" and "-option=value".
+ *
+ * @return 1 if @a input matches @a descriptor, 0 otherwise.
+ */
+int IsOption(const char* input, const char** value_ptr, const char* descriptor) {
+    int rval = 0;
+    int finished = 0;
+    assert(NULL != input);
+    assert(NULL != descriptor);
+    if ('-' == *input) {
+        ++input;
+        if ('-' == *input) {
+            ++input;
+        }
+    } else {
+        finished = 1;
+    }
+    while (!finished) {
+        if ((0 == *input) || ('=' == *input)) {
+            finished = 1;
+            rval = (0 == *descriptor) || (':' == *descriptor);
+        } else if ((0 == *descriptor) || ((':' != *descriptor) && (*input != *descriptor))) {
+            finished = 1;
+        } else {
+            if (':' != *descriptor) {
+                ++input;
+            }
+            ++descriptor;
+        }
+    }
+    if (NULL != value_ptr) {
+        *value_ptr = (rval && ('=' == *input)) ? (input + 1) : NULL;
+    }
+    return rval;
+}   /* IsOption() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Look for flag option of the form "-[-][no-]option".
+ *
+ * @a descriptor may contain ':' characters which indicate abbreviation
+ * points for the option. See IsOption() for more information.
+ *
+ * If @a input matches the descriptor then the value of @a *flag_value_ptr (if
+ * not NULL) will be set to 1. If @a input matches the descriptor with "no-"
+ * prefixed then @a *flag_value_ptr will be set to 0. If @a input does not
+ * match @a descriptor, @a *flag_value_ptr is not modified.
+ *
+ * @return 1 if @a input matches @a descriptor with or without a "no-" prefix,
+ * 0 otherwise.
+ */
+int IsFlagOption(const char* input, int* flag_value_ptr, const char* descriptor) {
+    int flag_value = 1;
+    int rval = 0;
+    assert(NULL != input);
+    assert(NULL != descriptor);
+    if ('-' == *input) {
+        rval = IsOption(input, NULL, descriptor);
+        if (!rval) {
+            flag_value = 0;
+            const int k = ('-' == input[1]) ? 1 : 0;
+            if (('n' == input[k+1]) && ('o' == input[k+2]) && ('-' == input[k+3])) {
+                rval = IsOption(&input[k+3], NULL, descriptor);
+            }
+        }
+    }
+    if (rval && (NULL != flag_value_ptr)) {
+        *flag_value_ptr = flag_value;
+    }
+    return rval;
+}   /* IsFlagOption() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Parse a size such as "512M" into @a *size. A suffix of K, M, G or T
+ * (either case, with an optional trailing 'B') multiplies by 1024, 1024^2,
+ * and so on.
+ *
+ * @return 1 if @a text is a valid size, 0 otherwise.
+ */
+int ParseSize(const char* text, uint64_t* size) {
+    uint64_t value = 0;
+    int digits = 0;
+    if (NULL == text) {
+        return 0;
+    }
+    for (; ('0' <= *text) && (*text <= '9'); ++text, ++digits) {
+        value = (10 * value) + (*text - '0');
+    }
+    if (0 == digits) {
+        return 0;
+    }
+    switch (*text) {
+    case 'T': case 't': value <<= 10;   /* Fall through. */
+    case 'G': case 'g': value <<= 10;   /* Fall through. */
+    case 'M': case 'm': value <<= 10;   /* Fall through. */
+    case 'K': case 'k': value <<= 10;
+        ++text;
+        break;
+    default:
+        break;
+    }
+    if (('B' == *text) || ('b' == *text)) {
+        ++text;
+    }
+    if (0 != *text) {
+        return 0;
+    }
+    *size = value;
+    return 1;
+}   /* ParseSize() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Print "program: message" to stderr, formatting the message from @a format
+ * like printf(), and exit with code 2.
+ */
+void Fail(const char* format, ...) {
+    va_list va;
+    va_start(va, format);
+    fprintf(stderr, "%s: ", g_program);
+    vfprintf(stderr, format, va);
+    fprintf(stderr, "\n");
+    va_end(va);
+    exit(2);
+}   /* Fail() */
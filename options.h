@@ -0,0 +1,33 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __options_h__
+#define __options_h__
+
+/*
+ * Command line helpers shared by the programs in this directory. See
+ * options.c for details.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Name of the running program for messages, defined by each program.
+ */
+extern const char* g_program;
+
+const char* NamePartOfPath(const char* path);
+int IsOption(const char* input, const char** value_ptr, const char* descriptor);
+int IsFlagOption(const char* input, int* flag_value_ptr, const char* descriptor);
+int ParseSize(const char* text, uint64_t* size);
+void Fail(const char* format, ...) __attribute__((noreturn, format(printf, 1, 2)));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
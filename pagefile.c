@@ -0,0 +1,236 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Page files; see pagefile.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pagefile.h"
+
+/**
+ * Fraction of main page slots the builder aims to fill. Records per page
+ * are roughly Poisson, so at 75% of 170 SHA1 slots a page overflows about
+ * once in a thousand pages.
+ */
+#define kPageLoad 0.75
+
+/**
+ * Main pages written per write() while building.
+ */
+#define kBuildPages 0x100
+
+/* ------------------------------------------------------------------------- */
+int pwned_is_page_file(const char* path) {
+    char magic[sizeof(PWNED_PAGES_MAGIC) - 1];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+    return (sizeof(magic) == n) && (0 == memcmp(magic, PWNED_PAGES_MAGIC, sizeof(magic)));
+}   /* pwned_is_page_file() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_pages_open(pwned_pages_t* pages, const char* path, pwned_key_type_t type) {
+    memset(pages, 0, sizeof(*pages));
+    pages->fd = open(path, O_RDONLY);
+    if (pages->fd < 0) {
+        return PWNED_DB_ERR_OPEN;
+    }
+    pwned_pages_header_t* header = &pages->header;
+    off_t size = lseek(pages->fd, 0, SEEK_END);
+    if (size < 0) {
+        pwned_pages_close(pages);
+        return PWNED_DB_ERR_SEEK;
+    }
+    pages->key_bytes = pwned_key_bytes(type);
+    if ((sizeof(*header) != pread(pages->fd, header, sizeof(*header), 0)) ||
+        (0 != memcmp(header->magic, PWNED_PAGES_MAGIC, sizeof(header->magic))) ||
+        (header->key_type != (uint32_t) type) ||
+        (header->record_bytes != pages->key_bytes + PWNED_COUNT_BYTES) ||
+        (header->page_bytes != PWNED_PAGE_BYTES) || (0 == header->pages) ||
+        ((uint64_t) size != (1 + header->pages + header->overflow_pages) * PWNED_PAGE_BYTES)) {
+        pwned_pages_close(pages);
+        return PWNED_DB_ERR_SIZE;
+    }
+
+    /*
+     * Lookups are random single-page reads; read-ahead would only turn each
+     * one into several.
+     */
+    posix_fadvise(pages->fd, 0, 0, POSIX_FADV_RANDOM);
+    return PWNED_DB_OK;
+}   /* pwned_pages_open() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_pages_close(pwned_pages_t* pages) {
+    if (pages->fd >= 0) {
+        close(pages->fd);
+    }
+    pages->fd = -1;
+}   /* pwned_pages_close() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_pages_find(const pwned_pages_t* pages, const uint8_t* key, uint64_t* count) {
+    uint8_t page[PWNED_PAGE_BYTES] __attribute__((aligned(PWNED_PAGE_BYTES)));
+    const uint32_t key_bytes = pages->key_bytes;
+    const uint32_t record_bytes = pages->header.record_bytes;
+    uint64_t number = pwned_page_of(key, pages->header.pages);
+    *count = 0;
+    while (0 != number) {
+        if (PWNED_PAGE_BYTES != pread(pages->fd, page, PWNED_PAGE_BYTES, number * PWNED_PAGE_BYTES)) {
+            return 0;
+        }
+        pwned_page_header_t header;
+        memcpy(&header, page, sizeof(header));
+        const uint8_t* records = &page[sizeof(header)];
+
+        /*
+         * The page is in L1 now, so a binary search of its ~170 sorted
+         * records costs next to nothing next to the read.
+         */
+        uint32_t lo = 0;
+        uint32_t hi = header.count;
+        while (lo < hi) {
+            uint32_t mid = lo + ((hi - lo) / 2);
+            const uint8_t* record = &records[mid * record_bytes];
+            int cmp = pwned_key_cmp(key, record, key_bytes);
+            if (0 == cmp) {
+                uint32_t n;
+                memcpy(&n, &record[key_bytes], sizeof(n));
+                *count = n;
+                return (n > 0);
+            }
+            if (cmp < 0) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+
+        /*
+         * Overflow pages hold the largest keys of the page they extend, so
+         * there is no need to follow the chain for a key below the last one.
+         */
+        if ((header.count > 0) &&
+            (pwned_key_cmp(key, &records[(header.count - 1) * record_bytes], key_bytes) < 0)) {
+            return 0;
+        }
+        number = header.next;
+    }
+    return 0;
+}   /* pwned_pages_find() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Fill @a page with @a n records at @a records and chain it to @a next.
+ */
+static void fill_page(uint8_t* page, const uint8_t* records, uint32_t n, uint32_t record_bytes,
+                      uint32_t next) {
+    pwned_page_header_t header = { (uint16_t) n, 0, next };
+    memset(page, 0, PWNED_PAGE_BYTES);
+    memcpy(page, &header, sizeof(header));
+    memcpy(&page[sizeof(header)], records, (size_t) n * record_bytes);
+}   /* fill_page() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_pages_build(const pwned_db_t* db, int fd, pwned_pages_header_t* header) {
+    const uint32_t record_bytes = db->record_bytes;
+    const uint32_t capacity = PWNED_PAGE_RECORDS(record_bytes);
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, PWNED_PAGES_MAGIC, sizeof(header->magic));
+    header->key_type = db->type;
+    header->record_bytes = record_bytes;
+    header->page_bytes = PWNED_PAGE_BYTES;
+    header->pages = (uint64_t) (db->records / (kPageLoad * capacity)) + 1;
+    header->records = db->records;
+
+    /*
+     * Records that do not fit in their main page are collected in order and
+     * written as overflow pages at the end. Each overflowing page's chain
+     * start is known when the page is written since chains are allocated in
+     * page order.
+     */
+    uint8_t* buffer = (uint8_t*) malloc(kBuildPages * PWNED_PAGE_BYTES);
+    uint8_t* spill = NULL;
+    uint64_t spill_records = 0;
+    uint64_t spill_capacity = 0;
+    if (NULL == buffer) {
+        return -1;
+    }
+    int err = 0;
+    uint64_t i = 0;
+    uint64_t buffered = 0;
+    uint64_t first_buffered = 1;
+    for (uint64_t p = 1; (0 == err) && (p <= header->pages); ++p) {
+        uint64_t j = i;
+        while ((j < db->records) && (pwned_page_of(pwned_db_record(db, j), header->pages) == p)) {
+            ++j;
+        }
+        uint64_t n = j - i;
+        uint32_t next = 0;
+        if (n > capacity) {
+            uint64_t extra = n - capacity;
+            next = (uint32_t) (1 + header->pages + header->overflow_pages);
+            header->overflow_pages += (extra + capacity - 1) / capacity;
+            if (spill_records + extra > spill_capacity) {
+                spill_capacity = 2 * (spill_records + extra);
+                uint8_t* bigger = (uint8_t*) realloc(spill, spill_capacity * record_bytes);
+                if (NULL == bigger) {
+                    err = -1;
+                    break;
+                }
+                spill = bigger;
+            }
+            memcpy(&spill[spill_records * record_bytes], pwned_db_record(db, i + capacity),
+                   extra * record_bytes);
+            spill_records += extra;
+            n = capacity;
+        }
+        fill_page(&buffer[buffered * PWNED_PAGE_BYTES], pwned_db_record(db, i), (uint32_t) n,
+                  record_bytes, next);
+        i = j;
+        if ((++buffered == kBuildPages) || (p == header->pages)) {
+            err = pwned_write_all_at(fd, buffer, buffered * PWNED_PAGE_BYTES,
+                               first_buffered * PWNED_PAGE_BYTES);
+            first_buffered += buffered;
+            buffered = 0;
+        }
+    }
+
+    /*
+     * Overflow pages, in the same order the chains were allocated. Each
+     * chain's last page is recognized by the main page it belongs to.
+     */
+    uint64_t number = 1 + header->pages;
+    for (uint64_t k = 0; (0 == err) && (k < spill_records); ++number) {
+        const uint8_t* first = &spill[k * record_bytes];
+        uint64_t owner = pwned_page_of(first, header->pages);
+        uint64_t n = 0;
+        while ((k + n < spill_records) && (n < capacity) &&
+               (pwned_page_of(&spill[(k + n) * record_bytes], header->pages) == owner)) {
+            ++n;
+        }
+        int more = (k + n < spill_records) &&
+            (pwned_page_of(&spill[(k + n) * record_bytes], header->pages) == owner);
+        fill_page(buffer, first, (uint32_t) n, record_bytes, more ? (uint32_t) (number + 1) : 0);
+        err = pwned_write_all_at(fd, buffer, PWNED_PAGE_BYTES, number * PWNED_PAGE_BYTES);
+        k += n;
+    }
+    if (0 == err) {
+        memset(buffer, 0, PWNED_PAGE_BYTES);
+        memcpy(buffer, header, sizeof(*header));
+        err = pwned_write_all_at(fd, buffer, PWNED_PAGE_BYTES, 0);
+    }
+    free(spill);
+    free(buffer);
+    return err;
+}   /* pwned_pages_build() */
@@ -0,0 +1,111 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __pagefile_h__
+#define __pagefile_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A page file holds the same records as a hash file, hashed by their leading
+ * key bits into fixed PWNED_PAGE_BYTES pages so that a lookup reads one page
+ * from disk instead of the ~log2(n) scattered reads of a binary search.
+ *
+ * Page 0 is a pwned_pages_header_t. Pages 1 through header.pages are the
+ * main pages: a key whose first 64 bits are h belongs in main page
+ * 1 + (h * pages) / 2^64. Since that is monotonic in the key, the main pages
+ * are in key order and are built in one sequential pass over a sorted hash
+ * file. The builder sizes the file for about 75% occupancy, so only the rare
+ * page that gets more than its share of records spills into a chain of
+ * overflow pages after the main pages.
+ *
+ * Each page starts with a pwned_page_header_t followed by its records,
+ * sorted by key, in the hash file record layout (see pwned_db.h). All
+ * integers are little-endian.
+ */
+#define PWNED_PAGE_BYTES        0x1000
+#define PWNED_PAGES_MAGIC       "PWNPAGE1"
+
+typedef struct {
+    char magic[8];              /**< PWNED_PAGES_MAGIC, not NUL-terminated. */
+    uint32_t key_type;          /**< pwned_key_type_t of the keys. */
+    uint32_t record_bytes;
+    uint32_t page_bytes;        /**< PWNED_PAGE_BYTES. */
+    uint32_t reserved;
+    uint64_t pages;             /**< Number of main pages. */
+    uint64_t overflow_pages;
+    uint64_t records;
+} pwned_pages_header_t;
+
+typedef struct {
+    uint16_t count;             /**< Records in this page. */
+    uint16_t reserved;
+    uint32_t next;              /**< Next overflow page in the chain, or 0. */
+} pwned_page_header_t;
+
+/**
+ * Records that fit in one page.
+ */
+#define PWNED_PAGE_RECORDS(_record_bytes) \
+    ((PWNED_PAGE_BYTES - sizeof(pwned_page_header_t)) / (_record_bytes))
+
+/**
+ * An open page file.
+ */
+typedef struct {
+    pwned_pages_header_t header;
+    uint32_t key_bytes;
+    int fd;
+} pwned_pages_t;
+
+/**
+ * @return 1 if the file at @a path starts with a page file header, 0 if not
+ * (including when it cannot be read).
+ */
+int pwned_is_page_file(const char* path);
+
+/**
+ * Open page file @a path, which must hold keys of @a type.
+ *
+ * @return PWNED_DB_OK on success, otherwise one of the PWNED_DB_ERR_xxx
+ * codes from pwned_db.h (PWNED_DB_ERR_SIZE for a bad header).
+ */
+int pwned_pages_open(pwned_pages_t* pages, const char* path, pwned_key_type_t type);
+
+void pwned_pages_close(pwned_pages_t* pages);
+
+/**
+ * Look up @a key, reading its main page (plus any overflow pages) with
+ * pread(), and set @a *count to its occurrence count.
+ *
+ * @return 1 if found with a non-zero count, 0 otherwise.
+ */
+int pwned_pages_find(const pwned_pages_t* pages, const uint8_t* key, uint64_t* count);
+
+/**
+ * Main page of @a key in a file with @a pages main pages.
+ */
+static inline uint64_t pwned_page_of(const uint8_t* key, uint64_t pages) {
+    return 1 + (uint64_t) (((unsigned __int128) pwned_load_be64(key) * pages) >> 64);
+}
+
+/**
+ * Write hash file @a db as a page file to @a fd, which must be seekable,
+ * and fill in @a header with what was written.
+ *
+ * @return 0 on success, -1 on a write error or if out of memory.
+ */
+int pwned_pages_build(const pwned_db_t* db, int fd, pwned_pages_header_t* header);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
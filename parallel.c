@@ -0,0 +1,158 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "pwned_db.h"
+
+/**
+ * Arguments handed to each thread started by pwned_parallel().
+ */
+typedef struct {
+    pwned_work_fn fn;
+    void* arg;
+    int index;
+    int threads;
+} parallel_task_t;
+
+/* ------------------------------------------------------------------------- */
+int pwned_cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int) n : 1;
+}   /* pwned_cpu_count() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_thread_count(int requested) {
+    return (requested > 0) ? requested : pwned_cpu_count();
+}   /* pwned_thread_count() */
+
+/* ------------------------------------------------------------------------- */
+double pwned_seconds(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + (now.tv_nsec / 1e9);
+}   /* pwned_seconds() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_compare_doubles(const void* a, const void* b) {
+    double x = *(const double*) a;
+    double y = *(const double*) b;
+    return (x < y) ? -1 : (x > y) ? 1 : 0;
+}   /* pwned_compare_doubles() */
+
+/* ------------------------------------------------------------------------- */
+static void* parallel_thread(void* arg) {
+    parallel_task_t* task = (parallel_task_t*) arg;
+    task->fn(task->arg, task->index, task->threads);
+    return NULL;
+}   /* parallel_thread() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_parallel(int threads, pwned_work_fn fn, void* arg) {
+    if (threads <= 1) {
+        fn(arg, 0, 1);
+        return;
+    }
+    pthread_t* ids = (pthread_t*) calloc(threads, sizeof(pthread_t));
+    parallel_task_t* tasks = (parallel_task_t*) calloc(threads, sizeof(parallel_task_t));
+    int* started = (int*) calloc(threads, sizeof(int));
+    if ((NULL == ids) || (NULL == tasks) || (NULL == started)) {
+        for (int i = 0; i < threads; ++i) {
+            fn(arg, i, threads);
+        }
+    } else {
+        for (int i = 0; i < threads; ++i) {
+            tasks[i].fn = fn;
+            tasks[i].arg = arg;
+            tasks[i].index = i;
+            tasks[i].threads = threads;
+        }
+        for (int i = 1; i < threads; ++i) {
+            started[i] = (0 == pthread_create(&ids[i], NULL, parallel_thread, &tasks[i]));
+        }
+        fn(arg, 0, threads);
+        for (int i = 1; i < threads; ++i) {
+            if (started[i]) {
+                pthread_join(ids[i], NULL);
+            } else {
+                fn(arg, i, threads);
+            }
+        }
+    }
+    free(ids);
+    free(tasks);
+    free(started);
+}   /* pwned_parallel() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_ordered_init(pwned_ordered_t* out, int fd, int chunks) {
+    pthread_mutex_init(&out->lock, NULL);
+    pthread_cond_init(&out->turn_done, NULL);
+    out->fd = fd;
+    out->chunks = chunks;
+    out->next_chunk = 0;
+    out->next_turn = 0;
+    struct stat st;
+    int flags = fcntl(fd, F_GETFL);
+    off_t start = lseek(fd, 0, SEEK_CUR);
+    out->seekable = (0 == fstat(fd, &st)) && S_ISREG(st.st_mode) && (flags >= 0) &&
+        (0 == (flags & O_APPEND)) && (start >= 0);
+    out->offset = out->seekable ? (uint64_t) start : 0;
+}   /* pwned_ordered_init() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_ordered_destroy(pwned_ordered_t* out) {
+    if (out->seekable) {
+        lseek(out->fd, out->offset, SEEK_SET);
+    }
+    pthread_cond_destroy(&out->turn_done);
+    pthread_mutex_destroy(&out->lock);
+}   /* pwned_ordered_destroy() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_ordered_claim(pwned_ordered_t* out) {
+    pthread_mutex_lock(&out->lock);
+    int chunk = (out->next_chunk < out->chunks) ? out->next_chunk++ : -1;
+    pthread_mutex_unlock(&out->lock);
+    return chunk;
+}   /* pwned_ordered_claim() */
+
+/* ------------------------------------------------------------------------- */
+static int ordered_write_all(pwned_ordered_t* out, const uint8_t* p, size_t size, uint64_t offset) {
+    return out->seekable ? pwned_write_all_at(out->fd, p, size, offset) :
+        pwned_write_all(out->fd, p, size);
+}   /* ordered_write_all() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_ordered_write(pwned_ordered_t* out, int chunk, const void* data, size_t size) {
+    pthread_mutex_lock(&out->lock);
+    while (out->next_turn != chunk) {
+        pthread_cond_wait(&out->turn_done, &out->lock);
+    }
+    uint64_t offset = out->offset;
+    out->offset += size;
+    int result = 0;
+    if (out->seekable) {
+        out->next_turn++;
+        pthread_cond_broadcast(&out->turn_done);
+        pthread_mutex_unlock(&out->lock);
+        result = ordered_write_all(out, (const uint8_t*) data, size, offset);
+    } else {
+        /* Keep the turn, but not the lock, until the data is out. */
+        pthread_mutex_unlock(&out->lock);
+        result = ordered_write_all(out, (const uint8_t*) data, size, offset);
+        pthread_mutex_lock(&out->lock);
+        out->next_turn++;
+        pthread_cond_broadcast(&out->turn_done);
+        pthread_mutex_unlock(&out->lock);
+    }
+    return result;
+}   /* pwned_ordered_write() */
@@ -0,0 +1,110 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __parallel_h__
+#define __parallel_h__
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Work function run by pwned_parallel(). @a index runs from 0 to
+ * @a threads - 1.
+ */
+typedef void (*pwned_work_fn)(void* arg, int index, int threads);
+
+/**
+ * Number of online CPUs, at least 1.
+ */
+int pwned_cpu_count(void);
+
+/**
+ * Resolve a thread count option: 0 means one per online CPU.
+ */
+int pwned_thread_count(int requested);
+
+/**
+ * Run @a fn on @a threads threads and wait for all of them to finish. The
+ * calling thread runs index 0. If a thread cannot be created its share is
+ * run by the calling thread, so all indices always run.
+ */
+void pwned_parallel(int threads, pwned_work_fn fn, void* arg);
+
+/**
+ * Monotonic clock in seconds, for reporting how long work took.
+ */
+double pwned_seconds(void);
+
+/**
+ * qsort() comparison of doubles, for taking percentiles of timings.
+ */
+int pwned_compare_doubles(const void* a, const void* b);
+
+/**
+ * First element of part @a index when @a n elements are split into
+ * @a parts nearly equal contiguous parts.
+ */
+static inline uint64_t pwned_part_start(uint64_t n, int index, int parts) {
+    return (uint64_t) (((unsigned __int128) n * index) / parts);
+}
+
+/**
+ * Next value of a splitmix64 generator at @a state; a fixed seed gives the
+ * same values on every run.
+ */
+static inline uint64_t pwned_splitmix64(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Output assembled from chunks that are produced on several threads but must
+ * appear in chunk order. Threads claim chunk numbers with
+ * pwned_ordered_claim(), build each chunk privately, then hand it to
+ * pwned_ordered_write(). Only the offset hand-off is serialized: when the
+ * output is a seekable regular file the data is written with pwrite()
+ * outside the lock, otherwise (a pipe, a terminal, or a file opened for
+ * appending, where pwrite() ignores the offset) chunks are written in turn.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t turn_done;
+    int fd;
+    int seekable;               /**< Whether chunks go out with pwrite(). */
+    int chunks;                 /**< Total number of chunks. */
+    int next_chunk;             /**< Next chunk to claim. */
+    int next_turn;              /**< Chunk whose turn it is to be placed. */
+    uint64_t offset;            /**< Output offset for chunk next_turn. */
+} pwned_ordered_t;
+
+void pwned_ordered_init(pwned_ordered_t* out, int fd, int chunks);
+void pwned_ordered_destroy(pwned_ordered_t* out);
+
+/**
+ * Claim the next chunk to produce.
+ *
+ * @return the chunk number, or -1 if all chunks have been claimed.
+ */
+int pwned_ordered_claim(pwned_ordered_t* out);
+
+/**
+ * Write @a size bytes at @a data as chunk @a chunk, waiting for all earlier
+ * chunks to be placed first. Every claimed chunk must be written, even if
+ * @a size is 0, or later chunks will wait forever.
+ *
+ * @return 0 on success, -1 on a write error (with errno set).
+ */
+int pwned_ordered_write(pwned_ordered_t* out, int chunk, const void* data, size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,141 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Per-phase hardware performance counters; see perfctr.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <linux/perf_event.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "perfctr.h"
+
+#define CACHE_READ_MISS(_cache) \
+    ((_cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+/**
+ * The events behind each pwned_perf_counter_t, and their column headings.
+ */
+static const struct {
+    uint32_t type;
+    uint64_t config;
+    const char* name;
+} kEvents[PWNED_PERF_COUNTERS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,          "cycles" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,        "instr" },
+    { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_LL),   "LLC-miss" },
+    { PERF_TYPE_HW_CACHE, CACHE_READ_MISS(PERF_COUNT_HW_CACHE_DTLB), "dTLB-miss" },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,       "br-miss" },
+};
+
+static const char* const kPhaseNames[PWNED_PHASES] = { "parse", "hash", "search", "output" };
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Read counter @a fd, scaled up for the time it was not running when the
+ * PMU had more events than counters.
+ */
+static uint64_t read_counter(int fd) {
+    uint64_t values[3];         /* value, time enabled, time running */
+    if ((fd < 0) || (sizeof(values) != read(fd, values, sizeof(values))) || (0 == values[2])) {
+        return 0;
+    }
+    if (values[2] < values[1]) {
+        return (uint64_t) ((double) values[0] * values[1] / values[2]);
+    }
+    return values[0];
+}   /* read_counter() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_perf_open(pwned_perf_t* perf) {
+    memset(perf, 0, sizeof(*perf));
+    perf->phase = PWNED_PHASE_NONE;
+    for (int c = 0; c < PWNED_PERF_COUNTERS; ++c) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = kEvents[c].type;
+        attr.config = kEvents[c].config;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        perf->fds[c] = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+        if (perf->fds[c] >= 0) {
+            perf->available++;
+        }
+    }
+    return perf->available;
+}   /* pwned_perf_open() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_perf_close(pwned_perf_t* perf) {
+    for (int c = 0; c < PWNED_PERF_COUNTERS; ++c) {
+        if (perf->fds[c] >= 0) {
+            close(perf->fds[c]);
+            perf->fds[c] = -1;
+        }
+    }
+    perf->available = 0;
+}   /* pwned_perf_close() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_perf_phase(pwned_perf_t* perf, pwned_perf_phase_t phase) {
+    uint64_t now[PWNED_PERF_COUNTERS];
+    double seconds = pwned_seconds();
+    for (int c = 0; c < PWNED_PERF_COUNTERS; ++c) {
+        now[c] = read_counter(perf->fds[c]);
+    }
+    if (PWNED_PHASE_NONE != perf->phase) {
+        perf->seconds[perf->phase] += seconds - perf->started;
+        for (int c = 0; c < PWNED_PERF_COUNTERS; ++c) {
+            perf->totals[perf->phase][c] += now[c] - perf->last[c];
+        }
+    }
+    perf->phase = phase;
+    perf->started = seconds;
+    memcpy(perf->last, now, sizeof(now));
+}   /* pwned_perf_phase() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_perf_report(const pwned_perf_t* perf, FILE* file, uint64_t lookups) {
+    const double n = (lookups > 0) ? (double) lookups : 1.0;
+    fprintf(file, "  %-8s %10s", "phase", "ns");
+    for (int c = 0; c < PWNED_PERF_COUNTERS; ++c) {
+        fprintf(file, " %10s", kEvents[c].name);
+    }
+    fprintf(file, " %6s\n", "IPC");
+    for (int p = 0; p <= PWNED_PHASES; ++p) {
+        double seconds = 0;
+        uint64_t totals[PWNED_PERF_COUNTERS] = { 0 };
+        for (int q = 0; q < PWNED_PHASES; ++q) {
+            if ((p == q) || (PWNED_PHASES == p)) {
+                seconds += perf->seconds[q];
+                for (int c = 0; c < PWNED_PERF_COUNTERS; ++c) {
+                    totals[c] += perf->totals[q][c];
+                }
+            }
+        }
+        if ((p < PWNED_PHASES) && (0 == seconds)) {
+            continue;                   /* e.g. no hashing when looking up hashes. */
+        }
+        fprintf(file, "  %-8s %10.1f", (p < PWNED_PHASES) ? kPhaseNames[p] : "total", 1e9 * seconds / n);
+        for (int c = 0; c < PWNED_PERF_COUNTERS; ++c) {
+            if (perf->fds[c] >= 0) {
+                fprintf(file, " %10.2f", totals[c] / n);
+            } else {
+                fprintf(file, " %10s", "-");
+            }
+        }
+        if ((perf->fds[PWNED_PERF_CYCLES] >= 0) && (perf->fds[PWNED_PERF_INSTRUCTIONS] >= 0) &&
+            (totals[PWNED_PERF_CYCLES] > 0)) {
+            fprintf(file, " %6.2f\n", (double) totals[PWNED_PERF_INSTRUCTIONS] / totals[PWNED_PERF_CYCLES]);
+        } else {
+            fprintf(file, " %6s\n", "-");
+        }
+    }
+}   /* pwned_perf_report() */
@@ -0,0 +1,77 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __perfctr_h__
+#define __perfctr_h__
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Hardware performance counters (perf_event_open(2)) for the calling
+ * thread, charged to the phase of a lookup that was running when they
+ * counted. Only user-space events are counted, which needs no privileges
+ * with the default perf_event_paranoid. A counter the CPU, the hypervisor or
+ * the kernel settings do not allow is left out, and with none at all only
+ * the time in each phase is kept.
+ */
+typedef enum {
+    PWNED_PERF_CYCLES,
+    PWNED_PERF_INSTRUCTIONS,
+    PWNED_PERF_LLC_MISSES,
+    PWNED_PERF_DTLB_MISSES,
+    PWNED_PERF_BRANCH_MISSES,
+    PWNED_PERF_COUNTERS
+} pwned_perf_counter_t;
+
+typedef enum {
+    PWNED_PHASE_PARSE,          /**< Reading hex hashes. */
+    PWNED_PHASE_HASH,           /**< Hashing passwords. */
+    PWNED_PHASE_SEARCH,         /**< find_hash(). */
+    PWNED_PHASE_OUTPUT,         /**< Formatting and writing results. */
+    PWNED_PHASES,
+    PWNED_PHASE_NONE = -1
+} pwned_perf_phase_t;
+
+typedef struct {
+    int fds[PWNED_PERF_COUNTERS];       /**< Counter file descriptors, or -1. */
+    int available;                      /**< Number of counters opened. */
+    int phase;                          /**< Phase being counted, or PWNED_PHASE_NONE. */
+    double started;                     /**< When @a phase started. */
+    uint64_t last[PWNED_PERF_COUNTERS]; /**< Counter values when @a phase started. */
+    uint64_t totals[PWNED_PHASES][PWNED_PERF_COUNTERS];
+    double seconds[PWNED_PHASES];
+} pwned_perf_t;
+
+/**
+ * Open and start the counters.
+ *
+ * @return the number of counters available, 0 if there are none.
+ */
+int pwned_perf_open(pwned_perf_t* perf);
+
+void pwned_perf_close(pwned_perf_t* perf);
+
+/**
+ * Charge what was counted since the last call to the phase that was
+ * running, and start counting for @a phase (PWNED_PHASE_NONE to stop).
+ * Each call reads every counter, so switch phases once per batch of
+ * lookups rather than once per lookup.
+ */
+void pwned_perf_phase(pwned_perf_t* perf, pwned_perf_phase_t phase);
+
+/**
+ * Print the time and counts per lookup in each phase to @a file, for
+ * @a lookups lookups.
+ */
+void pwned_perf_report(const pwned_perf_t* perf, FILE* file, uint64_t lookups);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,76 @@
+#!/bin/bash
+
+# (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt.
+# You are free to do whatever you want with this software. Have at it!
+
+# Training workload for 'make pgo'. Runs the instrumented programs in this
+# directory over a synthetic hash list so that gcc sees which paths are hot:
+# converting unsorted and NTLM lists with pwned2bin, hash and password
+# lookups (hits and misses, SHA1 and NTLM) with the main engines, -join,
+# bin2pwned, and lookups in page and filter files. Everything is written to
+# a scratch directory (first argument, default pgo-train) that is removed
+# at the end. PGO_RECORDS sets the size of the list.
+
+set -e
+
+dir=${1:-pgo-train}
+records=${PGO_RECORDS:-200000}
+passwords=$((records / 10))
+
+# Run a lookup, which exits with 1 when anything is not found.
+lookup() {
+    "$@" > /dev/null || [ $? -eq 1 ]
+}
+
+# Print $1 random HASH:count lines of $2 hex digits each.
+random_hashes() {
+    awk -v n="$1" -v digits="$2" -v seed="$3" 'BEGIN {
+        srand(seed);
+        for (i = 0; i < n; ++i) {
+            h = "";
+            for (j = 0; j < digits; j += 4) h = h sprintf("%04X", int(rand() * 65536));
+            printf "%s:%d\n", h, 1 + int(rand() * rand() * 1000);
+        }
+    }'
+}
+
+rm -rf "$dir"
+mkdir -p "$dir"
+random_hashes "$records" 40 1 > "$dir/sha1.txt"
+random_hashes "$records" 32 2 > "$dir/ntlm.txt"
+awk -v n="$passwords" 'BEGIN { for (i = 0; i < n; ++i) printf "pass%dword\n", (i * 7919) % 100003 }' \
+    > "$dir/passwords.txt"
+
+# Put the hashes of half the passwords in each list so that password
+# lookups find some, then convert with a small -memory to sort in runs.
+./pwned2bin < "$dir/sha1.txt" > "$dir/seed.bin"
+head -n $((passwords / 2)) "$dir/passwords.txt" > "$dir/half.txt"
+./find-pwned -f="$dir/seed.bin" -p -ph -pc -pnf -no-pf < "$dir/half.txt" | sed 's/:0$/:42/' \
+    >> "$dir/sha1.txt"
+./pwned2bin -memory=1M < "$dir/sha1.txt" > "$dir/sha1.bin"
+./pwned2bin -ntlm < "$dir/ntlm.txt" > "$dir/seed-ntlm.bin"
+./find-pwned -ntlm -f="$dir/seed-ntlm.bin" -p -ph -pc -pnf -no-pf < "$dir/half.txt" | sed 's/:0$/:42/' \
+    >> "$dir/ntlm.txt"
+./pwned2bin -ntlm -memory=1M < "$dir/ntlm.txt" > "$dir/ntlm.bin"
+
+# Hashes to look up: every other one in the list, and as many misses.
+(awk -F: 'NR % 2 == 0 { print $1 }' "$dir/sha1.txt"; random_hashes $((records / 2)) 40 3 | cut -d: -f1) \
+    > "$dir/hashes.txt"
+(awk -F: 'NR % 2 == 0 { print $1 }' "$dir/ntlm.txt"; random_hashes $((records / 2)) 32 4 | cut -d: -f1) \
+    > "$dir/ntlm-hashes.txt"
+
+lookup ./find-pwned -f="$dir/sha1.bin" -pc -ph < "$dir/hashes.txt"
+lookup ./find-pwned -f="$dir/sha1.bin" -p -pp < "$dir/passwords.txt"
+lookup ./find-pwned -f="$dir/sha1.bin" -engine=cuckoo < "$dir/hashes.txt"
+lookup ./find-pwned -f="$dir/sha1.bin" -auto -quiet < "$dir/hashes.txt"
+lookup ./find-pwned -f="$dir/sha1.bin" -engine=soa-interpolation-mmap < "$dir/hashes.txt"
+lookup ./find-pwned -ntlm -f="$dir/ntlm.bin" -pc < "$dir/ntlm-hashes.txt"
+lookup ./find-pwned -ntlm -f="$dir/ntlm.bin" -p < "$dir/passwords.txt"
+lookup ./find-pwned -f="$dir/sha1.bin" -join="$dir/hashes.txt"
+./bin2pwned "$dir/sha1.bin" > /dev/null
+./bin2pages "$dir/sha1.bin" "$dir/sha1.pages"
+lookup ./find-pwned -f="$dir/sha1.pages" < "$dir/hashes.txt"
+./bin2qf "$dir/sha1.bin" "$dir/sha1.qf"
+lookup ./find-pwned -f="$dir/sha1.qf" < "$dir/hashes.txt"
+
+rm -rf "$dir"
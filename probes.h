@@ -0,0 +1,104 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __probes_h__
+#define __probes_h__
+
+#include <stdint.h>
+
+/**
+ * USDT (user-level statically defined tracing) probes, for bpftrace,
+ * SystemTap, perf and friends. A probe is a single nop in the code plus an
+ * ELF note (.note.stapsdt) that tells the tracer where the nop is and where
+ * to find the arguments. Until a tracer attaches, which turns the nop into
+ * a breakpoint, a probe costs nothing but keeping its arguments at hand.
+ *
+ * PWNED_PROBEn(name, ...) fires probe find_pwned:name with n arguments,
+ * each passed to the tracer as a 64-bit integer (pointers included, so
+ * bpftrace can use str(arg0)). With <sys/sdt.h> (systemtap-sdt-dev) the
+ * probes come from it; otherwise, on x86-64, the same notes are written
+ * here, so no package is needed to build. Define PWNED_NO_PROBES to leave
+ * them out entirely.
+ *
+ * See find-pwned.bt for the probes and how to use them.
+ */
+#if defined(PWNED_NO_PROBES)
+#define PWNED_PROBE_NONE 1
+#elif defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define PWNED_PROBE_SDT 1
+#endif
+#endif
+
+#if defined(PWNED_PROBE_NONE)
+
+#define PWNED_PROBE0(name)                      do { } while (0)
+#define PWNED_PROBE1(name, a)                   do { (void) (a); } while (0)
+#define PWNED_PROBE2(name, a, b)                do { (void) (a); (void) (b); } while (0)
+#define PWNED_PROBE3(name, a, b, c)             do { (void) (a); (void) (b); (void) (c); } while (0)
+
+#elif defined(PWNED_PROBE_SDT)
+
+#include <sys/sdt.h>
+
+#define PWNED_PROBE0(name)                      DTRACE_PROBE(find_pwned, name)
+#define PWNED_PROBE1(name, a)                   DTRACE_PROBE1(find_pwned, name, (int64_t) (a))
+#define PWNED_PROBE2(name, a, b)                DTRACE_PROBE2(find_pwned, name, (int64_t) (a), (int64_t) (b))
+#define PWNED_PROBE3(name, a, b, c) \
+    DTRACE_PROBE3(find_pwned, name, (int64_t) (a), (int64_t) (b), (int64_t) (c))
+
+#elif defined(__x86_64__) && defined(__ELF__)
+
+/*
+ * The note layout is version 3 of the SystemTap SDT format, as written by
+ * <sys/sdt.h>: the address of the nop, the address of .stapsdt.base (so
+ * tracers can adjust for prelinking), a semaphore address (0: none), then
+ * the provider, probe name and argument string. Each argument is described
+ * as "-8@OPERAND", a signed 8-byte value in a register, memory or
+ * immediate.
+ */
+#define PWNED_PROBE_NOTE(name, args) \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"find_pwned\"\n" \
+    ".asciz \"" #name "\"\n" \
+    ".asciz \"" args "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n"
+
+#define PWNED_PROBE0(name) \
+    __asm__ __volatile__ (PWNED_PROBE_NOTE(name, ""))
+#define PWNED_PROBE1(name, a) \
+    __asm__ __volatile__ (PWNED_PROBE_NOTE(name, "-8@%0") :: "nor" ((int64_t) (a)))
+#define PWNED_PROBE2(name, a, b) \
+    __asm__ __volatile__ (PWNED_PROBE_NOTE(name, "-8@%0 -8@%1") \
+                          :: "nor" ((int64_t) (a)), "nor" ((int64_t) (b)))
+#define PWNED_PROBE3(name, a, b, c) \
+    __asm__ __volatile__ (PWNED_PROBE_NOTE(name, "-8@%0 -8@%1 -8@%2") \
+                          :: "nor" ((int64_t) (a)), "nor" ((int64_t) (b)), "nor" ((int64_t) (c)))
+
+#else
+
+#define PWNED_PROBE0(name)                      do { } while (0)
+#define PWNED_PROBE1(name, a)                   do { (void) (a); } while (0)
+#define PWNED_PROBE2(name, a, b)                do { (void) (a); (void) (b); } while (0)
+#define PWNED_PROBE3(name, a, b, c)             do { (void) (a); (void) (b); (void) (c); } while (0)
+
+#endif
+
+#endif
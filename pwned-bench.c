@@ -0,0 +1,550 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Microbenchmarks of the pieces of a lookup, to catch performance
+ * regressions before they ship: hashing passwords (SHA1 and NTLM, one at a
+ * time and through the multi-buffer kernels), parsing hex hashes, searching
+ * (binary search, leaf index, cuckoo table, some of the searchcore.h
+ * engines) and formatting output records.
+ *
+ * Everything runs on synthetic data made from a fixed seed, so runs on one
+ * machine are comparable. Each benchmark is timed with several batch sizes,
+ * warm (back to back) and cold (the CPU caches are flushed before each
+ * batch). The median of several runs is reported as JSON along with the
+ * fastest. With -baseline, the medians are compared with an earlier run's
+ * and the exit code is 1 if any benchmark got slower by more than
+ * -threshold percent.
+ *
+ * Use 'make bench' to run it against bench-baseline.json, and
+ * 'make bench-baseline' to save a new baseline.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cuckoo.h"
+#include "dbindex.h"
+#include "md4.h"
+#include "options.h"
+#include "parallel.h"
+#include "pwned_db.h"
+#include "searchcore.h"
+#include "sha1.h"
+
+/**
+ * Size of the synthetic hash file, and number of distinct inputs; half of
+ * the inputs are in the file.
+ */
+#define kRecords 0x100000
+#define kInputs 0x1000
+
+/**
+ * Operations timed per warm run, and the least batches and operations per
+ * cold run. A few dozen cold operations vary by far more than any
+ * threshold worth checking.
+ */
+#define kWarmOps 0x10000
+#define kColdBatches 0x10
+#define kColdOps 0x400
+
+/**
+ * Runs of each benchmark.
+ */
+#define kRepeats 7
+
+/**
+ * Default slowdown, in percent, that counts as a regression (-threshold).
+ */
+#define kDefaultThreshold 10
+
+/**
+ * Leaf size of the benchmarked index; the same as -auto uses.
+ */
+#define kLeafBytes 0x1000
+
+/**
+ * Most bytes read to flush the caches; some VMs report a last level cache
+ * far bigger than the one they get.
+ */
+#define kEvictMaxBytes 0x4000000
+
+/**
+ * Name of this program, from argv[0].
+ */
+const char* g_program = "pwned-bench";
+
+/**
+ * Synthetic data shared by the benchmarks.
+ */
+typedef struct {
+    pwned_db_t db;
+    pwned_cuckoo_t cuckoo;
+    pwned_index_t index;
+    pwned_core_t aos_branchless;
+    pwned_core_t aos_interpolation;
+    pwned_core_t soa_branchless;
+    pwned_core_t soa_interpolation;
+    uint8_t keys[kInputs][PWNED_SHA1_KEY_BYTES];
+    uint32_t counts[kInputs];
+    char hex[kInputs][2 * PWNED_SHA1_KEY_BYTES + 1];
+    char passwords[kInputs][0x10];
+    const void* password_data[kInputs];
+    const char* password_text[kInputs];
+    size_t password_sizes[kInputs];
+    uint8_t hashes[kInputs * PWNED_SHA1_KEY_BYTES];
+    uint8_t hashed[kInputs];
+    char text[kInputs * 0x40];
+} bench_data_t;
+
+bench_data_t g_data;
+
+/**
+ * Where benchmark results go so the compiler cannot drop the work.
+ */
+volatile uint64_t g_sink = 0;
+
+/**
+ * Buffer streamed through to flush the CPU caches for cold runs.
+ */
+uint8_t* g_evict = NULL;
+size_t g_evict_bytes = 0;
+
+/**
+ * Cost of one pwned_seconds() pair, subtracted from each cold batch.
+ */
+double g_timer_overhead = 0;
+
+/**
+ * Run @a n operations of a benchmark on inputs @a first to @a first + @a n.
+ */
+typedef void (*bench_fn)(size_t first, size_t n);
+
+typedef struct {
+    const char* name;
+    bench_fn fn;
+} bench_t;
+
+/* ------------------------------------------------------------------------- */
+static int compare_records(const void* a, const void* b) {
+    return memcmp(a, b, PWNED_SHA1_KEY_BYTES);
+}   /* compare_records() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Make the synthetic hash file, the tables over it and the inputs.
+ */
+static void make_data(void) {
+    bench_data_t* d = &g_data;
+    uint64_t state = 0x5EED;
+    uint8_t* records = (uint8_t*) malloc((size_t) kRecords * PWNED_SHA1_RECORD_BYTES);
+    if (NULL == records) {
+        Fail("out of memory for %d records", kRecords);
+    }
+    for (size_t i = 0; i < kRecords * PWNED_SHA1_RECORD_BYTES; i += sizeof(uint64_t)) {
+        uint64_t r = pwned_splitmix64(&state);
+        memcpy(&records[i], &r, sizeof(r));
+    }
+    for (size_t i = 0; i < kRecords; ++i) {
+        uint8_t* record = &records[i * PWNED_SHA1_RECORD_BYTES];
+        uint32_t count = 1 + (uint32_t) (pwned_splitmix64(&state) % 1000);
+        memcpy(record + PWNED_SHA1_KEY_BYTES, &count, sizeof(count));
+    }
+    qsort(records, kRecords, PWNED_SHA1_RECORD_BYTES, compare_records);
+    pwned_db_attach(&d->db, records, (uint64_t) kRecords * PWNED_SHA1_RECORD_BYTES, PWNED_KEY_SHA1);
+    if ((0 != pwned_cuckoo_build(&d->cuckoo, &d->db)) ||
+        (0 != pwned_index_build(&d->index, &d->db, kLeafBytes)) ||
+        (0 != pwned_core_open(&d->aos_branchless, &d->db, PWNED_LAYOUT_AOS, PWNED_SEARCH_BRANCHLESS,
+                              PWNED_BACKEND_MMAP)) ||
+        (0 != pwned_core_open(&d->aos_interpolation, &d->db, PWNED_LAYOUT_AOS, PWNED_SEARCH_INTERPOLATION,
+                              PWNED_BACKEND_MMAP)) ||
+        (0 != pwned_core_open(&d->soa_branchless, &d->db, PWNED_LAYOUT_SOA, PWNED_SEARCH_BRANCHLESS,
+                              PWNED_BACKEND_MMAP)) ||
+        (0 != pwned_core_open(&d->soa_interpolation, &d->db, PWNED_LAYOUT_SOA, PWNED_SEARCH_INTERPOLATION,
+                              PWNED_BACKEND_MMAP))) {
+        Fail("out of memory for the lookup tables");
+    }
+    for (size_t i = 0; i < kInputs; ++i) {
+        if (i & 1) {
+            uint64_t r = pwned_splitmix64(&state);
+            memcpy(d->keys[i], pwned_db_record(&d->db, r % kRecords), PWNED_SHA1_KEY_BYTES);
+        } else {
+            for (size_t k = 0; k < PWNED_SHA1_KEY_BYTES; ++k) {
+                d->keys[i][k] = (uint8_t) pwned_splitmix64(&state);
+            }
+        }
+        d->counts[i] = (uint32_t) pwned_splitmix64(&state);
+        *pwned_format_hex(d->hex[i], d->keys[i], PWNED_SHA1_KEY_BYTES) = 0;
+        int length = 6 + (int) (pwned_splitmix64(&state) % 8);
+        for (int k = 0; k < length; ++k) {
+            d->passwords[i][k] = 'a' + (pwned_splitmix64(&state) % 26);
+        }
+        d->passwords[i][length] = 0;
+        d->password_data[i] = d->passwords[i];
+        d->password_text[i] = d->passwords[i];
+        d->password_sizes[i] = length;
+    }
+    long llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+    g_evict_bytes = 2 * ((llc > 0) ? (size_t) llc : (size_t) 0x1000000);
+    if (g_evict_bytes > kEvictMaxBytes) {
+        g_evict_bytes = kEvictMaxBytes;
+    }
+    g_evict = (uint8_t*) calloc(1, g_evict_bytes);
+    if (NULL == g_evict) {
+        Fail("out of memory for the cache flush buffer");
+    }
+}   /* make_data() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_sha1(size_t first, size_t n) {
+    for (size_t i = first; i < first + n; ++i) {
+        sha1_buffer_bin(g_data.passwords[i], g_data.password_sizes[i],
+                        &g_data.hashes[i * PWNED_SHA1_KEY_BYTES]);
+    }
+}   /* bench_sha1() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_sha1_batch(size_t first, size_t n) {
+    sha1_buffer_bin_batch(&g_data.password_data[first], &g_data.password_sizes[first], n,
+                          &g_data.hashes[first * PWNED_SHA1_KEY_BYTES]);
+}   /* bench_sha1_batch() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_ntlm(size_t first, size_t n) {
+    for (size_t i = first; i < first + n; ++i) {
+        ntlm_hash(g_data.passwords[i], g_data.password_sizes[i],
+                  &g_data.hashes[i * PWNED_SHA1_KEY_BYTES]);
+    }
+}   /* bench_ntlm() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_ntlm_batch(size_t first, size_t n) {
+    ntlm_hash_batch(&g_data.password_text[first], &g_data.password_sizes[first], n,
+                    &g_data.hashes[first * MD4_BINARY_BYTES], &g_data.hashed[first]);
+}   /* bench_ntlm_batch() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_parse_hex(size_t first, size_t n) {
+    uint64_t valid = 0;
+    for (size_t i = first; i < first + n; ++i) {
+        valid += pwned_parse_hex(g_data.hex[i], &g_data.hashes[i * PWNED_SHA1_KEY_BYTES],
+                                 PWNED_SHA1_KEY_BYTES);
+    }
+    g_sink += valid;
+}   /* bench_parse_hex() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_search(size_t first, size_t n) {
+    uint64_t total = 0;
+    for (size_t i = first; i < first + n; ++i) {
+        uint64_t count = 0;
+        pwned_db_find(&g_data.db, g_data.keys[i], &count);
+        total += count;
+    }
+    g_sink += total;
+}   /* bench_search() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_index(size_t first, size_t n) {
+    uint64_t total = 0;
+    for (size_t i = first; i < first + n; ++i) {
+        uint64_t count = 0;
+        pwned_index_find(&g_data.index, g_data.keys[i], &count);
+        total += count;
+    }
+    g_sink += total;
+}   /* bench_index() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_cuckoo(size_t first, size_t n) {
+    uint64_t total = 0;
+    for (size_t i = first; i < first + n; ++i) {
+        uint64_t count = 0;
+        pwned_cuckoo_find(&g_data.cuckoo, g_data.keys[i], &count);
+        total += count;
+    }
+    g_sink += total;
+}   /* bench_cuckoo() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_core(const pwned_core_t* core, size_t first, size_t n) {
+    uint64_t total = 0;
+    for (size_t i = first; i < first + n; ++i) {
+        uint64_t count = 0;
+        pwned_core_find(core, g_data.keys[i], &count);
+        total += count;
+    }
+    g_sink += total;
+}   /* bench_core() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_aos_branchless(size_t first, size_t n) {
+    bench_core(&g_data.aos_branchless, first, n);
+}   /* bench_aos_branchless() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_aos_interpolation(size_t first, size_t n) {
+    bench_core(&g_data.aos_interpolation, first, n);
+}   /* bench_aos_interpolation() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_soa_branchless(size_t first, size_t n) {
+    bench_core(&g_data.soa_branchless, first, n);
+}   /* bench_soa_branchless() */
+
+/* ------------------------------------------------------------------------- */
+static void bench_soa_interpolation(size_t first, size_t n) {
+    bench_core(&g_data.soa_interpolation, first, n);
+}   /* bench_soa_interpolation() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Format "HASH:count\n" records as find-pwned -ph -pc and bin2pwned do.
+ */
+static void bench_format(size_t first, size_t n) {
+    char* p = g_data.text;
+    for (size_t i = first; i < first + n; ++i) {
+        p = pwned_format_hex(p, g_data.keys[i], PWNED_SHA1_KEY_BYTES);
+        *p++ = ':';
+        p = pwned_format_count(p, g_data.counts[i]);
+        *p++ = '\n';
+    }
+    g_sink += p - g_data.text;
+}   /* bench_format() */
+
+/**
+ * The benchmarks, in the order they run.
+ */
+const bench_t kBenchmarks[] = {
+    { "sha1",              bench_sha1 },
+    { "sha1_batch",        bench_sha1_batch },
+    { "ntlm",              bench_ntlm },
+    { "ntlm_batch",        bench_ntlm_batch },
+    { "parse_hex",         bench_parse_hex },
+    { "search",            bench_search },
+    { "index",             bench_index },
+    { "cuckoo",            bench_cuckoo },
+    { "aos_branchless",    bench_aos_branchless },
+    { "aos_interpolation", bench_aos_interpolation },
+    { "soa_branchless",    bench_soa_branchless },
+    { "soa_interpolation", bench_soa_interpolation },
+    { "format",            bench_format },
+};
+
+/**
+ * Inputs per timed batch.
+ */
+const size_t kBatchSizes[] = { 1, 64, 1024 };
+
+/**
+ * Every benchmark, warm and cold, with every batch size.
+ */
+#define kMaxCases ((int) (2 * (sizeof(kBenchmarks) / sizeof(kBenchmarks[0])) * \
+                          (sizeof(kBatchSizes) / sizeof(kBatchSizes[0]))))
+
+/**
+ * One benchmark run warm or cold with one batch size, and its timings.
+ */
+typedef struct {
+    const bench_t* bench;
+    int cold;
+    size_t batch;
+    uint64_t ops;
+    char name[0x40];
+    double samples[kRepeats];
+} bench_case_t;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Flush the CPU caches by reading a buffer twice the size of the last
+ * level cache (up to kEvictMaxBytes).
+ */
+static void evict_caches(void) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < g_evict_bytes; i += 64) {
+        sum += g_evict[i];
+    }
+    g_sink += sum;
+}   /* evict_caches() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Time @a ops operations of @a fn in batches of @a batch, flushing the
+ * caches before each batch if @a cold.
+ *
+ * @return nanoseconds per operation.
+ */
+static double time_run(bench_fn fn, size_t batch, int cold, uint64_t ops) {
+    uint64_t batches = ops / batch;
+    double total = 0;
+    if (!cold) {
+        double start = pwned_seconds();
+        for (uint64_t b = 0; b < batches; ++b) {
+            fn((b * batch) % kInputs, batch);
+        }
+        total = pwned_seconds() - start;
+    } else {
+        for (uint64_t b = 0; b < batches; ++b) {
+            evict_caches();
+            double start = pwned_seconds();
+            fn((b * batch) % kInputs, batch);
+            total += pwned_seconds() - start - g_timer_overhead;
+        }
+    }
+    return (total > 0) ? (1e9 * total / (batches * batch)) : 0;
+}   /* time_run() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Find the ns_per_op of benchmark @a name in baseline JSON @a text.
+ *
+ * @return 1 if found, 0 otherwise.
+ */
+static int baseline_value(const char* text, const char* name, double* value) {
+    char key[0x100];
+    snprintf(key, sizeof(key), "\"name\": \"%s\", \"ns_per_op\": ", name);
+    const char* p = (NULL == text) ? NULL : strstr(text, key);
+    if (NULL == p) {
+        return 0;
+    }
+    *value = strtod(p + strlen(key), NULL);
+    return *value > 0;
+}   /* baseline_value() */
+
+/* ------------------------------------------------------------------------- */
+int main(int argc, char* argv[]) {
+    g_program = NamePartOfPath(argv[0]);
+    const char* baseline_path = NULL;
+    const char* output_path = NULL;
+    const char* filter = NULL;
+    double threshold = kDefaultThreshold;
+    int quick = 0;
+    int verbose = 0;
+    for (int i = 1; i < argc; ++i) {
+        const char* opt = NULL;
+        if (IsOption(argv[i], &opt, "b:aseline") && (NULL != opt)) {
+            baseline_path = opt;
+        } else if (IsOption(argv[i], &opt, "o:utput") && (NULL != opt)) {
+            output_path = opt;
+        } else if (IsOption(argv[i], &opt, "f:ilter") && (NULL != opt)) {
+            filter = opt;
+        } else if (IsOption(argv[i], &opt, "t:hreshold") && (NULL != opt) &&
+                   (1 == sscanf(opt, "%lf", &threshold)) && (threshold >= 0)) {
+        } else if (IsFlagOption(argv[i], &quick, "q:uick")) {
+        } else if (IsFlagOption(argv[i], &verbose, "v:erbose")) {
+        } else {
+            fprintf(stderr,
+                    "usage: %s [options]\n"
+                    "\n"
+                    "    -b:aseline=FILE   Compare with the results in FILE.\n"
+                    "    -t:hreshold=PCT   Slowdown that counts as a regression. [%d]\n"
+                    "    -o:utput=FILE     Write the JSON results to FILE. [stdout]\n"
+                    "    -f:ilter=TEXT     Only run benchmarks whose name contains TEXT.\n"
+                    "    -[no-]q:uick      Fewer and shorter runs. [-no-quick]\n"
+                    "    -[no-]v:erbose    Print each result to stderr as it is done. [-no-verbose]\n"
+                    , g_program, kDefaultThreshold);
+            return 2;
+        }
+    }
+    FILE* out = stdout;
+    if ((NULL != output_path) && (NULL == (out = fopen(output_path, "w")))) {
+        Fail("could not create \"%s\"", output_path);
+    }
+    char* baseline = NULL;
+    if (NULL != baseline_path) {
+        size_t size = 0;
+        baseline = pwned_read_file(baseline_path, &size);
+        if (NULL == baseline) {
+            fprintf(stderr, "%s: no baseline \"%s\"; use 'make bench-baseline' to save one\n",
+                    g_program, baseline_path);
+        }
+    }
+
+    make_data();
+    double start = pwned_seconds();
+    for (int i = 0; i < 1000; ++i) {
+        g_timer_overhead = pwned_seconds();
+    }
+    g_timer_overhead = (g_timer_overhead - start) / 1000;
+    const int repeats = quick ? 3 : kRepeats;
+    const uint64_t warm_ops = quick ? (kWarmOps / 4) : kWarmOps;
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"records\": %d,\n", kRecords);
+    fprintf(out, "  \"sha1_kernel\": \"%s\",\n", sha1_kernel_name());
+    fprintf(out, "  \"md4_kernel\": \"%s\",\n", md4_kernel_name());
+    fprintf(out, "  \"cuckoo_kernel\": \"%s\",\n", pwned_cuckoo_kernel_name());
+    fprintf(out, "  \"benchmarks\": [");
+    bench_case_t cases[kMaxCases];
+    int count = 0;
+    for (size_t b = 0; b < sizeof(kBenchmarks) / sizeof(kBenchmarks[0]); ++b) {
+        for (int cold = 0; cold <= 1; ++cold) {
+            for (size_t s = 0; s < sizeof(kBatchSizes) / sizeof(kBatchSizes[0]); ++s) {
+                bench_case_t* c = &cases[count];
+                c->bench = &kBenchmarks[b];
+                c->cold = cold;
+                c->batch = kBatchSizes[s];
+                snprintf(c->name, sizeof(c->name), "%s/%s/%zu", c->bench->name, cold ? "cold" : "warm",
+                         c->batch);
+                if ((NULL != filter) && (NULL == strstr(c->name, filter))) {
+                    continue;
+                }
+                c->ops = warm_ops;
+                if (cold) {
+                    uint64_t min_ops = quick ? (kColdOps / 4) : kColdOps;
+                    uint64_t batches = (min_ops + c->batch - 1) / c->batch;
+                    c->ops = ((batches > kColdBatches) ? batches : kColdBatches) * c->batch;
+                }
+                ++count;
+            }
+        }
+    }
+
+    /*
+     * Take one run of every case before the next run of any, so that a
+     * spell when the machine is busy slows one run of many cases rather
+     * than every run of one; the median then drops it.
+     */
+    for (int r = 0; r < repeats; ++r) {
+        for (int i = 0; i < count; ++i) {
+            bench_case_t* c = &cases[i];
+            c->bench->fn(0, c->batch);          /* Fault in code and data. */
+            c->samples[r] = time_run(c->bench->fn, c->batch, c->cold, c->ops);
+        }
+    }
+
+    int regressions = 0;
+    for (int i = 0; i < count; ++i) {
+        bench_case_t* c = &cases[i];
+        qsort(c->samples, repeats, sizeof(c->samples[0]), pwned_compare_doubles);
+        double median = c->samples[repeats / 2];
+        fprintf(out, "%s\n    { \"name\": \"%s\", \"ns_per_op\": %.3f, \"best_ns_per_op\": %.3f, "
+                "\"ops\": %" PRIu64 ", \"repeats\": %d }", (i > 0) ? "," : "", c->name, median,
+                c->samples[0], c->ops, repeats);
+        double old = 0;
+        int have_old = baseline_value(baseline, c->name, &old);
+        int regressed = have_old && (median > old * (1 + (threshold / 100)));
+        regressions += regressed;
+        if (verbose || regressed) {
+            fprintf(stderr, "%-24s %10.3f ns/op", c->name, median);
+            if (have_old) {
+                fprintf(stderr, "  baseline %10.3f  %+6.1f%%%s", old,
+                        100 * (median - old) / old, regressed ? "  REGRESSION" : "");
+            }
+            fprintf(stderr, "\n");
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if ((out != stdout) && (0 != fclose(out))) {
+        Fail("could not write \"%s\"", output_path);
+    }
+    if (NULL != baseline) {
+        fprintf(stderr, "%s: %d of %d benchmarks more than %.0f%% slower than \"%s\"\n",
+                g_program, regressions, count, threshold, baseline_path);
+    }
+    free(baseline);
+    return (regressions > 0) ? 1 : 0;
+}   /* main() */
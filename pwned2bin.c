@@ -4,18 +4,196 @@
 /*
  * Read lines in pwned-password format from stdin and write them in binary to
  * stdout.
+ *
+ * By default the lines hold 40-character SHA1 hashes. With -ntlm they hold
+ * 32-character NTLM hashes. See pwned_db.h for the binary record layout.
+ *
+ * The output must be sorted by hash. Input that is already sorted (the
+ * "ordered by hash" downloads) is streamed straight through. Input that is
+ * not sorted (the "ordered by prevalence" downloads, or several lists
+ * catted together) is sorted with an external merge sort:
+ *
+ *   1. Records are read into a buffer bounded by -memory. Each full buffer
+ *      is split between -threads threads, each slice is radix sorted, and
+ *      the slices are merged into a temporary run file.
+ *
+ *   2. The runs are merged with a k-way heap merge, reading each run in
+ *      large sequential chunks.
+ *
+ * Either way, duplicate hashes are merged into one record whose count is
+ * the sum of their counts.
+ *
+ * Unsorted input is detected automatically as long as it shows up before
+ * the first buffer full of records has been written. If sorted input turns
+ * unsorted later than that, pwned2bin fails and -sort must be used.
+ *
+ * With -range=DIR, the input is instead a directory of files downloaded from
+ * the HIBP range API: one file per 5-hex-digit hash prefix (00000 through
+ * FFFFF, optionally with a .txt extension), each holding "SUFFIX:count"
+ * lines. See import_range_dir().
  */
 
+#define _GNU_SOURCE
+
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
-struct {
-    unsigned char sha[20];
-    uint32_t count;
-} line = { "", 0 };
+#include "options.h"
+#include "parallel.h"
+#include "pwned_db.h"
+#include "sort.h"
+
+/**
+ * Name of this program, from argv[0].
+ */
+const char* g_program = "pwned2bin";
+
+/**
+ * Number of bytes in each key; set by -ntlm.
+ */
+uint32_t key_bytes = PWNED_SHA1_KEY_BYTES;
+uint32_t record_bytes = PWNED_SHA1_RECORD_BYTES;
+
+/**
+ * Whether to sort even if the input looks sorted.
+ */
+int g_sort = 0;
+
+/**
+ * Memory to use for buffering and sorting records.
+ */
+#define kDefaultMemory (1ull << 30)
+uint64_t g_memory = kDefaultMemory;
+
+/**
+ * Directory for temporary run files.
+ */
+const char* g_tmp_dir = NULL;
+
+/**
+ * Directory of range API files to import, or NULL to read stdin.
+ */
+const char* g_range_dir = NULL;
+
+/**
+ * Threads used to sort or import; 0 means one per CPU.
+ */
+int g_threads = 0;
+
+/**
+ * Whether or not to emit verbose messages.
+ */
+int g_verbose = 0;
+
+/**
+ * Size of output and run file I/O.
+ */
+#define kIoBytes (8 << 20)
 
+/**
+ * Size of each read from stdin.
+ */
+#define kInputBytes (4 << 20)
+
+/* ------------------------------------------------------------------------- */
+void Verbose(const char* format, ...) __attribute__((format(printf, 1, 2)));
+void Verbose(const char* format, ...) {
+    if (g_verbose) {
+        va_list va;
+        va_start(va, format);
+        fprintf(stderr, "%s: ", g_program);
+        vfprintf(stderr, format, va);
+        fprintf(stderr, "\n");
+        va_end(va);
+    }
+}   /* Verbose() */
+
+/* ------------------------------------------------------------------------- */
+void write_all(int fd, const void* data, size_t size) {
+    if (0 != pwned_write_all(fd, data, size)) {
+        Fail("write failed: %s", strerror(errno));
+    }
+}   /* write_all() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Buffered record writer that merges consecutive records with equal keys.
+ */
+typedef struct {
+    int fd;
+    uint8_t* buffer;
+    size_t used;
+    uint8_t pending[PWNED_MAX_RECORD_BYTES];
+    int have_pending;
+    uint64_t records;           /**< Records written, after merging. */
+} writer_t;
+
+/* ------------------------------------------------------------------------- */
+void writer_init(writer_t* writer, int fd) {
+    writer->fd = fd;
+    writer->buffer = (uint8_t*) malloc(kIoBytes);
+    writer->used = 0;
+    writer->have_pending = 0;
+    writer->records = 0;
+    if (NULL == writer->buffer) {
+        Fail("out of memory for output buffer");
+    }
+}   /* writer_init() */
+
+/* ------------------------------------------------------------------------- */
+static void writer_push(writer_t* writer) {
+    if (writer->used + record_bytes > kIoBytes) {
+        write_all(writer->fd, writer->buffer, writer->used);
+        writer->used = 0;
+    }
+    memcpy(&writer->buffer[writer->used], writer->pending, record_bytes);
+    writer->used += record_bytes;
+    writer->records++;
+}   /* writer_push() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Add @a record, which must not sort before the previous record.
+ */
+void writer_add(writer_t* writer, const uint8_t* record) {
+    if (writer->have_pending) {
+        if (0 == pwned_key_cmp(writer->pending, record, key_bytes)) {
+            uint32_t a;
+            uint32_t b;
+            memcpy(&a, &writer->pending[key_bytes], sizeof(a));
+            memcpy(&b, &record[key_bytes], sizeof(b));
+            a = (a > UINT32_MAX - b) ? UINT32_MAX : a + b;
+            memcpy(&writer->pending[key_bytes], &a, sizeof(a));
+            return;
+        }
+        writer_push(writer);
+    }
+    memcpy(writer->pending, record, record_bytes);
+    writer->have_pending = 1;
+}   /* writer_add() */
+
+/* ------------------------------------------------------------------------- */
+void writer_finish(writer_t* writer) {
+    if (writer->have_pending) {
+        writer_push(writer);
+        writer->have_pending = 0;
+    }
+    write_all(writer->fd, writer->buffer, writer->used);
+    writer->used = 0;
+    free(writer->buffer);
+    writer->buffer = NULL;
+}   /* writer_finish() */
+
+/* ------------------------------------------------------------------------- */
 int hex_val(char c) {
     if (('0' <= c) && (c <= '9'))
         return c - '0';
@@ -26,38 +204,622 @@ int hex_val(char c) {
     return -1;
 }
 
-int get_hex_byte(unsigned char* b) {
-    int b1 = hex_val(getchar());
-    int b0 = hex_val(getchar());
-    if ((b1 < 0) || (b0 < 0))
+/* ------------------------------------------------------------------------- */
+/**
+ * Parse a "HASH:count" line [@a line, @a end) into @a record.
+ *
+ * @return 1 on success, 0 if the line is malformed.
+ */
+int parse_line(const char* line, const char* end, uint8_t* record) {
+    if ((size_t) (end - line) < (2 * key_bytes) + 2) {
         return 0;
-    *b = 16 * b1 + b0;
+    }
+    for (int k = 0; k < key_bytes; ++k) {
+        int b1 = hex_val(line[2*k+0]);
+        int b0 = hex_val(line[2*k+1]);
+        if ((b1 < 0) || (b0 < 0))
+            return 0;
+        record[k] = 16 * b1 + b0;
+    }
+    const char* p = &line[2 * key_bytes];
+    if (':' != *p++)
+        return 0;
+    uint64_t count = 0;
+    const char* digits = p;
+    while ((p < end) && ('0' <= *p) && (*p <= '9')) {
+        count = (10 * count) + (*p++ - '0');
+    }
+    if (p == digits)
+        return 0;
+    uint32_t count32 = (count > UINT32_MAX) ? UINT32_MAX : (uint32_t) count;
+    memcpy(&record[key_bytes], &count32, sizeof(count32));
     return 1;
 }
 
-int copy_line(void) {
-    for (int k = 0; k < 20; ++k) {
-        if (!get_hex_byte(&line.sha[k])) {
+/* ------------------------------------------------------------------------- */
+/**
+ * Reads stdin in large chunks and hands out one record per line.
+ */
+typedef struct {
+    char* buffer;
+    size_t size;                /**< Bytes in buffer. */
+    size_t pos;                 /**< Start of next line. */
+    int eof;
+    uint64_t lines;
+    uint64_t bad_lines;
+} reader_t;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Parse the next valid line from stdin into @a record.
+ *
+ * @return 1 if a record was read, 0 at end of input.
+ */
+int next_record(reader_t* reader, uint8_t* record) {
+    while (1) {
+        char* line = &reader->buffer[reader->pos];
+        char* eol = memchr(line, '\n', reader->size - reader->pos);
+        if ((NULL == eol) && !reader->eof) {
+            /* Move the partial line to the front and read more. */
+            size_t partial = reader->size - reader->pos;
+            memmove(reader->buffer, line, partial);
+            reader->size = partial;
+            reader->pos = 0;
+            size_t n = fread(&reader->buffer[partial], 1, kInputBytes - partial, stdin);
+            reader->size += n;
+            reader->eof = (0 == n);
+            continue;
+        }
+        if ((NULL == eol) && (reader->pos == reader->size)) {
             return 0;
         }
+        char* end = (NULL == eol) ? &reader->buffer[reader->size] : eol;
+        reader->pos = (NULL == eol) ? reader->size : (size_t) (eol + 1 - reader->buffer);
+        reader->lines++;
+        if (parse_line(line, end, record)) {
+            return 1;
+        }
+        while ((end > line) && (('\r' == end[-1]) || (' ' == end[-1]))) {
+            --end;
+        }
+        if (end > line) {
+            reader->bad_lines++;
+        }
     }
-    if (getchar() != ':')
-        return 0;
-    unsigned int count = 0;
-    if (1 != fscanf(stdin, "%u", &count)) {
+}   /* next_record() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * A sorted run of records to merge, either in memory or in a temporary file
+ * read through a buffer.
+ */
+typedef struct {
+    const uint8_t* data;        /**< Current buffer of records. */
+    uint64_t count;             /**< Records left in the buffer. */
+    int fd;                     /**< Run file, or -1 for a memory run. */
+    uint64_t file_records;      /**< Records left in the file after the buffer. */
+    uint64_t offset;            /**< File offset of the next read. */
+    uint8_t* buffer;            /**< Read buffer for file runs. */
+    size_t buffer_records;      /**< Records that fit in buffer. */
+} run_t;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Refill a file run's buffer.
+ *
+ * @return 1 if there are records in the buffer, 0 if the run is done.
+ */
+static int run_fill(run_t* run) {
+    if ((run->fd < 0) || (0 == run->file_records)) {
         return 0;
     }
-    line.count = (uint32_t) count;
-    write(1, &line, sizeof(line));
-    while (getchar() == ' ')
-        ;
-    getchar();
+    size_t n = (run->file_records < run->buffer_records) ? run->file_records : run->buffer_records;
+    size_t bytes = n * record_bytes;
+    size_t got = 0;
+    while (got < bytes) {
+        ssize_t r = pread(run->fd, &run->buffer[got], bytes - got, run->offset + got);
+        if (r <= 0) {
+            if ((r < 0) && (EINTR == errno)) {
+                continue;
+            }
+            Fail("could not read run file: %s", (r < 0) ? strerror(errno) : "truncated");
+        }
+        got += r;
+    }
+    run->offset += bytes;
+    run->file_records -= n;
+    run->data = run->buffer;
+    run->count = n;
     return 1;
-}
+}   /* run_fill() */
 
+/* ------------------------------------------------------------------------- */
+static inline int run_less(const run_t* a, const run_t* b) {
+    return pwned_key_cmp(a->data, b->data, key_bytes) < 0;
+}   /* run_less() */
+
+/* ------------------------------------------------------------------------- */
+static void heap_down(run_t** heap, int n, int i) {
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= n) {
+            break;
+        }
+        if ((child + 1 < n) && run_less(heap[child + 1], heap[child])) {
+            ++child;
+        }
+        if (!run_less(heap[child], heap[i])) {
+            break;
+        }
+        run_t* swap = heap[i];
+        heap[i] = heap[child];
+        heap[child] = swap;
+        i = child;
+    }
+}   /* heap_down() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Merge @a k sorted runs into @a writer with a binary heap.
+ */
+void merge_runs(run_t* runs, int k, writer_t* writer) {
+    run_t** heap = (run_t**) malloc(k * sizeof(run_t*));
+    int n = 0;
+    if (NULL == heap) {
+        Fail("out of memory for merge");
+    }
+    for (int i = 0; i < k; ++i) {
+        if ((runs[i].count > 0) || run_fill(&runs[i])) {
+            heap[n++] = &runs[i];
+        }
+    }
+    for (int i = (n / 2) - 1; i >= 0; --i) {
+        heap_down(heap, n, i);
+    }
+    while (n > 0) {
+        run_t* run = heap[0];
+        writer_add(writer, run->data);
+        run->data += record_bytes;
+        if ((0 == --run->count) && !run_fill(run)) {
+            heap[0] = heap[--n];
+        }
+        heap_down(heap, n, 0);
+    }
+    free(heap);
+}   /* merge_runs() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Most threads used to sort a buffer.
+ */
+#define kMaxSortThreads 0x100
+
+/**
+ * Shared state for sorting the slices of a buffer in parallel.
+ */
+typedef struct {
+    uint8_t* records;
+    uint64_t n;
+    uint64_t start[kMaxSortThreads + 1];    /**< First record of each slice. */
+    uint64_t count[kMaxSortThreads];        /**< Records in each slice after merging duplicates. */
+    int failed;
+} slice_sort_t;
+
+/* ------------------------------------------------------------------------- */
+static void sort_slice(void* arg, int index, int threads) {
+    slice_sort_t* sort = (slice_sort_t*) arg;
+    uint8_t* records = &sort->records[sort->start[index] * record_bytes];
+    uint64_t n = sort->start[index + 1] - sort->start[index];
+    if (0 != pwned_sort_records(records, n, record_bytes, key_bytes)) {
+        sort->failed = 1;
+        n = 0;
+    }
+    sort->count[index] = pwned_unique_records(records, n, record_bytes, key_bytes, 1);
+}   /* sort_slice() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Sort @a n records in @a records on several threads then merge them into
+ * @a writer.
+ */
+void sort_buffer(uint8_t* records, uint64_t n, writer_t* writer) {
+    static slice_sort_t sort;
+    int threads = pwned_thread_count(g_threads);
+    if (threads > kMaxSortThreads) {
+        threads = kMaxSortThreads;
+    }
+    if ((uint64_t) threads > n / 0x10000 + 1) {
+        threads = (int) (n / 0x10000) + 1;      /* Not worth a thread for small slices. */
+    }
+    sort.records = records;
+    sort.n = n;
+    sort.failed = 0;
+    for (int i = 0; i <= threads; ++i) {
+        sort.start[i] = pwned_part_start(n, i, threads);
+    }
+    double start = pwned_seconds();
+    pwned_parallel(threads, sort_slice, &sort);
+    if (sort.failed) {
+        Fail("out of memory sorting %" PRIu64 " records; try a smaller -memory", n);
+    }
+    run_t runs[kMaxSortThreads];
+    for (int i = 0; i < threads; ++i) {
+        memset(&runs[i], 0, sizeof(runs[i]));
+        runs[i].data = &records[sort.start[i] * record_bytes];
+        runs[i].count = sort.count[i];
+        runs[i].fd = -1;
+    }
+    merge_runs(runs, threads, writer);
+    Verbose("sorted %" PRIu64 " records on %d thread%s in %.3fs", n, threads,
+            (1 == threads) ? "" : "s", pwned_seconds() - start);
+}   /* sort_buffer() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Create an anonymous temporary file in g_tmp_dir.
+ */
+int temp_file(void) {
+    char path[0x1000];
+    snprintf(path, sizeof(path), "%s/pwned2bin-run-XXXXXX", g_tmp_dir);
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        Fail("could not create temporary file in \"%s\": %s", g_tmp_dir, strerror(errno));
+    }
+    unlink(path);
+    return fd;
+}   /* temp_file() */
+
+/**
+ * The range API splits the hashes by their first 20 bits (5 hex digits).
+ */
+#define kRangePrefixes      (1 << 20)
+#define kRangePrefixChars   5
+
+/**
+ * Prefixes handled by one import task; 256 tasks in all.
+ */
+#define kRangeChunkPrefixes 0x1000
+#define kRangeChunks        (kRangePrefixes / kRangeChunkPrefixes)
+
+/**
+ * Shared state for import_range_dir().
+ */
+typedef struct {
+    const char* dir;
+    const char* name_format;    /**< printf() format for a prefix's file name. */
+    pwned_ordered_t out;
+    pthread_mutex_t lock;       /**< Guards the totals below. */
+    uint64_t records;
+    uint64_t missing_files;
+    uint64_t bad_lines;
+} range_import_t;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Append the records in range file @a text (for hash @a prefix) to
+ * @a records, growing it as needed.
+ *
+ * @return the number of malformed lines.
+ */
+static uint64_t parse_range_file(const char* text, size_t size, uint32_t prefix,
+                                 uint8_t** records, uint64_t* n, uint64_t* capacity) {
+    char line[0x100];
+    uint64_t bad = 0;
+    snprintf(line, sizeof(line), "%05X", prefix);
+    const char* end = &text[size];
+    for (const char* p = text; p < end; ) {
+        const char* eol = memchr(p, '\n', end - p);
+        const char* next = (NULL == eol) ? end : (eol + 1);
+        eol = (NULL == eol) ? end : eol;
+        size_t length = eol - p;
+        if (length + kRangePrefixChars < sizeof(line)) {
+            if (*n == *capacity) {
+                *capacity = (0 == *capacity) ? 0x10000 : (2 * *capacity);
+                *records = (uint8_t*) realloc(*records, *capacity * record_bytes);
+                if (NULL == *records) {
+                    Fail("out of memory importing prefix %05X", prefix);
+                }
+            }
+            memcpy(&line[kRangePrefixChars], p, length);
+            uint8_t* record = &(*records)[*n * record_bytes];
+            if (parse_line(line, &line[kRangePrefixChars + length], record)) {
+                uint32_t count;
+                memcpy(&count, &record[key_bytes], sizeof(count));
+                *n += (count > 0);      /* Padding entries have a count of 0. */
+            } else if ((length > 1) || ((1 == length) && ('\r' != *p))) {
+                ++bad;
+            }
+        } else {
+            ++bad;
+        }
+        p = next;
+    }
+    return bad;
+}   /* parse_range_file() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Import thread: claim chunks of prefixes in order, parse their files, then
+ * hand the records to the ordered output, which places them after those of
+ * all earlier chunks.
+ */
+static void import_range_chunks(void* arg, int index, int threads) {
+    range_import_t* import = (range_import_t*) arg;
+    uint8_t* records = NULL;
+    uint64_t capacity = 0;
+    size_t text_capacity = 1 << 20;
+    char* text = (char*) malloc(text_capacity);
+    char path[0x1000];
+    if (NULL == text) {
+        Fail("out of memory for range files");
+    }
+    int chunk = 0;
+    while ((chunk = pwned_ordered_claim(&import->out)) >= 0) {
+        uint64_t n = 0;
+        uint64_t bad = 0;
+        uint64_t missing = 0;
+        for (uint32_t prefix = chunk * kRangeChunkPrefixes;
+             prefix < (uint32_t) (chunk + 1) * kRangeChunkPrefixes; ++prefix) {
+            char name[0x20];
+            snprintf(name, sizeof(name), import->name_format, prefix);
+            snprintf(path, sizeof(path), "%s/%s", import->dir, name);
+            int fd = open(path, O_RDONLY);
+            if (fd < 0) {
+                ++missing;
+                continue;
+            }
+            size_t size = 0;
+            ssize_t got = 0;
+            while ((got = read(fd, &text[size], text_capacity - size)) > 0) {
+                size += got;
+                if (size == text_capacity) {
+                    text_capacity *= 2;
+                    text = (char*) realloc(text, text_capacity);
+                    if (NULL == text) {
+                        Fail("out of memory reading \"%s\"", path);
+                    }
+                }
+            }
+            close(fd);
+            bad += parse_range_file(text, size, prefix, &records, &n, &capacity);
+        }
+
+        /*
+         * Range files should already be sorted by suffix, but make sure.
+         */
+        if (!pwned_records_sorted(records, n, record_bytes, key_bytes)) {
+            if (0 != pwned_sort_records(records, n, record_bytes, key_bytes)) {
+                Fail("out of memory sorting chunk %d", chunk);
+            }
+            n = pwned_unique_records(records, n, record_bytes, key_bytes, 1);
+        }
+
+        if (0 != pwned_ordered_write(&import->out, chunk, records, n * record_bytes)) {
+            Fail("write failed: %s", strerror(errno));
+        }
+        pthread_mutex_lock(&import->lock);
+        import->records += n;
+        import->bad_lines += bad;
+        import->missing_files += missing;
+        pthread_mutex_unlock(&import->lock);
+        Verbose("prefixes %05X-%05X: %" PRIu64 " records", chunk * kRangeChunkPrefixes,
+                (chunk + 1) * kRangeChunkPrefixes - 1, n);
+    }
+    free(text);
+    free(records);
+}   /* import_range_chunks() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Import the range API files in @a dir to stdout on several threads. Each
+ * prefix's records are written directly at their final position in the
+ * output, so no sort is needed: prefix order is global hash order.
+ */
+void import_range_dir(const char* dir) {
+    static const char* const kFormats[] = { "%05X", "%05X.txt", "%05x", "%05x.txt" };
+    range_import_t import;
+    char path[0x1000];
+    memset(&import, 0, sizeof(import));
+    import.dir = dir;
+    for (size_t i = 0; i < sizeof(kFormats) / sizeof(kFormats[0]); ++i) {
+        char name[0x20];
+        snprintf(name, sizeof(name), kFormats[i], 0);
+        snprintf(path, sizeof(path), "%s/%s", dir, name);
+        if (0 == access(path, R_OK)) {
+            import.name_format = kFormats[i];
+            break;
+        }
+    }
+    if (NULL == import.name_format) {
+        Fail("no range file for prefix 00000 in \"%s\"", dir);
+    }
+    pwned_ordered_init(&import.out, STDOUT_FILENO, kRangeChunks);
+    pthread_mutex_init(&import.lock, NULL);
+    int threads = pwned_thread_count(g_threads);
+    threads = (threads > kRangeChunks) ? kRangeChunks : threads;
+    double begin = pwned_seconds();
+    pwned_parallel(threads, import_range_chunks, &import);
+    pwned_ordered_destroy(&import.out);
+    pthread_mutex_destroy(&import.lock);
+    if (import.missing_files > 0) {
+        fprintf(stderr, "%s: %" PRIu64 " of %d range files missing from \"%s\"\n",
+                g_program, import.missing_files, kRangePrefixes, dir);
+    }
+    if (import.bad_lines > 0) {
+        fprintf(stderr, "%s: skipped %" PRIu64 " malformed line%s\n", g_program,
+                import.bad_lines, (1 == import.bad_lines) ? "" : "s");
+    }
+    Verbose("imported %" PRIu64 " records on %d thread%s in %.3fs", import.records, threads,
+            (1 == threads) ? "" : "s", pwned_seconds() - begin);
+}   /* import_range_dir() */
+
+/* ------------------------------------------------------------------------- */
 int main(int argc, char* argv[]) {
-    assert(sizeof(line) == 24);
-    while (copy_line())
-        ;
+    g_program = NamePartOfPath(argv[0]);
+    assert(sizeof(pwned_sha1_info_t) == 24);
+    assert(sizeof(pwned_ntlm_info_t) == 20);
+    for (int i = 1; i < argc; ++i) {
+        const char* opt = NULL;
+        int ntlm = 0;
+        if (IsFlagOption(argv[i], &ntlm, "ntlm")) {
+            key_bytes = ntlm ? PWNED_NTLM_KEY_BYTES : PWNED_SHA1_KEY_BYTES;
+        } else if (IsFlagOption(argv[i], &g_sort, "s:ort")) {
+        } else if (IsFlagOption(argv[i], &g_verbose, "v:erbose")) {
+        } else if (IsOption(argv[i], &opt, "m:emory")) {
+            if (!ParseSize(opt, &g_memory) || (g_memory < (1 << 20))) {
+                Fail("-memory requires a size of at least 1M, like 4G");
+            }
+        } else if (IsOption(argv[i], &opt, "t:hreads")) {
+            if ((NULL == opt) || (1 != sscanf(opt, "%d", &g_threads)) || (g_threads < 0)) {
+                Fail("-threads requires a non-negative integer");
+            }
+        } else if (IsOption(argv[i], &opt, "tmp")) {
+            g_tmp_dir = opt;
+        } else if (IsOption(argv[i], &opt, "r:ange")) {
+            if (NULL == opt) {
+                Fail("-range requires a directory");
+            }
+            g_range_dir = opt;
+        } else {
+            fprintf(stderr,
+                    "usage: %s [options] < hashes.txt > hashes.bin\n"
+                    "       %s [options] -range=DIR > hashes.bin\n"
+                    "\n"
+                    "    -[no-]ntlm      Input holds NTLM rather than SHA1 hashes. [-no-ntlm]\n"
+                    "    -[no-]s:ort     Sort even if the input looks sorted. [-no-sort]\n"
+                    "    -m:emory=SIZE   Memory for buffering and sorting. [1G]\n"
+                    "    -t:hreads=N     Sort/import threads; 0 for one per CPU. [0]\n"
+                    "    -tmp=DIR        Directory for temporary files. [$TMPDIR or /tmp]\n"
+                    "    -r:ange=DIR     Import range API files 00000..FFFFF from DIR.\n"
+                    "    -[no-]v:erbose  Print progress to stderr. [-no-verbose]\n"
+                    , g_program, g_program);
+            return 2;
+        }
+    }
+    record_bytes = key_bytes + PWNED_COUNT_BYTES;
+    if (NULL == g_tmp_dir) {
+        g_tmp_dir = (NULL != getenv("TMPDIR")) ? getenv("TMPDIR") : "/tmp";
+    }
+    if (NULL != g_range_dir) {
+        import_range_dir(g_range_dir);
+        return 0;
+    }
+
+    /*
+     * Each record in the buffer needs room for itself plus pwned_sort_records()'s
+     * scratch space: another copy of the record and two 16-byte sort items.
+     */
+    uint64_t capacity = g_memory / ((2 * record_bytes) + 32);
+    uint8_t* records = (uint8_t*) malloc(capacity * record_bytes);
+    reader_t reader = { (char*) malloc(kInputBytes), 0, 0, 0, 0, 0 };
+    if ((NULL == records) || (NULL == reader.buffer)) {
+        Fail("could not allocate %" PRIu64 " bytes; try a smaller -memory", g_memory);
+    }
+    writer_t out;
+    writer_init(&out, STDOUT_FILENO);
+    int sorting = g_sort;
+    int streamed = 0;
+    run_t* runs = NULL;
+    int run_count = 0;
+    uint64_t n = 0;
+    uint64_t total = 0;
+    while (next_record(&reader, &records[n * record_bytes])) {
+        const uint8_t* record = &records[n * record_bytes];
+        if (!sorting && (total > 0) &&
+            (pwned_key_cmp(record, (n > 0) ? (record - record_bytes) : out.pending, key_bytes) < 0)) {
+            if (streamed) {
+                Fail("input is not sorted at line %" PRIu64 " and output has already been "
+                     "written; use -sort", reader.lines);
+            }
+            Verbose("input is not sorted at line %" PRIu64 "; sorting", reader.lines);
+            sorting = 1;
+        }
+        ++n;
+        ++total;
+        if (n < capacity) {
+            continue;
+        }
+        if (!sorting) {
+            for (uint64_t i = 0; i < n; ++i) {
+                writer_add(&out, &records[i * record_bytes]);
+            }
+            streamed = 1;
+        } else {
+            /* Write the buffer as a sorted run. */
+            writer_t run_writer;
+            runs = (run_t*) realloc(runs, (run_count + 1) * sizeof(run_t));
+            if (NULL == runs) {
+                Fail("out of memory for runs");
+            }
+            memset(&runs[run_count], 0, sizeof(run_t));
+            writer_init(&run_writer, temp_file());
+            sort_buffer(records, n, &run_writer);
+            writer_finish(&run_writer);
+            runs[run_count].fd = run_writer.fd;
+            runs[run_count].file_records = run_writer.records;
+            Verbose("run %d: %" PRIu64 " records", run_count, run_writer.records);
+            ++run_count;
+        }
+        n = 0;
+    }
+    if (!sorting) {
+        for (uint64_t i = 0; i < n; ++i) {
+            writer_add(&out, &records[i * record_bytes]);
+        }
+    } else if (0 == run_count) {
+        sort_buffer(records, n, &out);
+    } else {
+        /*
+         * Sort what's left into memory then merge it with the runs, giving
+         * the remaining memory to the run read buffers.
+         */
+        writer_t last;
+        memset(&last, 0, sizeof(last));
+        runs = (run_t*) realloc(runs, (run_count + 1) * sizeof(run_t));
+        if (NULL == runs) {
+            Fail("out of memory for runs");
+        }
+        run_t* tail = &runs[run_count];
+        memset(tail, 0, sizeof(*tail));
+        tail->fd = -1;
+        if (n > 0) {
+            writer_init(&last, temp_file());
+            sort_buffer(records, n, &last);
+            writer_finish(&last);
+            tail->fd = last.fd;
+            tail->file_records = last.records;
+        }
+        free(records);
+        records = NULL;
+        int k = run_count + 1;
+        size_t per_run = (g_memory / k) / record_bytes;
+        per_run = (per_run < (kIoBytes / record_bytes)) ? (kIoBytes / record_bytes) : per_run;
+        for (int i = 0; i < k; ++i) {
+            runs[i].buffer_records = per_run;
+            runs[i].buffer = (runs[i].fd < 0) ? NULL : (uint8_t*) malloc(per_run * record_bytes);
+            if ((runs[i].fd >= 0) && (NULL == runs[i].buffer)) {
+                Fail("out of memory for %d merge buffers; try a smaller -memory", k);
+            }
+        }
+        double start = pwned_seconds();
+        merge_runs(runs, k, &out);
+        Verbose("merged %d runs in %.3fs", k, pwned_seconds() - start);
+        for (int i = 0; i < k; ++i) {
+            free(runs[i].buffer);
+            if (runs[i].fd >= 0) {
+                close(runs[i].fd);
+            }
+        }
+    }
+    writer_finish(&out);
+    if (reader.bad_lines > 0) {
+        fprintf(stderr, "%s: skipped %" PRIu64 " malformed line%s\n", g_program,
+                reader.bad_lines, (1 == reader.bad_lines) ? "" : "s");
+    }
+    Verbose("%" PRIu64 " lines, %" PRIu64 " records in, %" PRIu64 " records out",
+            reader.lines, total, out.records);
+    free(runs);
+    free(records);
+    free(reader.buffer);
     return 0;
 }
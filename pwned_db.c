@@ -0,0 +1,251 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "probes.h"
+#include "pwned_db.h"
+
+const char pwned_hex_pairs[2 * 0x100 + 1] =
+    "000102030405060708090A0B0C0D0E0F"
+    "101112131415161718191A1B1C1D1E1F"
+    "202122232425262728292A2B2C2D2E2F"
+    "303132333435363738393A3B3C3D3E3F"
+    "404142434445464748494A4B4C4D4E4F"
+    "505152535455565758595A5B5C5D5E5F"
+    "606162636465666768696A6B6C6D6E6F"
+    "707172737475767778797A7B7C7D7E7F"
+    "808182838485868788898A8B8C8D8E8F"
+    "909192939495969798999A9B9C9D9E9F"
+    "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+    "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+    "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+    "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+    "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+    "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+const char pwned_digit_pairs[2 * 100 + 1] =
+    "00010203040506070809" "10111213141516171819" "20212223242526272829"
+    "30313233343536373839" "40414243444546474849" "50515253545556575859"
+    "60616263646566676869" "70717273747576777879" "80818283848586878889"
+    "90919293949596979899";
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Binary search for @a key in @a records records of @a key_bytes + 4 bytes
+ * each. This is always inlined into a wrapper for each key width so that the
+ * record stride and key comparison are compile-time constants. Probe search
+ * gets the number of records compared, which stays in a register.
+ */
+static inline __attribute__((always_inline))
+int find_key(const uint8_t* data, uint64_t records, const uint8_t* key, uint64_t* count,
+             const uint32_t key_bytes) {
+    const uint32_t record_bytes = key_bytes + PWNED_COUNT_BYTES;
+    uint64_t lo = 0;
+    uint64_t hi = records;
+    uint32_t probes = 0;
+    while (lo < hi) {
+        uint64_t mid = lo + ((hi - lo) / 2);
+        const uint8_t* record = &data[mid * record_bytes];
+        int cmp = pwned_key_cmp(key, record, key_bytes);
+        probes++;
+        if (0 == cmp) {
+            uint32_t n;
+            memcpy(&n, record + key_bytes, sizeof(n));
+            *count = n;
+            PWNED_PROBE2(search, probes, n > 0);
+            return (n > 0);     /* Removed records in a delta have a count of 0. */
+        }
+        if (cmp < 0) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+    *count = 0;
+    PWNED_PROBE2(search, probes, 0);
+    return 0;
+}   /* find_key() */
+
+/* ------------------------------------------------------------------------- */
+static int find_sha1(const uint8_t* data, uint64_t records, const uint8_t* key, uint64_t* count) {
+    return find_key(data, records, key, count, PWNED_SHA1_KEY_BYTES);
+}   /* find_sha1() */
+
+/* ------------------------------------------------------------------------- */
+static int find_ntlm(const uint8_t* data, uint64_t records, const uint8_t* key, uint64_t* count) {
+    return find_key(data, records, key, count, PWNED_NTLM_KEY_BYTES);
+}   /* find_ntlm() */
+
+/* ------------------------------------------------------------------------- */
+const char* pwned_key_name(pwned_key_type_t type) {
+    return (PWNED_KEY_NTLM == type) ? "NTLM" : "SHA1";
+}   /* pwned_key_name() */
+
+/* ------------------------------------------------------------------------- */
+uint32_t pwned_key_bytes(pwned_key_type_t type) {
+    return (PWNED_KEY_NTLM == type) ? PWNED_NTLM_KEY_BYTES : PWNED_SHA1_KEY_BYTES;
+}   /* pwned_key_bytes() */
+
+/* ------------------------------------------------------------------------- */
+pwned_find_fn pwned_find_function(pwned_key_type_t type) {
+    return (PWNED_KEY_NTLM == type) ? find_ntlm : find_sha1;
+}   /* pwned_find_function() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_db_attach(pwned_db_t* db, const void* data, uint64_t size, pwned_key_type_t type) {
+    db->data = (const uint8_t*) data;
+    db->size = size;
+    db->type = type;
+    db->key_bytes = pwned_key_bytes(type);
+    db->record_bytes = db->key_bytes + PWNED_COUNT_BYTES;
+    db->records = size / db->record_bytes;
+    db->find = pwned_find_function(type);
+    db->fd = -1;
+    if ((0 == size) || (0 != (size % db->record_bytes))) {
+        return PWNED_DB_ERR_SIZE;
+    }
+    return PWNED_DB_OK;
+}   /* pwned_db_attach() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_db_open(pwned_db_t* db, const char* path, pwned_key_type_t type) {
+    pwned_db_attach(db, NULL, 0, type);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return PWNED_DB_ERR_OPEN;
+    }
+    off_t file_size = lseek(fd, 0, SEEK_END);
+    if (file_size < 0) {
+        close(fd);
+        return PWNED_DB_ERR_SEEK;
+    }
+    lseek(fd, 0, SEEK_SET);
+    if (PWNED_DB_OK != pwned_db_attach(db, NULL, file_size, type)) {
+        close(fd);
+        return PWNED_DB_ERR_SIZE;
+    }
+    void* data = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (MAP_FAILED == data) {
+        close(fd);
+        return PWNED_DB_ERR_MMAP;
+    }
+    db->data = (const uint8_t*) data;
+    db->fd = fd;
+    return PWNED_DB_OK;
+}   /* pwned_db_open() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_db_close(pwned_db_t* db) {
+    if (db->fd >= 0) {
+        munmap((void*) db->data, db->size);
+        close(db->fd);
+    }
+    db->data = NULL;
+    db->fd = -1;
+}   /* pwned_db_close() */
+
+/* ------------------------------------------------------------------------- */
+static inline int hex_digit(char c) {
+    if (('0' <= c) && (c <= '9')) return c - '0';
+    if (('A' <= c) && (c <= 'F')) return 10 + c - 'A';
+    if (('a' <= c) && (c <= 'f')) return 10 + c - 'a';
+    return -1;
+}   /* hex_digit() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_parse_hex(const char* hex, uint8_t* key, uint32_t key_bytes) {
+    for (uint32_t i = 0; i < key_bytes; ++i) {
+        int hi = hex_digit(hex[2*i+0]);
+        if (hi < 0) {
+            return 0;
+        }
+        int lo = hex_digit(hex[2*i+1]);
+        if (lo < 0) {
+            return 0;
+        }
+        key[i] = (hi << 4) | lo;
+    }
+    return 1;
+}   /* pwned_parse_hex() */
+
+/* ------------------------------------------------------------------------- */
+char* pwned_read_file(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (NULL == file) {
+        return NULL;
+    }
+    size_t capacity = 1 << 20;
+    size_t used = 0;
+    char* text = (char*) malloc(capacity + 1);
+    while (NULL != text) {
+        used += fread(&text[used], 1, capacity - used, file);
+        if (used < capacity) {
+            break;
+        }
+        capacity *= 2;
+        char* bigger = (char*) realloc(text, capacity + 1);
+        if (NULL == bigger) {
+            free(text);
+        }
+        text = bigger;
+    }
+    fclose(file);
+    if (NULL != text) {
+        text[used] = 0;
+        *size = used;
+    }
+    return text;
+}   /* pwned_read_file() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_write_all(int fd, const void* data, size_t size) {
+    const uint8_t* p = (const uint8_t*) data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        if (0 == n) {
+            errno = EIO;        /* No progress; don't spin or leave errno stale. */
+            return -1;
+        }
+        p += n;
+        size -= n;
+    }
+    return 0;
+}   /* pwned_write_all() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_write_all_at(int fd, const void* data, size_t size, uint64_t offset) {
+    const uint8_t* p = (const uint8_t*) data;
+    while (size > 0) {
+        ssize_t n = pwrite(fd, p, size, offset);
+        if (n < 0) {
+            if (EINTR == errno) {
+                continue;
+            }
+            return -1;
+        }
+        if (0 == n) {
+            errno = EIO;        /* No progress; don't spin or leave errno stale. */
+            return -1;
+        }
+        p += n;
+        size -= n;
+        offset += n;
+    }
+    return 0;
+}   /* pwned_write_all_at() */
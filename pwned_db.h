@@ -0,0 +1,245 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __pwned_db_h__
+#define __pwned_db_h__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Binary hash files consist of fixed-size records sorted by key. Each record
+ * is a binary key (hash) followed by a 32-bit little-endian occurrence
+ * count. The key width depends on the type of hash in the file.
+ */
+typedef enum {
+    PWNED_KEY_SHA1 = 0,     /**< 20-byte SHA1 of the password. */
+    PWNED_KEY_NTLM = 1,     /**< 16-byte NTLM hash (MD4 of UTF-16LE password). */
+} pwned_key_type_t;
+
+#define PWNED_SHA1_KEY_BYTES    0x14
+#define PWNED_NTLM_KEY_BYTES    0x10
+#define PWNED_MAX_KEY_BYTES     PWNED_SHA1_KEY_BYTES
+#define PWNED_COUNT_BYTES       0x04
+
+#define PWNED_SHA1_RECORD_BYTES (PWNED_SHA1_KEY_BYTES + PWNED_COUNT_BYTES)
+#define PWNED_NTLM_RECORD_BYTES (PWNED_NTLM_KEY_BYTES + PWNED_COUNT_BYTES)
+#define PWNED_MAX_RECORD_BYTES  (PWNED_MAX_KEY_BYTES + PWNED_COUNT_BYTES)
+
+/**
+ * Record layout of a SHA1 hash file.
+ */
+typedef struct {
+    uint8_t hash[PWNED_SHA1_KEY_BYTES]; /**< SHA1 hash of password. */
+    uint32_t count;                     /**< Number of times password was found in breaches. */
+} __attribute__((packed)) pwned_sha1_info_t;
+
+/**
+ * Record layout of an NTLM hash file.
+ */
+typedef struct {
+    uint8_t hash[PWNED_NTLM_KEY_BYTES]; /**< NTLM hash of password. */
+    uint32_t count;                     /**< Number of times password was found in breaches. */
+} __attribute__((packed)) pwned_ntlm_info_t;
+
+/**
+ * Search function specialized for a single key width. Searches @a records
+ * records at @a data for @a key.
+ *
+ * @return 1 if found with a non-zero count (setting @a *count), 0 otherwise
+ * (setting @a *count to 0).
+ */
+typedef int (*pwned_find_fn)(const uint8_t* data, uint64_t records, const uint8_t* key, uint64_t* count);
+
+/**
+ * Errors returned by pwned_db_open().
+ */
+#define PWNED_DB_OK             0
+#define PWNED_DB_ERR_OPEN       2       /**< open() failed. */
+#define PWNED_DB_ERR_SEEK       3       /**< lseek() failed. */
+#define PWNED_DB_ERR_SIZE       4       /**< File is empty or not a whole number of records. */
+#define PWNED_DB_ERR_MMAP       5       /**< mmap() failed. */
+
+/**
+ * A memory-mapped binary hash file.
+ */
+typedef struct {
+    const uint8_t* data;        /**< mmap()'d file contents. */
+    uint64_t size;              /**< Size of file in bytes. */
+    uint64_t records;           /**< Number of records in file. */
+    uint32_t key_bytes;         /**< Bytes in each key. */
+    uint32_t record_bytes;      /**< Bytes in each record (key + count). */
+    pwned_key_type_t type;      /**< Type of key in the file. */
+    pwned_find_fn find;         /**< Search specialized for key_bytes. */
+    int fd;                     /**< File descriptor, or -1. */
+} pwned_db_t;
+
+const char* pwned_key_name(pwned_key_type_t type);
+uint32_t pwned_key_bytes(pwned_key_type_t type);
+pwned_find_fn pwned_find_function(pwned_key_type_t type);
+
+/**
+ * Map hash file @a path holding keys of @a type into @a db.
+ *
+ * @return PWNED_DB_OK on success, otherwise one of PWNED_DB_ERR_xxx.
+ */
+int pwned_db_open(pwned_db_t* db, const char* path, pwned_key_type_t type);
+
+/**
+ * Initialize @a db to refer to @a size bytes of records already in memory.
+ *
+ * @return PWNED_DB_OK on success, PWNED_DB_ERR_SIZE if @a size is invalid.
+ */
+int pwned_db_attach(pwned_db_t* db, const void* data, uint64_t size, pwned_key_type_t type);
+
+void pwned_db_close(pwned_db_t* db);
+
+/**
+ * Parse 2 * @a key_bytes hex digits at @a hex into @a key.
+ *
+ * @return 1 if all the digits are valid hex, 0 otherwise.
+ */
+int pwned_parse_hex(const char* hex, uint8_t* key, uint32_t key_bytes);
+
+/**
+ * Read all of @a path into a NUL-terminated buffer, setting @a *size to the
+ * number of bytes read (not counting the NUL).
+ *
+ * @return the buffer, to be free()'d, or NULL on error.
+ */
+char* pwned_read_file(const char* path, size_t* size);
+
+/**
+ * Write all @a size bytes at @a data to @a fd, continuing after short writes
+ * and interrupted calls.
+ *
+ * @return 0 on success, -1 on error with errno set (EIO if a write made no
+ * progress).
+ */
+int pwned_write_all(int fd, const void* data, size_t size);
+
+/**
+ * Like pwned_write_all(), but with pwrite() at byte @a offset of @a fd.
+ */
+int pwned_write_all_at(int fd, const void* data, size_t size, uint64_t offset);
+
+/**
+ * Look up @a key in @a db, setting @a *count to its occurrence count.
+ *
+ * @return 1 if found, 0 otherwise.
+ */
+static inline int pwned_db_find(const pwned_db_t* db, const uint8_t* key, uint64_t* count) {
+    return db->find(db->data, db->records, key, count);
+}
+
+static inline const uint8_t* pwned_db_record(const pwned_db_t* db, uint64_t index) {
+    return db->data + (index * db->record_bytes);
+}
+
+static inline uint32_t pwned_db_count(const pwned_db_t* db, uint64_t index) {
+    uint32_t count;
+    memcpy(&count, pwned_db_record(db, index) + db->key_bytes, sizeof(count));
+    return count;
+}
+
+/**
+ * Load 64 bits from @a p in big-endian order so that integer comparison
+ * matches memcmp() ordering.
+ */
+static inline uint64_t pwned_load_be64(const uint8_t* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
+}
+
+static inline uint32_t pwned_load_be32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap32(v);
+}
+
+/**
+ * Compare keys @a a and @a b of @a key_bytes bytes, which must be 16 or 20.
+ * When @a key_bytes is a constant the comparison compiles down to two or
+ * three word compares.
+ *
+ * @return <0, 0 or >0 like memcmp().
+ */
+static inline __attribute__((always_inline))
+int pwned_key_cmp(const uint8_t* a, const uint8_t* b, uint32_t key_bytes) {
+    uint64_t x = pwned_load_be64(a);
+    uint64_t y = pwned_load_be64(b);
+    if (x != y) {
+        return (x < y) ? -1 : 1;
+    }
+    x = pwned_load_be64(a + 8);
+    y = pwned_load_be64(b + 8);
+    if (x != y) {
+        return (x < y) ? -1 : 1;
+    }
+    if (key_bytes > 16) {
+        uint32_t u = pwned_load_be32(a + 16);
+        uint32_t v = pwned_load_be32(b + 16);
+        if (u != v) {
+            return (u < v) ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Upper-case hex for each byte value ("00" through "FF") and decimal for
+ * 0 through 99 ("00" through "99"), two characters per entry, for fast
+ * text output of records.
+ */
+extern const char pwned_hex_pairs[2 * 0x100 + 1];
+extern const char pwned_digit_pairs[2 * 100 + 1];
+
+/**
+ * Write @a key_bytes bytes at @a key as upper-case hex at @a p.
+ *
+ * @return the position just past the last digit.
+ */
+static inline __attribute__((always_inline))
+char* pwned_format_hex(char* p, const uint8_t* key, uint32_t key_bytes) {
+    for (uint32_t k = 0; k < key_bytes; ++k) {
+        memcpy(p, &pwned_hex_pairs[2 * key[k]], 2);
+        p += 2;
+    }
+    return p;
+}
+
+/**
+ * Write @a value in decimal at @a p.
+ *
+ * @return the position just past the last digit.
+ */
+static inline char* pwned_format_count(char* p, uint32_t value) {
+    char digits[10];
+    char* d = &digits[sizeof(digits)];
+    while (value >= 100) {
+        d -= 2;
+        memcpy(d, &pwned_digit_pairs[2 * (value % 100)], 2);
+        value /= 100;
+    }
+    if (value >= 10) {
+        d -= 2;
+        memcpy(d, &pwned_digit_pairs[2 * value], 2);
+    } else {
+        *--d = '0' + value;
+    }
+    size_t n = &digits[sizeof(digits)] - d;
+    memcpy(p, d, n);
+    return p + n;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,252 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Counting quotient filter; see qfilter.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "qfilter.h"
+
+/**
+ * Fraction of slots filled by the builder. Higher loads make the filter
+ * smaller but the runs, and so the selects, longer.
+ */
+#define kQfLoad 0.85
+
+#define kQfBucketMask ((1u << PWNED_QF_COUNT_BITS) - 1)
+#define kQfMaxBucket kQfBucketMask
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Split @a key into its quotient (return value) and @a *remainder for a
+ * filter of @a slots slots.
+ */
+static inline uint64_t qf_split(const uint8_t* key, uint64_t slots, uint32_t* remainder) {
+    unsigned __int128 product = (unsigned __int128) pwned_load_be64(key) * slots;
+    *remainder = (uint32_t) (((uint64_t) product) >> (64 - PWNED_QF_REMAINDER_BITS));
+    return (uint64_t) (product >> 64);
+}   /* qf_split() */
+
+/* ------------------------------------------------------------------------- */
+static inline uint32_t qf_bucket(uint32_t count) {
+    uint32_t bucket = 32 - __builtin_clz(count);     /* 1 + floor(log2(count)) */
+    return (bucket > kQfMaxBucket) ? kQfMaxBucket : bucket;
+}   /* qf_bucket() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Position of the @a k'th (from 1) runend at or after slot @a pos, or
+ * UINT64_MAX if there are not that many.
+ */
+static inline uint64_t qf_select_runend(const pwned_qf_block_t* blocks, uint64_t block_count,
+                                        uint64_t pos, uint64_t k) {
+    uint64_t b = pos / PWNED_QF_BLOCK_SLOTS;
+    uint64_t word = (b < block_count) ? (blocks[b].runends & (~0ull << (pos % PWNED_QF_BLOCK_SLOTS))) : 0;
+    while (b < block_count) {
+        uint64_t n = __builtin_popcountll(word);
+        if (n >= k) {
+            while (--k > 0) {
+                word &= word - 1;
+            }
+            return (b * PWNED_QF_BLOCK_SLOTS) + __builtin_ctzll(word);
+        }
+        k -= n;
+        if (++b < block_count) {
+            word = blocks[b].runends;
+        }
+    }
+    return UINT64_MAX;
+}   /* qf_select_runend() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_qf_find(const pwned_qf_t* qf, const uint8_t* key, uint64_t* count) {
+    const pwned_qf_header_t* header = qf->header;
+    const pwned_qf_block_t* blocks = qf->blocks;
+    uint32_t remainder;
+    uint64_t quotient = qf_split(key, header->slots, &remainder);
+    const pwned_qf_block_t* block = &blocks[quotient / PWNED_QF_BLOCK_SLOTS];
+    uint32_t j = quotient % PWNED_QF_BLOCK_SLOTS;
+    *count = 0;
+    if (0 == ((block->occupieds >> j) & 1)) {
+        return 0;
+    }
+
+    /*
+     * This is the k'th run that belongs to this block's quotients; they
+     * follow the runs spilled in from earlier blocks, in quotient order.
+     */
+    uint64_t k = __builtin_popcountll(block->occupieds & ((j < 63) ? ((2ull << j) - 1) : ~0ull));
+    uint64_t first = (quotient - j) + block->offset;
+    uint64_t start = first;
+    if (k > 1) {
+        start = qf_select_runend(blocks, header->blocks, first, k - 1) + 1;
+    }
+    start = (start < quotient) ? quotient : start;
+    uint64_t end = qf_select_runend(blocks, header->blocks, start, 1);
+    for (uint64_t s = start; s <= end; ++s) {
+        uint32_t slot = blocks[s / PWNED_QF_BLOCK_SLOTS].slots[s % PWNED_QF_BLOCK_SLOTS];
+        uint32_t r = slot >> PWNED_QF_COUNT_BITS;
+        if (r >= remainder) {
+            if (r > remainder) {
+                return 0;
+            }
+            *count = 1ull << ((slot & kQfBucketMask) - 1);
+            return 1;
+        }
+    }
+    return 0;
+}   /* pwned_qf_find() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_is_qf_file(const char* path) {
+    char magic[sizeof(PWNED_QF_MAGIC) - 1];
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    ssize_t n = pread(fd, magic, sizeof(magic), 0);
+    close(fd);
+    return (sizeof(magic) == n) && (0 == memcmp(magic, PWNED_QF_MAGIC, sizeof(magic)));
+}   /* pwned_is_qf_file() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_qf_open(pwned_qf_t* qf, const char* path, pwned_key_type_t type) {
+    memset(qf, 0, sizeof(*qf));
+    qf->fd = open(path, O_RDONLY);
+    if (qf->fd < 0) {
+        return PWNED_DB_ERR_OPEN;
+    }
+    off_t size = lseek(qf->fd, 0, SEEK_END);
+    if (size < 0) {
+        pwned_qf_close(qf);
+        return PWNED_DB_ERR_SEEK;
+    }
+    pwned_qf_header_t header;
+    if ((sizeof(header) != pread(qf->fd, &header, sizeof(header), 0)) ||
+        (0 != memcmp(header.magic, PWNED_QF_MAGIC, sizeof(header.magic))) ||
+        (header.key_type != (uint32_t) type) ||
+        (header.remainder_bits != PWNED_QF_REMAINDER_BITS) ||
+        (header.blocks < (header.slots + PWNED_QF_BLOCK_SLOTS - 1) / PWNED_QF_BLOCK_SLOTS) ||
+        ((uint64_t) size != sizeof(header) + (header.blocks * sizeof(pwned_qf_block_t)))) {
+        pwned_qf_close(qf);
+        return PWNED_DB_ERR_SIZE;
+    }
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, qf->fd, 0);
+    if (MAP_FAILED == data) {
+        pwned_qf_close(qf);
+        return PWNED_DB_ERR_MMAP;
+    }
+    qf->size = size;
+    qf->header = (const pwned_qf_header_t*) data;
+    qf->blocks = (const pwned_qf_block_t*) &qf->header[1];
+    return PWNED_DB_OK;
+}   /* pwned_qf_open() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_qf_close(pwned_qf_t* qf) {
+    if (NULL != qf->header) {
+        munmap((void*) qf->header, qf->size);
+    }
+    if (qf->fd >= 0) {
+        close(qf->fd);
+    }
+    qf->header = NULL;
+    qf->blocks = NULL;
+    qf->fd = -1;
+}   /* pwned_qf_close() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_qf_build(const pwned_db_t* db, int fd, pwned_qf_header_t* header) {
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, PWNED_QF_MAGIC, sizeof(header->magic));
+    header->key_type = db->type;
+    header->remainder_bits = PWNED_QF_REMAINDER_BITS;
+    header->slots = (uint64_t) (db->records / kQfLoad) + PWNED_QF_BLOCK_SLOTS;
+    header->blocks = (header->slots + PWNED_QF_BLOCK_SLOTS - 1) / PWNED_QF_BLOCK_SLOTS;
+    uint64_t capacity = header->blocks + 1;
+    pwned_qf_block_t* blocks = (pwned_qf_block_t*) calloc(capacity, sizeof(blocks[0]));
+    if (NULL == blocks) {
+        return -1;
+    }
+
+    /*
+     * Walk the records in order. Each quotient's run goes at the quotient's
+     * slot or just past the previous run, whichever is later; runs may
+     * spill past the last quotient into extra blocks. A block's offset is
+     * how far the runs of earlier quotients reach into it, which is known
+     * as soon as the first quotient at or after the block's start appears.
+     */
+    uint64_t next_free = 0;
+    uint64_t next_offset_block = 0;
+    uint64_t i = 0;
+    while (i < db->records) {
+        uint32_t remainder;
+        uint64_t quotient = qf_split(pwned_db_record(db, i), header->slots, &remainder);
+        for (; next_offset_block * PWNED_QF_BLOCK_SLOTS <= quotient; ++next_offset_block) {
+            uint64_t block_start = next_offset_block * PWNED_QF_BLOCK_SLOTS;
+            blocks[next_offset_block].offset = (next_free > block_start) ? (next_free - block_start) : 0;
+        }
+        uint64_t pos = (next_free > quotient) ? next_free : quotient;
+        uint64_t run_length = 0;
+        uint32_t last = UINT32_MAX;
+        for (; i < db->records; ++i) {
+            uint32_t r;
+            if (qf_split(pwned_db_record(db, i), header->slots, &r) != quotient) {
+                break;
+            }
+            uint32_t count = pwned_db_count(db, i);
+            if (0 == count) {
+                continue;
+            }
+            if (pos / PWNED_QF_BLOCK_SLOTS >= capacity) {
+                pwned_qf_block_t* bigger = (pwned_qf_block_t*) realloc(blocks, 2 * capacity * sizeof(blocks[0]));
+                if (NULL == bigger) {
+                    free(blocks);
+                    return -1;
+                }
+                memset(&bigger[capacity], 0, capacity * sizeof(blocks[0]));
+                blocks = bigger;
+                capacity *= 2;
+            }
+            if ((run_length > 0) && (r == last)) {
+                /* Two keys that differ only past the remainder: keep the larger count. */
+                uint32_t* slot = &blocks[(pos - 1) / PWNED_QF_BLOCK_SLOTS].slots[(pos - 1) % PWNED_QF_BLOCK_SLOTS];
+                uint32_t bucket = qf_bucket(count);
+                if (bucket > (*slot & kQfBucketMask)) {
+                    *slot = (r << PWNED_QF_COUNT_BITS) | bucket;
+                }
+                continue;
+            }
+            blocks[pos / PWNED_QF_BLOCK_SLOTS].slots[pos % PWNED_QF_BLOCK_SLOTS] =
+                (r << PWNED_QF_COUNT_BITS) | qf_bucket(count);
+            last = r;
+            ++pos;
+            ++run_length;
+            ++header->records;
+        }
+        if (run_length > 0) {
+            blocks[quotient / PWNED_QF_BLOCK_SLOTS].occupieds |= 1ull << (quotient % PWNED_QF_BLOCK_SLOTS);
+            blocks[(pos - 1) / PWNED_QF_BLOCK_SLOTS].runends |= 1ull << ((pos - 1) % PWNED_QF_BLOCK_SLOTS);
+            next_free = pos;
+        }
+    }
+    uint64_t used_blocks = (next_free + PWNED_QF_BLOCK_SLOTS - 1) / PWNED_QF_BLOCK_SLOTS;
+    header->blocks = (used_blocks > header->blocks) ? used_blocks : header->blocks;
+    for (; next_offset_block < header->blocks; ++next_offset_block) {
+        uint64_t block_start = next_offset_block * PWNED_QF_BLOCK_SLOTS;
+        blocks[next_offset_block].offset = (next_free > block_start) ? (next_free - block_start) : 0;
+    }
+    int err = (0 != lseek(fd, 0, SEEK_SET)) ||
+        (0 != pwned_write_all(fd, header, sizeof(*header))) ||
+        (0 != pwned_write_all(fd, blocks, header->blocks * sizeof(blocks[0])));
+    free(blocks);
+    return err ? -1 : 0;
+}   /* pwned_qf_build() */
@@ -0,0 +1,112 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __qfilter_h__
+#define __qfilter_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A counting quotient filter: a compact, approximate version of a hash file
+ * that answers "absent" or "present with a count of about 2^k" in roughly
+ * 4.4 bytes per hash instead of 24.
+ *
+ * It is a rank-and-select quotient filter. The first 64 bits h of a key,
+ * scaled by the number of slots, split into a quotient (the slot the key
+ * belongs in, (h * slots) / 2^64) and the top PWNED_QF_REMAINDER_BITS of
+ * the fraction left over (the remainder). Each slot stores a remainder and a
+ * PWNED_QF_COUNT_BITS log-quantized count:
+ *
+ *     bucket = 1 + floor(log2(count)),   so bucket k means count >= 2^(k-1).
+ *
+ * The remainders of all keys with the same quotient form a sorted run that
+ * starts at the quotient's slot or, if that is taken, just after the run
+ * before it. Slots are grouped into blocks of 64 with two bit vectors,
+ * "occupieds" (some key has this quotient) and "runends" (a run ends in this
+ * slot), plus the number of slots at the start of the block used by runs of
+ * earlier blocks. A lookup is a popcount in the quotient's block and a short
+ * select over runends, usually within the same block: one or two cache
+ * misses.
+ *
+ * False positives happen when an absent key has the same quotient and
+ * remainder as a present one, about once in 2^27 lookups.
+ *
+ * Since the quotient and remainder come from the leading key bits, a sorted
+ * hash file yields the runs in order and the filter is built in one pass.
+ */
+#define PWNED_QF_MAGIC          "PWNQF001"
+#define PWNED_QF_BLOCK_SLOTS    64
+#define PWNED_QF_COUNT_BITS     5
+#define PWNED_QF_REMAINDER_BITS (32 - PWNED_QF_COUNT_BITS)
+
+typedef struct {
+    char magic[8];              /**< PWNED_QF_MAGIC, not NUL-terminated. */
+    uint32_t key_type;          /**< pwned_key_type_t of the keys. */
+    uint32_t remainder_bits;    /**< PWNED_QF_REMAINDER_BITS. */
+    uint64_t slots;             /**< Number of quotients. */
+    uint64_t blocks;            /**< Blocks in the file, including overflow past slots. */
+    uint64_t records;           /**< Keys in the filter. */
+    uint8_t reserved[0x1000 - 40];      /**< Pads the header to a page. */
+} pwned_qf_header_t;
+
+typedef struct {
+    uint64_t occupieds;
+    uint64_t runends;
+    uint64_t offset;            /**< Slots at the start used by earlier blocks' runs. */
+    uint32_t slots[PWNED_QF_BLOCK_SLOTS];   /**< remainder << COUNT_BITS | bucket. */
+} pwned_qf_block_t;
+
+/**
+ * A memory-mapped filter file.
+ */
+typedef struct {
+    const pwned_qf_header_t* header;
+    const pwned_qf_block_t* blocks;
+    uint64_t size;
+    int fd;
+} pwned_qf_t;
+
+/**
+ * @return 1 if the file at @a path starts with a filter header, 0 if not.
+ */
+int pwned_is_qf_file(const char* path);
+
+/**
+ * Map filter file @a path, which must hold keys of @a type.
+ *
+ * @return PWNED_DB_OK on success, otherwise one of the PWNED_DB_ERR_xxx
+ * codes from pwned_db.h (PWNED_DB_ERR_SIZE for a bad header).
+ */
+int pwned_qf_open(pwned_qf_t* qf, const char* path, pwned_key_type_t type);
+
+void pwned_qf_close(pwned_qf_t* qf);
+
+/**
+ * Look up @a key. If it is (probably) present, set @a *count to the low end
+ * of its count bucket, 2^(bucket-1).
+ *
+ * @return 1 if probably present, 0 if certainly absent.
+ */
+int pwned_qf_find(const pwned_qf_t* qf, const uint8_t* key, uint64_t* count);
+
+/**
+ * Write a filter holding the records of hash file @a db with non-zero
+ * counts to @a fd, which must be seekable, and fill in @a header with what
+ * was written.
+ *
+ * @return 0 on success, -1 on a write error or if out of memory.
+ */
+int pwned_qf_build(const pwned_db_t* db, int fd, pwned_qf_header_t* header);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,303 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * A subset of the hashcat rule language, used to turn one password into
+ * the close variants (case flips, leetspeak, appended digits) that should
+ * also be rejected. See rules.h for the supported functions.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rules.h"
+
+/* ------------------------------------------------------------------------- */
+static inline char to_lower(char c) {
+    return (('A' <= c) && (c <= 'Z')) ? (c + 'a' - 'A') : c;
+}   /* to_lower() */
+
+/* ------------------------------------------------------------------------- */
+static inline char to_upper(char c) {
+    return (('a' <= c) && (c <= 'z')) ? (c + 'A' - 'a') : c;
+}   /* to_upper() */
+
+/* ------------------------------------------------------------------------- */
+static inline char toggle(char c) {
+    return (('a' <= c) && (c <= 'z')) ? to_upper(c) : to_lower(c);
+}   /* toggle() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * @return the value of position character @a c (0-9, A-Z), or -1.
+ */
+static inline int position(char c) {
+    if (('0' <= c) && (c <= '9')) return c - '0';
+    if (('A' <= c) && (c <= 'Z')) return 10 + c - 'A';
+    return -1;
+}   /* position() */
+
+/* ------------------------------------------------------------------------- */
+int rule_apply(const char* rule, const char* word, size_t length, char* out) {
+    char temp[RULE_MAX_LENGTH];
+    int n = (int) length;
+    if (length >= RULE_MAX_LENGTH) {
+        return -1;
+    }
+    memcpy(out, word, length);
+    while (0 != *rule) {
+        const char op = *rule++;
+        int p = 0;
+        switch (op) {
+        case ' ':
+        case ':':
+            break;
+        case 'l':
+            for (int i = 0; i < n; ++i) out[i] = to_lower(out[i]);
+            break;
+        case 'u':
+            for (int i = 0; i < n; ++i) out[i] = to_upper(out[i]);
+            break;
+        case 'c':
+            for (int i = 0; i < n; ++i) out[i] = (0 == i) ? to_upper(out[i]) : to_lower(out[i]);
+            break;
+        case 'C':
+            for (int i = 0; i < n; ++i) out[i] = (0 == i) ? to_lower(out[i]) : to_upper(out[i]);
+            break;
+        case 't':
+            for (int i = 0; i < n; ++i) out[i] = toggle(out[i]);
+            break;
+        case 'T':
+            if ((p = position(*rule++)) < 0) return -1;
+            if (p < n) out[p] = toggle(out[p]);
+            break;
+        case 'r':
+            for (int i = 0; i < n / 2; ++i) {
+                char c = out[i];
+                out[i] = out[n - 1 - i];
+                out[n - 1 - i] = c;
+            }
+            break;
+        case 'd':
+            if (2 * n >= RULE_MAX_LENGTH) return -1;
+            memcpy(&out[n], out, n);
+            n *= 2;
+            break;
+        case 'f':
+            if (2 * n >= RULE_MAX_LENGTH) return -1;
+            for (int i = 0; i < n; ++i) out[n + i] = out[n - 1 - i];
+            n *= 2;
+            break;
+        case '{':
+            if (n > 1) {
+                char c = out[0];
+                memmove(out, &out[1], n - 1);
+                out[n - 1] = c;
+            }
+            break;
+        case '}':
+            if (n > 1) {
+                char c = out[n - 1];
+                memmove(&out[1], out, n - 1);
+                out[0] = c;
+            }
+            break;
+        case '$':
+            if ((0 == *rule) || (n + 1 >= RULE_MAX_LENGTH)) return -1;
+            out[n++] = *rule++;
+            break;
+        case '^':
+            if ((0 == *rule) || (n + 1 >= RULE_MAX_LENGTH)) return -1;
+            memmove(&out[1], out, n++);
+            out[0] = *rule++;
+            break;
+        case '[':
+            if (n > 0) memmove(out, &out[1], --n);
+            break;
+        case ']':
+            if (n > 0) --n;
+            break;
+        case 'D':
+            if ((p = position(*rule++)) < 0) return -1;
+            if (p < n) memmove(&out[p], &out[p + 1], n-- - p - 1);
+            break;
+        case '\'':
+            if ((p = position(*rule++)) < 0) return -1;
+            if (p < n) n = p;
+            break;
+        case 's':
+            if ((0 == rule[0]) || (0 == rule[1])) return -1;
+            for (int i = 0; i < n; ++i) {
+                if (out[i] == rule[0]) out[i] = rule[1];
+            }
+            rule += 2;
+            break;
+        case '@': {
+            if (0 == *rule) return -1;
+            int k = 0;
+            for (int i = 0; i < n; ++i) {
+                if (out[i] != *rule) out[k++] = out[i];
+            }
+            n = k;
+            ++rule;
+            break;
+        }
+        case 'z':
+            if ((p = position(*rule++)) < 0) return -1;
+            if (n > 0) {
+                if (n + p >= RULE_MAX_LENGTH) return -1;
+                memcpy(temp, out, n);
+                memset(out, temp[0], p);
+                memcpy(&out[p], temp, n);
+                n += p;
+            }
+            break;
+        case 'Z':
+            if ((p = position(*rule++)) < 0) return -1;
+            if (n > 0) {
+                if (n + p >= RULE_MAX_LENGTH) return -1;
+                memset(&out[n], out[n - 1], p);
+                n += p;
+            }
+            break;
+        default:
+            return -1;
+        }
+    }
+    return n;
+}   /* rule_apply() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Append a copy of @a rule to @a rules.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+static int rules_add(rules_t* rules, const char* rule) {
+    if (rules->count == rules->capacity) {
+        size_t capacity = (0 == rules->capacity) ? 0x100 : (2 * rules->capacity);
+        char** bigger = (char**) realloc(rules->rules, capacity * sizeof(char*));
+        if (NULL == bigger) {
+            return -1;
+        }
+        rules->rules = bigger;
+        rules->capacity = capacity;
+    }
+    char* copy = (char*) malloc(strlen(rule) + 1);
+    if (NULL == copy) {
+        return -1;
+    }
+    strcpy(copy, rule);
+    rules->rules[rules->count++] = copy;
+    return 0;
+}   /* rules_add() */
+
+/* ------------------------------------------------------------------------- */
+int rules_default(rules_t* rules) {
+    static const char* const kSimple[] = {
+        ":", "l", "u", "c", "C", "t", "r", "d", "f", "{", "}", "[", "]",
+        "sa@", "sa4", "se3", "si1", "si!", "so0", "ss$", "ss5", "st7", "sl1",
+        "sa@ se3 si1 so0 ss$", "sa4 se3 si1 so0 ss5",
+        "c sa@ se3 si1 so0 ss$", "c sa4 se3 si1 so0 ss5",
+        "sa@ se3 si1 so0 ss$ $1", "sa@ se3 si1 so0 ss$ $!",
+    };
+    static const char* const kCases[] = { "", "c ", "u " };
+    static const char* const kSymbols[] = { "$!", "$@", "$#", "$1 $!", "$1 $2 $3", "$1 $2 $3 $4" };
+    char rule[0x40];
+    rules->rules = NULL;
+    rules->count = 0;
+    rules->capacity = 0;
+    for (size_t i = 0; i < sizeof(kSimple) / sizeof(kSimple[0]); ++i) {
+        if (0 != rules_add(rules, kSimple[i])) return -1;
+    }
+    for (size_t c = 0; c < sizeof(kCases) / sizeof(kCases[0]); ++c) {
+        for (int d = 0; d < 10; ++d) {
+            snprintf(rule, sizeof(rule), "%s$%d", kCases[c], d);
+            if (0 != rules_add(rules, rule)) return -1;
+        }
+        for (int d = 0; d < 100; ++d) {
+            snprintf(rule, sizeof(rule), "%s$%d $%d", kCases[c], d / 10, d % 10);
+            if (0 != rules_add(rules, rule)) return -1;
+        }
+        for (int year = 2000; year < 2030; ++year) {
+            snprintf(rule, sizeof(rule), "%s$%d $%d $%d $%d", kCases[c],
+                     year / 1000, (year / 100) % 10, (year / 10) % 10, year % 10);
+            if (0 != rules_add(rules, rule)) return -1;
+        }
+        for (size_t s = 0; s < sizeof(kSymbols) / sizeof(kSymbols[0]); ++s) {
+            snprintf(rule, sizeof(rule), "%s%s", kCases[c], kSymbols[s]);
+            if (0 != rules_add(rules, rule)) return -1;
+        }
+    }
+    return 0;
+}   /* rules_default() */
+
+/* ------------------------------------------------------------------------- */
+int rules_load(rules_t* rules, const char* path, size_t* rejected) {
+    char line[0x200];
+    char out[RULE_MAX_LENGTH];
+    size_t bad = 0;
+    rules->rules = NULL;
+    rules->count = 0;
+    rules->capacity = 0;
+    FILE* file = fopen(path, "r");
+    if (NULL == file) {
+        return -1;
+    }
+    while (NULL != fgets(line, sizeof(line), file)) {
+        size_t n = strlen(line);
+        while ((n > 0) && (('\n' == line[n-1]) || ('\r' == line[n-1]))) {
+            line[--n] = 0;
+        }
+        if ((0 == n) || ('#' == line[0])) {
+            continue;
+        }
+        if (rule_apply(line, "x", 1, out) < 0) {
+            ++bad;
+            continue;
+        }
+        if (0 != rules_add(rules, line)) {
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    if (NULL != rejected) {
+        *rejected = bad;
+    }
+    return 0;
+}   /* rules_load() */
+
+/* ------------------------------------------------------------------------- */
+void rules_free(rules_t* rules) {
+    for (size_t i = 0; i < rules->count; ++i) {
+        free(rules->rules[i]);
+    }
+    free(rules->rules);
+    rules->rules = NULL;
+    rules->count = 0;
+    rules->capacity = 0;
+}   /* rules_free() */
+
+/* ------------------------------------------------------------------------- */
+size_t rules_expand(const rules_t* rules, const char* word, size_t length,
+                    char* buffer, size_t buffer_size, rule_candidate_t* candidates, size_t max) {
+    size_t used = 0;
+    size_t n = 0;
+    for (size_t r = 0; (r < rules->count) && (r <= UINT16_MAX) && (n < max); ++r) {
+        if (used + RULE_MAX_LENGTH > buffer_size) {
+            break;
+        }
+        int size = rule_apply(rules->rules[r], word, length, &buffer[used]);
+        if (size <= 0) {
+            continue;
+        }
+        candidates[n].offset = (uint32_t) used;
+        candidates[n].length = (uint16_t) size;
+        candidates[n].rule = (uint16_t) r;
+        used += size;
+        ++n;
+    }
+    return n;
+}   /* rules_expand() */
@@ -0,0 +1,99 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __rules_h__
+#define __rules_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Longest candidate a rule may produce, as in hashcat.
+ */
+#define RULE_MAX_LENGTH     0x100
+
+/**
+ * A list of password mangling rules in hashcat syntax.
+ *
+ * Supported rule functions (N is a position 0-9 or A-Z, X and Y are
+ * characters):
+ *
+ *     :     do nothing              l     lower case all
+ *     u     upper case all          c     capitalize, lower the rest
+ *     C     lower first, upper rest t     toggle case of all
+ *     TN    toggle case at N        r     reverse
+ *     d     duplicate word          f     append reversed word
+ *     {     rotate left             }     rotate right
+ *     $X    append X                ^X    prepend X
+ *     [     delete first            ]     delete last
+ *     DN    delete at N             'N    truncate at N
+ *     sXY   replace all X with Y    @X    purge all X
+ *     zN    duplicate first N times ZN    duplicate last N times
+ *
+ * Spaces between functions are ignored. Only the first 65536 rules are
+ * used by rules_expand().
+ */
+typedef struct {
+    char** rules;               /**< NUL-terminated rule strings. */
+    size_t count;               /**< Number of rules. */
+    size_t capacity;            /**< Entries allocated in rules. */
+} rules_t;
+
+/**
+ * A candidate produced by rules_expand(): @a length bytes at @a offset in
+ * the candidate buffer, produced by rule number @a rule.
+ */
+typedef struct {
+    uint32_t offset;
+    uint16_t length;
+    uint16_t rule;
+} rule_candidate_t;
+
+/**
+ * Fill @a rules with the built-in rule set: case changes, leetspeak,
+ * appended digits and symbols, and combinations of those. This produces a
+ * few hundred candidates per password.
+ *
+ * @return 0 on success, -1 if out of memory.
+ */
+int rules_default(rules_t* rules);
+
+/**
+ * Load hashcat-style rules from @a path, one per line. Blank lines and
+ * lines starting with '#' are skipped, as are rules using unsupported
+ * functions; @a *rejected (if not NULL) is set to the number of those.
+ *
+ * @return 0 on success, -1 if the file cannot be read or out of memory.
+ */
+int rules_load(rules_t* rules, const char* path, size_t* rejected);
+
+void rules_free(rules_t* rules);
+
+/**
+ * Apply @a rule to @a word of @a length bytes, writing the result to @a out,
+ * which must hold RULE_MAX_LENGTH bytes.
+ *
+ * @return length of the result, or -1 if the rule is invalid or the result
+ * would be too long.
+ */
+int rule_apply(const char* rule, const char* word, size_t length, char* out);
+
+/**
+ * Apply every rule in @a rules to @a word, appending the candidates to
+ * @a buffer (@a buffer_size bytes) and describing them in @a candidates
+ * (@a max entries). Rules that fail or produce an empty word are skipped.
+ *
+ * @return the number of candidates written.
+ */
+size_t rules_expand(const rules_t* rules, const char* word, size_t length,
+                    char* buffer, size_t buffer_size, rule_candidate_t* candidates, size_t max);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,383 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Policy-templated search engines over a sorted hash file; see searchcore.h.
+ *
+ * Each engine is find<KeyBytes, Layout, Search, Backend>(). The backend
+ * fetches record i; the layout says what the search compares at record i
+ * (the big-endian first 64 bits of its key) and where the whole record is;
+ * the search finds the first record whose prefix is not below the key's.
+ * All three are resolved at compile time, so each instantiation is a plain
+ * loop like find_key() in pwned_db.c.
+ *
+ * This is C++ only for the templates: there are no exceptions, RTTI,
+ * new/delete or library classes, so the programs still link as C with gcc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "searchcore.h"
+
+namespace {
+
+/**
+ * Prefix reported for a record that could not be read. It sorts after every
+ * key, so the search moves left of it and ends without a match.
+ */
+const uint64_t kUnreadable = ~(uint64_t) 0;
+
+/**
+ * Most interpolation guesses before the search falls back to halving, and
+ * the range below which it halves anyway; near the end a guess often moves
+ * only one side in by a record or two.
+ */
+const unsigned kMaxGuesses = 8;
+const uint64_t kBisectRecords = 0x40;
+
+const char* const kLayoutNames[PWNED_LAYOUTS] = { "aos", "soa" };
+const char* const kSearchNames[PWNED_SEARCHES] = { "binary", "branchless", "interpolation" };
+const char* const kBackendNames[PWNED_BACKENDS] = { "mmap", "pread" };
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Backend reading records through the mapping of the file.
+ */
+template <uint32_t RecordBytes>
+class Mmap {
+public:
+    explicit Mmap(const pwned_core_t* core) : data_(core->data) {}
+
+    const uint8_t* fetch(uint64_t i) {
+        return data_ + (i * RecordBytes);
+    }
+
+    void prefetch(uint64_t i) const {
+        __builtin_prefetch(data_ + (i * RecordBytes));
+    }
+
+private:
+    const uint8_t* data_;
+};
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Backend reading each record with pread(). The last record read is kept,
+ * since the search usually asks for the one it stopped on again.
+ */
+template <uint32_t RecordBytes>
+class Pread {
+public:
+    explicit Pread(const pwned_core_t* core) : fd_(core->fd), last_(~(uint64_t) 0) {}
+
+    const uint8_t* fetch(uint64_t i) {
+        if (i != last_) {
+            if ((ssize_t) RecordBytes != pread(fd_, record_, RecordBytes, (off_t) (i * RecordBytes))) {
+                last_ = ~(uint64_t) 0;
+                return NULL;
+            }
+            last_ = i;
+        }
+        return record_;
+    }
+
+    void prefetch(uint64_t) const {}
+
+private:
+    int fd_;
+    uint64_t last_;
+    uint8_t record_[RecordBytes];
+};
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Layout searching the records themselves: each probe reads a record.
+ */
+template <uint32_t KeyBytes, class Backend>
+class Aos {
+public:
+    explicit Aos(const pwned_core_t* core) : backend_(core) {}
+
+    uint64_t prefix(uint64_t i) {
+        const uint8_t* record = backend_.fetch(i);
+        return (NULL == record) ? kUnreadable : pwned_load_be64(record);
+    }
+
+    const uint8_t* record(uint64_t i) {
+        return backend_.fetch(i);
+    }
+
+    void prefetch(uint64_t i) const {
+        backend_.prefetch(i);
+    }
+
+private:
+    Backend backend_;
+};
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Layout searching a dense array of key prefixes: eight of them share a
+ * cache line where a 24-byte record has two or three, and the backend is
+ * read only for records whose prefix matches.
+ */
+template <uint32_t KeyBytes, class Backend>
+class Soa {
+public:
+    explicit Soa(const pwned_core_t* core) : prefixes_(core->prefixes), backend_(core) {}
+
+    uint64_t prefix(uint64_t i) const {
+        return prefixes_[i];
+    }
+
+    const uint8_t* record(uint64_t i) {
+        return backend_.fetch(i);
+    }
+
+    void prefetch(uint64_t i) const {
+        __builtin_prefetch(&prefixes_[i]);
+    }
+
+private:
+    const uint64_t* prefixes_;
+    Backend backend_;
+};
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Three-way binary search on the prefix, stopping early on an equal one.
+ */
+struct Binary {
+    template <class Layout>
+    static uint64_t lower_bound(Layout& layout, uint64_t records, uint64_t key) {
+        uint64_t lo = 0;
+        uint64_t hi = records;
+        while (lo < hi) {
+            uint64_t mid = lo + ((hi - lo) / 2);
+            uint64_t prefix = layout.prefix(mid);
+            if (prefix < key) {
+                lo = mid + 1;
+            } else if (prefix > key) {
+                hi = mid;
+            } else {
+                /* Keys sharing all 64 bits are rare; back up to the first. */
+                while ((mid > lo) && (layout.prefix(mid - 1) == key)) {
+                    --mid;
+                }
+                return mid;
+            }
+        }
+        return lo;
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Lower bound with a fixed number of steps and a conditional move in each,
+ * so there is no branch to mispredict; both possible next probes are
+ * prefetched while the current one loads.
+ */
+struct Branchless {
+    template <class Layout>
+    static uint64_t lower_bound(Layout& layout, uint64_t records, uint64_t key) {
+        if (0 == records) {
+            return 0;
+        }
+        uint64_t base = 0;
+        uint64_t n = records;
+        while (n > 1) {
+            uint64_t half = n / 2;
+            layout.prefetch(base + (half / 2));
+            layout.prefetch(base + half + (half / 2));
+            base = (layout.prefix(base + half) < key) ? base + half : base;
+            n -= half;
+        }
+        return base + (layout.prefix(base) < key);
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Interpolation search on the prefix. Hashes are uniform, so the first
+ * guess of a key's position is usually within a few hundred records of it
+ * in even the biggest file, and a few more land on it.
+ */
+struct Interpolation {
+    template <class Layout>
+    static uint64_t lower_bound(Layout& layout, uint64_t records, uint64_t key) {
+        if (0 == records) {
+            return 0;
+        }
+        uint64_t lo = 0;
+        uint64_t hi = records - 1;
+        uint64_t lo_prefix = layout.prefix(lo);
+        if (key <= lo_prefix) {
+            return 0;
+        }
+        uint64_t hi_prefix = layout.prefix(hi);
+        if (key > hi_prefix) {
+            return records;
+        }
+        /* Now prefix(lo) < key <= prefix(hi), so the answer is in (lo, hi]. */
+        for (unsigned guesses = 0; hi - lo > 1; ++guesses) {
+            uint64_t mid;
+            if ((guesses < kMaxGuesses) && (hi - lo > kBisectRecords)) {
+                unsigned __int128 offset = (unsigned __int128) (key - lo_prefix - 1) * (hi - lo - 1);
+                mid = lo + 1 + (uint64_t) (offset / (hi_prefix - lo_prefix));
+            } else {
+                mid = lo + ((hi - lo) / 2);
+            }
+            uint64_t prefix = layout.prefix(mid);
+            if (prefix < key) {
+                lo = mid;
+                lo_prefix = prefix;
+            } else {
+                hi = mid;
+                hi_prefix = prefix;
+            }
+        }
+        return hi;
+    }
+};
+
+/* ------------------------------------------------------------------------- */
+template <uint32_t KeyBytes, template <uint32_t, class> class Layout, class Search,
+          template <uint32_t> class Backend>
+int find(const pwned_core_t* core, const uint8_t* key, uint64_t* count) {
+    Layout<KeyBytes, Backend<KeyBytes + PWNED_COUNT_BYTES> > layout(core);
+    const uint64_t prefix = pwned_load_be64(key);
+    const uint64_t records = core->records;
+    for (uint64_t i = Search::lower_bound(layout, records, prefix);
+         (i < records) && (layout.prefix(i) == prefix); ++i) {
+        const uint8_t* record = layout.record(i);
+        if (NULL == record) {
+            break;
+        }
+        int cmp = pwned_key_cmp(key, record, KeyBytes);
+        if (0 == cmp) {
+            uint32_t n;
+            memcpy(&n, record + KeyBytes, sizeof(n));
+            *count = n;
+            return (n > 0);
+        }
+        if (cmp < 0) {
+            break;
+        }
+    }
+    *count = 0;
+    return 0;
+}   /* find() */
+
+/* ------------------------------------------------------------------------- */
+template <uint32_t KeyBytes, template <uint32_t, class> class Layout, class Search>
+pwned_core_find_fn pick_backend(pwned_backend_t backend) {
+    return (PWNED_BACKEND_PREAD == backend) ? find<KeyBytes, Layout, Search, Pread> :
+        find<KeyBytes, Layout, Search, Mmap>;
+}   /* pick_backend() */
+
+/* ------------------------------------------------------------------------- */
+template <uint32_t KeyBytes, template <uint32_t, class> class Layout>
+pwned_core_find_fn pick_search(pwned_search_t search, pwned_backend_t backend) {
+    switch (search) {
+    case PWNED_SEARCH_BRANCHLESS:
+        return pick_backend<KeyBytes, Layout, Branchless>(backend);
+    case PWNED_SEARCH_INTERPOLATION:
+        return pick_backend<KeyBytes, Layout, Interpolation>(backend);
+    default:
+        return pick_backend<KeyBytes, Layout, Binary>(backend);
+    }
+}   /* pick_search() */
+
+/* ------------------------------------------------------------------------- */
+template <uint32_t KeyBytes>
+pwned_core_find_fn pick_layout(pwned_layout_t layout, pwned_search_t search, pwned_backend_t backend) {
+    return (PWNED_LAYOUT_SOA == layout) ? pick_search<KeyBytes, Soa>(search, backend) :
+        pick_search<KeyBytes, Aos>(search, backend);
+}   /* pick_layout() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Match the @a length characters at @a text against @a names.
+ *
+ * @return the index of the match, or -1.
+ */
+int match_name(const char* text, size_t length, const char* const* names, int count) {
+    for (int i = 0; i < count; ++i) {
+        if ((strlen(names[i]) == length) && (0 == strncmp(text, names[i], length))) {
+            return i;
+        }
+    }
+    return -1;
+}   /* match_name() */
+
+}   /* namespace */
+
+/* ------------------------------------------------------------------------- */
+int pwned_core_parse(const char* name, pwned_layout_t* layout, pwned_search_t* search,
+                     pwned_backend_t* backend) {
+    const char* dash1 = strchr(name, '-');
+    const char* dash2 = (NULL == dash1) ? NULL : strchr(dash1 + 1, '-');
+    if (NULL == dash2) {
+        return 0;
+    }
+    int l = match_name(name, dash1 - name, kLayoutNames, PWNED_LAYOUTS);
+    int s = match_name(dash1 + 1, dash2 - dash1 - 1, kSearchNames, PWNED_SEARCHES);
+    int b = match_name(dash2 + 1, strlen(dash2 + 1), kBackendNames, PWNED_BACKENDS);
+    if ((l < 0) || (s < 0) || (b < 0)) {
+        return 0;
+    }
+    *layout = (pwned_layout_t) l;
+    *search = (pwned_search_t) s;
+    *backend = (pwned_backend_t) b;
+    return 1;
+}   /* pwned_core_parse() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_core_name(const pwned_core_t* core, char* name, size_t size) {
+    snprintf(name, size, "%s-%s-%s", kLayoutNames[core->layout], kSearchNames[core->search],
+             kBackendNames[core->backend]);
+}   /* pwned_core_name() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_core_open(pwned_core_t* core, const pwned_db_t* db, pwned_layout_t layout,
+                    pwned_search_t search, pwned_backend_t backend) {
+    memset(core, 0, sizeof(*core));
+    core->data = db->data;
+    core->fd = db->fd;
+    core->records = db->records;
+    core->type = db->type;
+    core->layout = layout;
+    core->search = search;
+    core->backend = backend;
+    if (((PWNED_BACKEND_PREAD == backend) && (db->fd < 0)) ||
+        (((PWNED_BACKEND_MMAP == backend) || (PWNED_LAYOUT_SOA == layout)) && (NULL == db->data))) {
+        return -1;
+    }
+    if (PWNED_LAYOUT_SOA == layout) {
+        core->prefixes = (uint64_t*) malloc((db->records + 1) * sizeof(core->prefixes[0]));
+        if (NULL == core->prefixes) {
+            return -1;
+        }
+        for (uint64_t i = 0; i < db->records; ++i) {
+            core->prefixes[i] = pwned_load_be64(pwned_db_record(db, i));
+        }
+    }
+    core->find = (PWNED_KEY_NTLM == db->type) ?
+        pick_layout<PWNED_NTLM_KEY_BYTES>(layout, search, backend) :
+        pick_layout<PWNED_SHA1_KEY_BYTES>(layout, search, backend);
+    return 0;
+}   /* pwned_core_open() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_core_close(pwned_core_t* core) {
+    free(core->prefixes);
+    core->prefixes = NULL;
+}   /* pwned_core_close() */
+
+/* ------------------------------------------------------------------------- */
+uint64_t pwned_core_bytes(const pwned_core_t* core) {
+    return (NULL == core->prefixes) ? 0 : core->records * sizeof(core->prefixes[0]);
+}   /* pwned_core_bytes() */
@@ -0,0 +1,120 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __searchcore_h__
+#define __searchcore_h__
+
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * A search engine over a sorted hash file put together from three
+ * independent choices, each a template policy in searchcore.cc:
+ *
+ *   layout  - aos: search the records where they are (key and count
+ *             together, as in the file).
+ *             soa: search an in-RAM array of the first 64 bits of each key
+ *             (8 bytes per record), reading the full record only to confirm
+ *             a match.
+ *   search  - binary: the classic three-way binary search.
+ *             branchless: a lower bound with conditional moves instead of
+ *             branches, prefetching both halves ahead.
+ *             interpolation: guesses where the key is from its value, which
+ *             takes a handful of probes on uniformly distributed hashes,
+ *             falling back to halving if the guesses stop converging.
+ *   backend - mmap: read records through the mapping of the file.
+ *             pread: read each record with pread(), for files that are not
+ *             mapped or cached.
+ *
+ * Every combination, for both key widths, is compiled as its own function
+ * with no tests of the configuration in its loop. pwned_core_open() picks
+ * one of them once, so adding an engine costs the others nothing.
+ */
+typedef enum {
+    PWNED_LAYOUT_AOS,
+    PWNED_LAYOUT_SOA,
+    PWNED_LAYOUTS
+} pwned_layout_t;
+
+typedef enum {
+    PWNED_SEARCH_BINARY,
+    PWNED_SEARCH_BRANCHLESS,
+    PWNED_SEARCH_INTERPOLATION,
+    PWNED_SEARCHES
+} pwned_search_t;
+
+typedef enum {
+    PWNED_BACKEND_MMAP,
+    PWNED_BACKEND_PREAD,
+    PWNED_BACKENDS
+} pwned_backend_t;
+
+typedef struct pwned_core_s pwned_core_t;
+
+/**
+ * Lookup specialized for one key width, layout, search and backend.
+ */
+typedef int (*pwned_core_find_fn)(const pwned_core_t* core, const uint8_t* key, uint64_t* count);
+
+struct pwned_core_s {
+    const uint8_t* data;        /**< Records, for the mmap backend. */
+    int fd;                     /**< Hash file, for the pread backend. */
+    uint64_t records;
+    uint64_t* prefixes;         /**< First 64 bits of each key, big-endian, for the soa layout. */
+    pwned_key_type_t type;
+    pwned_layout_t layout;
+    pwned_search_t search;
+    pwned_backend_t backend;
+    pwned_core_find_fn find;
+};
+
+/**
+ * Parse engine name @a name, "LAYOUT-SEARCH-BACKEND" (for example
+ * "soa-interpolation-mmap"), into its three parts.
+ *
+ * @return 1 if @a name is valid, 0 otherwise.
+ */
+int pwned_core_parse(const char* name, pwned_layout_t* layout, pwned_search_t* search,
+                     pwned_backend_t* backend);
+
+/**
+ * Write the name of @a core's engine into @a name, of @a size bytes.
+ */
+void pwned_core_name(const pwned_core_t* core, char* name, size_t size);
+
+/**
+ * Set up @a core to search @a db with the given policies. The pread backend
+ * needs db->fd; the mmap backend needs db->data. The soa layout builds its
+ * prefix array here.
+ *
+ * @return 0 on success, -1 if out of memory or @a db cannot be read the
+ * way @a backend needs.
+ */
+int pwned_core_open(pwned_core_t* core, const pwned_db_t* db, pwned_layout_t layout,
+                    pwned_search_t search, pwned_backend_t backend);
+
+void pwned_core_close(pwned_core_t* core);
+
+/**
+ * Bytes of RAM used by @a core besides the hash file.
+ */
+uint64_t pwned_core_bytes(const pwned_core_t* core);
+
+/**
+ * Look up @a key with @a core, with the same results as pwned_db_find().
+ * A record that cannot be read with the pread backend is not found.
+ */
+static inline int pwned_core_find(const pwned_core_t* core, const uint8_t* key, uint64_t* count) {
+    return core->find(core, key, count);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
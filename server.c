@@ -0,0 +1,521 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Server mode (-serve=ADDR) and router mode (-route=ADDR), which together
+ * spread the hash file over a cluster of hosts. See client.h for the
+ * protocol.
+ *
+ * A server answers lookups from its hash file (through find_hash(), so any
+ * -engine works) for the keys in its -range of hash prefixes. Only the part
+ * of the file in that range is ever searched, so only those pages need to
+ * be in memory, and several servers on different hosts can share one big
+ * file between them.
+ *
+ * A router holds no data. Each batch a client sends it is split by range
+ * into one sub-batch per shard (-shard=RANGE@ADDR), the sub-batches are
+ * sent to all the shards before any answer is read so that the shards work
+ * in parallel, and the answers are merged back into the client's order.
+ * Every client connection gets its own thread and its own persistent
+ * connection to each shard. A shard may list several replicas, which are
+ * used in turn and hedged as described in client.h.
+ *
+ * With -numa, a server binds each connection's thread to a NUMA node, in
+ * turn, and gives each node its own copy of what a lookup reads most: a
+ * sparse index of the hash file (the top levels of the binary search) or,
+ * with -engine=cuckoo, the whole table. Each copy is built by a thread
+ * bound to its node, so first touch puts it in that node's memory. Only the
+ * leaf reads from the mapped file, about one page per lookup, can still go
+ * to another node.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "client.h"
+#include "cuckoo.h"
+#include "find-pwned.h"
+#include "join.h"
+#include "dbindex.h"
+#include "numa.h"
+#include "parallel.h"
+
+/**
+ * Bytes of hash file per leaf of the -numa index. Leaves follow the pages
+ * of the shared mapping (see dbindex.h), so after searching the node's own
+ * index a lookup reads one page of it, rarely two.
+ */
+#define kNumaLeafBytes 0x1000
+
+/**
+ * A shard of the key space and the server (or router) that holds it.
+ */
+typedef struct {
+    pwned_range_t range;
+    const char* address;
+} shard_t;
+
+/**
+ * A NUMA node's CPUs and its copy of the lookup structures.
+ */
+typedef struct {
+    pwned_numa_node_t node;
+    pwned_index_t index;
+    pwned_cuckoo_t cuckoo;
+    const pwned_db_t* db;
+    int failed;
+} server_node_t;
+
+/**
+ * Arguments for a server connection thread.
+ */
+typedef struct {
+    int fd;
+    const pwned_db_t* db;
+    const pwned_range_t* range;
+    server_node_t* nodes;       /**< NULL without -numa. */
+    int node_count;
+} server_connection_t;
+
+/**
+ * Arguments for a router connection thread.
+ */
+typedef struct {
+    int fd;
+    const shard_t* shards;
+    int shard_count;
+    pwned_key_type_t type;
+} router_connection_t;
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Accept connections on @a listener forever, handing each to a new detached
+ * thread running @a fn with an argument built by copying @a size bytes of
+ * @a arg and setting its first member, the socket.
+ *
+ * @return 2 if accept() fails for good.
+ */
+static int accept_loop(int listener, void* (*fn)(void*), const void* arg, size_t size) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (1) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            if ((EINTR == errno) || (ECONNABORTED == errno)) {
+                continue;
+            }
+            PrintError("accept() failed: %s", strerror(errno));
+            break;
+        }
+        int on = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        void* copy = malloc(size);
+        pthread_t thread;
+        if (NULL == copy) {
+            close(fd);
+            continue;
+        }
+        memcpy(copy, arg, size);
+        *(int*) copy = fd;
+        if (0 != pthread_create(&thread, &attr, fn, copy)) {
+            PrintError("could not start a thread for a new connection");
+            close(fd);
+            free(copy);
+        }
+    }
+    pthread_attr_destroy(&attr);
+    close(listener);
+    return 2;
+}   /* accept_loop() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Look up @a key on @a node, or with find_hash() if there are no nodes.
+ */
+static inline int node_find(const server_node_t* node, const pwned_db_t* db, const uint8_t* key,
+                            uint64_t* count) {
+    if (NULL == node) {
+        return find_hash(db, key, count);
+    }
+    int found;
+    if (ENGINE_CUCKOO == g_lookup) {
+        found = pwned_cuckoo_find(&node->cuckoo, key, count);
+    } else if (NULL != node->index.prefixes) {
+        found = pwned_index_find(&node->index, key, count);
+    } else {
+        return find_hash(db, key, count);
+    }
+    if (NULL != g_trace) {
+        pwned_trace_record(g_trace, key, found);
+    }
+    return found;
+}   /* node_find() */
+
+/* ------------------------------------------------------------------------- */
+static void* serve_connection(void* arg) {
+    static int next_node = 0;
+    server_connection_t* conn = (server_connection_t*) arg;
+    const uint32_t key_bytes = conn->db->key_bytes;
+    const server_node_t* node = NULL;
+    if (NULL != conn->nodes) {
+        node = &conn->nodes[__sync_fetch_and_add(&next_node, 1) % conn->node_count];
+        pwned_numa_bind(&node->node);
+    }
+    uint8_t* keys = (uint8_t*) malloc((size_t) PWNED_NET_MAX_BATCH * key_bytes);
+    uint32_t* reply = (uint32_t*) malloc(sizeof(pwned_net_response_t) +
+                                         PWNED_NET_MAX_BATCH * sizeof(uint32_t));
+    pwned_net_request_t request;
+    while ((NULL != keys) && (NULL != reply) &&
+           (1 == pwned_net_read(conn->fd, &request, sizeof(request)))) {
+        pwned_net_response_t response = { PWNED_NET_OK, request.count };
+        if ((request.key_bytes != key_bytes) || (request.count > PWNED_NET_MAX_BATCH)) {
+            response.status = PWNED_NET_BAD_REQUEST;
+            response.count = 0;
+            pwned_net_write(conn->fd, &response, sizeof(response));
+            break;
+        }
+        if (1 != pwned_net_read(conn->fd, keys, (size_t) request.count * key_bytes)) {
+            break;
+        }
+        uint32_t* counts = &reply[sizeof(response) / sizeof(reply[0])];
+        for (uint32_t i = 0; i < request.count; ++i) {
+            const uint8_t* key = &keys[i * key_bytes];
+            uint64_t count = 0;
+            if (pwned_range_contains(conn->range, key)) {
+                node_find(node, conn->db, key, &count);
+            } else {
+                response.status = PWNED_NET_OUT_OF_RANGE;
+            }
+            counts[i] = (count > UINT32_MAX) ? UINT32_MAX : (uint32_t) count;
+        }
+        memcpy(reply, &response, sizeof(response));
+        if (0 != pwned_net_write(conn->fd, reply, sizeof(response) + request.count * sizeof(counts[0]))) {
+            break;
+        }
+    }
+    close(conn->fd);
+    free(reply);
+    free(keys);
+    free(conn);
+    return NULL;
+}   /* serve_connection() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Index in @a db of the first record at or after 64-bit key prefix
+ * @a prefix.
+ */
+static uint64_t prefix_lower_bound(const pwned_db_t* db, uint64_t prefix) {
+    uint8_t key[PWNED_MAX_KEY_BYTES] = {0};
+    for (int i = 0; i < 8; ++i) {
+        key[i] = (uint8_t) (prefix >> (56 - (8 * i)));
+    }
+    return pwned_lower_bound(db, key, 0, db->records);
+}   /* prefix_lower_bound() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Build node @a index's lookup structures on a thread bound to it.
+ */
+static void build_node(void* arg, int index, int threads) {
+    server_node_t* node = &((server_node_t*) arg)[index];
+    const pwned_db_t* db = node->db;
+    pwned_numa_bind(&node->node);
+    if (ENGINE_CUCKOO == g_lookup) {
+        node->failed = (0 != pwned_cuckoo_build(&node->cuckoo, db));
+    } else if ((ENGINE_SEARCH == g_lookup) && (db->records > 0)) {
+        node->failed = (0 != pwned_index_build(&node->index, db, kNumaLeafBytes));
+    }
+}   /* build_node() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Free the lookup structures of @a count nodes and the nodes themselves.
+ */
+static void free_nodes(server_node_t* nodes, int count) {
+    for (int i = 0; i < count; ++i) {
+        pwned_cuckoo_free(&nodes[i].cuckoo);
+        pwned_index_free(&nodes[i].index);
+    }
+    free(nodes);
+}   /* free_nodes() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Find the NUMA nodes and build each one's copy of the lookup structures
+ * for @a db.
+ *
+ * @return the nodes, or NULL on error.
+ */
+static server_node_t* build_nodes(const pwned_db_t* db, int* node_count) {
+    pwned_numa_node_t found[PWNED_NUMA_MAX_NODES];
+    int n = pwned_numa_nodes(found, PWNED_NUMA_MAX_NODES);
+    server_node_t* nodes = (server_node_t*) calloc(n, sizeof(nodes[0]));
+    if (NULL == nodes) {
+        return NULL;
+    }
+    for (int i = 0; i < n; ++i) {
+        nodes[i].node = found[i];
+        nodes[i].db = db;
+    }
+    double start = pwned_seconds();
+    pwned_parallel(n, build_node, nodes);
+    for (int i = 0; i < n; ++i) {
+        if (nodes[i].failed) {
+            PrintError("out of memory building lookup tables for NUMA node %d", nodes[i].node.id);
+            free_nodes(nodes, n);
+            return NULL;
+        }
+        PrintVerbose("NUMA node %d: %d CPUs, %" PRIu64 " bytes of %s", nodes[i].node.id,
+                     nodes[i].node.cpu_count,
+                     (ENGINE_CUCKOO == g_lookup) ? pwned_cuckoo_bytes(&nodes[i].cuckoo) :
+                     (nodes[i].index.leaves * sizeof(uint64_t)),
+                     (ENGINE_CUCKOO == g_lookup) ? "cuckoo table" : "index");
+    }
+    PrintVerbose("built %d node copies in %.3fs", n, pwned_seconds() - start);
+    *node_count = n;
+    return nodes;
+}   /* build_nodes() */
+
+/* ------------------------------------------------------------------------- */
+void range_view(const pwned_db_t* db, const pwned_range_t* range, pwned_db_t* view) {
+    *view = *db;
+    if (db->records > 0) {
+        uint64_t lo = prefix_lower_bound(db, range->lo);
+        uint64_t hi = (UINT64_MAX == range->hi) ? db->records : prefix_lower_bound(db, range->hi + 1);
+        view->data = pwned_db_record(db, lo);
+        view->records = hi - lo;
+        view->size = view->records * db->record_bytes;
+    }
+}   /* range_view() */
+
+/* ------------------------------------------------------------------------- */
+int run_server(const char* address, const pwned_range_t* range, const pwned_db_t* db) {
+    int listener = pwned_net_listen(address);
+    if (listener < 0) {
+        PrintError("could not listen on \"%s\"", address);
+        return 2;
+    }
+
+    /*
+     * Narrow the file to the range so that searches never touch the rest of
+     * it. Engines with their own tables ignore the db; main() builds the
+     * -engine=cuckoo table over the same range.
+     */
+    pwned_db_t view;
+    range_view(db, range, &view);
+    PrintVerbose("serving %" PRIu64 " %s hashes in %016" PRIX64 "-%016" PRIX64 " on %s",
+                 view.records, pwned_key_name(db->type), range->lo, range->hi, address);
+    server_connection_t conn = { -1, &view, range, NULL, 0 };
+    if (g_numa) {
+        conn.nodes = build_nodes(&view, &conn.node_count);
+        if (NULL == conn.nodes) {
+            close(listener);
+            return 2;
+        }
+    }
+    return accept_loop(listener, serve_connection, &conn, sizeof(conn));
+}   /* run_server() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Index of the shard holding @a key; the shards are sorted and cover all
+ * keys.
+ */
+static int shard_of(const shard_t* shards, int shard_count, const uint8_t* key) {
+    uint64_t prefix = pwned_load_be64(key);
+    int lo = 0;
+    int hi = shard_count - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (shards[mid].range.lo <= prefix) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}   /* shard_of() */
+
+/* ------------------------------------------------------------------------- */
+static void* route_connection(void* arg) {
+    router_connection_t* conn = (router_connection_t*) arg;
+    const int shard_count = conn->shard_count;
+    const uint32_t key_bytes = pwned_key_bytes(conn->type);
+    pwned_client_t* clients = (pwned_client_t*) calloc(shard_count, sizeof(clients[0]));
+    uint32_t* starts = (uint32_t*) calloc(shard_count + 1, sizeof(starts[0]));
+    int* sent = (int*) calloc(shard_count, sizeof(sent[0]));
+    uint8_t* keys = (uint8_t*) malloc((size_t) PWNED_NET_MAX_BATCH * key_bytes);
+    uint8_t* parts = (uint8_t*) malloc((size_t) PWNED_NET_MAX_BATCH * key_bytes);
+    uint32_t* part_counts = (uint32_t*) malloc(PWNED_NET_MAX_BATCH * sizeof(uint32_t));
+    uint32_t* order = (uint32_t*) malloc(PWNED_NET_MAX_BATCH * sizeof(uint32_t));
+    uint16_t* owner = (uint16_t*) malloc(PWNED_NET_MAX_BATCH * sizeof(uint16_t));
+    uint32_t* reply = (uint32_t*) malloc(sizeof(pwned_net_response_t) +
+                                         PWNED_NET_MAX_BATCH * sizeof(uint32_t));
+    int ok = (NULL != clients) && (NULL != starts) && (NULL != sent) && (NULL != keys) && (NULL != parts) &&
+        (NULL != part_counts) && (NULL != order) && (NULL != owner) && (NULL != reply);
+    for (int s = 0; ok && (s < shard_count); ++s) {
+        if (0 != pwned_client_open(&clients[s], conn->shards[s].address, conn->type)) {
+            PrintError("could not connect to shard %s", conn->shards[s].address);
+        }
+        clients[s].hedge_percentile = g_hedge_percentile;
+    }
+    pwned_net_request_t request;
+    while (ok && (1 == pwned_net_read(conn->fd, &request, sizeof(request)))) {
+        pwned_net_response_t response = { PWNED_NET_OK, request.count };
+        if ((request.key_bytes != key_bytes) || (request.count > PWNED_NET_MAX_BATCH)) {
+            response.status = PWNED_NET_BAD_REQUEST;
+            response.count = 0;
+            pwned_net_write(conn->fd, &response, sizeof(response));
+            break;
+        }
+        const uint32_t n = request.count;
+        if (1 != pwned_net_read(conn->fd, keys, (size_t) n * key_bytes)) {
+            break;
+        }
+
+        /*
+         * Counting sort of the keys by shard, remembering where each came
+         * from. Keys stay in order within a shard, so a sorted batch gives
+         * sorted sub-batches.
+         */
+        memset(starts, 0, (shard_count + 1) * sizeof(starts[0]));
+        for (uint32_t i = 0; i < n; ++i) {
+            owner[i] = (uint16_t) shard_of(conn->shards, shard_count, &keys[i * key_bytes]);
+            starts[owner[i] + 1]++;
+        }
+        for (int s = 0; s < shard_count; ++s) {
+            starts[s + 1] += starts[s];
+        }
+        for (uint32_t i = 0; i < n; ++i) {
+            uint32_t j = starts[owner[i]]++;
+            memcpy(&parts[j * key_bytes], &keys[i * key_bytes], key_bytes);
+            order[j] = i;
+        }
+        for (int s = shard_count; s > 0; --s) {
+            starts[s] = starts[s - 1];
+        }
+        starts[0] = 0;
+
+        /*
+         * Send everything, then collect the answers. The shards serve their
+         * sub-batches at the same time.
+         */
+        for (int s = 0; s < shard_count; ++s) {
+            uint32_t count = starts[s + 1] - starts[s];
+            sent[s] = (count > 0) &&
+                (0 == pwned_client_send(&clients[s], &parts[starts[s] * key_bytes], count));
+            if ((count > 0) && !sent[s]) {
+                response.status = PWNED_NET_UNAVAILABLE;
+            }
+        }
+        for (int s = 0; s < shard_count; ++s) {
+            uint32_t count = starts[s + 1] - starts[s];
+            int status = sent[s] ? pwned_client_receive(&clients[s], &part_counts[starts[s]], count) : -1;
+            if (status < 0) {
+                memset(&part_counts[starts[s]], 0, count * sizeof(part_counts[0]));
+                if (count > 0) {
+                    response.status = PWNED_NET_UNAVAILABLE;
+                }
+            } else if ((PWNED_NET_OK != status) && (PWNED_NET_OK == response.status)) {
+                response.status = status;
+            }
+        }
+        uint32_t* counts = &reply[sizeof(response) / sizeof(reply[0])];
+        for (uint32_t j = 0; j < n; ++j) {
+            counts[order[j]] = part_counts[j];
+        }
+        memcpy(reply, &response, sizeof(response));
+        if (0 != pwned_net_write(conn->fd, reply, sizeof(response) + n * sizeof(counts[0]))) {
+            break;
+        }
+    }
+    for (int s = 0; (NULL != clients) && (s < shard_count); ++s) {
+        pwned_client_close(&clients[s]);
+    }
+    close(conn->fd);
+    free(reply);
+    free(owner);
+    free(order);
+    free(part_counts);
+    free(parts);
+    free(keys);
+    free(sent);
+    free(starts);
+    free(clients);
+    free(conn);
+    return NULL;
+}   /* route_connection() */
+
+/* ------------------------------------------------------------------------- */
+static int compare_shards(const void* a, const void* b) {
+    const shard_t* x = (const shard_t*) a;
+    const shard_t* y = (const shard_t*) b;
+    return (x->range.lo < y->range.lo) ? -1 : (x->range.lo > y->range.lo) ? 1 : 0;
+}   /* compare_shards() */
+
+/* ------------------------------------------------------------------------- */
+int run_router(const char* address, const char* const* specs, int spec_count, pwned_key_type_t type) {
+    shard_t* shards = (shard_t*) calloc(spec_count, sizeof(shards[0]));
+    if (NULL == shards) {
+        PrintError("out of memory");
+        return 2;
+    }
+    for (int s = 0; s < spec_count; ++s) {
+        char range[0x40];
+        const char* at = strchr(specs[s], '@');
+        size_t n = (NULL == at) ? 0 : (size_t) (at - specs[s]);
+        if ((0 == n) || (n >= sizeof(range))) {
+            PrintUsageError(2, "-shard \"%s\" should be RANGE@HOST:PORT", specs[s]);
+        }
+        memcpy(range, specs[s], n);
+        range[n] = 0;
+        if (!pwned_parse_range(range, &shards[s].range)) {
+            PrintUsageError(2, "invalid hex prefix range \"%s\" in -shard", range);
+        }
+        shards[s].address = &at[1];
+    }
+
+    /*
+     * Every key has to belong to exactly one shard.
+     */
+    qsort(shards, spec_count, sizeof(shards[0]), compare_shards);
+    uint64_t next = 0;
+    for (int s = 0; s < spec_count; ++s) {
+        if (shards[s].range.lo != next) {
+            PrintUsageError(2, "-shard ranges have a gap or overlap at %016" PRIX64, next);
+        }
+        next = shards[s].range.hi + 1;
+        if ((0 == next) && (s + 1 < spec_count)) {
+            PrintUsageError(2, "-shard ranges overlap after the last key");
+        }
+    }
+    if ((0 == spec_count) || (0 != next)) {
+        PrintUsageError(2, "-shard ranges do not reach the last key (FFFF...)");
+    }
+    int listener = pwned_net_listen(address);
+    if (listener < 0) {
+        PrintError("could not listen on \"%s\"", address);
+        free(shards);
+        return 2;
+    }
+    for (int s = 0; s < spec_count; ++s) {
+        PrintVerbose("shard %016" PRIX64 "-%016" PRIX64 " at %s",
+                     shards[s].range.lo, shards[s].range.hi, shards[s].address);
+    }
+    router_connection_t conn = { -1, shards, spec_count, type };
+    int rval = accept_loop(listener, route_connection, &conn, sizeof(conn));
+    free(shards);
+    return rval;
+}   /* run_router() */
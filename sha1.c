@@ -1,6 +1,7 @@
 /* (c) 2018 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
 /* You are free to do whatever you want with this software. Have at it! */
 
+#include "multibuf.h"
 #include "sha1.h"
 
 /**
@@ -241,3 +242,129 @@ uint8_t* sha1_buffer_bin(const void* restrict data, size_t size, uint8_t* restri
     }
     return bin;
 }   /* sha1_buffer_bin() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Multi-buffer SHA1 of single, already padded blocks; see multibuf.h.
+ * Message word i of lane l is at w_in[i][l]; result word j of lane l goes
+ * to h[j][l].
+ */
+#define SHA1_KERNEL(_name, _lanes, _attributes)                         \
+    typedef uint32_t _name##_vec_t __attribute__((vector_size(4 * _lanes))); \
+    static _attributes void _name(const uint32_t w_in[0x10][_lanes], uint32_t h[5][_lanes]) { \
+        _name##_vec_t w[0x10];                                          \
+        _name##_vec_t zero = { 0 };                                     \
+        _name##_vec_t a = zero + 0x67452301;                            \
+        _name##_vec_t b = zero + 0xEFCDAB89;                            \
+        _name##_vec_t c = zero + 0x98BADCFE;                            \
+        _name##_vec_t d = zero + 0x10325476;                            \
+        _name##_vec_t e = zero + 0xC3D2E1F0;                            \
+        for (int i = 0; i < 0x10; ++i) {                                \
+            memcpy(&w[i], w_in[i], sizeof(w[i]));                       \
+        }                                                               \
+        for (int i = 0; i < 0x50; ++i) {                                \
+            _name##_vec_t f;                                            \
+            uint32_t k;                                                 \
+            if (i >= 0x10) {                                            \
+                _name##_vec_t x = w[(i-3) & 0xF] ^ w[(i-8) & 0xF] ^ w[(i-14) & 0xF] ^ w[i & 0xF]; \
+                w[i & 0xF] = (x << 1) | (x >> 31);                      \
+            }                                                           \
+            if (i < 0x14) {                                             \
+                f = d ^ (b & (c ^ d));                                  \
+                k = 0x5A827999;                                         \
+            } else if (i < 0x28) {                                      \
+                f = b ^ c ^ d;                                          \
+                k = 0x6ED9EBA1;                                         \
+            } else if (i < 0x3C) {                                      \
+                f = (b & c) | (d & (b | c));                            \
+                k = 0x8F1BBCDC;                                         \
+            } else {                                                    \
+                f = b ^ c ^ d;                                          \
+                k = 0xCA62C1D6;                                         \
+            }                                                           \
+            _name##_vec_t temp = ((a << 5) | (a >> 27)) + f + e + k + w[i & 0xF]; \
+            e = d;                                                      \
+            d = c;                                                      \
+            c = (b << 30) | (b >> 2);                                   \
+            b = a;                                                      \
+            a = temp;                                                   \
+        }                                                               \
+        a += 0x67452301;                                                \
+        b += 0xEFCDAB89;                                                \
+        c += 0x98BADCFE;                                                \
+        d += 0x10325476;                                                \
+        e += 0xC3D2E1F0;                                                \
+        memcpy(h[0], &a, sizeof(a));                                    \
+        memcpy(h[1], &b, sizeof(b));                                    \
+        memcpy(h[2], &c, sizeof(c));                                    \
+        memcpy(h[3], &d, sizeof(d));                                    \
+        memcpy(h[4], &e, sizeof(e));                                    \
+    }
+
+SHA1_KERNEL(sha1_kernel_x4, 4, )
+SHA1_KERNEL(sha1_kernel_x8, 8, MULTIBUF_AVX2)
+
+/**
+ * Most bytes that fit with SHA1 padding in a single block.
+ */
+#define SHA1_SINGLE_BLOCK_BYTES (SHA1_BLOCK_BYTES - 9)
+
+/* ------------------------------------------------------------------------- */
+const char* sha1_kernel_name(void) {
+    return multibuf_kernel_name();
+}   /* sha1_kernel_name() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Hash up to SHA1_BATCH_MAX single-block messages with the widest kernel.
+ * Longer messages are skipped and left to the caller.
+ */
+static void sha1_hash_lanes(const void* const* data, const size_t* sizes, size_t n,
+                            uint8_t* bins) {
+    uint32_t w[0x10][MULTIBUF_LANES_MAX];
+    uint32_t h[5][MULTIBUF_LANES_MAX];
+    memset(w, 0, sizeof(w));
+    for (size_t l = 0; l < n; ++l) {
+        uint8_t block[SHA1_BLOCK_BYTES] = { 0 };
+        if (sizes[l] > SHA1_SINGLE_BLOCK_BYTES) {
+            continue;
+        }
+        memcpy(block, data[l], sizes[l]);
+        block[sizes[l]] = 0x80;
+        block[SHA1_BLOCK_BYTES - 2] = (8 * sizes[l]) >> 8;
+        block[SHA1_BLOCK_BYTES - 1] = (8 * sizes[l]) & 0xFF;
+        for (int i = 0; i < 0x10; ++i) {
+            w[i][l] = (((uint32_t) block[(4*i)+0]) << 0x18) +
+                      (((uint32_t) block[(4*i)+1]) << 0x10) +
+                      (((uint32_t) block[(4*i)+2]) << 0x08) +
+                      (((uint32_t) block[(4*i)+3]) << 0x00);
+        }
+    }
+    multibuf_run((const uint32_t (*)[MULTIBUF_LANES_MAX]) w, h, 5, n, sha1_kernel_x4, sha1_kernel_x8);
+    for (size_t l = 0; l < n; ++l) {
+        uint8_t* bin = &bins[l * SHA1_BINARY_BYTES];
+        for (int j = 0; j < 5; ++j) {
+            bin[4*j + 0] = h[j][l] >> 24;
+            bin[4*j + 1] = h[j][l] >> 16;
+            bin[4*j + 2] = h[j][l] >>  8;
+            bin[4*j + 3] = h[j][l] >>  0;
+        }
+    }
+}   /* sha1_hash_lanes() */
+
+/* ------------------------------------------------------------------------- */
+void sha1_buffer_bin_batch(const void* const* data, const size_t* sizes, size_t n, uint8_t* bins) {
+    while (n > 0) {
+        size_t chunk = (n < SHA1_BATCH_MAX) ? n : SHA1_BATCH_MAX;
+        sha1_hash_lanes(data, sizes, chunk, bins);
+        for (size_t l = 0; l < chunk; ++l) {
+            if (sizes[l] > SHA1_SINGLE_BLOCK_BYTES) {
+                sha1_buffer_bin(data[l], sizes[l], &bins[l * SHA1_BINARY_BYTES]);
+            }
+        }
+        data += chunk;
+        sizes += chunk;
+        bins += chunk * SHA1_BINARY_BYTES;
+        n -= chunk;
+    }
+}   /* sha1_buffer_bin_batch() */
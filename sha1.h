@@ -51,6 +51,26 @@ char*  sha1_buffer(const void* restrict data, size_t size, char* restrict text);
 char*  sha1_buffer_flags(const void* restrict data, size_t size, char* restrict text, uint32_t flags);
 uint8_t* sha1_buffer_bin(const void* restrict data, size_t size, uint8_t* restrict bin);
 
+/**
+ * Most messages hashed together by one multi-buffer kernel call; the lane
+ * count of the widest kernel.
+ */
+#define SHA1_BATCH_MAX  8
+
+/**
+ * Binary SHA1 of @a n messages, writing SHA1_BINARY_BYTES per message to
+ * consecutive locations in @a bins. Messages that fit in a single block
+ * (55 bytes or fewer, i.e. nearly all passwords) are hashed several at a
+ * time using the widest SIMD kernel the CPU supports; longer ones use
+ * sha1_buffer_bin().
+ */
+void sha1_buffer_bin_batch(const void* const* data, const size_t* sizes, size_t n, uint8_t* bins);
+
+/**
+ * Name of the multi-buffer kernel selected for this CPU, e.g. "avx2".
+ */
+const char* sha1_kernel_name(void);
+
 #ifdef __cplusplus
 }
 #endif
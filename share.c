@@ -0,0 +1,246 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Sharing a hash file through a sealed memfd; see share.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "share.h"
+
+/**
+ * Bytes copied into the memfd between dropping the source pages.
+ */
+#define kShareChunk 0x4000000
+
+/**
+ * Seals that make the memfd safe to share: nobody, the loader included,
+ * can change its contents or size, or remove the seals.
+ */
+#define kShareSeals (F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL)
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Create a memfd of at least @a size bytes and map it writable, on huge
+ * pages if @a huge and enough of them are reserved.
+ *
+ * @return the memfd with @a *data and @a *mapped set, or -1.
+ */
+static int create_memfd(uint64_t size, int huge, void** data, uint64_t* mapped) {
+    int fd = memfd_create("pwned-db", MFD_CLOEXEC | MFD_ALLOW_SEALING | (huge ? MFD_HUGETLB : 0));
+    struct stat st;
+    if ((fd < 0) || (0 != fstat(fd, &st))) {
+        goto fail;
+    }
+    uint64_t page = st.st_blksize;      /* The huge page size on hugetlbfs. */
+    *mapped = ((size + page - 1) / page) * page;
+    if (0 != ftruncate(fd, *mapped)) {
+        goto fail;
+    }
+    *data = mmap(NULL, *mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == *data) {
+        goto fail;                      /* Too few huge pages reserved. */
+    }
+    if (!huge) {
+        madvise(*data, *mapped, MADV_HUGEPAGE);     /* Transparent huge pages, if shmem allows. */
+    }
+    return fd;
+fail:
+    if (fd >= 0) {
+        close(fd);
+    }
+    return -1;
+}   /* create_memfd() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_share_load(const pwned_db_t* db, pwned_share_header_t* header) {
+    void* data = NULL;
+    uint64_t mapped = 0;
+    int huge = 1;
+    int fd = create_memfd(db->size, huge, &data, &mapped);
+    if (fd < 0) {
+        huge = 0;
+        fd = create_memfd(db->size, huge, &data, &mapped);
+    }
+    if (fd < 0) {
+        return -1;
+    }
+    for (uint64_t offset = 0; offset < db->size; offset += kShareChunk) {
+        uint64_t size = db->size - offset;
+        if (size > kShareChunk) {
+            size = kShareChunk;
+        }
+        uint64_t done = 0;
+        while (done < size) {
+            ssize_t n = pread(db->fd, (uint8_t*) data + offset + done, size - done, offset + done);
+            if ((n < 0) && (EINTR == errno)) {
+                continue;
+            }
+            if (n <= 0) {
+                munmap(data, mapped);
+                close(fd);
+                return -1;
+            }
+            done += n;
+        }
+        posix_fadvise(db->fd, offset, size, POSIX_FADV_DONTNEED);
+    }
+    munmap(data, mapped);               /* F_SEAL_WRITE needs no writable mappings. */
+    if (0 != fcntl(fd, F_ADD_SEALS, kShareSeals)) {
+        close(fd);
+        return -1;
+    }
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, PWNED_SHARE_MAGIC, sizeof(header->magic));
+    header->key_type = db->type;
+    header->huge_pages = huge;
+    header->size = db->size;
+    header->mapped = mapped;
+    return fd;
+}   /* pwned_share_load() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Fill in @a addr for Unix socket @a path.
+ *
+ * @return 1 on success, 0 if @a path is too long.
+ */
+static int socket_address(const char* path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return 0;
+    }
+    strcpy(addr->sun_path, path);
+    return 1;
+}   /* socket_address() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_share_serve(const char* path, int memfd, const pwned_share_header_t* header) {
+    struct sockaddr_un addr;
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ((listener < 0) || !socket_address(path, &addr)) {
+        return -1;
+    }
+    unlink(path);
+    if ((0 != bind(listener, (struct sockaddr*) &addr, sizeof(addr))) ||
+        (0 != listen(listener, SOMAXCONN))) {
+        close(listener);
+        return -1;
+    }
+    while (1) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd < 0) {
+            continue;
+        }
+        union {
+            struct cmsghdr header;
+            char space[CMSG_SPACE(sizeof(int))];
+        } control;
+        struct iovec iov = { (void*) header, sizeof(*header) };
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        memset(&control, 0, sizeof(control));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control.space;
+        msg.msg_controllen = sizeof(control.space);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(cmsg), &memfd, sizeof(int));
+        sendmsg(fd, &msg, MSG_NOSIGNAL);    /* A worker that went away just misses out. */
+        close(fd);
+    }
+    return -1;
+}   /* pwned_share_serve() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Receive the header and memfd from the loader on socket @a sock.
+ *
+ * @return the memfd, or -1.
+ */
+static int receive_memfd(int sock, pwned_share_header_t* header) {
+    union {
+        struct cmsghdr header;
+        char space[CMSG_SPACE(sizeof(int))];
+    } control;
+    struct iovec iov = { header, sizeof(*header) };
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.space;
+    msg.msg_controllen = sizeof(control.space);
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    } while ((n < 0) && (EINTR == errno));
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    int fd = -1;
+    if ((NULL != cmsg) && (SOL_SOCKET == cmsg->cmsg_level) && (SCM_RIGHTS == cmsg->cmsg_type)) {
+        memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+    }
+    if ((n != sizeof(*header)) && (fd >= 0)) {
+        close(fd);
+        fd = -1;
+    }
+    return fd;
+}   /* receive_memfd() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_share_attach(pwned_db_t* db, const char* path, pwned_key_type_t type) {
+    struct sockaddr_un addr;
+    pwned_share_header_t header;
+    pwned_db_attach(db, NULL, 0, type);
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if ((sock < 0) || !socket_address(path, &addr) ||
+        (0 != connect(sock, (struct sockaddr*) &addr, sizeof(addr)))) {
+        if (sock >= 0) {
+            close(sock);
+        }
+        return PWNED_DB_ERR_OPEN;
+    }
+    int fd = receive_memfd(sock, &header);
+    close(sock);
+    if ((fd < 0) || (0 != memcmp(header.magic, PWNED_SHARE_MAGIC, sizeof(header.magic)))) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return PWNED_DB_ERR_OPEN;
+    }
+    int rval = PWNED_DB_OK;
+    struct stat st;
+    if (header.key_type != (uint32_t) type) {
+        rval = PWNED_SHARE_ERR_TYPE;
+    } else if (kShareSeals != (fcntl(fd, F_GET_SEALS) & kShareSeals)) {
+        rval = PWNED_SHARE_ERR_SEALS;
+    } else if ((0 != fstat(fd, &st)) || ((uint64_t) st.st_size != header.mapped) ||
+               (header.size > header.mapped) ||
+               (PWNED_DB_OK != pwned_db_attach(db, NULL, header.size, type))) {
+        rval = PWNED_DB_ERR_SIZE;
+    } else {
+        void* data = mmap(NULL, header.mapped, PROT_READ, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == data) {
+            rval = PWNED_DB_ERR_MMAP;
+        } else {
+            pwned_db_attach(db, data, header.size, type);
+        }
+    }
+    close(fd);                          /* The mapping keeps the memfd alive. */
+    return rval;
+}   /* pwned_share_attach() */
@@ -0,0 +1,74 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __share_h__
+#define __share_h__
+
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sharing one in-memory copy of a hash file among many processes.
+ *
+ * A loader (find-pwned -share) copies the hash file once into a memfd,
+ * backed by huge pages when the system has them reserved, and seals it so
+ * that it can never change size or be written again. It then hands the
+ * memfd to every process that connects to its Unix socket, as SCM_RIGHTS
+ * ancillary data on a pwned_share_header_t. A worker (find-pwned -attach)
+ * just maps it: nothing is read from disk, and with huge pages the mapping
+ * takes a few hundred page table entries instead of millions.
+ */
+#define PWNED_SHARE_MAGIC       "PWNSHR01"
+
+typedef struct {
+    char magic[8];              /**< PWNED_SHARE_MAGIC, not NUL-terminated. */
+    uint32_t key_type;          /**< pwned_key_type_t of the keys. */
+    uint32_t huge_pages;        /**< 1 if the memfd is on hugetlbfs. */
+    uint64_t size;              /**< Bytes of records. */
+    uint64_t mapped;            /**< Size of the memfd: @a size rounded up to its page size. */
+} pwned_share_header_t;
+
+/**
+ * Errors from pwned_share_attach() besides the PWNED_DB_ERR_xxx ones.
+ */
+#define PWNED_SHARE_ERR_TYPE    6       /**< The loader has the other key type. */
+#define PWNED_SHARE_ERR_SEALS   7       /**< The memfd is not sealed against writes. */
+
+/**
+ * Copy the records of @a db (opened with pwned_db_open()) into a new sealed
+ * memfd and describe it in @a header. The file's own pages are dropped from
+ * the page cache as they are copied, so the host does not hold it twice.
+ *
+ * @return the memfd, or -1 on error.
+ */
+int pwned_share_load(const pwned_db_t* db, pwned_share_header_t* header);
+
+/**
+ * Listen on Unix socket @a path, replacing any stale socket there, and send
+ * @a header and @a memfd to each process that connects. Does not return
+ * unless the socket cannot be set up.
+ *
+ * @return -1.
+ */
+int pwned_share_serve(const char* path, int memfd, const pwned_share_header_t* header);
+
+/**
+ * Get the hash file from the loader on Unix socket @a path and map it
+ * read-only into @a db, which must hold keys of @a type. The mapping lasts
+ * until the process exits; pwned_db_close() leaves it alone.
+ *
+ * @return PWNED_DB_OK, PWNED_DB_ERR_OPEN if the loader could not be reached,
+ * PWNED_DB_ERR_SIZE, PWNED_DB_ERR_MMAP, or PWNED_SHARE_ERR_xxx.
+ */
+int pwned_share_attach(pwned_db_t* db, const char* path, pwned_key_type_t type);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,144 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pwned_db.h"
+#include "sort.h"
+
+/**
+ * Leading 64 key bits of a record and the record's original position.
+ */
+typedef struct {
+    uint64_t prefix;
+    uint64_t index;
+} sort_item_t;
+
+#define kRadixBits      8
+#define kRadixBuckets   (1 << kRadixBits)
+#define kRadixPasses    (64 / kRadixBits)
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Stable LSD radix sort of @a items by prefix. @a temp must hold @a n items.
+ *
+ * @return whichever of @a items or @a temp holds the result.
+ */
+static sort_item_t* radix_sort_items(sort_item_t* items, sort_item_t* temp, size_t n) {
+    size_t histogram[kRadixPasses][kRadixBuckets];
+    memset(histogram, 0, sizeof(histogram));
+    for (size_t i = 0; i < n; ++i) {
+        uint64_t prefix = items[i].prefix;
+        for (int pass = 0; pass < kRadixPasses; ++pass) {
+            histogram[pass][(prefix >> (pass * kRadixBits)) & (kRadixBuckets - 1)]++;
+        }
+    }
+    for (int pass = 0; pass < kRadixPasses; ++pass) {
+        const int shift = pass * kRadixBits;
+        if (n == histogram[pass][(items[0].prefix >> shift) & (kRadixBuckets - 1)]) {
+            continue;           /* Every item has the same digit; nothing moves. */
+        }
+        size_t offset = 0;
+        for (int b = 0; b < kRadixBuckets; ++b) {
+            size_t count = histogram[pass][b];
+            histogram[pass][b] = offset;
+            offset += count;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            temp[histogram[pass][(items[i].prefix >> shift) & (kRadixBuckets - 1)]++] = items[i];
+        }
+        sort_item_t* swap = items;
+        items = temp;
+        temp = swap;
+    }
+    return items;
+}   /* radix_sort_items() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_sort_records(void* records, size_t n, uint32_t record_bytes, uint32_t key_bytes) {
+    uint8_t* base = (uint8_t*) records;
+    if (n < 2) {
+        return 0;
+    }
+    sort_item_t* items = (sort_item_t*) malloc(2 * n * sizeof(sort_item_t));
+    uint8_t* sorted = (uint8_t*) malloc(n * (size_t) record_bytes);
+    if ((NULL == items) || (NULL == sorted)) {
+        free(items);
+        free(sorted);
+        return -1;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        items[i].prefix = pwned_load_be64(&base[i * record_bytes]);
+        items[i].index = i;
+    }
+    sort_item_t* result = radix_sort_items(items, &items[n], n);
+
+    /*
+     * Order runs with the same 64-bit prefix by full key. Insertion sort is
+     * fine here since such runs are almost always a single key repeated.
+     */
+    for (size_t start = 0; start < n; ) {
+        size_t end = start + 1;
+        while ((end < n) && (result[end].prefix == result[start].prefix)) {
+            ++end;
+        }
+        for (size_t i = start + 1; i < end; ++i) {
+            sort_item_t item = result[i];
+            const uint8_t* key = &base[item.index * record_bytes];
+            size_t j = i;
+            while ((j > start) &&
+                   (pwned_key_cmp(&base[result[j-1].index * record_bytes], key, key_bytes) > 0)) {
+                result[j] = result[j-1];
+                --j;
+            }
+            result[j] = item;
+        }
+        start = end;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        memcpy(&sorted[i * record_bytes], &base[result[i].index * record_bytes], record_bytes);
+    }
+    memcpy(base, sorted, n * (size_t) record_bytes);
+    free(items);
+    free(sorted);
+    return 0;
+}   /* pwned_sort_records() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_records_sorted(const void* records, size_t n, uint32_t record_bytes, uint32_t key_bytes) {
+    const uint8_t* base = (const uint8_t*) records;
+    for (size_t i = 1; i < n; ++i) {
+        if (pwned_key_cmp(&base[(i-1) * record_bytes], &base[i * record_bytes], key_bytes) >= 0) {
+            return 0;
+        }
+    }
+    return 1;
+}   /* pwned_records_sorted() */
+
+/* ------------------------------------------------------------------------- */
+size_t pwned_unique_records(void* records, size_t n, uint32_t record_bytes, uint32_t key_bytes,
+                            int sum_counts) {
+    uint8_t* base = (uint8_t*) records;
+    size_t out = (n > 0) ? 1 : 0;      /* The first record always stays. */
+    for (size_t i = 1; i < n; ++i) {
+        uint8_t* record = &base[i * record_bytes];
+        uint8_t* last = &base[(out - 1) * (size_t) record_bytes];
+        if (0 == pwned_key_cmp(last, record, key_bytes)) {
+            if (sum_counts) {
+                uint32_t a;
+                uint32_t b;
+                memcpy(&a, last + key_bytes, sizeof(a));
+                memcpy(&b, record + key_bytes, sizeof(b));
+                a = (a > UINT32_MAX - b) ? UINT32_MAX : a + b;
+                memcpy(last + key_bytes, &a, sizeof(a));
+            }
+            continue;
+        }
+        if (out != i) {
+            memcpy(&base[out * record_bytes], record, record_bytes);
+        }
+        ++out;
+    }
+    return out;
+}   /* pwned_unique_records() */
@@ -0,0 +1,47 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __sort_h__
+#define __sort_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Sort @a n fixed-size records of @a record_bytes bytes at @a records by the
+ * @a key_bytes (16 or 20) byte key at the start of each record.
+ *
+ * Keys are hashes, so they are sorted with an LSD radix sort on their first
+ * 64 bits; the rare records whose first 64 bits tie are then ordered by
+ * full key. Records with equal keys keep their original order.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int pwned_sort_records(void* records, size_t n, uint32_t record_bytes, uint32_t key_bytes);
+
+/**
+ * @return 1 if the @a n records at @a records are in strictly ascending key
+ * order (sorted without duplicates), 0 otherwise.
+ */
+int pwned_records_sorted(const void* records, size_t n, uint32_t record_bytes, uint32_t key_bytes);
+
+/**
+ * Collapse runs of records with equal keys in the sorted @a records into
+ * one record. When @a sum_counts is non-zero the records must be hash file
+ * records (key followed by a 32-bit count) and the counts of merged records
+ * are added, saturating at UINT32_MAX; otherwise the first record is kept.
+ *
+ * @return the number of records remaining.
+ */
+size_t pwned_unique_records(void* records, size_t n, uint32_t record_bytes, uint32_t key_bytes,
+                            int sum_counts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,195 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Recording and reading lookup traces; see trace.h.
+ */
+
+#define _GNU_SOURCE
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "parallel.h"
+#include "trace.h"
+
+/**
+ * Longest record: a 64-bit varint and a key.
+ */
+#define kMaxRecordBytes (10 + PWNED_MAX_KEY_BYTES)
+
+/**
+ * Most seconds a lookup stays in the buffer before it is written out.
+ */
+#define kFlushSeconds 1.0
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Write out the buffer; the caller holds the lock.
+ */
+static void flush_trace(pwned_trace_writer_t* trace, double now) {
+    if (!trace->failed && (0 != pwned_write_all(trace->fd, trace->buffer, trace->used))) {
+        trace->failed = 1;
+    }
+    trace->used = 0;
+    trace->flushed = now;
+}   /* flush_trace() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_trace_create(pwned_trace_writer_t* trace, const char* path, pwned_key_type_t type) {
+    memset(trace, 0, sizeof(*trace));
+    trace->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (trace->fd < 0) {
+        return -1;
+    }
+    pthread_mutex_init(&trace->lock, NULL);
+    trace->key_bytes = pwned_key_bytes(type);
+    trace->start = pwned_seconds();
+    trace->flushed = trace->start;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    pwned_trace_header_t header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PWNED_TRACE_MAGIC, sizeof(header.magic));
+    header.key_type = type;
+    header.started = (uint64_t) now.tv_sec * 1000000 + now.tv_usec;
+    memcpy(trace->buffer, &header, sizeof(header));
+    trace->used = sizeof(header);
+    return 0;
+}   /* pwned_trace_create() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_trace_record(pwned_trace_writer_t* trace, const uint8_t* key, int found) {
+    pthread_mutex_lock(&trace->lock);
+    double now = pwned_seconds();
+    uint64_t us = (uint64_t) ((now - trace->start) * 1e6);
+    uint64_t value = (((us > trace->last_us) ? us - trace->last_us : 0) << 1) | (found ? 1 : 0);
+    trace->last_us = (us > trace->last_us) ? us : trace->last_us;
+    uint8_t* p = &trace->buffer[trace->used];
+    while (value >= 0x80) {
+        *p++ = (uint8_t) (value | 0x80);
+        value >>= 7;
+    }
+    *p++ = (uint8_t) value;
+    if (found) {
+        memcpy(p, key, trace->key_bytes);
+        p += trace->key_bytes;
+    }
+    trace->used = p - trace->buffer;
+    trace->records++;
+    if ((trace->used > sizeof(trace->buffer) - kMaxRecordBytes) || (now - trace->flushed >= kFlushSeconds)) {
+        flush_trace(trace, now);
+    }
+    pthread_mutex_unlock(&trace->lock);
+}   /* pwned_trace_record() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_trace_close(pwned_trace_writer_t* trace) {
+    pthread_mutex_lock(&trace->lock);
+    flush_trace(trace, pwned_seconds());
+    pthread_mutex_unlock(&trace->lock);
+    pthread_mutex_destroy(&trace->lock);
+    int rval = (0 != close(trace->fd)) ? -1 : 0;
+    trace->fd = -1;
+    return trace->failed ? -1 : rval;
+}   /* pwned_trace_close() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Decode the records in @a data[0..size), storing each lookup's time and
+ * key in @a trace if its arrays are allocated, and counting them.
+ */
+static void decode_records(pwned_trace_t* trace, const uint8_t* data, size_t size) {
+    uint64_t seed = 0x7EACE;
+    uint64_t us = 0;
+    uint64_t first_us = 0;
+    size_t at = 0;
+    trace->count = 0;
+    trace->hits = 0;
+    while (at < size) {
+        uint64_t value = 0;
+        int shift = 0;
+        while ((at < size) && (data[at] & 0x80) && (shift < 63)) {
+            value |= (uint64_t) (data[at++] & 0x7F) << shift;
+            shift += 7;
+        }
+        if (at >= size) {
+            break;
+        }
+        value |= (uint64_t) data[at++] << shift;
+        int found = (int) (value & 1);
+        if (found && (size - at < trace->key_bytes)) {
+            break;
+        }
+        us += value >> 1;
+        if (0 == trace->count) {
+            first_us = us;
+        }
+        if (NULL != trace->at) {
+            uint8_t* key = &trace->keys[trace->count * trace->key_bytes];
+            trace->at[trace->count] = (us - first_us) / 1e6;
+            if (found) {
+                memcpy(key, &data[at], trace->key_bytes);
+            } else {
+                for (uint32_t b = 0; b < trace->key_bytes; b += 8) {
+                    uint64_t z = pwned_splitmix64(&seed);
+                    memcpy(&key[b], &z, (trace->key_bytes - b < 8) ? trace->key_bytes - b : 8);
+                }
+            }
+        }
+        at += found ? trace->key_bytes : 0;
+        trace->hits += found;
+        trace->count++;
+    }
+}   /* decode_records() */
+
+/* ------------------------------------------------------------------------- */
+int pwned_trace_load(pwned_trace_t* trace, const char* path, pwned_key_type_t type) {
+    memset(trace, 0, sizeof(*trace));
+    size_t size = 0;
+    uint8_t* data = (uint8_t*) pwned_read_file(path, &size);
+    if (NULL == data) {
+        return PWNED_DB_ERR_OPEN;
+    }
+    pwned_trace_header_t header;
+    if (size < sizeof(header)) {
+        free(data);
+        return PWNED_TRACE_ERR_FORMAT;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (0 != memcmp(header.magic, PWNED_TRACE_MAGIC, sizeof(header.magic))) {
+        free(data);
+        return PWNED_TRACE_ERR_FORMAT;
+    }
+    if (header.key_type != type) {
+        free(data);
+        return PWNED_TRACE_ERR_TYPE;
+    }
+    trace->type = type;
+    trace->key_bytes = pwned_key_bytes(type);
+    trace->started = header.started;
+    decode_records(trace, &data[sizeof(header)], size - sizeof(header));
+    trace->at = (double*) malloc((trace->count + 1) * sizeof(trace->at[0]));
+    trace->keys = (uint8_t*) malloc((trace->count + 1) * trace->key_bytes);
+    if ((NULL == trace->at) || (NULL == trace->keys)) {
+        free(data);
+        pwned_trace_free(trace);
+        return PWNED_DB_ERR_OPEN;
+    }
+    decode_records(trace, &data[sizeof(header)], size - sizeof(header));
+    free(data);
+    return PWNED_DB_OK;
+}   /* pwned_trace_load() */
+
+/* ------------------------------------------------------------------------- */
+void pwned_trace_free(pwned_trace_t* trace) {
+    free(trace->at);
+    free(trace->keys);
+    trace->at = NULL;
+    trace->keys = NULL;
+    trace->count = 0;
+}   /* pwned_trace_free() */
@@ -0,0 +1,113 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+#ifndef __trace_h__
+#define __trace_h__
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "pwned_db.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Traces of lookups, recorded from real traffic (find-pwned -record) and
+ * replayed to test caches and index layouts against its real skew towards
+ * popular passwords (-replay).
+ *
+ * A trace file is a pwned_trace_header_t followed by one record per lookup:
+ * a LEB128 varint holding the microseconds since the previous lookup
+ * shifted left by one, with the low bit set if the hash was found, then the
+ * hash itself for found hashes only. A hash that is in the list is already
+ * public; one that is not may be a password nobody else uses, and a
+ * dictionary attack on its hash could recover it. So only the fact of the
+ * miss and its time are kept, and a replay looks up a random key in its
+ * place. A found lookup takes 21-24 bytes, a miss 1-3.
+ */
+#define PWNED_TRACE_MAGIC       "PWNTRC01"
+
+typedef struct {
+    char magic[8];              /**< PWNED_TRACE_MAGIC, not NUL-terminated. */
+    uint32_t key_type;          /**< pwned_key_type_t of the hashes. */
+    uint32_t reserved;
+    uint64_t started;           /**< Wall clock time recording started, in microseconds since 1970. */
+} pwned_trace_header_t;
+
+/**
+ * Errors from pwned_trace_load() besides PWNED_DB_ERR_OPEN.
+ */
+#define PWNED_TRACE_ERR_FORMAT  8       /**< Not a trace file. */
+#define PWNED_TRACE_ERR_TYPE    9       /**< A trace of the other key type. */
+
+#define PWNED_TRACE_BUFFER      0x10000
+
+/**
+ * A trace being recorded. Lookups may be recorded from many threads at
+ * once; they are serialized by @a lock, and the buffer is written out when
+ * it fills or when a lookup comes a second or more after the last write, so
+ * a busy server that is killed loses only about its last second.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    int fd;
+    uint32_t key_bytes;
+    double start;               /**< pwned_seconds() when recording started. */
+    uint64_t last_us;           /**< Microseconds from @a start to the last lookup. */
+    double flushed;             /**< When the buffer was last written. */
+    uint64_t records;
+    int failed;                 /**< A write failed; nothing more is recorded. */
+    size_t used;
+    uint8_t buffer[PWNED_TRACE_BUFFER];
+} pwned_trace_writer_t;
+
+/**
+ * Create trace file @a path for lookups of @a type keys.
+ *
+ * @return 0 on success, -1 if the file cannot be created.
+ */
+int pwned_trace_create(pwned_trace_writer_t* trace, const char* path, pwned_key_type_t type);
+
+/**
+ * Record a lookup of @a key, now, and whether it was @a found.
+ */
+void pwned_trace_record(pwned_trace_writer_t* trace, const uint8_t* key, int found);
+
+/**
+ * Write out what is buffered and close the file.
+ *
+ * @return 0 on success, -1 if any write failed.
+ */
+int pwned_trace_close(pwned_trace_writer_t* trace);
+
+/**
+ * A trace read back for replay.
+ */
+typedef struct {
+    pwned_key_type_t type;
+    uint32_t key_bytes;
+    uint64_t started;           /**< From the header. */
+    uint64_t count;             /**< Lookups. */
+    uint64_t hits;              /**< ... of which were found when recorded. */
+    double* at;                 /**< Seconds from the first lookup to each one. */
+    uint8_t* keys;              /**< Each lookup's key, random for misses. */
+} pwned_trace_t;
+
+/**
+ * Read trace file @a path of @a type keys. A record cut short at the end,
+ * as by a recorder that was killed, is ignored.
+ *
+ * @return PWNED_DB_OK, PWNED_DB_ERR_OPEN if the file cannot be read (or
+ * there is no memory for it), or PWNED_TRACE_ERR_xxx.
+ */
+int pwned_trace_load(pwned_trace_t* trace, const char* path, pwned_key_type_t type);
+
+void pwned_trace_free(pwned_trace_t* trace);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
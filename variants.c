@@ -0,0 +1,196 @@
+/* (c) 2018-2019 Doug Rogers under Zero Clause BSD License. See LICENSE.txt. */
+/* You are free to do whatever you want with this software. Have at it! */
+
+/*
+ * Variant checking (-rules): look up every rule-derived variant of a
+ * password, not just the password itself.
+ *
+ * All the candidates for one password are generated into a single buffer,
+ * hashed together by the multi-buffer SHA1 or MD4 kernels, sorted and then
+ * looked up with one merge join, which shares the upper levels of the
+ * search between candidates.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "find-pwned.h"
+#include "join.h"
+#include "md4.h"
+#include "rules.h"
+#include "sha1.h"
+#include "sort.h"
+
+/**
+ * Candidate hash and its index in the candidate list; sorted for the join.
+ */
+typedef struct {
+    uint8_t key[PWNED_MAX_KEY_BYTES];
+    uint32_t candidate;
+} __attribute__((packed)) variant_record_t;
+
+/**
+ * Buffers reused from one password to the next, sized for the rule set.
+ */
+typedef struct {
+    size_t capacity;                    /**< Candidates the buffers can hold. */
+    char* text;                         /**< Candidate text, back to back. */
+    rule_candidate_t* candidates;
+    const char** pointers;
+    size_t* sizes;
+    uint8_t* hashes;
+    uint8_t* hashed;                    /**< Zero if a candidate could not be hashed. */
+    variant_record_t* records;
+    uint32_t* counts;
+    uint32_t* count_of;                 /**< Count for each candidate, in rule order. */
+    uint8_t* duplicate;                 /**< Non-zero if an earlier candidate had the same hash. */
+} variant_buffers_t;
+
+static variant_buffers_t g_buffers = { 0 };
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Resize the allocation that the pointer at @a buffer points to to @a bytes
+ * bytes, leaving it as it was if out of memory.
+ *
+ * @return 1 on success, 0 if out of memory.
+ */
+static int grow_buffer(void* buffer, size_t bytes) {
+    void* old;
+    memcpy(&old, buffer, sizeof(old));          /* Any object pointer type. */
+    void* bigger = realloc(old, bytes);
+    if (NULL == bigger) {
+        return 0;
+    }
+    memcpy(buffer, &bigger, sizeof(bigger));
+    return 1;
+}   /* grow_buffer() */
+
+/* ------------------------------------------------------------------------- */
+/**
+ * Make the buffers hold @a capacity candidates. Buffers already grown stay
+ * grown if a later one fails; the capacity only changes once all have.
+ *
+ * @return 1 on success, 0 if out of memory.
+ */
+static int grow_buffers(size_t capacity) {
+    variant_buffers_t* b = &g_buffers;
+    if (capacity <= b->capacity) {
+        return 1;
+    }
+    if (!grow_buffer(&b->text, capacity * RULE_MAX_LENGTH) ||
+        !grow_buffer(&b->candidates, capacity * sizeof(rule_candidate_t)) ||
+        !grow_buffer(&b->pointers, capacity * sizeof(const char*)) ||
+        !grow_buffer(&b->sizes, capacity * sizeof(size_t)) ||
+        !grow_buffer(&b->hashes, capacity * PWNED_MAX_KEY_BYTES) ||
+        !grow_buffer(&b->hashed, capacity) ||
+        !grow_buffer(&b->records, capacity * sizeof(variant_record_t)) ||
+        !grow_buffer(&b->counts, capacity * sizeof(uint32_t)) ||
+        !grow_buffer(&b->count_of, capacity * sizeof(uint32_t)) ||
+        !grow_buffer(&b->duplicate, capacity)) {
+        return 0;
+    }
+    b->capacity = capacity;
+    return 1;
+}   /* grow_buffers() */
+
+/* ------------------------------------------------------------------------- */
+int handle_variants(const char* input, const pwned_db_t* db, const rules_t* rules) {
+    variant_buffers_t* b = &g_buffers;
+    const uint32_t key_bytes = db->key_bytes;
+    g_count++;
+    if (!grow_buffers(rules->count + 1)) {
+        PrintError("out of memory for %zu rules", rules->count);
+        return 0;
+    }
+    size_t n = rules_expand(rules, input, strlen(input), b->text, b->capacity * RULE_MAX_LENGTH,
+                            b->candidates, b->capacity);
+    for (size_t i = 0; i < n; ++i) {
+        b->pointers[i] = &b->text[b->candidates[i].offset];
+        b->sizes[i] = b->candidates[i].length;
+    }
+    if (PWNED_KEY_NTLM == db->type) {
+        ntlm_hash_batch(b->pointers, b->sizes, n, b->hashes, b->hashed);
+    } else {
+        sha1_buffer_bin_batch((const void* const*) b->pointers, b->sizes, n, b->hashes);
+        memset(b->hashed, 1, n);
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if (!b->hashed[i]) {
+            PrintError("out of memory hashing a %zu-byte variant; it is not looked up", b->sizes[i]);
+            memset(&b->hashes[i * key_bytes], 0, key_bytes);
+        }
+    }
+
+    /*
+     * Sort the hashes, keeping track of where each came from, and join them
+     * against the hash file in a single pass.
+     */
+    const uint32_t record_bytes = key_bytes + sizeof(uint32_t);
+    uint8_t* records = (uint8_t*) b->records;
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t candidate = (uint32_t) i;
+        memcpy(&records[i * record_bytes], &b->hashes[i * key_bytes], key_bytes);
+        memcpy(&records[(i * record_bytes) + key_bytes], &candidate, sizeof(candidate));
+    }
+    if (0 != pwned_sort_records(records, n, record_bytes, key_bytes)) {
+        PrintError("out of memory sorting variants");
+        return 0;
+    }
+    pwned_join(db, records, n, record_bytes, b->counts, 1);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t candidate;
+        memcpy(&candidate, &records[(i * record_bytes) + key_bytes], sizeof(candidate));
+        b->count_of[candidate] = b->hashed[candidate] ? b->counts[i] : 0;
+        b->duplicate[candidate] =
+            (i > 0) && (0 == memcmp(&records[(i - 1) * record_bytes], &records[i * record_bytes], key_bytes));
+    }
+
+    /*
+     * Report hits in rule order. The sort is stable, so the first rule to
+     * produce a given hash is the one reported.
+     */
+    int found = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if ((0 == b->count_of[i]) || b->duplicate[i]) {
+            continue;
+        }
+        found = 1;
+        if (g_quiet || !g_print_found) {
+            continue;
+        }
+        if (g_print_index) {
+            printf("%" PRIu64 "%s", g_count, g_delimiter);
+        }
+        if (g_print_password) {
+            printf("%s%s", input, g_delimiter);
+        }
+        printf("%s", rules->rules[b->candidates[i].rule]);
+        if (g_print_password) {
+            printf("%s%.*s", g_delimiter, (int) b->sizes[i], b->pointers[i]);
+        }
+        if (g_print_hash) {
+            printf("%s", g_delimiter);
+            print_hex(&b->hashes[i * key_bytes], key_bytes);
+        }
+        if (g_print_count) {
+            printf("%s%" PRIu32, g_delimiter, b->count_of[i]);
+        }
+        printf("\n");
+    }
+    if (!found && !g_quiet && g_print_not_found) {
+        const char* delim = "";
+        if (g_print_index) {
+            printf("%" PRIu64, g_count);
+            delim = g_delimiter;
+        }
+        if (g_print_password) {
+            printf("%s%s", delim, input);
+            delim = g_delimiter;
+        }
+        printf("%s0\n", delim);
+    }
+    return found;
+}   /* handle_variants() */